@@ -31,6 +31,15 @@ enum PixelFormat
     PIXEL_FORMAT_NV12
 };
 
+// Matrix used when RGB input is converted to YUV before encoding
+enum ColorMatrix
+{
+    COLOR_MATRIX_DEFAULT = 0, // BT.709
+    COLOR_MATRIX_BT601,
+    COLOR_MATRIX_BT709,
+    COLOR_MATRIX_BT2020
+};
+
 // Creation parameters for encoder/decoder
 struct CreateParams
 {
@@ -40,6 +49,9 @@ struct CreateParams
     DeviceType  deviceType;  // Type of device (DX12 or CUDA)
     CodecType   codecType;   // Type of encoder/decoder (H264, H265, AV1)
     PixelFormat pixelFormat; // Pixel format of the input/output frames
+    ColorMatrix colorMatrix; // RGBA8/BGRA8 input on CUDA: matrix of the YUV the encoder is fed
+    bool        fullRange;   // RGBA8/BGRA8 input on CUDA: full-range instead of limited-range YUV
+    bool        yuv444;      // RGBA8/BGRA8 input on CUDA: encode 4:4:4 instead of 4:2:0 (not for AV1)
 };
 
 // Frame data structure
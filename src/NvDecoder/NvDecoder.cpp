@@ -855,7 +855,8 @@ int NvDecoder::GetSEIMessage(CUVIDSEIMESSAGEINFO *pSEIMessageInfo)
 
 NvDecoder::NvDecoder(CUcontext cuContext, bool bUseDeviceFrame, cudaVideoCodec eCodec, bool bLowLatency, 
     bool bDeviceFramePitched, const Rect *pCropRect, const Dim *pResizeDim, bool extract_user_SEI_Message,
-    int maxWidth, int maxHeight, unsigned int clkRate, bool force_zero_latency, unsigned int initial_dec_surfaces, CUstream custream) :
+    int maxWidth, int maxHeight, unsigned int clkRate, bool force_zero_latency, unsigned int initial_dec_surfaces, CUstream custream,
+    CUvideoctxlock ctxLock) :
     m_cuContext(cuContext), m_bUseDeviceFrame(bUseDeviceFrame), m_eCodec(eCodec), m_bDeviceFramePitched(bDeviceFramePitched),
     m_bExtractSEIMessage(extract_user_SEI_Message), m_nMaxWidth (maxWidth), m_nMaxHeight(maxHeight),
     m_bForce_zero_latency(force_zero_latency), m_nNumDecSurfaces (initial_dec_surfaces)
@@ -864,7 +865,15 @@ NvDecoder::NvDecoder(CUcontext cuContext, bool bUseDeviceFrame, cudaVideoCodec e
     if (pResizeDim) m_resizeDim = *pResizeDim;
     m_bMemoryOptimize = (initial_dec_surfaces != 0);
 
-    NVDEC_API_CALL(cuvidCtxLockCreate(&m_ctxLock, cuContext));
+    if (ctxLock == NULL)
+    {
+        NVDEC_API_CALL(cuvidCtxLockCreate(&m_ctxLock, cuContext));
+    }
+    else
+    {
+        m_bExternalCtxLock = true;
+        m_ctxLock = ctxLock;
+    }
 
     if(custream==NULL)
     {
@@ -934,7 +943,10 @@ NvDecoder::~NvDecoder() {
     }
     cuCtxPopCurrent(NULL);
 
-    cuvidCtxLockDestroy(m_ctxLock);
+    if (!m_bExternalCtxLock)
+    {
+        cuvidCtxLockDestroy(m_ctxLock);
+    }
 
     STOP_TIMER("Session Deinitialization Time: ");
 }
@@ -117,11 +117,14 @@ public:
     *  @brief This function is used to initialize the decoder session.
     *  Application must call this function to initialize the decoder, before
     *  starting to decode any frames.
+    *  A context lock created by the application may be passed in ctxLock so that several
+    *  decoders sharing one CUcontext also share one lock; it is not destroyed by the decoder.
     */
     NvDecoder(CUcontext cuContext, bool bUseDeviceFrame, cudaVideoCodec eCodec, bool bLowLatency = false,
               bool bDeviceFramePitched = false, const Rect *pCropRect = NULL, const Dim *pResizeDim = NULL,
               bool extract_user_SEI_Message = false, int maxWidth = 0, int maxHeight = 0, unsigned int clkRate = 1000,
-              bool force_zero_latency = false, unsigned int initial_dec_surfaces = 0, CUstream custream=NULL);
+              bool force_zero_latency = false, unsigned int initial_dec_surfaces = 0, CUstream custream=NULL,
+              CUvideoctxlock ctxLock = NULL);
     ~NvDecoder();
 
     /**
@@ -334,6 +337,7 @@ private:
 private:
     CUcontext m_cuContext = NULL;
     CUvideoctxlock m_ctxLock;
+    bool m_bExternalCtxLock = false;
     CUvideoparser m_hParser = NULL;
     CUvideodecoder m_hDecoder = NULL;
     bool m_bUseDeviceFrame;
@@ -278,6 +278,13 @@ public:
     */
     uint32_t GetEncoderBufferCount() const { return m_nEncoderBuffer; }
 
+    /**
+    *  @brief This function selects IVF framed (default) or raw OBU output for AV1.
+    *  Raw output leaves containers to the caller, e.g. IVFWriter, which also patches the frame count.
+    *  Must be called before the first packet is retrieved.
+    */
+    void SetUseIVFContainer(bool bUseIVFContainer) { m_bUseIVFContainer = bUseIVFContainer; }
+
     /*
     * @brief This function returns initializeParams(width, height, fps etc).
     */
@@ -461,7 +468,6 @@ protected:
     int32_t m_iGot = 0;
     int32_t m_nEncoderBuffer = 0;
     int32_t m_nOutputDelay = 0;
-    IVFUtils m_IVFUtils;
     bool m_bWriteIVFFileHeader = true;
     bool m_bUseIVFContainer = true;
     std::vector<NV_ENC_OUTPUT_PTR> m_vBitstreamOutputBuffer;
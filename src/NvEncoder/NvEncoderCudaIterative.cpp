@@ -380,6 +380,7 @@ NVENCSTATUS NvEncoderCudaIterative::EncodeFrameIteration(NV_ENC_PIC_PARAMS* pPic
     iterData.outputIdx = outBufIdx;
     iterData.recIdx = recBufIdx; 
     iterData.stateIdx = pPicParams->stateBufferIdx;
+    iterData.qualParam = getQualParam();
     m_EncMultipleStates.encIterationData.push_back(iterData);
     m_EncMultipleStates.stateBufUsage[pPicParams->stateBufferIdx] = true;
 
@@ -482,11 +483,10 @@ NVENCSTATUS NvEncoderCudaIterative::EncodeFrameExternalLookahead(uint32_t frameI
     return nvStatus;
 }
 
-void NvEncoderCudaIterative::updateQualParam(int32_t &currentQualParam, int32_t delta, bool& reachedLimit, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams)
+void NvEncoderCudaIterative::getQualParamRange(int32_t &minQualParam, int32_t &maxQualParam) const
 {
-    int32_t maxQualParam = 0, minQualParam = 0;
-
-    if(m_initializeParams.encodeConfig->rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP) // contant QP mode
+    minQualParam = 1;
+    if(m_encodeConfig.rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP) // contant QP mode
     {
         if(m_initializeParams.encodeGUID == NV_ENC_CODEC_H264_GUID || m_initializeParams.encodeGUID == NV_ENC_CODEC_HEVC_GUID)
             maxQualParam = MAX_QP_HEVC;
@@ -495,30 +495,48 @@ void NvEncoderCudaIterative::updateQualParam(int32_t &currentQualParam, int32_t
     }
     else // VBR constant quality mode
         maxQualParam = MAX_CQ;
+}
+
+int32_t NvEncoderCudaIterative::getQualParam() const
+{
+    if(m_encodeConfig.rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP)
+        return m_encodeConfig.rcParams.constQP.qpIntra;
+    return m_encodeConfig.rcParams.targetQuality;
+}
+
+void NvEncoderCudaIterative::setQualParam(int32_t qualParam, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams)
+{
+    if(reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP)
+    {
+        reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.constQP = {uint32_t(qualParam), uint32_t(qualParam), uint32_t(qualParam)};
+        std::cout << "New QP = " << qualParam << std::endl; 
+    }
+    else
+    {
+        reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.targetQuality = uint8_t(qualParam);
+        std::cout << "New CQ = " << qualParam << std::endl;
+    }
+    Reconfigure(reconfigureParams); 
+}
+
+void NvEncoderCudaIterative::updateQualParam(int32_t &currentQualParam, int32_t delta, bool& reachedLimit, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams)
+{
+    int32_t maxQualParam = 0, minQualParam = 0;
+    getQualParamRange(minQualParam, maxQualParam);
 
     int32_t newQualParam = currentQualParam + delta;
-    if(newQualParam <= 0 || newQualParam > maxQualParam)
+    if(newQualParam < minQualParam || newQualParam > maxQualParam)
         reachedLimit = true;
     
     if(!reachedLimit)
     {
         currentQualParam += delta;
-        if(reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP)
-        {
-            reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.constQP = {uint32_t(currentQualParam), uint32_t(currentQualParam), uint32_t(currentQualParam)};
-            std::cout << "New QP = " << currentQualParam << std::endl; 
-        }
-        else
-        {
-            reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.targetQuality = uint8_t(currentQualParam);
-            std::cout << "New CQ = " << currentQualParam << std::endl;
-        }
-        Reconfigure(reconfigureParams); 
+        setQualParam(currentQualParam, reconfigureParams);
     }
 
 }
 
-void NvEncoderCudaIterative::EncodeFrameConstantQuality(std::vector<std::vector<uint8_t>> &vPacket, std::vector<CUdeviceptr> vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nDeltaQualParam, uint32_t nFrame)
+void NvEncoderCudaIterative::EncodeFrameConstantQuality(std::vector<std::vector<uint8_t>> &vPacket, const std::vector<CUdeviceptr> &vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nDeltaQualParam, uint32_t nFrame)
 {
     if (!IsHWEncoderInitialized())
     {
@@ -531,14 +549,23 @@ void NvEncoderCudaIterative::EncodeFrameConstantQuality(std::vector<std::vector<
     if(m_initializeParams.encodeConfig->rcParams.enableExtLookahead && EncodeFrameExternalLookahead(nFrame) != NV_ENC_SUCCESS)
         return;
 
-	int32_t currQualParam = (reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.rateControlMode == NV_ENC_PARAMS_RC_CONSTQP) ?
-                            reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.constQP.qpIntra : // get last QP
-                            reconfigureParams->reInitEncodeParams.encodeConfig->rcParams.targetQuality;    // get last CQ
-    int32_t bestQualParam = currQualParam;
-    int32_t deltaQualParam = nDeltaQualParam;
-    bool reachedQualParamLimit = false;
+    QualitySearchConfig searchConfig;
+    getQualParamRange(searchConfig.nMinParam, searchConfig.nMaxParam);
+    // AV1 QPs are qindex values, about four per H.264/HEVC QP step
+    searchConfig.dDefaultSlope = searchConfig.nMaxParam == MAX_QP_AV1 ? 0.125 : 0.5;
+    searchConfig.dMinQuality = minTargetQuality;
+    searchConfig.dMaxQuality = maxTargetQuality;
+    searchConfig.nStep = nDeltaQualParam;
+    searchConfig.nMaxIterations = m_nNumIterations;
+    searchConfig.eMode = m_eQualSearchMode;
+    m_qualSearch.SetConfig(searchConfig);
+
+    // start the new frame from the QP/CQ the previous frames settled on
+    int32_t currQualParam = getQualParam();
+    int32_t seedQualParam = m_qualSearch.GetSeedParam(currQualParam);
+    if(seedQualParam != currQualParam)
+        setQualParam(seedQualParam, reconfigureParams);
     float currQualMetric = 0.0;
-    float bestQualMetric = 0.0;
 
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
     std::vector<NvEncIterationData> currItersData;
@@ -562,6 +589,7 @@ void NvEncoderCudaIterative::EncodeFrameConstantQuality(std::vector<std::vector<
         {
             bestIter = 0;
             iter = 0;
+            m_qualSearch.StartFrame();
             // check when iteration number reaches the maximum number of iterations
             while (iter < m_nNumIterations)
             {
@@ -576,36 +604,25 @@ void NvEncoderCudaIterative::EncodeFrameConstantQuality(std::vector<std::vector<
                 GetEncodedPacket(iter, frameIdxDisplay, overlayFrame, recIdx);
                 if(overlayFrame)
                     GetEncodedPacket(iter, frameIdxDisplay, overlayFrame, recIdx);
-                calcPSNRY(
-                    reinterpret_cast<uint8_t*>(vDeviceFrameBuffer[frameIdxDisplay % m_nEncoderBuffer]), 
-                    reinterpret_cast<uint8_t*>((CUdeviceptr)m_vReconFrames[recIdx].inputPtr),  
-                    m_nWidth, m_nHeight, m_cudaPitch, currQualMetric
-                );
+                FrameMetrics metrics = {};
+                MeasureQuality(vDeviceFrameBuffer[frameIdxDisplay % m_nEncoderBuffer], (CUdeviceptr)m_vReconFrames[recIdx].inputPtr, metrics);
+                currQualMetric = (float)metrics.adPsnr[0];
+                // the first iteration of this frame may have been sent by an earlier call, with the QP/CQ of that time
+                currItersData = m_EncMultipleStates.findIterations(frameIdxDisplay);
+                currQualParam = iter < currItersData.size() ? currItersData[iter].qualParam : getQualParam();
                 std::cout << "frameIdxDisplay = " << frameIdxDisplay << 
                              " iter = " << iter << 
                              " avgQP = " << m_EncMultipleStates.avgQPFrame.back() << 
                              " totalBits = " << m_EncMultipleStates.totalBitsFrame.back() << 
                              " PSNR-Y = " << currQualMetric << std::endl;
-                bestQualMetric = currQualMetric; 
-                bestQualParam = currQualParam;
-                bestIter = iter;
-                // check when metric hits the target range 
-                // for the last iteration QP/CQ is adjusted, however it only takes effect the next time EncodeFrameIteration is called
-                if(!(currQualMetric > minTargetQuality && currQualMetric < maxTargetQuality))
-                {
-                    if(currQualMetric < minTargetQuality)
-                        deltaQualParam = -nDeltaQualParam;
-                    else
-                        deltaQualParam = nDeltaQualParam;
-                    updateQualParam(currQualParam, deltaQualParam, reachedQualParamLimit, reconfigureParams);
-                    if(reachedQualParamLimit)
-                        break;
-                }
-                // skip remaining iteration if the target range was reached
-                else
-                    break; 
+                // stop once the metric is in the target range or the search has nothing left to try
+                int32_t nextQualParam = 0;
+                if(!m_qualSearch.AddResult(currQualParam, currQualMetric, nextQualParam))
+                    break;
+                setQualParam(nextQualParam, reconfigureParams);
                 iter++;
             }
+            bestIter = m_qualSearch.FinishFrame();
             currItersData = m_EncMultipleStates.findIterations(frameIdxDisplay);
             RestoreEncoderState(bestIter, currItersData);
             
@@ -763,22 +780,29 @@ void NvEncoderCudaIterative::GetEncodedPacket(uint32_t currIter, uint32_t &frame
     {
         m_vPackets[currIter].push_back(std::vector<uint8_t>());
     }
-    m_vPackets[currIter][i].clear();
-    
-    if ((m_initializeParams.encodeGUID == NV_ENC_CODEC_AV1_GUID) && (m_bUseIVFContainer))
+
+    bool bWriteIVF = (m_initializeParams.encodeGUID == NV_ENC_CODEC_AV1_GUID) && (m_bUseIVFContainer);
+    uint32_t nHeaderSize = 0;
+    if (bWriteIVF)
     {
         if(lockBitstreamData.frameIdxDisplay)
         {
             m_bWriteIVFFileHeader = false;
         }
+        nHeaderSize = (m_bWriteIVFFileHeader ? IVFUtils::nFileHeaderSize : 0) + IVFUtils::nFrameHeaderSize;
+    }
+    m_vPackets[currIter][i].resize(nHeaderSize + lockBitstreamData.bitstreamSizeInBytes);
+    uint8_t *pDst = m_vPackets[currIter][i].data();
+    if (bWriteIVF)
+    {
         if (m_bWriteIVFFileHeader)
         {
-            m_IVFUtils.WriteFileHeader(m_vPackets[currIter][i], MAKE_FOURCC('A', 'V', '0', '1'), m_initializeParams.encodeWidth, m_initializeParams.encodeHeight, m_initializeParams.frameRateNum, m_initializeParams.frameRateDen, 0xFFFF);
+            pDst += IVFUtils::WriteFileHeader(pDst, MAKE_FOURCC('A', 'V', '0', '1'), m_initializeParams.encodeWidth, m_initializeParams.encodeHeight, m_initializeParams.frameRateNum, m_initializeParams.frameRateDen, 0xFFFF);
         }
 
-        m_IVFUtils.WriteFrameHeader(m_vPackets[currIter][i], lockBitstreamData.bitstreamSizeInBytes, lockBitstreamData.outputTimeStamp);
+        pDst += IVFUtils::WriteFrameHeader(pDst, lockBitstreamData.bitstreamSizeInBytes, lockBitstreamData.outputTimeStamp);
     }
-    m_vPackets[currIter][i].insert(m_vPackets[currIter][i].end(), &pData[0], &pData[lockBitstreamData.bitstreamSizeInBytes]);
+    memcpy(pDst, pData, lockBitstreamData.bitstreamSizeInBytes);
 
     if(!overlayFrame)
     {   
@@ -813,7 +837,7 @@ NVENCSTATUS NvEncoderCudaIterative::DoEncode(NV_ENC_INPUT_PTR inputBuffer, NV_EN
     return nvStatus; 
 }
 
-void NvEncoderCudaIterative::EndEncode(std::vector<std::vector<uint8_t>> &vPacket, std::vector<CUdeviceptr> vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nDeltaQualParam, uint32_t nFrame)
+void NvEncoderCudaIterative::EndEncode(std::vector<std::vector<uint8_t>> &vPacket, const std::vector<CUdeviceptr> &vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nDeltaQualParam, uint32_t nFrame)
 {
     if (!IsHWEncoderInitialized())
     {
@@ -843,11 +867,9 @@ void NvEncoderCudaIterative::EndEncode(std::vector<std::vector<uint8_t>> &vPacke
             GetEncodedPacket(0, frameIdxDisplay, overlayFrame, recIdx);
             if(overlayFrame)
                 GetEncodedPacket(0, frameIdxDisplay, overlayFrame, recIdx);
-            calcPSNRY(
-                    reinterpret_cast<uint8_t*>(vDeviceFrameBuffer[frameIdxDisplay % m_nEncoderBuffer]), 
-                    reinterpret_cast<uint8_t*>((CUdeviceptr)m_vReconFrames[recIdx].inputPtr), 
-                    m_nWidth, m_nHeight, m_cudaPitch, qualMetric
-                );
+            FrameMetrics metrics = {};
+            MeasureQuality(vDeviceFrameBuffer[frameIdxDisplay % m_nEncoderBuffer], (CUdeviceptr)m_vReconFrames[recIdx].inputPtr, metrics);
+            qualMetric = (float)metrics.adPsnr[0];
             std::cout << "frameIdxDisplay = " << frameIdxDisplay << 
                          " iter = " << 0 << 
                          " avgQP = " << m_EncMultipleStates.avgQPFrame.back() << 
@@ -858,6 +880,14 @@ void NvEncoderCudaIterative::EndEncode(std::vector<std::vector<uint8_t>> &vPacke
             m_iGot++;
         }
     }
+
+    const QualitySearchStats &searchStats = m_qualSearch.GetStats();
+    if(searchStats.nFrames)
+    {
+        std::cout << "Quality search: " << searchStats.nFrames << " frames" <<
+                     " iterations/frame = " << searchStats.GetIterationsPerFrame() <<
+                     " in target range = " << 100.0 * searchStats.nFramesInWindow / searchStats.nFrames << "%" << std::endl;
+    }
 }
 
 void NvEncoderCudaIterative::DestroyEncoder()
@@ -870,5 +900,52 @@ void NvEncoderCudaIterative::DestroyEncoder()
     for (size_t i = 0; i < m_nNumIterations; i++)
         free(m_EncMultipleStates.statsData[i]);
 
+    if (m_pMetrics)
+    {
+        CUDA_DRVAPI_CALL(cuCtxPushCurrent(m_cuContext));
+        m_pMetrics.reset();
+        CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+    }
+
     NvEncoder::DestroyEncoder();
 }
+
+bool NvEncoderCudaIterative::MeasureQuality(CUdeviceptr dpSrc, CUdeviceptr dpRecon, FrameMetrics &metrics)
+{
+    METRICS_FORMAT eFormat = METRICS_FORMAT_NV12;
+    int nBitDepth = 8;
+    uint32_t nFlags = METRICS_PSNR;
+    switch (m_eBufferFormat)
+    {
+    case NV_ENC_BUFFER_FORMAT_NV12:
+        break;
+    case NV_ENC_BUFFER_FORMAT_YUV420_10BIT:
+        eFormat = METRICS_FORMAT_P016;
+        nBitDepth = 10;
+        break;
+    case NV_ENC_BUFFER_FORMAT_YUV444:
+        eFormat = METRICS_FORMAT_YUV444;
+        break;
+    case NV_ENC_BUFFER_FORMAT_YUV444_10BIT:
+        eFormat = METRICS_FORMAT_YUV444P16;
+        nBitDepth = 10;
+        break;
+    case NV_ENC_BUFFER_FORMAT_P210:
+        eFormat = METRICS_FORMAT_P016;
+        nBitDepth = 10;
+        nFlags |= METRICS_LUMA_ONLY;
+        break;
+    default:
+        // Planar 4:2:0 sources are reconstructed as NV12 and 4:2:2 chroma has no metrics layout, so only luma compares
+        nFlags |= METRICS_LUMA_ONLY;
+        break;
+    }
+
+    CUDA_DRVAPI_CALL(cuCtxPushCurrent(m_cuContext));
+    if (!m_pMetrics)
+        m_pMetrics.reset(new FrameMetricsEngine(GetMaxEncodeWidth(), GetMaxEncodeHeight(), METRICS_PSNR));
+    bool bOk = m_pMetrics->Compute(reinterpret_cast<const uint8_t*>(dpSrc), (int)m_cudaPitch, reinterpret_cast<const uint8_t*>(dpRecon),
+        (int)m_cudaPitch, m_nWidth, m_nHeight, eFormat, nBitDepth, nFlags) && m_pMetrics->GetResult(metrics);
+    CUDA_DRVAPI_CALL(cuCtxPopCurrent(NULL));
+    return bOk;
+}
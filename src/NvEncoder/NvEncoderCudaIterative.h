@@ -36,8 +36,10 @@
 #include <sstream>
 #include <string.h>
 #include <math.h>
+#include <memory>
 #include "NvEncoder/NvEncoderCuda.h"
 #include "../Utils/Metrics.h"
+#include "../Utils/QualitySearch.h"
 
 #define MAX_QP_H264 51
 #define MAX_QP_HEVC 51
@@ -56,6 +58,7 @@ struct NvEncIterationData
     uint32_t stateIdx;
     uint32_t dispIdx;
     uint32_t recIdx;
+    int32_t qualParam; // QP or CQ the iteration was encoded with
 };
 
 struct NvEncBlockStatsInfo
@@ -159,7 +162,7 @@ public:
     *  in pOutputBuffer. If there is buffering enabled, this may return without 
     *  any data in pOutputBuffer.
     */
-    void EncodeFrameConstantQuality(std::vector<std::vector<uint8_t>> &vPacket, std::vector<CUdeviceptr> vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nQPDelta, uint32_t nFrame);
+    void EncodeFrameConstantQuality(std::vector<std::vector<uint8_t>> &vPacket, const std::vector<CUdeviceptr> &vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nQPDelta, uint32_t nFrame);
 
     NVENCSTATUS EncodeFrameExternalLookahead(uint32_t frameIdx);
 
@@ -173,7 +176,7 @@ public:
     *  an encoder session. Video memory buffer pointer containing compressed data
     *  is returned in pOutputBuffer.
     */
-    void EndEncode(std::vector<std::vector<uint8_t>> &vPacket, std::vector<CUdeviceptr> vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nQPDelta, uint32_t nFrame);
+    void EndEncode(std::vector<std::vector<uint8_t>> &vPacket, const std::vector<CUdeviceptr> &vDeviceFrameBuffer, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams, double minTargetQuality, double maxTargetQuality, uint32_t nQPDelta, uint32_t nFrame);
 
     /**
     *  @brief  This function is used to destroy the encoder session.
@@ -225,8 +228,28 @@ public:
     
     size_t GetCUDAPitch(){return m_cudaPitch;};
     void updateQualParam(int32_t &currentQP, int32_t deltaQP, bool& reachedLimit, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams);
+    void setQualParam(int32_t qualParam, NV_ENC_RECONFIGURE_PARAMS* reconfigureParams);
+    int32_t getQualParam() const;
+    void getQualParamRange(int32_t &minQualParam, int32_t &maxQualParam) const;
     void collectFrameStats(void* stats);
 
+    /**
+    *  @brief Quality of a reconstructed frame against its source. The metrics engine and its
+    *  scratch are created on first use and kept until DestroyEncoder().
+    */
+    bool MeasureQuality(CUdeviceptr dpSrc, CUdeviceptr dpRecon, FrameMetrics &metrics);
+
+    /**
+    *  @brief Selects how EncodeFrameConstantQuality() searches for the QP/CQ of each frame.
+    *  QUALITY_SEARCH_FIXED_STEP steps by nQPDelta per iteration as earlier versions did.
+    */
+    void SetQualitySearchMode(QUALITY_SEARCH_MODE eMode) { m_eQualSearchMode = eMode; }
+
+    /**
+    *  @brief Iterations per frame and how many frames reached the target quality range.
+    */
+    const QualitySearchStats &GetQualitySearchStats() const { return m_qualSearch.GetStats(); }
+
 private:
     NvEncMultipleStates m_EncMultipleStates;
     std::vector<NV_ENC_INPUT_PTR> m_vMappedReconBuffers;
@@ -240,4 +263,7 @@ private:
     int32_t m_iToSendAllIterations = 0; // same as m_iToSend but includes all iterations
     int32_t m_iGotAllIterations = 0;    // same as m_iGot but includes all iterations
     std::vector<std::vector<std::vector<uint8_t>>> m_vPackets; // keep track packets per iteration
+    std::unique_ptr<FrameMetricsEngine> m_pMetrics;
+    QualityParamSearch m_qualSearch;
+    QUALITY_SEARCH_MODE m_eQualSearchMode = QUALITY_SEARCH_SECANT;
 };
@@ -412,19 +412,26 @@ void NvEncoderD3D12::GetEncodedPacket(std::vector<NV_ENC_OUTPUT_RESOURCE_D3D12*>
             NvEncOutputFrame nvEncOutputFrame;
             vPacket.push_back(nvEncOutputFrame);
         }
-        vPacket[i].frame.clear();
-        if (m_initializeParams.encodeGUID == NV_ENC_CODEC_AV1_GUID)
+
+        bool bWriteIVF = (m_initializeParams.encodeGUID == NV_ENC_CODEC_AV1_GUID) && (m_bUseIVFContainer);
+        uint32_t nHeaderSize = 0;
+        if (bWriteIVF)
+        {
+            nHeaderSize = (m_bWriteIVFFileHeader ? IVFUtils::nFileHeaderSize : 0) + IVFUtils::nFrameHeaderSize;
+        }
+        vPacket[i].frame.resize(nHeaderSize + lockBitstreamData.bitstreamSizeInBytes);
+        uint8_t* pDst = vPacket[i].frame.data();
+        if (bWriteIVF)
         {
             if (m_bWriteIVFFileHeader)
             {
-                m_IVFUtils.WriteFileHeader(vPacket[i].frame, MAKE_FOURCC('A', 'V', '0', '1'), m_initializeParams.encodeWidth, m_initializeParams.encodeHeight, m_initializeParams.frameRateNum, m_initializeParams.frameRateDen, 0xFFFF);
+                pDst += IVFUtils::WriteFileHeader(pDst, MAKE_FOURCC('A', 'V', '0', '1'), m_initializeParams.encodeWidth, m_initializeParams.encodeHeight, m_initializeParams.frameRateNum, m_initializeParams.frameRateDen, 0xFFFF);
                 m_bWriteIVFFileHeader = false;
             }
 
-            m_IVFUtils.WriteFrameHeader(vPacket[i].frame, lockBitstreamData.bitstreamSizeInBytes, lockBitstreamData.outputTimeStamp);
-
+            pDst += IVFUtils::WriteFrameHeader(pDst, lockBitstreamData.bitstreamSizeInBytes, lockBitstreamData.outputTimeStamp);
         }
-        vPacket[i].frame.insert(vPacket[i].frame.end(), &pData[0], &pData[lockBitstreamData.bitstreamSizeInBytes]);
+        memcpy(pDst, pData, lockBitstreamData.bitstreamSizeInBytes);
         vPacket[i].pictureType = lockBitstreamData.pictureType;
         vPacket[i].timeStamp = lockBitstreamData.outputTimeStamp;
         i++;
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "NvCodecUtils.h"
+#include "NalUnitSplitter.h"
+
+//---------------------------------------------------------------------------
+//! \file AnnexBConverter.h
+//! \brief Converts H.264/HEVC samples between length-prefixed (avcC/hvcC) and Annex-B framing.
+//!
+//! Replaces the h264_mp4toannexb/hevc_mp4toannexb bitstream filters. With 4-byte NAL lengths
+//! and 4-byte start codes both directions rewrite the prefixes in place; otherwise the sample
+//! is written once into a scratch buffer that is reused across calls.
+//---------------------------------------------------------------------------
+
+class AnnexBConverter {
+public:
+    /**
+    *   @brief  Reads the NAL length size and parameter sets from avcC/hvcC extradata.
+    *   Extradata that is already Annex-B (as some Matroska files carry) switches the converter to pass-through.
+    *   @return false if the extradata cannot be parsed
+    */
+    bool Init(const uint8_t *pExtradata, size_t nExtradata, NAL_CODEC eCodec) {
+        this->eCodec = eCodec;
+        vParamSets.clear();
+        nLengthSize = 4;
+        bPassThrough = false;
+
+        if (nExtradata >= 3 && pExtradata[0] == 0 && pExtradata[1] == 0 && (pExtradata[2] == 1 || (nExtradata >= 4 && pExtradata[2] == 0 && pExtradata[3] == 1))) {
+            bPassThrough = true;
+            return true;
+        }
+        return eCodec == NAL_CODEC_HEVC ? ParseHvcC(pExtradata, nExtradata) : ParseAvcC(pExtradata, nExtradata);
+    }
+
+    bool IsPassThrough() const {
+        return bPassThrough;
+    }
+    int GetLengthSize() const {
+        return nLengthSize;
+    }
+    /**
+    *   @brief  Parameter sets from the extradata, in Annex-B form with 4-byte start codes.
+    */
+    const std::vector<uint8_t> &GetParameterSets() const {
+        return vParamSets;
+    }
+
+    /**
+    *   @brief  Converts a length-prefixed sample to Annex-B.
+    *   Parameter sets from the extradata are inserted before the first key frame slice unless the sample carries its own.
+    *   Zero-length NAL units, which some muxers write, are dropped.
+    *   pData is modified when the conversion can be done in place; *ppOut then equals pData, otherwise it points
+    *   into a scratch buffer that stays valid until the next call.
+    *   @return false if the NAL lengths do not add up to nSize or the sample holds no NAL unit
+    */
+    bool ToAnnexB(uint8_t *pData, size_t nSize, const uint8_t **ppOut, size_t *pnOut) {
+        if (bPassThrough) {
+            *ppOut = pData;
+            *pnOut = nSize;
+            return true;
+        }
+
+        // First pass validates the layout before anything is overwritten
+        size_t nNal = 0, nEmpty = 0, nKeyOffset = SIZE_MAX;
+        bool bHasParamSets = false;
+        for (size_t nPos = 0; nPos < nSize;) {
+            uint32_t nNalSize;
+            if (!ReadLength(pData, nSize, nPos, nNalSize)) {
+                return false;
+            }
+            if (nNalSize == 0) {
+                nEmpty++;
+                nPos += nLengthSize;
+                continue;
+            }
+            nNal++;
+            uint8_t nType = GetNalType(pData + nPos + nLengthSize, eCodec);
+            bHasParamSets |= IsParameterSetNal(nType, eCodec);
+            if (nKeyOffset == SIZE_MAX && IsKeyFrameNal(nType, eCodec)) {
+                nKeyOffset = nPos;
+            }
+            nPos += nLengthSize + nNalSize;
+        }
+        if (!nNal) {
+            return false;
+        }
+        bool bInject = nKeyOffset != SIZE_MAX && !bHasParamSets && !vParamSets.empty();
+
+        // Dropping an empty NAL unit shortens the sample, so that case is never done in place
+        if (nLengthSize == 4 && !bInject && !nEmpty) {
+            for (size_t nPos = 0; nPos < nSize;) {
+                uint32_t nNalSize = GetBe32(pData + nPos);
+                memcpy(pData + nPos, aStartCode, 4);
+                nPos += 4 + nNalSize;
+            }
+            *ppOut = pData;
+            *pnOut = nSize;
+            return true;
+        }
+
+        size_t nOut = nSize - nEmpty * nLengthSize + nNal * (4 - nLengthSize) + (bInject ? vParamSets.size() : 0);
+        // resize() keeps the capacity, so steady state costs no allocations
+        vOut.resize(nOut);
+        uint8_t *pDst = vOut.data();
+        for (size_t nPos = 0; nPos < nSize;) {
+            uint32_t nNalSize = 0;
+            ReadLength(pData, nSize, nPos, nNalSize);
+            if (nNalSize == 0) {
+                nPos += nLengthSize;
+                continue;
+            }
+            if (bInject && nPos == nKeyOffset) {
+                memcpy(pDst, vParamSets.data(), vParamSets.size());
+                pDst += vParamSets.size();
+            }
+            memcpy(pDst, aStartCode, 4);
+            memcpy(pDst + 4, pData + nPos + nLengthSize, nNalSize);
+            pDst += 4 + nNalSize;
+            nPos += nLengthSize + nNalSize;
+        }
+        *ppOut = vOut.data();
+        *pnOut = nOut;
+        return true;
+    }
+
+    /**
+    *   @brief  Converts an Annex-B access unit to 4-byte length-prefixed NAL units, e.g. for MP4 samples.
+    *   Rewritten in place when every NAL unit has a 4-byte start code and no padding; otherwise *ppOut
+    *   points into a scratch buffer that stays valid until the next call.
+    *   @param  bStripParameterSets   Drop VPS/SPS/PPS, for containers that keep them in the sample entry
+    */
+    bool FromAnnexB(uint8_t *pData, size_t nSize, const uint8_t **ppOut, size_t *pnOut, bool bStripParameterSets = false) {
+        SplitNalUnits(pData, nSize, vNal, eCodec);
+        if (vNal.empty()) {
+            return false;
+        }
+
+        bool bInPlace = !bStripParameterSets && vNal[0].nOffset == 0;
+        size_t nOut = 0;
+        for (size_t i = 0; i < vNal.size(); i++) {
+            const NalUnit &nal = vNal[i];
+            size_t nEnd = nal.pData + nal.nSize - pData;
+            size_t nNextOffset = i + 1 < vNal.size() ? vNal[i + 1].nOffset : nSize;
+            bInPlace &= nal.nStartCodeSize == 4 && nEnd == nNextOffset;
+            if (!(bStripParameterSets && IsParameterSetNal(nal.nType, eCodec))) {
+                nOut += 4 + nal.nSize;
+            }
+        }
+
+        if (bInPlace) {
+            for (const NalUnit &nal : vNal) {
+                PutBe32(pData + nal.nOffset, nal.nSize);
+            }
+            *ppOut = pData;
+            *pnOut = nSize;
+            return true;
+        }
+
+        vOut.resize(nOut);
+        uint8_t *pDst = vOut.data();
+        for (const NalUnit &nal : vNal) {
+            if (bStripParameterSets && IsParameterSetNal(nal.nType, eCodec)) {
+                continue;
+            }
+            PutBe32(pDst, nal.nSize);
+            memcpy(pDst + 4, nal.pData, nal.nSize);
+            pDst += 4 + nal.nSize;
+        }
+        *ppOut = vOut.data();
+        *pnOut = nOut;
+        return true;
+    }
+
+private:
+    bool ParseAvcC(const uint8_t *p, size_t n) {
+        if (n < 7 || p[0] != 1) {
+            LOG(ERROR) << "Invalid avcC extradata";
+            return false;
+        }
+        nLengthSize = (p[4] & 3) + 1;
+        size_t nPos = 5;
+        // SPS count in the low 5 bits, followed by the PPS list with an 8-bit count
+        for (int iList = 0; iList < 2; iList++) {
+            if (nPos >= n) {
+                return false;
+            }
+            int nCount = iList == 0 ? (p[nPos] & 0x1F) : p[nPos];
+            nPos++;
+            for (int i = 0; i < nCount; i++) {
+                if (!AppendParamSet(p, n, nPos)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool ParseHvcC(const uint8_t *p, size_t n) {
+        if (n < 23) {
+            LOG(ERROR) << "Invalid hvcC extradata";
+            return false;
+        }
+        nLengthSize = (p[21] & 3) + 1;
+        int nArrays = p[22];
+        size_t nPos = 23;
+        for (int iArray = 0; iArray < nArrays; iArray++) {
+            if (n - nPos < 3) {
+                return false;
+            }
+            int nCount = (p[nPos + 1] << 8) | p[nPos + 2];
+            nPos += 3;
+            for (int i = 0; i < nCount; i++) {
+                if (!AppendParamSet(p, n, nPos)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool AppendParamSet(const uint8_t *p, size_t n, size_t &nPos) {
+        if (n - nPos < 2) {
+            return false;
+        }
+        size_t nNalSize = (p[nPos] << 8) | p[nPos + 1];
+        nPos += 2;
+        if (n - nPos < nNalSize) {
+            return false;
+        }
+        vParamSets.insert(vParamSets.end(), aStartCode, aStartCode + 4);
+        vParamSets.insert(vParamSets.end(), p + nPos, p + nPos + nNalSize);
+        nPos += nNalSize;
+        return true;
+    }
+
+    // A zero length is valid; the caller skips the empty NAL unit
+    bool ReadLength(const uint8_t *pData, size_t nSize, size_t nPos, uint32_t &nNalSize) const {
+        if (nSize - nPos < (size_t)nLengthSize) {
+            return false;
+        }
+        nNalSize = 0;
+        for (int i = 0; i < nLengthSize; i++) {
+            nNalSize = (nNalSize << 8) | pData[nPos + i];
+        }
+        return nNalSize <= nSize - nPos - nLengthSize;
+    }
+
+    static uint32_t GetBe32(const uint8_t *p) {
+        return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    static void PutBe32(uint8_t *p, uint32_t nValue) {
+        p[0] = (uint8_t)(nValue >> 24);
+        p[1] = (uint8_t)(nValue >> 16);
+        p[2] = (uint8_t)(nValue >> 8);
+        p[3] = (uint8_t)nValue;
+    }
+
+private:
+    static constexpr uint8_t aStartCode[4] = {0, 0, 0, 1};
+    NAL_CODEC eCodec = NAL_CODEC_H264;
+    int nLengthSize = 4;
+    bool bPassThrough = false;
+    std::vector<uint8_t> vParamSets;
+    std::vector<uint8_t> vOut;
+    std::vector<NalUnit> vNal;
+};
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "NvCodecUtils.h"
+
+//---------------------------------------------------------------------------
+//! \file Av1ObuParser.h
+//! \brief Splits AV1 low overhead bitstream format data into OBUs and parses the headers
+//! needed for ingest: OBU headers, the sequence header and the frame type.
+//!
+//! OBUs are returned as spans into the caller's buffer; nothing is copied.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    OBU_SEQUENCE_HEADER = 1,
+    OBU_TEMPORAL_DELIMITER = 2,
+    OBU_FRAME_HEADER = 3,
+    OBU_TILE_GROUP = 4,
+    OBU_METADATA = 5,
+    OBU_FRAME = 6,
+    OBU_REDUNDANT_FRAME_HEADER = 7,
+    OBU_TILE_LIST = 8,
+    OBU_PADDING = 15,
+} AV1_OBU_TYPE;
+
+typedef enum {
+    AV1_KEY_FRAME = 0,
+    AV1_INTER_FRAME = 1,
+    AV1_INTRA_ONLY_FRAME = 2,
+    AV1_SWITCH_FRAME = 3,
+} AV1_FRAME_TYPE;
+
+/**
+* @brief An OBU inside a buffer. pData points at the OBU header, pPayload past the header and size field.
+*/
+struct ObuUnit {
+    const uint8_t *pData;
+    uint32_t nSize;         /*!< OBU size including header and size field */
+    const uint8_t *pPayload;
+    uint32_t nPayloadSize;
+    uint8_t nType;
+    uint8_t nTemporalId;
+    uint8_t nSpatialId;
+    bool bHasExtension;
+};
+
+/**
+* @brief Fields of sequence_header_obu() up to and including color_config().
+*/
+struct Av1SequenceHeader {
+    uint8_t nProfile;
+    bool bStillPicture;
+    bool bReducedStillPictureHeader;
+    uint8_t nLevelIdx;              /*!< seq_level_idx[0] */
+    uint8_t nTier;                  /*!< seq_tier[0] */
+    uint32_t nMaxFrameWidth;
+    uint32_t nMaxFrameHeight;
+    bool bFrameIdNumbersPresent;
+    uint8_t nBitDepth;
+    bool bMonochrome;
+    uint8_t nSubsamplingX;
+    uint8_t nSubsamplingY;
+    uint8_t nChromaSamplePosition;
+    uint8_t nColorPrimaries;
+    uint8_t nTransferCharacteristics;
+    uint8_t nMatrixCoefficients;
+    bool bFullRange;
+    bool bTimingInfoPresent;
+    uint32_t nNumUnitsInDisplayTick;
+    uint32_t nTimeScale;
+};
+
+/**
+* @brief Reads a leb128() value. Returns false if the buffer ends first or the value has more than 8 bytes.
+*/
+inline bool ReadLeb128(const uint8_t *&p, const uint8_t *pEnd, uint64_t &nValue) {
+    nValue = 0;
+    for (int i = 0; i < 8; i++) {
+        if (p >= pEnd) {
+            return false;
+        }
+        uint8_t b = *p++;
+        nValue |= (uint64_t)(b & 0x7F) << (i * 7);
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Writes nValue as leb128() padded to nBytes bytes (1..8). Returns the number of bytes written.
+*/
+inline int WriteLeb128(uint8_t *p, uint64_t nValue, int nBytes = 0) {
+    int n = 0;
+    do {
+        uint8_t b = nValue & 0x7F;
+        nValue >>= 7;
+        if (nValue || n + 1 < nBytes) {
+            b |= 0x80;
+        }
+        p[n++] = b;
+    } while (nValue || n < nBytes);
+    return n;
+}
+
+/**
+* @brief Parses the OBU at p. An OBU without obu_has_size_field extends to pEnd.
+*/
+inline bool ParseObu(const uint8_t *p, const uint8_t *pEnd, ObuUnit &obu) {
+    if (p >= pEnd) {
+        return false;
+    }
+    const uint8_t *pStart = p;
+    uint8_t nHeader = *p++;
+    if (nHeader & 0x80) {
+        // obu_forbidden_bit
+        return false;
+    }
+    obu.pData = pStart;
+    obu.nType = (nHeader >> 3) & 0x0F;
+    obu.bHasExtension = (nHeader >> 2) & 1;
+    bool bHasSizeField = (nHeader >> 1) & 1;
+    obu.nTemporalId = 0;
+    obu.nSpatialId = 0;
+    if (obu.bHasExtension) {
+        if (p >= pEnd) {
+            return false;
+        }
+        obu.nTemporalId = (*p >> 5) & 0x07;
+        obu.nSpatialId = (*p >> 3) & 0x03;
+        p++;
+    }
+    uint64_t nPayloadSize = pEnd - p;
+    if (bHasSizeField && (!ReadLeb128(p, pEnd, nPayloadSize) || nPayloadSize > (uint64_t)(pEnd - p))) {
+        return false;
+    }
+    obu.pPayload = p;
+    obu.nPayloadSize = (uint32_t)nPayloadSize;
+    obu.nSize = (uint32_t)(p + nPayloadSize - pStart);
+    return true;
+}
+
+/**
+* @brief Splits a buffer of OBUs, e.g. one IVF frame or temporal unit.
+*  @return Number of OBUs written to vObu; parsing stops at the first malformed OBU
+*/
+inline size_t SplitObuUnits(const uint8_t *pBuf, size_t nBuf, std::vector<ObuUnit> &vObu) {
+    vObu.clear();
+    const uint8_t *p = pBuf, *pEnd = pBuf + nBuf;
+    ObuUnit obu;
+    while (p < pEnd && ParseObu(p, pEnd, obu)) {
+        vObu.push_back(obu);
+        p += obu.nSize;
+    }
+    return vObu.size();
+}
+
+/**
+* @brief Parses sequence_header_obu() from the OBU payload.
+*/
+inline bool ParseSequenceHeader(const uint8_t *pPayload, size_t nPayloadSize, Av1SequenceHeader &seq) {
+    seq = {};
+    BitReader br(pPayload, nPayloadSize);
+    seq.nProfile = (uint8_t)br.ReadBits(3);
+    seq.bStillPicture = br.ReadBit();
+    seq.bReducedStillPictureHeader = br.ReadBit();
+    if (seq.bReducedStillPictureHeader) {
+        seq.nLevelIdx = (uint8_t)br.ReadBits(5);
+    } else {
+        bool bDecoderModelInfoPresent = false;
+        uint32_t nBufferDelayLength = 0;
+        seq.bTimingInfoPresent = br.ReadBit();
+        if (seq.bTimingInfoPresent) {
+            seq.nNumUnitsInDisplayTick = br.ReadBits(32);
+            seq.nTimeScale = br.ReadBits(32);
+            if (br.ReadBit()) {
+                // num_ticks_per_picture_minus_1
+                br.ReadUvlc();
+            }
+            bDecoderModelInfoPresent = br.ReadBit();
+            if (bDecoderModelInfoPresent) {
+                nBufferDelayLength = br.ReadBits(5) + 1;
+                br.SkipBits(32 + 5 + 5);
+            }
+        }
+        bool bInitialDisplayDelayPresent = br.ReadBit();
+        uint32_t nOperatingPoints = br.ReadBits(5) + 1;
+        for (uint32_t i = 0; i < nOperatingPoints; i++) {
+            br.SkipBits(12);
+            uint8_t nLevelIdx = (uint8_t)br.ReadBits(5);
+            uint8_t nTier = nLevelIdx > 7 ? (uint8_t)br.ReadBit() : 0;
+            if (i == 0) {
+                seq.nLevelIdx = nLevelIdx;
+                seq.nTier = nTier;
+            }
+            if (bDecoderModelInfoPresent && br.ReadBit()) {
+                br.SkipBits(2 * nBufferDelayLength + 1);
+            }
+            if (bInitialDisplayDelayPresent && br.ReadBit()) {
+                br.SkipBits(4);
+            }
+        }
+    }
+
+    int nFrameWidthBits = br.ReadBits(4) + 1;
+    int nFrameHeightBits = br.ReadBits(4) + 1;
+    seq.nMaxFrameWidth = br.ReadBits(nFrameWidthBits) + 1;
+    seq.nMaxFrameHeight = br.ReadBits(nFrameHeightBits) + 1;
+    if (!seq.bReducedStillPictureHeader) {
+        seq.bFrameIdNumbersPresent = br.ReadBit();
+    }
+    if (seq.bFrameIdNumbersPresent) {
+        br.SkipBits(4 + 3);
+    }
+    // use_128x128_superblock, enable_filter_intra, enable_intra_edge_filter
+    br.SkipBits(3);
+    if (!seq.bReducedStillPictureHeader) {
+        // enable_interintra_compound, enable_masked_compound, enable_warped_motion, enable_dual_filter
+        br.SkipBits(4);
+        bool bEnableOrderHint = br.ReadBit();
+        if (bEnableOrderHint) {
+            br.SkipBits(2);
+        }
+        uint32_t nForceScreenContentTools = 2;
+        if (!br.ReadBit()) {
+            nForceScreenContentTools = br.ReadBit();
+        }
+        if (nForceScreenContentTools > 0 && !br.ReadBit()) {
+            // seq_force_integer_mv
+            br.SkipBits(1);
+        }
+        if (bEnableOrderHint) {
+            br.SkipBits(3);
+        }
+    }
+    // enable_superres, enable_cdef, enable_restoration
+    br.SkipBits(3);
+
+    // color_config()
+    bool bHighBitDepth = br.ReadBit();
+    seq.nBitDepth = 8;
+    if (seq.nProfile == 2 && bHighBitDepth) {
+        seq.nBitDepth = br.ReadBit() ? 12 : 10;
+    } else if (bHighBitDepth) {
+        seq.nBitDepth = 10;
+    }
+    seq.bMonochrome = seq.nProfile == 1 ? false : br.ReadBit();
+    seq.nColorPrimaries = 2;
+    seq.nTransferCharacteristics = 2;
+    seq.nMatrixCoefficients = 2;
+    if (br.ReadBit()) {
+        seq.nColorPrimaries = (uint8_t)br.ReadBits(8);
+        seq.nTransferCharacteristics = (uint8_t)br.ReadBits(8);
+        seq.nMatrixCoefficients = (uint8_t)br.ReadBits(8);
+    }
+    if (seq.bMonochrome) {
+        seq.bFullRange = br.ReadBit();
+        seq.nSubsamplingX = seq.nSubsamplingY = 1;
+    } else if (seq.nColorPrimaries == 1 && seq.nTransferCharacteristics == 13 && seq.nMatrixCoefficients == 0) {
+        // sRGB
+        seq.bFullRange = true;
+    } else {
+        seq.bFullRange = br.ReadBit();
+        if (seq.nProfile == 0) {
+            seq.nSubsamplingX = seq.nSubsamplingY = 1;
+        } else if (seq.nProfile > 1) {
+            if (seq.nBitDepth == 12) {
+                seq.nSubsamplingX = (uint8_t)br.ReadBit();
+                seq.nSubsamplingY = seq.nSubsamplingX ? (uint8_t)br.ReadBit() : 0;
+            } else {
+                seq.nSubsamplingX = 1;
+            }
+        }
+        if (seq.nSubsamplingX && seq.nSubsamplingY) {
+            seq.nChromaSamplePosition = (uint8_t)br.ReadBits(2);
+        }
+    }
+    return !br.IsOverrun();
+}
+
+/**
+* @brief Reads frame_type from a frame header or frame OBU payload.
+*  @return false for show_existing_frame headers, which carry no frame type
+*/
+inline bool ParseFrameType(const uint8_t *pPayload, size_t nPayloadSize, bool bReducedStillPictureHeader, AV1_FRAME_TYPE &eFrameType, bool *pbShowFrame = NULL) {
+    if (bReducedStillPictureHeader) {
+        eFrameType = AV1_KEY_FRAME;
+        if (pbShowFrame) {
+            *pbShowFrame = true;
+        }
+        return true;
+    }
+    BitReader br(pPayload, nPayloadSize);
+    if (br.ReadBit()) {
+        // show_existing_frame
+        return false;
+    }
+    eFrameType = (AV1_FRAME_TYPE)br.ReadBits(2);
+    bool bShowFrame = br.ReadBit();
+    if (pbShowFrame) {
+        *pbShowFrame = bShowFrame;
+    }
+    return !br.IsOverrun();
+}
+
+/**
+* @brief Parses the sequence header of a temporal unit, if it carries one before its first frame.
+*  @return true if seq was updated; a truncated or corrupt sequence header leaves seq untouched
+*/
+inline bool FindSequenceHeader(const uint8_t *pBuf, size_t nBuf, Av1SequenceHeader &seq) {
+    const uint8_t *p = pBuf, *pEnd = pBuf + nBuf;
+    ObuUnit obu;
+    while (p < pEnd && ParseObu(p, pEnd, obu)) {
+        if (obu.nType == OBU_SEQUENCE_HEADER) {
+            Av1SequenceHeader parsed;
+            if (!ParseSequenceHeader(obu.pPayload, obu.nPayloadSize, parsed)) {
+                return false;
+            }
+            seq = parsed;
+            return true;
+        }
+        if (obu.nType == OBU_FRAME || obu.nType == OBU_FRAME_HEADER) {
+            return false;
+        }
+        p += obu.nSize;
+    }
+    return false;
+}
+
+/**
+* @brief Returns true if the temporal unit starts with a shown key frame, i.e. decoding can start here.
+*  pSeq may carry the active sequence header for streams that repeat it only at the start.
+*/
+inline bool IsKeyFrameTemporalUnit(const uint8_t *pBuf, size_t nBuf, const Av1SequenceHeader *pSeq = NULL) {
+    bool bReduced = pSeq ? pSeq->bReducedStillPictureHeader : false;
+    const uint8_t *p = pBuf, *pEnd = pBuf + nBuf;
+    ObuUnit obu;
+    while (p < pEnd && ParseObu(p, pEnd, obu)) {
+        if (obu.nType == OBU_SEQUENCE_HEADER && obu.nPayloadSize >= 1) {
+            // reduced_still_picture_header is the fifth bit of the payload
+            bReduced = (obu.pPayload[0] >> 3) & 1;
+        } else if (obu.nType == OBU_FRAME_HEADER || obu.nType == OBU_FRAME) {
+            AV1_FRAME_TYPE eFrameType;
+            bool bShowFrame = false;
+            return ParseFrameType(obu.pPayload, obu.nPayloadSize, bReduced, eFrameType, &bShowFrame) && eFrameType == AV1_KEY_FRAME && bShowFrame;
+        }
+        p += obu.nSize;
+    }
+    return false;
+}
@@ -28,6 +28,7 @@
 #include <cuda_runtime.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "BitDepth.h"
 
 static __global__ void ConvertUInt8ToUInt16Kernel(uint8_t *dpUInt8, uint16_t *dpUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight)
 {
@@ -55,16 +56,150 @@ static __global__ void ConvertUInt16ToUInt8Kernel(uint16_t *dpUInt16, uint8_t *d
     dpUInt8[y * nDestPitch + x] = ((uchar2 *)&dpUInt16[y * srcStrideInPixels + x])->y;
 }
 
-void ConvertUInt8ToUInt16(uint8_t *dpUInt8, uint16_t *dpUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight)
+void ConvertUInt8ToUInt16(uint8_t *dpUInt8, uint16_t *dpUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight, cudaStream_t stream)
 {
     dim3 blockSize(16, 16, 1);
     dim3 gridSize(((uint32_t)nWidth + blockSize.x - 1) / blockSize.x, ((uint32_t)nHeight + blockSize.y - 1) / blockSize.y, 1);
-    ConvertUInt8ToUInt16Kernel <<< gridSize, blockSize >>>(dpUInt8, dpUInt16, nSrcPitch, nDestPitch, nWidth, nHeight);
+    ConvertUInt8ToUInt16Kernel <<< gridSize, blockSize, 0, stream >>>(dpUInt8, dpUInt16, nSrcPitch, nDestPitch, nWidth, nHeight);
 }
 
-void ConvertUInt16ToUInt8(uint16_t *dpUInt16, uint8_t *dpUInt8, int nSrcPitch, int nDestPitch, int nWidth, int nHeight)
+void ConvertUInt16ToUInt8(uint16_t *dpUInt16, uint8_t *dpUInt8, int nSrcPitch, int nDestPitch, int nWidth, int nHeight, cudaStream_t stream)
 {
     dim3 blockSize(16, 16, 1);
     dim3 gridSize(((uint32_t)nWidth + blockSize.x - 1) / blockSize.x, ((uint32_t)nHeight + blockSize.y - 1) / blockSize.y, 1);
-    ConvertUInt16ToUInt8Kernel <<<gridSize, blockSize >>>(dpUInt16, dpUInt8, nSrcPitch, nDestPitch, nWidth, nHeight);
+    ConvertUInt16ToUInt8Kernel <<<gridSize, blockSize, 0, stream >>>(dpUInt16, dpUInt8, nSrcPitch, nDestPitch, nWidth, nHeight);
+}
+
+// Vector types that load four consecutive samples, or two, of a layout in one access
+template<YUV420_LAYOUT eLayout> struct BitDepthVec {
+    typedef ushort4 V4;
+    typedef ushort2 V2;
+};
+template<> struct BitDepthVec<YUV420_LAYOUT_NV12> {
+    typedef uchar4 V4;
+    typedef uchar2 V2;
+};
+
+template<YUV420_LAYOUT eLayout>
+static __device__ void LoadSamples4(const uint8_t *pRow, int i, uint32_t *a) {
+    typename BitDepthVec<eLayout>::V4 v = *(const typename BitDepthVec<eLayout>::V4 *)(pRow + i * GetYuv420SampleSize(eLayout));
+    a[0] = v.x; a[1] = v.y; a[2] = v.z; a[3] = v.w;
+}
+
+template<YUV420_LAYOUT eLayout>
+static __device__ void StoreSamples4(uint8_t *pRow, int i, const uint32_t *a) {
+    typename BitDepthVec<eLayout>::V4 v;
+    v.x = a[0]; v.y = a[1]; v.z = a[2]; v.w = a[3];
+    *(typename BitDepthVec<eLayout>::V4 *)(pRow + i * GetYuv420SampleSize(eLayout)) = v;
+}
+
+template<YUV420_LAYOUT eLayout>
+static __device__ void LoadSamples2(const uint8_t *pRow, int i, uint32_t *a) {
+    typename BitDepthVec<eLayout>::V2 v = *(const typename BitDepthVec<eLayout>::V2 *)(pRow + i * GetYuv420SampleSize(eLayout));
+    a[0] = v.x; a[1] = v.y;
+}
+
+template<YUV420_LAYOUT eLayout>
+static __device__ void StoreSamples2(uint8_t *pRow, int i, const uint32_t *a) {
+    typename BitDepthVec<eLayout>::V2 v;
+    v.x = a[0]; v.y = a[1];
+    *(typename BitDepthVec<eLayout>::V2 *)(pRow + i * GetYuv420SampleSize(eLayout)) = v;
+}
+
+// Chroma pairs cx and cx + 1 as U0 V0 U1 V1
+template<YUV420_LAYOUT eLayout>
+static __device__ void LoadChroma4(const Yuv420Surface &s, int cx, int cy, uint32_t *a) {
+    if (GetYuv420ChromaStep(eLayout) == 2) {
+        LoadSamples4<eLayout>(s.pU + (size_t)cy * s.nUvPitch, 2 * cx, a);
+        return;
+    }
+    uint32_t aU[2], aV[2];
+    LoadSamples2<eLayout>(s.pU + (size_t)cy * s.nUvPitch, cx, aU);
+    LoadSamples2<eLayout>(s.pV + (size_t)cy * s.nUvPitch, cx, aV);
+    a[0] = aU[0]; a[1] = aV[0]; a[2] = aU[1]; a[3] = aV[1];
+}
+
+template<YUV420_LAYOUT eLayout>
+static __device__ void StoreChroma4(const Yuv420Surface &s, int cx, int cy, const uint32_t *a) {
+    if (GetYuv420ChromaStep(eLayout) == 2) {
+        StoreSamples4<eLayout>(s.pU + (size_t)cy * s.nUvPitch, 2 * cx, a);
+        return;
+    }
+    uint32_t aU[2] = {a[0], a[2]}, aV[2] = {a[1], a[3]};
+    StoreSamples2<eLayout>(s.pU + (size_t)cy * s.nUvPitch, cx, aU);
+    StoreSamples2<eLayout>(s.pV + (size_t)cy * s.nUvPitch, cx, aV);
+}
+
+// Each thread converts a 4x2 luma block and its two chroma pairs. With bVector the planes are 8-byte aligned, so
+// interior blocks move their samples with vector loads and stores; blocks on the right and bottom edges go sample by sample.
+template<YUV420_LAYOUT eSrc, YUV420_LAYOUT eDst, bool bVector>
+static __global__ void ConvertYuv420BitDepthKernel(Yuv420Surface src, Yuv420Surface dst, int nWidth, int nHeight, BITDEPTH_DITHER eDither) {
+    int x0 = (blockIdx.x * blockDim.x + threadIdx.x) * 4, y0 = (blockIdx.y * blockDim.y + threadIdx.y) * 2;
+    if (x0 >= nWidth || y0 >= nHeight) {
+        return;
+    }
+    if (!bVector || x0 + 4 > nWidth || y0 + 2 > nHeight) {
+        ConvertBitDepthBlock<eSrc, eDst>(src, dst, nWidth, nHeight, x0, y0, eDither);
+        return;
+    }
+
+    uint32_t a[4];
+    for (int y = y0; y < y0 + 2; y++) {
+        LoadSamples4<eSrc>(src.pY + (size_t)y * src.nYPitch, x0, a);
+        for (int i = 0; i < 4; i++) {
+            a[i] = ConvertSampleBitDepth<eSrc, eDst>(a[i], x0 + i, y, eDither);
+        }
+        StoreSamples4<eDst>(dst.pY + (size_t)y * dst.nYPitch, x0, a);
+    }
+
+    int cx = x0 / 2, cy = y0 / 2;
+    LoadChroma4<eSrc>(src, cx, cy, a);
+    for (int i = 0; i < 4; i++) {
+        a[i] = ConvertSampleBitDepth<eSrc, eDst>(a[i], cx + i / 2, cy, eDither);
+    }
+    StoreChroma4<eDst>(dst, cx, cy, a);
+}
+
+static bool IsVectorAligned(const Yuv420Surface &s) {
+    uintptr_t n = (uintptr_t)s.pY | (uintptr_t)s.pU | (uintptr_t)s.nYPitch | (uintptr_t)s.nUvPitch;
+    if (s.eLayout == YUV420_LAYOUT_I010) {
+        n |= (uintptr_t)s.pV;
+    }
+    return n % 8 == 0;
+}
+
+template<YUV420_LAYOUT eSrc, YUV420_LAYOUT eDst>
+static void LaunchConvertYuv420BitDepth(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight, BITDEPTH_DITHER eDither,
+    cudaStream_t stream) {
+    dim3 block(32, 8);
+    dim3 grid(((nWidth + 3) / 4 + block.x - 1) / block.x, ((nHeight + 1) / 2 + block.y - 1) / block.y);
+    if (IsVectorAligned(src) && IsVectorAligned(dst)) {
+        ConvertYuv420BitDepthKernel<eSrc, eDst, true> <<<grid, block, 0, stream>>>(src, dst, nWidth, nHeight, eDither);
+    } else {
+        ConvertYuv420BitDepthKernel<eSrc, eDst, false> <<<grid, block, 0, stream>>>(src, dst, nWidth, nHeight, eDither);
+    }
+}
+
+void ConvertYuv420BitDepth(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight, BITDEPTH_DITHER eDither,
+    cudaStream_t stream) {
+    if (nWidth <= 0 || nHeight <= 0) {
+        LOG(ERROR) << "ConvertYuv420BitDepth: invalid size " << nWidth << "x" << nHeight;
+        return;
+    }
+
+#define BITDEPTH_CASE(S, D) \
+    if (src.eLayout == S && dst.eLayout == D) { \
+        LaunchConvertYuv420BitDepth<S, D>(src, dst, nWidth, nHeight, eDither, stream); \
+    }
+    BITDEPTH_CASE(YUV420_LAYOUT_NV12, YUV420_LAYOUT_NV12)
+    BITDEPTH_CASE(YUV420_LAYOUT_NV12, YUV420_LAYOUT_P010)
+    BITDEPTH_CASE(YUV420_LAYOUT_NV12, YUV420_LAYOUT_I010)
+    BITDEPTH_CASE(YUV420_LAYOUT_P010, YUV420_LAYOUT_NV12)
+    BITDEPTH_CASE(YUV420_LAYOUT_P010, YUV420_LAYOUT_P010)
+    BITDEPTH_CASE(YUV420_LAYOUT_P010, YUV420_LAYOUT_I010)
+    BITDEPTH_CASE(YUV420_LAYOUT_I010, YUV420_LAYOUT_NV12)
+    BITDEPTH_CASE(YUV420_LAYOUT_I010, YUV420_LAYOUT_P010)
+    BITDEPTH_CASE(YUV420_LAYOUT_I010, YUV420_LAYOUT_I010)
+#undef BITDEPTH_CASE
+    ck(cudaGetLastError());
 }
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include "NvCodecUtils.h"
+#include "BitDepthMath.h"
+
+//---------------------------------------------------------------------------
+//! \file BitDepth.h
+//! \brief GPU 4:2:0 bit depth and layout conversion in BitDepth.cu.
+//---------------------------------------------------------------------------
+
+/**
+* @brief Converts a 4:2:0 frame between NV12, P010 (NVENC's YUV420_10BIT) and I010, e.g. I010 sources for a 10-bit encode
+* or dithered NV12 for SDR renditions. Each thread handles four pixels of two rows; with 8-byte aligned planes and pitches
+* they are moved with vector loads. ConvertYuv420BitDepthHost() is the CPU reference.
+*   @param  eDither  Rounding of 8-bit output; 10-bit output is always rounded to nearest
+*/
+void ConvertYuv420BitDepth(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight,
+    BITDEPTH_DITHER eDither = BITDEPTH_DITHER_ORDERED, CUstream_st *stream = nullptr);
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ColorSpaceMath.h"
+
+//---------------------------------------------------------------------------
+//! \file BitDepthMath.h
+//! \brief Per-sample math of the 4:2:0 bit depth and layout conversions in BitDepth.cu.
+//!
+//! Samples pass through a 16-bit MSB-aligned intermediate: 8-bit values are shifted up
+//! exactly, 10-bit outputs are rounded and 8-bit outputs are rounded or ordered-dithered
+//! with a 4x4 Bayer matrix. The dither depends only on the sample position, so the GPU
+//! and ConvertYuv420BitDepthHost() give identical results.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    YUV420_LAYOUT_NV12 = 0,                 /*!< 8-bit, interleaved chroma */
+    YUV420_LAYOUT_P010,                     /*!< 16-bit MSB-aligned, interleaved chroma; reads P016 too, writes 10 bits */
+    YUV420_LAYOUT_I010,                     /*!< 16-bit holding 10-bit values in the low bits, planar chroma */
+} YUV420_LAYOUT;
+
+typedef enum {
+    BITDEPTH_DITHER_NONE = 0,               /*!< Round to nearest */
+    BITDEPTH_DITHER_ORDERED,                /*!< 4x4 Bayer; only affects 8-bit output */
+} BITDEPTH_DITHER;
+
+/**
+* @brief Planes of one 4:2:0 frame. For interleaved layouts pV is pU plus one sample; pitches are in bytes.
+*/
+struct Yuv420Surface {
+    uint8_t *pY, *pU, *pV;
+    int nYPitch, nUvPitch;
+    YUV420_LAYOUT eLayout;
+};
+
+/**
+* @brief Describes a contiguous frame. I010 chroma planes have half the luma pitch, as YuvConverter lays them out.
+*/
+inline Yuv420Surface MakeYuv420Surface(YUV420_LAYOUT eLayout, uint8_t *pFrame, int nPitch, int nHeight) {
+    Yuv420Surface s;
+    s.eLayout = eLayout;
+    s.pY = pFrame;
+    s.nYPitch = nPitch;
+    s.pU = pFrame + (size_t)nPitch * nHeight;
+    if (eLayout == YUV420_LAYOUT_I010) {
+        s.nUvPitch = (nPitch / 2 + 1) / 2 * 2;
+        s.pV = s.pU + (size_t)s.nUvPitch * ((nHeight + 1) / 2);
+    } else {
+        s.nUvPitch = nPitch;
+        s.pV = s.pU + (eLayout == YUV420_LAYOUT_NV12 ? 1 : 2);
+    }
+    return s;
+}
+
+inline COLORSPACE_HD int GetYuv420SampleSize(YUV420_LAYOUT eLayout) {
+    return eLayout == YUV420_LAYOUT_NV12 ? 1 : 2;
+}
+
+inline COLORSPACE_HD int GetYuv420ChromaStep(YUV420_LAYOUT eLayout) {
+    return eLayout == YUV420_LAYOUT_I010 ? 1 : 2;
+}
+
+/**
+* @brief Centred 4x4 Bayer threshold in units of 1/256 of an 8-bit step.
+*/
+inline COLORSPACE_HD uint32_t GetBayerThreshold(int x, int y) {
+    // Bit-reversed interleave of (x ^ y, y) gives {0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}
+    uint32_t a = (uint32_t)(x ^ y), b = (uint32_t)y;
+    uint32_t nBayer = (a & 1) << 3 | (b & 1) << 2 | (a & 2) | (b >> 1 & 1);
+    return nBayer * 16 + 8;
+}
+
+template<YUV420_LAYOUT eSrc>
+inline COLORSPACE_HD uint32_t ToSample16(uint32_t v) {
+    return eSrc == YUV420_LAYOUT_NV12 ? v << 8 : (eSrc == YUV420_LAYOUT_I010 ? (v & 0x3FF) << 6 : v);
+}
+
+template<YUV420_LAYOUT eDst>
+inline COLORSPACE_HD uint32_t FromSample16(uint32_t v16, int x, int y, BITDEPTH_DITHER eDither) {
+    if (eDst == YUV420_LAYOUT_NV12) {
+        uint32_t v = (v16 + (eDither == BITDEPTH_DITHER_ORDERED ? GetBayerThreshold(x, y) : 128)) >> 8;
+        return v > 255 ? 255 : v;
+    }
+    uint32_t v = (v16 + 32) >> 6;
+    v = v > 1023 ? 1023 : v;
+    return eDst == YUV420_LAYOUT_P010 ? v << 6 : v;
+}
+
+/**
+* @brief Converts one sample; (x, y) is its position within its plane and only matters for dithering.
+*/
+template<YUV420_LAYOUT eSrc, YUV420_LAYOUT eDst>
+inline COLORSPACE_HD uint32_t ConvertSampleBitDepth(uint32_t v, int x, int y, BITDEPTH_DITHER eDither) {
+    return FromSample16<eDst>(ToSample16<eSrc>(v), x, y, eDither);
+}
+
+template<YUV420_LAYOUT eLayout>
+inline COLORSPACE_HD uint32_t LoadYuv420Sample(const uint8_t *pRow, int i) {
+    return eLayout == YUV420_LAYOUT_NV12 ? pRow[i] : ((const uint16_t *)pRow)[i];
+}
+
+template<YUV420_LAYOUT eLayout>
+inline COLORSPACE_HD void StoreYuv420Sample(uint8_t *pRow, int i, uint32_t v) {
+    if (eLayout == YUV420_LAYOUT_NV12) {
+        pRow[i] = (uint8_t)v;
+    } else {
+        ((uint16_t *)pRow)[i] = (uint16_t)v;
+    }
+}
+
+/**
+* @brief Converts the luma samples (x0..x0 + 3, y0..y0 + 1) and their two chroma pairs; x0 is a multiple of 4 and y0 is even.
+* Samples outside nWidth x nHeight are skipped.
+*/
+template<YUV420_LAYOUT eSrc, YUV420_LAYOUT eDst>
+inline COLORSPACE_HD void ConvertBitDepthBlock(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight, int x0, int y0,
+    BITDEPTH_DITHER eDither) {
+    for (int y = y0; y < y0 + 2 && y < nHeight; y++) {
+        const uint8_t *pSrc = src.pY + (size_t)y * src.nYPitch;
+        uint8_t *pDst = dst.pY + (size_t)y * dst.nYPitch;
+        for (int x = x0; x < x0 + 4 && x < nWidth; x++) {
+            StoreYuv420Sample<eDst>(pDst, x, ConvertSampleBitDepth<eSrc, eDst>(LoadYuv420Sample<eSrc>(pSrc, x), x, y, eDither));
+        }
+    }
+
+    int cy = y0 / 2, nChromaWidth = (nWidth + 1) / 2;
+    const int nSrcStep = GetYuv420ChromaStep(eSrc), nDstStep = GetYuv420ChromaStep(eDst);
+    const uint8_t *apSrc[2] = {src.pU + (size_t)cy * src.nUvPitch, src.pV + (size_t)cy * src.nUvPitch};
+    uint8_t *apDst[2] = {dst.pU + (size_t)cy * dst.nUvPitch, dst.pV + (size_t)cy * dst.nUvPitch};
+    for (int cx = x0 / 2; cx < x0 / 2 + 2 && cx < nChromaWidth; cx++) {
+        for (int c = 0; c < 2; c++) {
+            uint32_t v = LoadYuv420Sample<eSrc>(apSrc[c], cx * nSrcStep);
+            StoreYuv420Sample<eDst>(apDst[c], cx * nDstStep, ConvertSampleBitDepth<eSrc, eDst>(v, cx, cy, eDither));
+        }
+    }
+}
+
+template<YUV420_LAYOUT eSrc, YUV420_LAYOUT eDst>
+inline void ConvertYuv420BitDepthHost(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight, BITDEPTH_DITHER eDither) {
+    for (int y = 0; y < nHeight; y += 2) {
+        for (int x = 0; x < nWidth; x += 4) {
+            ConvertBitDepthBlock<eSrc, eDst>(src, dst, nWidth, nHeight, x, y, eDither);
+        }
+    }
+}
+
+template<YUV420_LAYOUT eSrc>
+inline void ConvertYuv420BitDepthHost(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight, BITDEPTH_DITHER eDither) {
+    switch (dst.eLayout) {
+    case YUV420_LAYOUT_NV12:
+        ConvertYuv420BitDepthHost<eSrc, YUV420_LAYOUT_NV12>(src, dst, nWidth, nHeight, eDither);
+        break;
+    case YUV420_LAYOUT_P010:
+        ConvertYuv420BitDepthHost<eSrc, YUV420_LAYOUT_P010>(src, dst, nWidth, nHeight, eDither);
+        break;
+    case YUV420_LAYOUT_I010:
+        ConvertYuv420BitDepthHost<eSrc, YUV420_LAYOUT_I010>(src, dst, nWidth, nHeight, eDither);
+        break;
+    }
+}
+
+/**
+* @brief CPU reference for ConvertYuv420BitDepth(); the planes are host memory here.
+*/
+inline void ConvertYuv420BitDepthHost(const Yuv420Surface &src, const Yuv420Surface &dst, int nWidth, int nHeight,
+    BITDEPTH_DITHER eDither = BITDEPTH_DITHER_ORDERED) {
+    switch (src.eLayout) {
+    case YUV420_LAYOUT_NV12:
+        ConvertYuv420BitDepthHost<YUV420_LAYOUT_NV12>(src, dst, nWidth, nHeight, eDither);
+        break;
+    case YUV420_LAYOUT_P010:
+        ConvertYuv420BitDepthHost<YUV420_LAYOUT_P010>(src, dst, nWidth, nHeight, eDither);
+        break;
+    case YUV420_LAYOUT_I010:
+        ConvertYuv420BitDepthHost<YUV420_LAYOUT_I010>(src, dst, nWidth, nHeight, eDither);
+        break;
+    }
+}
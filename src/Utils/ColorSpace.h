@@ -28,19 +28,7 @@
 #pragma once
 #include <stdint.h>
 #include <cuda_runtime.h>
-
-typedef enum ColorSpaceStandard {
-    ColorSpaceStandard_BT709 = 1,
-    ColorSpaceStandard_Unspecified = 2,
-    ColorSpaceStandard_Reserved = 3,
-    ColorSpaceStandard_FCC = 4,
-    ColorSpaceStandard_BT470 = 5,
-    ColorSpaceStandard_BT601 = 6,
-    ColorSpaceStandard_SMPTE240M = 7,
-    ColorSpaceStandard_YCgCo = 8,
-    ColorSpaceStandard_BT2020 = 9,
-    ColorSpaceStandard_BT2020C = 10
-} ColorSpaceStandard;
+#include "ColorSpaceMath.h"
 
 typedef struct uchar6_
 {
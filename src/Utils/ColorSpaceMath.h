@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+//! \file ColorSpaceMath.h
+//! \brief RGB to YUV pixel math shared by the CUDA kernels in ColorSpace.cu and the host code.
+//!
+//! Everything here is plain C++ with __host__ __device__ qualifiers under nvcc, so the
+//! CPU reference converters at the end produce the same values as the GPU path and can
+//! be used to check it on machines without a GPU. Results may differ by one code value
+//! where nvcc contracts the multiply-adds.
+//---------------------------------------------------------------------------
+
+#if defined(__CUDACC__)
+#define COLORSPACE_HD __host__ __device__
+#else
+#define COLORSPACE_HD
+#endif
+
+typedef enum ColorSpaceStandard {
+    ColorSpaceStandard_BT709 = 1,
+    ColorSpaceStandard_Unspecified = 2,
+    ColorSpaceStandard_Reserved = 3,
+    ColorSpaceStandard_FCC = 4,
+    ColorSpaceStandard_BT470 = 5,
+    ColorSpaceStandard_BT601 = 6,
+    ColorSpaceStandard_SMPTE240M = 7,
+    ColorSpaceStandard_YCgCo = 8,
+    ColorSpaceStandard_BT2020 = 9,
+    ColorSpaceStandard_BT2020C = 10
+} ColorSpaceStandard;
+
+/**
+* @brief Luma weights Kr and Kb of a matrix standard; anything unknown is treated as BT.709.
+*/
+inline COLORSPACE_HD void GetLumaWeights(int iMatrix, float &wr, float &wb) {
+    switch (iMatrix) {
+    case ColorSpaceStandard_BT709:
+    default:
+        wr = 0.2126f; wb = 0.0722f;
+        break;
+
+    case ColorSpaceStandard_FCC:
+        wr = 0.30f; wb = 0.11f;
+        break;
+
+    case ColorSpaceStandard_BT470:
+    case ColorSpaceStandard_BT601:
+        wr = 0.2990f; wb = 0.1140f;
+        break;
+
+    case ColorSpaceStandard_SMPTE240M:
+        wr = 0.212f; wb = 0.087f;
+        break;
+
+    case ColorSpaceStandard_BT2020:
+    case ColorSpaceStandard_BT2020C:
+        wr = 0.2627f; wb = 0.0593f;
+        break;
+    }
+}
+
+/**
+* @brief Rows Y, U, V applied to R, G, B, plus the offsets added afterwards. Small enough to pass to a kernel by value.
+*/
+struct RgbToYuvMatrix {
+    float m[3][3];
+    float fOffsetY;
+    float fOffsetC;
+};
+
+/**
+*   @param  nBytesPerSample  1 for 8-bit samples, 2 for 16-bit
+*/
+inline COLORSPACE_HD RgbToYuvMatrix MakeRgbToYuvMatrix(int iMatrix, bool bFullRange, int nBytesPerSample = 1) {
+    float wr, wb;
+    GetLumaWeights(iMatrix, wr, wb);
+    float yscale = bFullRange ? 1.0f : 219.0f / 255.0f;
+    float cscale = bFullRange ? 1.0f : 224.0f / 255.0f;
+    float fOffsetY = bFullRange ? 0.0f : (float)(1 << (nBytesPerSample * 8 - 4));
+    float fOffsetC = (float)(1 << (nBytesPerSample * 8 - 1));
+
+    RgbToYuvMatrix mat = {{
+        {wr, 1.0f - wb - wr, wb},
+        {-0.5f * wr / (1.0f - wb), -0.5f * (1 - wb - wr) / (1.0f - wb), 0.5f},
+        {0.5f, -0.5f * (1.0f - wb - wr) / (1.0f - wr), -0.5f * wb / (1.0f - wr)},
+    }, fOffsetY, fOffsetC};
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            mat.m[i][j] *= i == 0 ? yscale : cscale;
+        }
+    }
+    return mat;
+}
+
+/**
+* @brief Columns Y, U, V applied after subtracting the offsets; the result is in the sample range of the input.
+*/
+struct YuvToRgbMatrix {
+    float m[3][3];
+    float fOffsetY;
+    float fOffsetC;
+};
+
+inline COLORSPACE_HD YuvToRgbMatrix MakeYuvToRgbMatrix(int iMatrix, bool bFullRange, int nBytesPerSample = 1) {
+    float wr, wb;
+    GetLumaWeights(iMatrix, wr, wb);
+    float yscale = bFullRange ? 1.0f : 255.0f / 219.0f;
+    float cscale = bFullRange ? 1.0f : 255.0f / 224.0f;
+    float fOffsetY = bFullRange ? 0.0f : (float)(1 << (nBytesPerSample * 8 - 4));
+    float fOffsetC = (float)(1 << (nBytesPerSample * 8 - 1));
+
+    YuvToRgbMatrix mat = {{
+        {1.0f, 0.0f, (1.0f - wr) / 0.5f},
+        {1.0f, -wb * (1.0f - wb) / 0.5f / (1 - wb - wr), -wr * (1 - wr) / 0.5f / (1 - wb - wr)},
+        {1.0f, (1.0f - wb) / 0.5f, 0.0f},
+    }, fOffsetY, fOffsetC};
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            mat.m[i][j] *= j == 0 ? yscale : cscale;
+        }
+    }
+    return mat;
+}
+
+inline COLORSPACE_HD uint8_t ClampToUint8(float f) {
+    f += 0.5f;
+    return f <= 0.0f ? 0 : (f >= 255.0f ? 255 : (uint8_t)f);
+}
+
+inline COLORSPACE_HD uint8_t RgbToY8(const RgbToYuvMatrix &mat, float r, float g, float b) {
+    return ClampToUint8(mat.m[0][0] * r + mat.m[0][1] * g + mat.m[0][2] * b + mat.fOffsetY);
+}
+
+inline COLORSPACE_HD uint8_t RgbToU8(const RgbToYuvMatrix &mat, float r, float g, float b) {
+    return ClampToUint8(mat.m[1][0] * r + mat.m[1][1] * g + mat.m[1][2] * b + mat.fOffsetC);
+}
+
+inline COLORSPACE_HD uint8_t RgbToV8(const RgbToYuvMatrix &mat, float r, float g, float b) {
+    return ClampToUint8(mat.m[2][0] * r + mat.m[2][1] * g + mat.m[2][2] * b + mat.fOffsetC);
+}
+
+/**
+* @brief Loads one packed 8-bit pixel as a little-endian word; a single 32-bit load on the device.
+*/
+inline COLORSPACE_HD uint32_t LoadRgb32(const uint8_t *p) {
+#if defined(__CUDA_ARCH__)
+    return *(const uint32_t *)p;
+#else
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+#endif
+}
+
+/**
+* @brief Converts the 2x2 block at (x, y) (both even) of packed 8-bit RGB to NV12. On odd sizes the last column or row is
+* replicated into the chroma average, and the chroma pitch must hold the width rounded up to even. iR and iB are the byte
+* positions of red and blue within a pixel.
+*/
+template<int iR, int iB>
+inline COLORSPACE_HD void Rgb32BlockToNv12(const RgbToYuvMatrix &mat, const uint8_t *pRgb, int nRgbPitch, uint8_t *pY, int nYPitch,
+    uint8_t *pUv, int nUvPitch, int nWidth, int nHeight, int x, int y) {
+    int x1 = x + 1 < nWidth ? x + 1 : x;
+    int y1 = y + 1 < nHeight ? y + 1 : y;
+    const int ax[4] = {x, x1, x, x1};
+    const int ay[4] = {y, y, y1, y1};
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        uint32_t v = LoadRgb32(pRgb + ay[i] * nRgbPitch + ax[i] * 4);
+        float pr = (v >> (8 * iR)) & 0xFF, pg = (v >> 8) & 0xFF, pb = (v >> (8 * iB)) & 0xFF;
+        r += pr;
+        g += pg;
+        b += pb;
+        pY[ay[i] * nYPitch + ax[i]] = RgbToY8(mat, pr, pg, pb);
+    }
+    r *= 0.25f;
+    g *= 0.25f;
+    b *= 0.25f;
+    uint8_t *pDst = pUv + (y / 2) * nUvPitch + x;
+    pDst[0] = RgbToU8(mat, r, g, b);
+    pDst[1] = RgbToV8(mat, r, g, b);
+}
+
+template<int iR, int iB>
+inline COLORSPACE_HD void Rgb32PixelToYuv444(const RgbToYuvMatrix &mat, const uint8_t *pRgb, int nRgbPitch, uint8_t *pYuv, int nYuvPitch,
+    int nHeight, int x, int y) {
+    uint32_t v = LoadRgb32(pRgb + y * nRgbPitch + x * 4);
+    float r = (v >> (8 * iR)) & 0xFF, g = (v >> 8) & 0xFF, b = (v >> (8 * iB)) & 0xFF;
+    uint8_t *pDst = pYuv + y * nYuvPitch + x;
+    size_t nPlane = (size_t)nYuvPitch * nHeight;
+    pDst[0] = RgbToY8(mat, r, g, b);
+    pDst[nPlane] = RgbToU8(mat, r, g, b);
+    pDst[2 * nPlane] = RgbToV8(mat, r, g, b);
+}
+
+/**
+* @brief CPU reference for Color32ToNv12(); chroma follows the luma plane at nNv12Pitch * nHeight.
+*   @param  bRgba   true for R,G,B,A byte order, false for B,G,R,A
+*/
+inline void Rgb32ToNv12Host(const uint8_t *pRgb, int nRgbPitch, bool bRgba, uint8_t *pNv12, int nNv12Pitch, int nWidth, int nHeight,
+    int iMatrix, bool bFullRange) {
+    RgbToYuvMatrix mat = MakeRgbToYuvMatrix(iMatrix, bFullRange);
+    uint8_t *pUv = pNv12 + (size_t)nNv12Pitch * nHeight;
+    for (int y = 0; y < nHeight; y += 2) {
+        for (int x = 0; x < nWidth; x += 2) {
+            if (bRgba) {
+                Rgb32BlockToNv12<0, 2>(mat, pRgb, nRgbPitch, pNv12, nNv12Pitch, pUv, nNv12Pitch, nWidth, nHeight, x, y);
+            } else {
+                Rgb32BlockToNv12<2, 0>(mat, pRgb, nRgbPitch, pNv12, nNv12Pitch, pUv, nNv12Pitch, nWidth, nHeight, x, y);
+            }
+        }
+    }
+}
+
+/**
+* @brief CPU reference for Color32ToYuv444(); planes Y, U, V follow each other every nYuvPitch * nHeight bytes.
+*/
+inline void Rgb32ToYuv444Host(const uint8_t *pRgb, int nRgbPitch, bool bRgba, uint8_t *pYuv, int nYuvPitch, int nWidth, int nHeight,
+    int iMatrix, bool bFullRange) {
+    RgbToYuvMatrix mat = MakeRgbToYuvMatrix(iMatrix, bFullRange);
+    for (int y = 0; y < nHeight; y++) {
+        for (int x = 0; x < nWidth; x++) {
+            if (bRgba) {
+                Rgb32PixelToYuv444<0, 2>(mat, pRgb, nRgbPitch, pYuv, nYuvPitch, nHeight, x, y);
+            } else {
+                Rgb32PixelToYuv444<2, 0>(mat, pRgb, nRgbPitch, pYuv, nYuvPitch, nHeight, x, y);
+            }
+        }
+    }
+}
@@ -30,12 +30,12 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavformat/avio.h>
 #include <libavcodec/avcodec.h>
-/* Explicitly include bsf.h when building against FFmpeg 4.3 (libavcodec 58.45.100) or later for backward compatibility */
-#if LIBAVCODEC_VERSION_INT >= 3824484
-#include <libavcodec/bsf.h>
-#endif
 }
+#include <algorithm>
+#include <fstream>
+#include <memory>
 #include "NvCodecUtils.h"
+#include "AnnexBConverter.h"
 
 //---------------------------------------------------------------------------
 //! \file FFmpegDemuxer.h 
@@ -52,8 +52,7 @@ private:
     AVFormatContext *fmtc = NULL;
     AVIOContext *avioc = NULL;
     AVPacket* pkt = NULL; /*!< AVPacket stores compressed data typically exported by demuxers and then passed as input to decoders */
-    AVPacket* pktFiltered = NULL;
-    AVBSFContext *bsfc = NULL;
+    AnnexBConverter annexBConverter; /*!< Rewrites length-prefixed H.264/HEVC samples to Annex-B */
 
     int iVideoStream;
     bool bMp4H264, bMp4HEVC, bMp4MPEG4;
@@ -65,6 +64,54 @@ private:
 
     uint8_t *pDataWithHeader = NULL;
 
+    /**
+    * @brief Read position of the custom AVIO context that serves a MappedFileReader
+    */
+    struct MappedInput {
+        const MappedFileReader *pFile;
+        const uint8_t *pBuf;
+        uint64_t nSize;
+        uint64_t nPos;
+        uint64_t nPrefetchBegin, nPrefetchEnd; /*!< Range last handed to MappedFileReader::WillNeed() */
+    };
+    MappedInput *pMappedInput = NULL;
+    static const int nMappedReadAhead = 8 * 1024 * 1024;
+
+public:
+    /**
+    * @brief One entry of the keyframe index. Timestamps are in video stream time base units.
+    */
+    struct KeyFrameIndexEntry {
+        int64_t pts;
+        int64_t dts;
+        int64_t pos; /*!< Byte offset of the packet in the container, -1 if unknown */
+    };
+
+private:
+    /**
+    * @brief Header of a keyframe index sidecar file, followed by nEntries KeyFrameIndexEntry records
+    * in native byte order sorted by pts. The source fields identify the file the index was built from.
+    */
+    struct KeyFrameIndexHeader {
+        char szMagic[4];
+        uint32_t nVersion;
+        int32_t nTimeBaseNum, nTimeBaseDen;
+        uint64_t nEntries;
+        int64_t nSourceSize;    /*!< Input size in bytes, -1 if the input cannot tell */
+        int64_t nSourceMtime;   /*!< Modification time of the input file, 0 unless opened by path */
+        uint64_t nSourceHash;   /*!< Hash of the container header as parsed: streams, duration and video extradata */
+    };
+    static const uint32_t nKeyFrameIndexVersion = 2;
+
+    std::vector<KeyFrameIndexEntry> vKeyFrameIndex;     /*!< Collected while demuxing from the start, sorted by pts once complete */
+    bool bKeyFrameIndexComplete = false;                /*!< Set when a pass reached EOF without seeking */
+    bool bCollectKeyFrames = true;
+    std::unique_ptr<MappedFileReader> pKeyFrameIndexFile;
+    const KeyFrameIndexEntry *pLoadedIndex = NULL;      /*!< Points into pKeyFrameIndexFile */
+    uint64_t nLoadedIndexEntries = 0;
+    int64_t nSeekTarget = AV_NOPTS_VALUE;
+    int64_t nSourceMtime = 0;
+
     unsigned int frameCount = 0;
 
 public:
@@ -87,8 +134,7 @@ private:
 
         // Allocate the AVPackets and initialize to default values
         pkt = av_packet_alloc();
-        pktFiltered = av_packet_alloc();
-        if (!pkt || !pktFiltered) {
+        if (!pkt) {
             LOG(ERROR) << "AVPacket allocation failed";
             return;
         }
@@ -100,7 +146,6 @@ private:
         if (iVideoStream < 0) {
             LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "Could not find stream in input file";
             av_packet_free(&pkt);
-            av_packet_free(&pktFiltered);
             return;
         }
 
@@ -191,30 +236,14 @@ private:
                 || !strcmp(fmtc->iformat->long_name, "Matroska / WebM")
             );
 
-        // Initialize bitstream filter and its required resources
-        if (bMp4H264) {
-            const AVBitStreamFilter *bsf = av_bsf_get_by_name("h264_mp4toannexb");
-            if (!bsf) {
-                LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "av_bsf_get_by_name() failed";
-                av_packet_free(&pkt);
-                av_packet_free(&pktFiltered);
-                return;
-            }
-            ck(av_bsf_alloc(bsf, &bsfc));
-            avcodec_parameters_copy(bsfc->par_in, fmtc->streams[iVideoStream]->codecpar);
-            ck(av_bsf_init(bsfc));
-        }
-        if (bMp4HEVC) {
-            const AVBitStreamFilter *bsf = av_bsf_get_by_name("hevc_mp4toannexb");
-            if (!bsf) {
-                LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "av_bsf_get_by_name() failed";
+        // Length-prefixed samples are converted natively instead of through the *_mp4toannexb bitstream filters
+        if (bMp4H264 || bMp4HEVC) {
+            AVCodecParameters *par = fmtc->streams[iVideoStream]->codecpar;
+            if (!annexBConverter.Init(par->extradata, par->extradata_size, bMp4HEVC ? NAL_CODEC_HEVC : NAL_CODEC_H264)) {
+                LOG(ERROR) << "Unable to parse " << (bMp4HEVC ? "hvcC" : "avcC") << " extradata";
                 av_packet_free(&pkt);
-                av_packet_free(&pktFiltered);
                 return;
             }
-            ck(av_bsf_alloc(bsf, &bsfc));
-            avcodec_parameters_copy(bsfc->par_in, fmtc->streams[iVideoStream]->codecpar);
-            ck(av_bsf_init(bsfc));
         }
     }
 
@@ -245,6 +274,52 @@ private:
         return ctx;
     }
 
+    AVFormatContext *CreateFormatContext(const MappedFileReader *pFile) {
+        MappedInput *pInput = new MappedInput();
+        pInput->pFile = pFile;
+        if (!pFile->GetBuffer(&pInput->pBuf, &pInput->nSize)) {
+            LOG(ERROR) << "Input file is not mapped";
+            delete pInput;
+            return NULL;
+        }
+
+        AVFormatContext *ctx = NULL;
+        if (!(ctx = avformat_alloc_context())) {
+            LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
+            delete pInput;
+            return NULL;
+        }
+
+        // Large reads bypass this buffer (direct mode) and copy straight from the mapping into the packet,
+        // so it only has to hold header parsing reads
+        int avioc_buffer_size = 256 * 1024;
+        uint8_t *avioc_buffer = (uint8_t *)av_malloc(avioc_buffer_size);
+        if (!avioc_buffer) {
+            LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
+            delete pInput;
+            return NULL;
+        }
+        AVIOContext *pb = avio_alloc_context(avioc_buffer, avioc_buffer_size,
+            0, pInput, &ReadMapped, NULL, &SeekMapped);
+        if (!pb) {
+            LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
+            av_free(avioc_buffer);
+            delete pInput;
+            return NULL;
+        }
+        pb->direct = 1;
+        ctx->pb = pb;
+
+        if (!ck(avformat_open_input(&ctx, NULL, NULL, NULL))) {
+            // avformat_open_input() frees ctx on failure but leaves the caller's AVIO context alone
+            av_freep(&pb->buffer);
+            av_freep(&pb);
+            delete pInput;
+            return NULL;
+        }
+        return ctx;
+    }
+
     /**
     *   @brief  Allocate and return AVFormatContext*.
     *   @param  szFilePath - Filepath pointing to input stream.
@@ -259,8 +334,24 @@ private:
     }
 
 public:
-    FFmpegDemuxer(const char *szFilePath, int64_t timescale = 1 /*Hz*/) : FFmpegDemuxer(CreateFormatContext(szFilePath), timescale) {}
+    FFmpegDemuxer(const char *szFilePath, int64_t timescale = 1 /*Hz*/) : FFmpegDemuxer(CreateFormatContext(szFilePath), timescale) {
+        struct stat st;
+        if (stat(szFilePath, &st) == 0) {
+            nSourceMtime = (int64_t)st.st_mtime;
+        }
+    }
     FFmpegDemuxer(DataProvider *pDataProvider) : FFmpegDemuxer(CreateFormatContext(pDataProvider)) {avioc = fmtc->pb;}
+    /**
+    *   @brief  Demuxes a memory-mapped file through a seekable AVIO context that reads from the mapping.
+    *   Starts without reading the file up front and works with MP4s whose moov atom is at the end.
+    *   pFile must outlive the demuxer and may be shared by several demuxers.
+    */
+    FFmpegDemuxer(const MappedFileReader *pFile, int64_t timescale = 1 /*Hz*/) : FFmpegDemuxer(CreateFormatContext(pFile), timescale) {
+        if (fmtc) {
+            avioc = fmtc->pb;
+            pMappedInput = (MappedInput *)avioc->opaque;
+        }
+    }
     ~FFmpegDemuxer() {
 
         if (!fmtc) {
@@ -270,13 +361,6 @@ public:
         if (pkt) {
             av_packet_free(&pkt);
         }
-        if (pktFiltered) {
-            av_packet_free(&pktFiltered);
-        }
-
-        if (bsfc) {
-            av_bsf_free(&bsfc);
-        }
 
         avformat_close_input(&fmtc);
 
@@ -288,6 +372,8 @@ public:
         if (pDataWithHeader) {
             av_free(pDataWithHeader);
         }
+
+        delete pMappedInput;
     }
     AVFormatContext* GetAVFormatContext() {
         return fmtc;
@@ -310,6 +396,9 @@ public:
     int GetFrameSize() {
         return nWidth * (nHeight + nChromaHeight) * nBPP;
     }
+    int GetVideoStreamIndex() {
+        return iVideoStream;
+    }
     bool Demux(uint8_t **ppData, int *pnBytes, int64_t *pts = NULL, int64_t* dts = NULL, int *isVideoPacket = NULL, int *streamIndex = NULL) {
         if (!fmtc) {
             return false;
@@ -317,32 +406,48 @@ public:
 
         *pnBytes = 0;
 
-        if (pkt->data) {
-            av_packet_unref(pkt);
-        }
+        const uint8_t *pAnnexB = NULL;
+        size_t nAnnexB = 0;
+        for (;;) {
+            if (pkt->data) {
+                av_packet_unref(pkt);
+            }
 
-        if (av_read_frame(fmtc, pkt) < 0) {
-            if (isVideoPacket)
-                *isVideoPacket = 1;
-            if (streamIndex)
-                *streamIndex = iVideoStream;
-            return false;
+            int e = av_read_frame(fmtc, pkt);
+            if (e < 0) {
+                EndOfInput(e);
+                if (isVideoPacket)
+                    *isVideoPacket = 1;
+                if (streamIndex)
+                    *streamIndex = iVideoStream;
+                return false;
+            }
+
+            if (pkt->stream_index != iVideoStream) {
+                break;
+            }
+            CollectKeyFrame(pkt);
+            if (!bMp4H264 && !bMp4HEVC) {
+                break;
+            }
+            // Demuxed packets are normally unshared, in which case this does not copy
+            ck(av_packet_make_writable(pkt));
+            if (annexBConverter.ToAnnexB(pkt->data, pkt->size, &pAnnexB, &nAnnexB)) {
+                break;
+            }
+            // Length-prefixed data is garbage to NVDEC, so the packet is dropped rather than passed on
+            LOG(ERROR) << "Dropped malformed length-prefixed packet of " << pkt->size << " bytes";
         }
 
         if (pkt->stream_index == iVideoStream)
         {
             if (bMp4H264 || bMp4HEVC) {
-                if (pktFiltered->data) {
-                    av_packet_unref(pktFiltered);
-                }
-                ck(av_bsf_send_packet(bsfc, pkt));
-                ck(av_bsf_receive_packet(bsfc, pktFiltered));
-                *ppData = pktFiltered->data;
-                *pnBytes = pktFiltered->size;
+                *ppData = const_cast<uint8_t *>(pAnnexB);
+                *pnBytes = (int)nAnnexB;
                 if (pts)
-                    *pts = pktFiltered->pts;
+                    *pts = pkt->pts;
                 if (dts)
-                    *dts = pktFiltered->dts;
+                    *dts = pkt->dts;
             }
             else {
 
@@ -402,9 +507,249 @@ public:
         return true;
     }
 
+    /**
+    *   @brief  Reads the next packet of any stream as stored in the container, for stream copy.
+    *   Unlike Demux() nothing is converted, so the payload stays in the reference-counted buffer
+    *   av_read_frame() filled and can be handed to a muxer without copying. pPacket must be unreferenced
+    *   (or moved into av_interleaved_write_frame()) before the next call.
+    */
+    bool DemuxPacket(AVPacket *pPacket) {
+        if (!fmtc) {
+            return false;
+        }
+        int e = av_read_frame(fmtc, pPacket);
+        if (e < 0) {
+            EndOfInput(e);
+            return false;
+        }
+        if (pPacket->stream_index == iVideoStream) {
+            CollectKeyFrame(pPacket);
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Positions the demuxer on the last keyframe at or before nTargetPts (video stream time base).
+    *   Seeking is keyframe accurate; for frame accuracy decode from here and discard frames whose
+    *   timestamp is below GetSeekTarget(), as SeekTranscodeDecoder does. Uses the loaded keyframe index when there is one.
+    */
+    bool Seek(int64_t nTargetPts) {
+        if (!fmtc) {
+            return false;
+        }
+
+        // Keyframes seen from here on would not extend the index contiguously
+        bCollectKeyFrames = false;
+        if (pkt->data) {
+            av_packet_unref(pkt);
+        }
+
+        int ret;
+        const KeyFrameIndexEntry *pEntry = FindKeyFrame(nTargetPts);
+        if (pEntry && pEntry->pos >= 0 && CanSeekToPacketOffset()) {
+            ret = av_seek_frame(fmtc, iVideoStream, pEntry->pos, AVSEEK_FLAG_BYTE);
+        } else {
+            // With an index hit the container lands exactly on the keyframe instead of searching for one
+            ret = av_seek_frame(fmtc, iVideoStream, pEntry ? pEntry->pts : nTargetPts, AVSEEK_FLAG_BACKWARD);
+        }
+        if (ret < 0) {
+            LOG(ERROR) << "Seek to " << nTargetPts << " failed";
+            nSeekTarget = AV_NOPTS_VALUE;
+            return false;
+        }
+        nSeekTarget = nTargetPts;
+        return true;
+    }
+
+    /**
+    *   @brief  Whether the demuxer picks up cleanly after a byte seek to a packet's pos. Formats that scan for sync
+    *   (transport and program streams, raw elementary streams) do; Matroska, FLV and the like would be left resyncing
+    *   in the middle of a cluster or tag, so they are seeked by timestamp instead.
+    */
+    bool CanSeekToPacketOffset() const {
+        static const char *aszFormats[] = {"mpegts", "mpegtsraw", "mpeg", "mpegvideo", "h264", "hevc"};
+        if (fmtc->iformat->flags & AVFMT_NO_BYTE_SEEK) {
+            return false;
+        }
+        for (const char *szFormat : aszFormats) {
+            if (!strcmp(fmtc->iformat->name, szFormat)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+    *   @brief  Target of the last Seek(), or AV_NOPTS_VALUE. Decoded frames with a smaller timestamp are to be discarded.
+    */
+    int64_t GetSeekTarget() const {
+        return nSeekTarget;
+    }
+
+    /**
+    *   @brief  Writes the keyframes collected by an uninterrupted demux pass from the start to the end of the file.
+    */
+    bool SaveKeyFrameIndex(const char *szIndexPath) {
+        if (!bKeyFrameIndexComplete) {
+            LOG(ERROR) << "Keyframe index is incomplete; demux the whole file once without seeking";
+            return false;
+        }
+        AVRational rTimeBase = fmtc->streams[iVideoStream]->time_base;
+        KeyFrameIndexHeader header = {{'N', 'V', 'K', 'I'}, nKeyFrameIndexVersion, rTimeBase.num, rTimeBase.den, vKeyFrameIndex.size(),
+            GetSourceSize(), nSourceMtime, GetSourceHash()};
+        std::ofstream fpOut(szIndexPath, std::ios::out | std::ios::binary);
+        fpOut.write((const char *)&header, sizeof(header));
+        fpOut.write((const char *)vKeyFrameIndex.data(), vKeyFrameIndex.size() * sizeof(KeyFrameIndexEntry));
+        if (!fpOut) {
+            LOG(ERROR) << "Unable to write keyframe index: " << szIndexPath;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Maps a keyframe index written by SaveKeyFrameIndex(). Entries are used in place, so loading costs no parsing.
+    *   An index written for a file of another size, modification time or header is rejected.
+    */
+    bool LoadKeyFrameIndex(const char *szIndexPath) {
+        std::unique_ptr<MappedFileReader> pFile(new MappedFileReader(szIndexPath, false));
+        const uint8_t *pBuf = NULL;
+        uint64_t nSize = 0;
+        if (!fmtc || !pFile->GetBuffer(&pBuf, &nSize) || nSize < sizeof(KeyFrameIndexHeader)) {
+            return false;
+        }
+
+        const KeyFrameIndexHeader *pHeader = (const KeyFrameIndexHeader *)pBuf;
+        AVRational rTimeBase = fmtc->streams[iVideoStream]->time_base;
+        if (memcmp(pHeader->szMagic, "NVKI", 4) || pHeader->nVersion != nKeyFrameIndexVersion
+            || pHeader->nTimeBaseNum != rTimeBase.num || pHeader->nTimeBaseDen != rTimeBase.den
+            || pHeader->nEntries > (nSize - sizeof(KeyFrameIndexHeader)) / sizeof(KeyFrameIndexEntry)) {
+            LOG(ERROR) << "Keyframe index does not match this stream: " << szIndexPath;
+            return false;
+        }
+        if (pHeader->nSourceSize != GetSourceSize() || pHeader->nSourceMtime != nSourceMtime || pHeader->nSourceHash != GetSourceHash()) {
+            LOG(ERROR) << "Keyframe index was written for another version of this file: " << szIndexPath;
+            return false;
+        }
+
+        pLoadedIndex = (const KeyFrameIndexEntry *)(pBuf + sizeof(KeyFrameIndexHeader));
+        nLoadedIndexEntries = pHeader->nEntries;
+        pKeyFrameIndexFile = std::move(pFile);
+        return true;
+    }
+
     static int ReadPacket(void *opaque, uint8_t *pBuf, int nBuf) {
         return ((DataProvider *)opaque)->GetData(pBuf, nBuf);
     }
+
+    static int ReadMapped(void *opaque, uint8_t *pBuf, int nBuf) {
+        MappedInput *pInput = (MappedInput *)opaque;
+        if (pInput->nPos >= pInput->nSize) {
+            return AVERROR_EOF;
+        }
+        int nRead = (int)(std::min)((uint64_t)nBuf, pInput->nSize - pInput->nPos);
+
+        // Keep one read-ahead window in flight ahead of the parser so it rarely waits on a page fault
+        if (pInput->nPos < pInput->nPrefetchBegin || pInput->nPos + nRead > pInput->nPrefetchEnd) {
+            pInput->pFile->WillNeed(pInput->nPos, nMappedReadAhead);
+            pInput->nPrefetchBegin = pInput->nPos;
+            pInput->nPrefetchEnd = pInput->nPos + nMappedReadAhead;
+        }
+
+        memcpy(pBuf, pInput->pBuf + pInput->nPos, nRead);
+        pInput->nPos += nRead;
+        return nRead;
+    }
+
+    static int64_t SeekMapped(void *opaque, int64_t offset, int whence) {
+        MappedInput *pInput = (MappedInput *)opaque;
+        switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return (int64_t)pInput->nSize;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += (int64_t)pInput->nPos;
+            break;
+        case SEEK_END:
+            offset += (int64_t)pInput->nSize;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+        if (offset < 0) {
+            return AVERROR(EINVAL);
+        }
+        pInput->nPos = (uint64_t)offset;
+        return offset;
+    }
+
+private:
+    void CollectKeyFrame(const AVPacket *pPacket) {
+        if (bCollectKeyFrames && (pPacket->flags & AV_PKT_FLAG_KEY)) {
+            vKeyFrameIndex.push_back({pPacket->pts != AV_NOPTS_VALUE ? pPacket->pts : pPacket->dts, pPacket->dts, pPacket->pos});
+        }
+    }
+
+    // Only a clean end of file proves that every keyframe was seen; a read error leaves the index incomplete
+    void EndOfInput(int e) {
+        if (e == AVERROR_EOF) {
+            CompleteKeyFrameIndex();
+        } else {
+            LOG(ERROR) << "av_read_frame() failed with error " << e << ", demuxing stopped";
+            bCollectKeyFrames = false;
+        }
+    }
+
+    int64_t GetSourceSize() const {
+        int64_t nSize = fmtc->pb ? avio_size(fmtc->pb) : -1;
+        return nSize < 0 ? -1 : nSize;
+    }
+
+    // FNV-1a over what avformat parsed from the header, so an edited file with the same size and time still mismatches
+    uint64_t GetSourceHash() const {
+        uint64_t h = 14695981039346656037ull;
+        auto hash = [&h](const void *p, size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                h = (h ^ ((const uint8_t *)p)[i]) * 1099511628211ull;
+            }
+        };
+        hash(&fmtc->nb_streams, sizeof(fmtc->nb_streams));
+        hash(&fmtc->duration, sizeof(fmtc->duration));
+        for (unsigned i = 0; i < fmtc->nb_streams; i++) {
+            const AVStream *st = fmtc->streams[i];
+            int32_t aStream[] = {st->codecpar->codec_type, st->codecpar->codec_id, st->time_base.num, st->time_base.den};
+            hash(aStream, sizeof(aStream));
+            hash(&st->duration, sizeof(st->duration));
+        }
+        const AVCodecParameters *par = fmtc->streams[iVideoStream]->codecpar;
+        if (par->extradata) {
+            hash(par->extradata, par->extradata_size);
+        }
+        return h;
+    }
+
+    void CompleteKeyFrameIndex() {
+        if (bCollectKeyFrames) {
+            std::sort(vKeyFrameIndex.begin(), vKeyFrameIndex.end(), [](const KeyFrameIndexEntry &a, const KeyFrameIndexEntry &b) { return a.pts < b.pts; });
+            bKeyFrameIndexComplete = true;
+            bCollectKeyFrames = false;
+        }
+    }
+
+    /**
+    *   @brief  Binary search for the last indexed keyframe with pts <= nTargetPts.
+    */
+    const KeyFrameIndexEntry *FindKeyFrame(int64_t nTargetPts) const {
+        const KeyFrameIndexEntry *pBegin = pLoadedIndex, *pEnd = pLoadedIndex + nLoadedIndexEntries;
+        if (!pLoadedIndex && bKeyFrameIndexComplete) {
+            pBegin = vKeyFrameIndex.data();
+            pEnd = pBegin + vKeyFrameIndex.size();
+        }
+        const KeyFrameIndexEntry *p = std::upper_bound(pBegin, pEnd, nTargetPts,
+            [](int64_t nPts, const KeyFrameIndexEntry &entry) { return nPts < entry.pts; });
+        return p == pBegin ? NULL : p - 1;
+    }
 };
 
 inline cudaVideoCodec FFmpeg2NvCodecId(AVCodecID id) {
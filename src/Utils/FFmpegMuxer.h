@@ -26,6 +26,12 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "NvCodecUtils.h"
 #include "FFmpegDemuxer.h"
 //---------------------------------------------------------------------------
@@ -60,6 +66,20 @@ MEDIA_FORMAT GetMediaFormat (char* szOutputFileName)
         return MEDIA_FORMAT_ELEMENTARY;
 }
 
+/**
+* @brief Counters of the asynchronous writer, sampled with FFmpegMuxer::GetStats()
+*/
+struct MuxStats {
+    uint64_t nPacketsQueued;        /*!< Packets accepted by Mux() */
+    uint64_t nPacketsWritten;       /*!< Packets handed to av_interleaved_write_frame() */
+    uint64_t nBytesWritten;
+    uint64_t nProducerStalls;       /*!< Mux() calls that waited because the queue was full */
+    uint32_t nQueueDepth;           /*!< Packets waiting for the writer thread */
+    uint32_t nMaxQueueDepth;
+    double fAvgWriteLatencyMs;      /*!< Time spent in av_interleaved_write_frame() per packet */
+    double fMaxWriteLatencyMs;
+};
+
 class FFmpegMuxer {
 private:
     AVFormatContext* inFmtc = NULL;
@@ -74,8 +94,24 @@ private:
     double timeBase = 0.0;
     int64_t userTimeScale = 0;
 
+    // Asynchronous mode: Mux() copies the packet into the queue and the writer thread muxes it
+    bool bAsync = false;
+    std::unique_ptr<SpscRingQueue<AVPacket *>> pQueue;
+    std::thread writerThread;
+    std::atomic<bool> bWriteError{false};
+    FILE *fpOut = NULL;                 /*!< Backs the custom AVIO context in asynchronous mode */
+    std::mutex statsMutex;
+    MuxStats stats = {};
+    double fTotalWriteLatencyMs = 0.0;
+    static const int nAsyncAvioBufferSize = 4 * 1024 * 1024;
+
 public:
-    FFmpegMuxer(const char* szFilePath, MEDIA_FORMAT mediaFormat, AVFormatContext *inFmtc, AVCodecID codecID, int width, int height) {
+    /**
+    *   @param  nAsyncQueueSize     0 keeps the synchronous behaviour where Mux() writes on the calling thread.
+    *                               Otherwise Mux() copies the packet into a lock-free queue of this many entries and a
+    *                               writer thread muxes it through a 4 MB AVIO buffer, so disk stalls do not block the encoder.
+    */
+    FFmpegMuxer(const char* szFilePath, MEDIA_FORMAT mediaFormat, AVFormatContext *inFmtc, AVCodecID codecID, int width, int height, int nAsyncQueueSize = 0) {
 
         if (mediaFormat == MEDIA_FORMAT_MOV)
         {
@@ -125,9 +161,15 @@ public:
             }
         }
 
+        bAsync = nAsyncQueueSize > 0;
+
         //fix the default time resolution
         if (!(fmtc->oformat->flags & AVFMT_NOFILE)) {
-            if (avio_open(&fmtc->pb, szFilePath, AVIO_FLAG_WRITE) < 0) {
+            if (bAsync) {
+                if (!OpenBufferedOutput(szFilePath)) {
+                    return;
+                }
+            } else if (avio_open(&fmtc->pb, szFilePath, AVIO_FLAG_WRITE) < 0) {
                 LOG(ERROR) << "Error opening output file" << szFilePath;
                 return;
             }
@@ -143,6 +185,11 @@ public:
             LOG(ERROR) << "Error allocating packet";
             return;
         }
+
+        if (bAsync) {
+            pQueue.reset(new SpscRingQueue<AVPacket *>(nAsyncQueueSize));
+            writerThread = std::thread(&FFmpegMuxer::WriterLoop, this);
+        }
     }
 
     ~FFmpegMuxer() {
@@ -151,9 +198,19 @@ public:
             return;
         }
 
+        if (writerThread.joinable()) {
+            pQueue->Close();
+            writerThread.join();
+        }
+
         av_write_trailer(fmtc);
 
-        if (!(fmtc->oformat->flags & AVFMT_NOFILE)) {
+        if (fpOut) {
+            // Custom AVIO context: avio_closep() would treat the opaque pointer as a URLContext
+            avio_flush(fmtc->pb);
+            fmtc->pb = NULL;
+            fclose(fpOut);
+        } else if (!(fmtc->oformat->flags & AVFMT_NOFILE)) {
             avio_closep(&fmtc->pb);
         }
 
@@ -168,42 +225,157 @@ public:
         }
     }
 
+    /**
+    *   @brief  Muxes one packet. In asynchronous mode the data is copied and the call only blocks while the queue is full;
+    *   a false return then reports an earlier write failure. Must be called from a single thread.
+    */
     bool Mux(uint8_t* data, unsigned int size, int64_t pts, int64_t dts, int stream_index, int is_key_frame = 0, int numb = 0) {
         if (!fmtc) {
             return false;
         }
 
-        packet->data = data;
-        packet->size = size;
-        packet->stream_index = stream_index;
-        if (is_key_frame)
-            packet->flags |= AV_PKT_FLAG_KEY;
+        if (!bAsync) {
+            packet->data = data;
+            packet->size = size;
+            SetPacketProperties(packet, pts, dts, stream_index, is_key_frame, numb);
+
+            if (av_interleaved_write_frame(fmtc, packet) < 0) {
+                LOG(ERROR) << "Error writing frame\n";
+                return false;
+            }
+
+            return true;
+        }
+
+        if (bWriteError || !pQueue) {
+            return false;
+        }
+        AVPacket *pkt = av_packet_alloc();
+        if (!pkt || av_new_packet(pkt, size) < 0) {
+            LOG(ERROR) << "Error allocating packet";
+            av_packet_free(&pkt);
+            return false;
+        }
+        memcpy(pkt->data, data, size);
+        SetPacketProperties(pkt, pts, dts, stream_index, is_key_frame, numb);
+
+        bool bStalled = pQueue->Push(std::move(pkt));
+
+        uint32_t nDepth = (uint32_t)pQueue->Size();
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.nPacketsQueued++;
+        stats.nProducerStalls += bStalled ? 1 : 0;
+        stats.nMaxQueueDepth = (std::max)(stats.nMaxQueueDepth, nDepth);
+        return true;
+    }
+
+    /**
+    *   @brief  Returns the writer statistics. All zero in synchronous mode.
+    */
+    MuxStats GetStats() {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        MuxStats s = stats;
+        s.nQueueDepth = pQueue ? (uint32_t)pQueue->Size() : 0;
+        s.fAvgWriteLatencyMs = stats.nPacketsWritten ? fTotalWriteLatencyMs / stats.nPacketsWritten : 0.0;
+        return s;
+    }
+
+private:
+    void SetPacketProperties(AVPacket *pkt, int64_t pts, int64_t dts, int stream_index, int is_key_frame, int numb) {
+        pkt->stream_index = stream_index;
+        pkt->flags = is_key_frame ? AV_PKT_FLAG_KEY : 0;
 
         int offset = 0;
         if (inFmtc->streams[stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
         {
             AVRational r = { 1, inFmtc->streams[stream_index]->avg_frame_rate.num };
             if (inFmtc->streams[stream_index]->avg_frame_rate.num > 0) {
-                packet->duration = av_rescale_q(1, r, fmtc->streams[stream_index]->time_base);
+                pkt->duration = av_rescale_q(1, r, fmtc->streams[stream_index]->time_base);
                 offset = (int)(numb * inFmtc->streams[stream_index]->time_base.den * inFmtc->streams[stream_index]->avg_frame_rate.den / inFmtc->streams[stream_index]->avg_frame_rate.num);
             }
             else {
-                packet->duration = 0;
+                pkt->duration = 0;
             }
         }
 
-        packet->pts = av_rescale_q(pts, inFmtc->streams[stream_index]->time_base, fmtc->streams[stream_index]->time_base) + offset;
-        packet->dts = av_rescale_q(dts, inFmtc->streams[stream_index]->time_base, fmtc->streams[stream_index]->time_base);
+        pkt->pts = av_rescale_q(pts, inFmtc->streams[stream_index]->time_base, fmtc->streams[stream_index]->time_base) + offset;
+        pkt->dts = av_rescale_q(dts, inFmtc->streams[stream_index]->time_base, fmtc->streams[stream_index]->time_base);
 
-        if (packet->pts < packet->dts) {
-            packet->pts = packet->dts;
+        if (pkt->pts < pkt->dts) {
+            pkt->pts = pkt->dts;
         }
+    }
 
-        if (av_interleaved_write_frame(fmtc, packet) < 0) {
-            LOG(ERROR) << "Error writing frame\n";
-            return false;
+    void WriterLoop() {
+        AVPacket *pkt = NULL;
+        while (pQueue->Pop(pkt)) {
+            if (bWriteError) {
+                av_packet_free(&pkt);
+                continue;
+            }
+            int nSize = pkt->size;
+            auto t0 = std::chrono::steady_clock::now();
+            int ret = av_interleaved_write_frame(fmtc, pkt);
+            double fLatencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            av_packet_free(&pkt);
+            if (ret < 0) {
+                LOG(ERROR) << "Error writing frame";
+                bWriteError = true;
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.nPacketsWritten++;
+            stats.nBytesWritten += nSize;
+            fTotalWriteLatencyMs += fLatencyMs;
+            stats.fMaxWriteLatencyMs = (std::max)(stats.fMaxWriteLatencyMs, fLatencyMs);
         }
+    }
 
+    /**
+    *   @brief  Opens the output through a custom AVIO context with a large buffer, so the writer thread issues few large writes.
+    */
+    bool OpenBufferedOutput(const char *szFilePath) {
+        fpOut = fopen(szFilePath, "wb");
+        if (!fpOut) {
+            LOG(ERROR) << "Error opening output file" << szFilePath;
+            return false;
+        }
+        uint8_t *avioc_buffer = (uint8_t *)av_malloc(nAsyncAvioBufferSize);
+        avioc = avioc_buffer ? avio_alloc_context(avioc_buffer, nAsyncAvioBufferSize, 1, fpOut, NULL, &WriteOutput, &SeekOutput) : NULL;
+        if (!avioc) {
+            LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
+            av_free(avioc_buffer);
+            fclose(fpOut);
+            fpOut = NULL;
+            return false;
+        }
+        fmtc->pb = avioc;
+        fmtc->flags |= AVFMT_FLAG_CUSTOM_IO;
+        // Leave flushing to the AVIO buffer instead of after every packet
+        fmtc->flush_packets = 0;
         return true;
     }
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    static int WriteOutput(void *opaque, const uint8_t *pBuf, int nBuf) {
+#else
+    static int WriteOutput(void *opaque, uint8_t *pBuf, int nBuf) {
+#endif
+        return fwrite(pBuf, 1, nBuf, (FILE *)opaque) == (size_t)nBuf ? nBuf : AVERROR(EIO);
+    }
+
+    static int64_t SeekOutput(void *opaque, int64_t offset, int whence) {
+        FILE *fp = (FILE *)opaque;
+        if (whence & AVSEEK_SIZE) {
+            return -1;
+        }
+#ifdef _WIN32
+        int ret = _fseeki64(fp, offset, whence & ~AVSEEK_FORCE);
+        return ret == 0 ? _ftelli64(fp) : AVERROR(EIO);
+#else
+        int ret = fseeko(fp, offset, whence & ~AVSEEK_FORCE);
+        return ret == 0 ? ftello(fp) : AVERROR(EIO);
+#endif
+    }
 };
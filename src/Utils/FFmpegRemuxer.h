@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "NvCodecUtils.h"
+#include "FFmpegDemuxer.h"
+
+//---------------------------------------------------------------------------
+//! \file FFmpegRemuxer.h
+//! \brief Stream copy from one container to another without decoding.
+//!
+//! Packets go from FFmpegDemuxer::DemuxPacket() straight into av_interleaved_write_frame(),
+//! which takes over the demuxer's buffer reference, so payloads are never copied by this code.
+//! Timestamps are rebased per stream from its own time base, independent of FFmpegMuxer.
+//---------------------------------------------------------------------------
+
+struct RemuxStats {
+    uint64_t nPacketsWritten;
+    uint64_t nBytesWritten;
+    uint64_t nPacketsSkipped;       /*!< Packets outside the trim range or of dropped streams */
+    double fSeconds;                /*!< Wall time spent in Run() */
+};
+
+class FFmpegRemuxer {
+public:
+    /**
+    *   @param  pDemuxer        Source; FFmpegDemuxer(const MappedFileReader *) keeps reads at disk speed
+    *   @param  szOutputFormat  libavformat short name ("mp4", "mpegts", "matroska", ...); NULL guesses it from szOutputPath
+    *   @param  bVideoOnly      Drop all but the demuxer's video stream
+    */
+    FFmpegRemuxer(FFmpegDemuxer *pDemuxer, const char *szOutputPath, const char *szOutputFormat = NULL, bool bVideoOnly = false) : pDemuxer(pDemuxer) {
+        AVFormatContext *inFmtc = pDemuxer->GetAVFormatContext();
+        if (!inFmtc) {
+            LOG(ERROR) << "Demuxer has no input";
+            return;
+        }
+        if (avformat_alloc_output_context2(&fmtc, NULL, szOutputFormat, szOutputPath) < 0 || !fmtc) {
+            LOG(ERROR) << "Unable to create output context for " << szOutputPath;
+            return;
+        }
+
+        for (int i = 0; i < (int)inFmtc->nb_streams; i++) {
+            AVCodecParameters *par = inFmtc->streams[i]->codecpar;
+            bool bCopy = i == pDemuxer->GetVideoStreamIndex() || (!bVideoOnly && (par->codec_type == AVMEDIA_TYPE_AUDIO || par->codec_type == AVMEDIA_TYPE_SUBTITLE));
+            if (!bCopy) {
+                vStreamMap.push_back(-1);
+                continue;
+            }
+            AVStream *stream = avformat_new_stream(fmtc, NULL);
+            if (!stream || avcodec_parameters_copy(stream->codecpar, par) < 0) {
+                LOG(ERROR) << "Error copying codec parameters of stream " << i;
+                return;
+            }
+            // The source container's tag may be invalid in the target container; let the muxer pick
+            stream->codecpar->codec_tag = 0;
+            stream->time_base = inFmtc->streams[i]->time_base;
+            vStreamMap.push_back(stream->index);
+        }
+
+        if (!(fmtc->oformat->flags & AVFMT_NOFILE) && !OpenBufferedOutput(szOutputPath)) {
+            return;
+        }
+        if (avformat_write_header(fmtc, NULL) < 0) {
+            LOG(ERROR) << "Error writing header";
+            return;
+        }
+        bHeaderWritten = true;
+    }
+
+    ~FFmpegRemuxer() {
+        if (!fmtc) {
+            return;
+        }
+        if (bHeaderWritten && !bTrailerWritten) {
+            av_write_trailer(fmtc);
+        }
+        if (fpOut) {
+            avio_flush(fmtc->pb);
+            fmtc->pb = NULL;
+            fclose(fpOut);
+        }
+        avformat_free_context(fmtc);
+        if (avioc) {
+            av_freep(&avioc->buffer);
+            av_freep(&avioc);
+        }
+    }
+
+    /**
+    *   @brief  Copies [fStart, fEnd) in seconds from the start of the video stream (fEnd <= 0 copies to the end).
+    *   The output starts at the last key frame at or before fStart. Every stream ends at fEnd: video at the first
+    *   packet decoded at or after it, so frames shown before fEnd keep their references, and other streams at the
+    *   first packet presented at or after it. All streams are rebased so the first video key frame is decoded at
+    *   time 0; packets of other streams that would land before it are dropped. Writes the trailer; call once.
+    */
+    bool Run(double fStart = 0.0, double fEnd = 0.0) {
+        if (!bHeaderWritten || bTrailerWritten) {
+            return false;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        AVFormatContext *inFmtc = pDemuxer->GetAVFormatContext();
+        int iVideo = pDemuxer->GetVideoStreamIndex();
+        AVRational videoTimeBase = inFmtc->streams[iVideo]->time_base;
+
+        // Transport streams rarely start at 0, so the trim points are relative to the stream's first timestamp
+        int64_t nStreamStart = inFmtc->streams[iVideo]->start_time != AV_NOPTS_VALUE ? inFmtc->streams[iVideo]->start_time : 0;
+        if (fStart > 0.0 && !pDemuxer->Seek(nStreamStart + (int64_t)(fStart / av_q2d(videoTimeBase)))) {
+            return false;
+        }
+        // In AV_TIME_BASE_Q, so it applies to every stream
+        int64_t nEndTime = fEnd > 0.0 ? av_rescale_q(nStreamStart, videoTimeBase, AV_TIME_BASE_Q) + (int64_t)(fEnd * AV_TIME_BASE) : INT64_MAX;
+
+        // Decode time of the first video key frame in AV_TIME_BASE_Q
+        int64_t nOffset = AV_NOPTS_VALUE;
+        // Input streams past nEndTime; reading stops once every copied stream is
+        std::vector<bool> vEnded(vStreamMap.size(), false);
+        size_t nEnded = 0, nCopied = vStreamMap.size() - std::count(vStreamMap.begin(), vStreamMap.end(), -1);
+        AVPacket *pkt = av_packet_alloc();
+        bool bOk = pkt != NULL;
+        while (bOk && nEnded < nCopied && pDemuxer->DemuxPacket(pkt)) {
+            // Streams that appear after the header, as in MPEG-TS, have no output stream
+            if (pkt->stream_index < 0 || pkt->stream_index >= (int)vStreamMap.size()) {
+                stats.nPacketsSkipped++;
+                av_packet_unref(pkt);
+                continue;
+            }
+            int iOut = vStreamMap[pkt->stream_index];
+            AVStream *in = inFmtc->streams[pkt->stream_index];
+            bool bVideo = pkt->stream_index == iVideo;
+            bool bKey = bVideo && (pkt->flags & AV_PKT_FLAG_KEY);
+            int64_t nDts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+            int64_t nPts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+
+            if (nOffset == AV_NOPTS_VALUE && bKey && nDts != AV_NOPTS_VALUE) {
+                nOffset = av_rescale_q(nDts, in->time_base, AV_TIME_BASE_Q);
+            }
+            int64_t nCut = bVideo ? nDts : nPts;
+            if (iOut >= 0 && !vEnded[pkt->stream_index] && nCut != AV_NOPTS_VALUE
+                && av_rescale_q(nCut, in->time_base, AV_TIME_BASE_Q) >= nEndTime) {
+                vEnded[pkt->stream_index] = true;
+                nEnded++;
+            }
+            // Anything before the first video key frame would reference data that is not in the output
+            if (iOut < 0 || vEnded[pkt->stream_index] || nOffset == AV_NOPTS_VALUE || nDts == AV_NOPTS_VALUE) {
+                stats.nPacketsSkipped++;
+                av_packet_unref(pkt);
+                continue;
+            }
+
+            int64_t nRebase = av_rescale_q(nOffset, AV_TIME_BASE_Q, in->time_base);
+            if (pkt->pts != AV_NOPTS_VALUE) {
+                pkt->pts -= nRebase;
+            }
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                pkt->dts -= nRebase;
+            }
+            if (!bVideo && nPts - nRebase < 0) {
+                stats.nPacketsSkipped++;
+                av_packet_unref(pkt);
+                continue;
+            }
+            av_packet_rescale_ts(pkt, in->time_base, fmtc->streams[iOut]->time_base);
+            pkt->stream_index = iOut;
+            pkt->pos = -1;
+
+            int nSize = pkt->size;
+            if (av_interleaved_write_frame(fmtc, pkt) < 0) {
+                LOG(ERROR) << "Error writing packet";
+                bOk = false;
+                break;
+            }
+            stats.nPacketsWritten++;
+            stats.nBytesWritten += nSize;
+        }
+        av_packet_free(&pkt);
+
+        bOk &= av_write_trailer(fmtc) >= 0;
+        bTrailerWritten = true;
+        if (nOffset == AV_NOPTS_VALUE) {
+            LOG(WARNING) << "No video key frame in the requested range";
+        }
+        stats.fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return bOk;
+    }
+
+    RemuxStats GetStats() const {
+        return stats;
+    }
+
+private:
+    /**
+    *   @brief  Output through a custom AVIO context with a large buffer, so the file sees few large writes.
+    */
+    bool OpenBufferedOutput(const char *szFilePath) {
+        fpOut = fopen(szFilePath, "wb");
+        if (!fpOut) {
+            LOG(ERROR) << "Error opening output file " << szFilePath;
+            return false;
+        }
+        uint8_t *avioc_buffer = (uint8_t *)av_malloc(nAvioBufferSize);
+        avioc = avioc_buffer ? avio_alloc_context(avioc_buffer, nAvioBufferSize, 1, fpOut, NULL, &WriteOutput, &SeekOutput) : NULL;
+        if (!avioc) {
+            LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
+            av_free(avioc_buffer);
+            fclose(fpOut);
+            fpOut = NULL;
+            return false;
+        }
+        fmtc->pb = avioc;
+        fmtc->flags |= AVFMT_FLAG_CUSTOM_IO;
+        fmtc->flush_packets = 0;
+        return true;
+    }
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+    static int WriteOutput(void *opaque, const uint8_t *pBuf, int nBuf) {
+#else
+    static int WriteOutput(void *opaque, uint8_t *pBuf, int nBuf) {
+#endif
+        return fwrite(pBuf, 1, nBuf, (FILE *)opaque) == (size_t)nBuf ? nBuf : AVERROR(EIO);
+    }
+
+    static int64_t SeekOutput(void *opaque, int64_t offset, int whence) {
+        FILE *fp = (FILE *)opaque;
+        if (whence & AVSEEK_SIZE) {
+            return -1;
+        }
+#ifdef _WIN32
+        int ret = _fseeki64(fp, offset, whence & ~AVSEEK_FORCE);
+        return ret == 0 ? _ftelli64(fp) : AVERROR(EIO);
+#else
+        int ret = fseeko(fp, offset, whence & ~AVSEEK_FORCE);
+        return ret == 0 ? ftello(fp) : AVERROR(EIO);
+#endif
+    }
+
+private:
+    FFmpegDemuxer *pDemuxer;
+    AVFormatContext *fmtc = NULL;
+    AVIOContext *avioc = NULL;
+    FILE *fpOut = NULL;
+    std::vector<int> vStreamMap;        /*!< Input stream index to output stream index, -1 if dropped */
+    bool bHeaderWritten = false;
+    bool bTrailerWritten = false;
+    RemuxStats stats = {};
+    static const int nAvioBufferSize = 4 * 1024 * 1024;
+};
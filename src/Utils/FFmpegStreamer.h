@@ -34,6 +34,8 @@ extern "C" {
 #include <libswresample/swresample.h>
 };
 #include "Logger.h"
+#include "NalUnitSplitter.h"
+#include "Av1ObuParser.h"
 
 using namespace std;
 
@@ -58,14 +60,32 @@ static string AvErrorToString(int av_error_code) {
     return str;
 }
 
+/**
+* @brief When FFmpegStreamer pushes buffered data to the network
+*/
+typedef enum {
+    STREAM_FLUSH_EVERY_PACKET = 0,  /*!< Lowest latency, one send per packet */
+    STREAM_FLUSH_KEYFRAME = 1,      /*!< Flush before each keyframe, so whole GOPs go out together */
+    STREAM_FLUSH_AVIO = 2,          /*!< Only when the AVIO buffer is full */
+} STREAM_FLUSH_POLICY;
+
 class FFmpegStreamer {
 private:
     AVFormatContext *oc = NULL;
     AVStream *vs = NULL;
+    AVPacket *pkt = NULL;   /*!< Reused for every packet; it only ever references caller data */
     int nFps = 0;
+    STREAM_FLUSH_POLICY eFlushPolicy = STREAM_FLUSH_EVERY_PACKET;
+    Av1SequenceHeader av1Seq = {};
+    bool bHaveAv1Seq = false;
 
 public:
-    FFmpegStreamer(AVCodecID eCodecId, int nWidth, int nHeight, int nFps, const char *szInFilePath) : nFps(nFps) {
+    /**
+    *   @brief  Opens an MPEG-TS (H.264/HEVC) or IVF (AV1) output. AV1 packets must be raw temporal units,
+    *   see NvEncoder::SetUseIVFContainer().
+    */
+    FFmpegStreamer(AVCodecID eCodecId, int nWidth, int nHeight, int nFps, const char *szInFilePath, STREAM_FLUSH_POLICY eFlushPolicy = STREAM_FLUSH_EVERY_PACKET)
+        : nFps(nFps), eFlushPolicy(eFlushPolicy) {
         avformat_network_init();
 
         int ret = 0;
@@ -99,6 +119,11 @@ public:
         vpar->width = nWidth;
         vpar->height = nHeight;
 
+        // Stream() flushes explicitly; keep the muxer from flushing on its own
+        if (eFlushPolicy != STREAM_FLUSH_EVERY_PACKET) {
+            oc->flush_packets = 0;
+        }
+
         // Everything is ready. Now open the output stream.
         if (avio_open(&oc->pb, oc->url, AVIO_FLAG_WRITE) < 0) {
             LOG(ERROR) << "FFMPEG: Could not open " << oc->url;
@@ -110,8 +135,14 @@ public:
             LOG(ERROR) << "FFMPEG: avformat_write_header error!";
             return;
         }
+
+        pkt = av_packet_alloc();
+        if (!pkt) {
+            LOG(ERROR) << "AVPacket allocation failed !";
+        }
     }
     ~FFmpegStreamer() {
+        av_packet_free(&pkt);
         if (oc) {
             av_write_trailer(oc);
             avio_close(oc->pb);
@@ -119,31 +150,66 @@ public:
         }
     }
 
+    /**
+    *   @brief  Streams a packet without B-frames (dts == pts); the keyframe flag is taken from the bitstream.
+    *   @param  nPts    Presentation time in frame units
+    */
     bool Stream(uint8_t *pData, int nBytes, int nPts) {
-        AVPacket *pkt = av_packet_alloc();
+        return Stream(pData, nBytes, nPts, nPts, -1);
+    }
+
+    /**
+    *   @brief  Streams a packet with explicit decode order information, e.g. from NvEncOutputFrame.
+    *   @param  nPts, nDts  Presentation and decode time in frame units
+    *   @param  nKeyFrame   1 or 0 from the encoder (pictureType == NV_ENC_PIC_TYPE_IDR), -1 to detect from the bitstream
+    */
+    bool Stream(uint8_t *pData, int nBytes, int64_t nPts, int64_t nDts, int nKeyFrame) {
         if (!pkt) {
-            LOG(ERROR) << "AVPacket allocation failed !";
             return false;
         }
-        pkt->pts = av_rescale_q(nPts++, AVRational {1, nFps}, vs->time_base);
-        // No B-frames
-        pkt->dts = pkt->pts;
+        bool bKeyFrame = nKeyFrame < 0 ? IsKeyFrame(pData, nBytes) : nKeyFrame != 0;
+
+        pkt->pts = av_rescale_q(nPts, AVRational {1, nFps}, vs->time_base);
+        pkt->dts = av_rescale_q(nDts, AVRational {1, nFps}, vs->time_base);
         pkt->stream_index = vs->index;
         pkt->data = pData;
         pkt->size = nBytes;
+        pkt->flags = bKeyFrame ? AV_PKT_FLAG_KEY : 0;
 
-        if(!memcmp(pData, "\x00\x00\x00\x01\x67", 5)) {
-            pkt->flags |= AV_PKT_FLAG_KEY;
+        if (bKeyFrame && eFlushPolicy == STREAM_FLUSH_KEYFRAME) {
+            av_write_frame(oc, NULL);
         }
 
         // Write the compressed frame into the output
         int ret = av_write_frame(oc, pkt);
-        av_write_frame(oc, NULL);
-        if (ret < 0) {
-            LOG(ERROR) << "FFMPEG: Error while writing video frame";
+        if (eFlushPolicy == STREAM_FLUSH_EVERY_PACKET) {
+            av_write_frame(oc, NULL);
         }
+        // pkt does not own pData; drop the reference without freeing anything
+        pkt->data = NULL;
+        pkt->size = 0;
 
-        av_packet_free(&pkt);
+        if (ret < 0) {
+            LOG(ERROR) << "FFMPEG: Error while writing video frame: " << AvErrorToString(ret);
+            return false;
+        }
         return true;
     }
+
+private:
+    bool IsKeyFrame(const uint8_t *pData, int nBytes) {
+        switch (vs->codecpar->codec_id) {
+        case AV_CODEC_ID_H264:
+            return ContainsKeyFrame(pData, nBytes, NAL_CODEC_H264);
+        case AV_CODEC_ID_HEVC:
+            return ContainsKeyFrame(pData, nBytes, NAL_CODEC_HEVC);
+        case AV_CODEC_ID_AV1:
+            if (FindSequenceHeader(pData, nBytes, av1Seq)) {
+                bHaveAv1Seq = true;
+            }
+            return IsKeyFrameTemporalUnit(pData, nBytes, bHaveAv1Seq ? &av1Seq : NULL);
+        default:
+            return false;
+        }
+    }
 };
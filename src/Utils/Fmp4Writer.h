@@ -0,0 +1,607 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <codec/codec.h>
+#include "NvCodecUtils.h"
+#include "NalUnitSplitter.h"
+#include "Av1ObuParser.h"
+
+//---------------------------------------------------------------------------
+//! \file Fmp4Writer.h
+//! \brief Fragmented MP4 (CMAF) writer for H.264, HEVC and AV1 without libavformat.
+//!
+//! The initialization segment (ftyp + moov) is built from the encoder sequence header
+//! (NvEncoder::GetSequenceParams()). AddSample() writes each payload once, straight into the
+//! caller's buffer behind room reserved for the moof, and WriteFragment() fills in the moof
+//! and the mdat size afterwards. The sample queue is reused across fragments.
+//---------------------------------------------------------------------------
+
+class Fmp4Writer {
+public:
+    /**
+    *   @param  nTimescale              Units per second of the timestamps passed to AddSample()
+    *   @param  nDefaultSampleDuration  Duration of the last sample of a fragment when the next dts is not known
+    */
+    Fmp4Writer(cdc::CodecType eCodec, uint32_t nWidth, uint32_t nHeight, uint32_t nTimescale, uint32_t nDefaultSampleDuration)
+        : eCodec(eCodec), nWidth(nWidth), nHeight(nHeight), nTimescale(nTimescale), nDefaultSampleDuration(nDefaultSampleDuration) {}
+
+    /**
+    *   @brief  Builds the avcC/hvcC/av1C record from Annex-B parameter sets (H.264/HEVC) or a sequence header OBU (AV1).
+    */
+    bool SetSequenceHeader(const uint8_t *pData, size_t nSize) {
+        vConfig.clear();
+        bool bOk = eCodec == cdc::CODEC_TYPE_AV1 ? BuildAv1C(pData, nSize) : eCodec == cdc::CODEC_TYPE_H265 ? BuildHvcC(pData, nSize) : BuildAvcC(pData, nSize);
+        if (!bOk) {
+            LOG(ERROR) << "Unable to build the decoder configuration record from the sequence header";
+            vConfig.clear();
+        }
+        return bOk;
+    }
+
+    /**
+    *   @brief  RFC 6381 codecs parameter (e.g. "avc1.640028") for manifests; empty until SetSequenceHeader() succeeded.
+    */
+    std::string GetCodecString() const {
+        char szCodec[64] = {};
+        if (vConfig.size() < 4) {
+            return std::string();
+        }
+        if (eCodec == cdc::CODEC_TYPE_H264) {
+            snprintf(szCodec, sizeof(szCodec), "avc1.%02X%02X%02X", vConfig[1], vConfig[2], vConfig[3]);
+        } else if (eCodec == cdc::CODEC_TYPE_AV1) {
+            snprintf(szCodec, sizeof(szCodec), "av01.%d.%02d%c.%02d", vConfig[1] >> 5, vConfig[1] & 0x1F, (vConfig[2] & 0x80) ? 'H' : 'M',
+                (vConfig[2] & 0x40) ? ((vConfig[2] & 0x20) ? 12 : 10) : 8);
+        } else {
+            // general_profile_compatibility_flags are written bit-reversed, constraint bytes without trailing zeros
+            uint32_t nCompat = ((uint32_t)vConfig[2] << 24) | (vConfig[3] << 16) | (vConfig[4] << 8) | vConfig[5], nReversed = 0;
+            for (int i = 0; i < 32; i++) {
+                nReversed |= ((nCompat >> i) & 1) << (31 - i);
+            }
+            const char *aszSpace[] = {"", "A", "B", "C"};
+            int n = snprintf(szCodec, sizeof(szCodec), "hvc1.%s%d.%X.%c%d", aszSpace[vConfig[1] >> 6], vConfig[1] & 0x1F, nReversed,
+                (vConfig[1] & 0x20) ? 'H' : 'L', vConfig[12]);
+            int nLast = 11;
+            while (nLast >= 6 && vConfig[nLast] == 0) {
+                nLast--;
+            }
+            for (int i = 6; i <= nLast; i++) {
+                n += snprintf(szCodec + n, sizeof(szCodec) - n, ".%X", vConfig[i]);
+            }
+        }
+        return szCodec;
+    }
+
+    /**
+    *   @brief  Appends ftyp and moov to vOut.
+    */
+    bool WriteInitSegment(std::vector<uint8_t> &vOut) {
+        if (vConfig.empty()) {
+            LOG(ERROR) << "SetSequenceHeader() must succeed before the init segment is written";
+            return false;
+        }
+
+        size_t ftyp = BeginBox(vOut, "ftyp");
+        PutFourCC(vOut, "iso6");
+        Put32(vOut, 0);
+        PutFourCC(vOut, "iso6");
+        PutFourCC(vOut, "cmfc");
+        PutFourCC(vOut, eCodec == cdc::CODEC_TYPE_AV1 ? "av01" : "mp41");
+        EndBox(vOut, ftyp);
+
+        size_t moov = BeginBox(vOut, "moov");
+        size_t mvhd = BeginFullBox(vOut, "mvhd", 0, 0);
+        Put32(vOut, 0);                 // creation_time
+        Put32(vOut, 0);                 // modification_time
+        Put32(vOut, nTimescale);
+        Put32(vOut, 0);                 // duration, carried by the fragments
+        Put32(vOut, 0x00010000);        // rate 1.0
+        Put16(vOut, 0x0100);            // volume 1.0
+        PutZeros(vOut, 10);
+        PutMatrix(vOut);
+        PutZeros(vOut, 24);             // pre_defined
+        Put32(vOut, nTrackId + 1);      // next_track_ID
+        EndBox(vOut, mvhd);
+
+        size_t trak = BeginBox(vOut, "trak");
+        size_t tkhd = BeginFullBox(vOut, "tkhd", 0, 3);  // enabled, in movie
+        Put32(vOut, 0);
+        Put32(vOut, 0);
+        Put32(vOut, nTrackId);
+        Put32(vOut, 0);
+        Put32(vOut, 0);                 // duration
+        PutZeros(vOut, 8);
+        Put16(vOut, 0);                 // layer
+        Put16(vOut, 0);                 // alternate_group
+        Put16(vOut, 0);                 // volume
+        Put16(vOut, 0);
+        PutMatrix(vOut);
+        Put32(vOut, nWidth << 16);
+        Put32(vOut, nHeight << 16);
+        EndBox(vOut, tkhd);
+
+        size_t mdia = BeginBox(vOut, "mdia");
+        size_t mdhd = BeginFullBox(vOut, "mdhd", 0, 0);
+        Put32(vOut, 0);
+        Put32(vOut, 0);
+        Put32(vOut, nTimescale);
+        Put32(vOut, 0);
+        Put16(vOut, 0x55C4);            // language "und"
+        Put16(vOut, 0);
+        EndBox(vOut, mdhd);
+
+        size_t hdlr = BeginFullBox(vOut, "hdlr", 0, 0);
+        Put32(vOut, 0);
+        PutFourCC(vOut, "vide");
+        PutZeros(vOut, 12);
+        const char szHandlerName[] = "VideoHandler";
+        vOut.insert(vOut.end(), szHandlerName, szHandlerName + sizeof(szHandlerName));
+        EndBox(vOut, hdlr);
+
+        size_t minf = BeginBox(vOut, "minf");
+        size_t vmhd = BeginFullBox(vOut, "vmhd", 0, 1);
+        PutZeros(vOut, 8);              // graphicsmode, opcolor
+        EndBox(vOut, vmhd);
+        size_t dinf = BeginBox(vOut, "dinf");
+        size_t dref = BeginFullBox(vOut, "dref", 0, 0);
+        Put32(vOut, 1);
+        size_t url = BeginFullBox(vOut, "url ", 0, 1);  // media data in the same file
+        EndBox(vOut, url);
+        EndBox(vOut, dref);
+        EndBox(vOut, dinf);
+
+        size_t stbl = BeginBox(vOut, "stbl");
+        size_t stsd = BeginFullBox(vOut, "stsd", 0, 0);
+        Put32(vOut, 1);
+        WriteSampleEntry(vOut);
+        EndBox(vOut, stsd);
+        // Sample tables stay empty; samples are described by the fragments
+        const char *aszEmptyTables[] = {"stts", "stsc", "stco"};
+        for (const char *szType : aszEmptyTables) {
+            size_t box = BeginFullBox(vOut, szType, 0, 0);
+            Put32(vOut, 0);
+            EndBox(vOut, box);
+        }
+        size_t stsz = BeginFullBox(vOut, "stsz", 0, 0);
+        Put32(vOut, 0);
+        Put32(vOut, 0);
+        EndBox(vOut, stsz);
+        EndBox(vOut, stbl);
+        EndBox(vOut, minf);
+        EndBox(vOut, mdia);
+        EndBox(vOut, trak);
+
+        size_t mvex = BeginBox(vOut, "mvex");
+        size_t trex = BeginFullBox(vOut, "trex", 0, 0);
+        Put32(vOut, nTrackId);
+        Put32(vOut, 1);                 // default_sample_description_index
+        Put32(vOut, nDefaultSampleDuration);
+        Put32(vOut, 0);
+        Put32(vOut, 0);
+        EndBox(vOut, trex);
+        EndBox(vOut, mvex);
+        EndBox(vOut, moov);
+        return true;
+    }
+
+    /**
+    *   @brief  Adds one access unit to the fragment being built at the end of vOut. H.264/HEVC data is Annex-B and is
+    *   stored length-prefixed without AUDs and parameter sets (they live in the sample entry); AV1 temporal delimiters
+    *   are dropped. The first sample of a fragment reserves the moof and mdat headers; vOut must be passed unchanged
+    *   to every AddSample() and the WriteFragment() of that fragment.
+    *   @param  nDts, nPts  In nTimescale units
+    */
+    bool AddSample(std::vector<uint8_t> &vOut, const uint8_t *pData, size_t nSize, int64_t nDts, int64_t nPts, bool bKeyFrame) {
+        if (vSamples.empty()) {
+            pFragmentOut = &vOut;
+            nFragmentStart = vOut.size();
+            nReservedSamples = std::max<size_t>(nReservedSamples, 1);
+            vOut.resize(nFragmentStart + GetMoofSize(nReservedSamples) + 8);
+        } else if (pFragmentOut != &vOut) {
+            LOG(ERROR) << "Samples of one fragment must go to the same buffer";
+            return false;
+        }
+        size_t nStart = vOut.size();
+
+        if (eCodec == cdc::CODEC_TYPE_AV1) {
+            const uint8_t *p = pData, *pEnd = pData + nSize;
+            ObuUnit obu;
+            while (p < pEnd && ParseObu(p, pEnd, obu)) {
+                if (obu.nType != OBU_TEMPORAL_DELIMITER) {
+                    vOut.insert(vOut.end(), obu.pData, obu.pData + obu.nSize);
+                }
+                p += obu.nSize;
+            }
+        } else {
+            NAL_CODEC eNalCodec = GetNalCodec(eCodec);
+            SplitNalUnits(pData, nSize, vNal, eNalCodec);
+            size_t nPayload = 0;
+            for (const NalUnit &nal : vNal) {
+                nPayload += IsAudNal(nal.nType, eNalCodec) || IsParameterSetNal(nal.nType, eNalCodec) ? 0 : 4 + nal.nSize;
+            }
+            vOut.resize(nStart + nPayload);
+            uint8_t *p = vOut.data() + nStart;
+            for (const NalUnit &nal : vNal) {
+                if (IsAudNal(nal.nType, eNalCodec) || IsParameterSetNal(nal.nType, eNalCodec)) {
+                    continue;
+                }
+                p = Put32(p, (uint32_t)nal.nSize);
+                memcpy(p, nal.pData, nal.nSize);
+                p += nal.nSize;
+            }
+        }
+
+        Sample sample;
+        sample.nSize = (uint32_t)(vOut.size() - nStart);
+        sample.nDts = nDts;
+        sample.nCompositionOffset = (int32_t)(nPts - nDts);
+        sample.bKeyFrame = bKeyFrame;
+        if (sample.nSize == 0) {
+            LOG(WARNING) << "Sample at dts " << nDts << " has no payload";
+            if (vSamples.empty()) {
+                vOut.resize(nFragmentStart);
+            }
+            return false;
+        }
+        vSamples.push_back(sample);
+        return true;
+    }
+
+    size_t GetPendingSampleCount() const {
+        return vSamples.size();
+    }
+
+    /**
+    *   @brief  Completes the fragment the queued samples were written into: fills in the reserved moof and the
+    *   mdat header in front of the payload, then empties the queue.
+    *   @param  vOut        The buffer passed to AddSample()
+    *   @param  nNextDts    dts of the sample that will follow, for the duration of the last sample; INT64_MIN if unknown
+    */
+    bool WriteFragment(std::vector<uint8_t> &vOut, int64_t nNextDts = INT64_MIN) {
+        if (vSamples.empty()) {
+            return false;
+        }
+        if (pFragmentOut != &vOut) {
+            LOG(ERROR) << "WriteFragment() needs the buffer the samples were added to";
+            return false;
+        }
+
+        // More samples than reserved for: the one case where the payload has to move
+        if (vSamples.size() > nReservedSamples) {
+            size_t nReservedEnd = nFragmentStart + GetMoofSize(nReservedSamples);
+            vOut.insert(vOut.begin() + nReservedEnd, GetMoofSize(vSamples.size()) - GetMoofSize(nReservedSamples), 0);
+            nReservedSamples = vSamples.size();
+        }
+        size_t nTrunSize = 8 + 4 + 4 + 4 + vSamples.size() * 16;
+        size_t nTrafSize = 8 + 16 + 20 + nTrunSize;
+        // Room left by fewer samples than reserved, at least 16 bytes, becomes a free box at the end of the moof
+        size_t nMoofSize = GetMoofSize(nReservedSamples);
+        size_t nFreeSize = nMoofSize - GetMoofSize(vSamples.size());
+        size_t nMdatSize = vOut.size() - nFragmentStart - nMoofSize;
+        if (nMdatSize > UINT32_MAX) {
+            LOG(ERROR) << "Fragment too large";
+            return false;
+        }
+        uint8_t *p = vOut.data() + nFragmentStart;
+
+        p = PutBoxHeader(p, nMoofSize, "moof");
+        p = PutBoxHeader(p, 16, "mfhd");
+        p = Put32(p, 0);
+        p = Put32(p, ++nSequenceNumber);
+
+        p = PutBoxHeader(p, nTrafSize, "traf");
+        p = PutBoxHeader(p, 16, "tfhd");
+        p = Put32(p, 0x020000);         // default-base-is-moof
+        p = Put32(p, nTrackId);
+        p = PutBoxHeader(p, 20, "tfdt");
+        p = Put32(p, 0x01000000);       // version 1
+        p = Put64(p, (uint64_t)vSamples[0].nDts);
+
+        p = PutBoxHeader(p, nTrunSize, "trun");
+        p = Put32(p, 0x01000F01);       // version 1 (signed composition offsets); data offset, duration, size, flags, composition offset
+        p = Put32(p, (uint32_t)vSamples.size());
+        p = Put32(p, (uint32_t)(nMoofSize + 8));
+        for (size_t i = 0; i < vSamples.size(); i++) {
+            const Sample &sample = vSamples[i];
+            int64_t nDuration = i + 1 < vSamples.size() ? vSamples[i + 1].nDts - sample.nDts
+                : nNextDts != INT64_MIN ? nNextDts - sample.nDts
+                : i > 0 ? sample.nDts - vSamples[i - 1].nDts : nDefaultSampleDuration;
+            p = Put32(p, (uint32_t)nDuration);
+            p = Put32(p, sample.nSize);
+            // sample_depends_on = 2 for sync samples, otherwise depends_on = 1 and sample_is_non_sync_sample
+            p = Put32(p, sample.bKeyFrame ? 0x02000000 : 0x01010000);
+            p = Put32(p, (uint32_t)sample.nCompositionOffset);
+        }
+
+        if (nFreeSize) {
+            p = PutBoxHeader(p, nFreeSize, "free");
+            memset(p, 0, nFreeSize - 8);
+            p += nFreeSize - 8;
+        }
+        PutBoxHeader(p, nMdatSize, "mdat");
+
+        // The next fragment most likely has as many samples as this one
+        nReservedSamples = vSamples.size();
+        vSamples.clear();
+        pFragmentOut = NULL;
+        return true;
+    }
+
+private:
+    struct Sample {
+        uint32_t nSize;
+        int64_t nDts;
+        int32_t nCompositionOffset;
+        bool bKeyFrame;
+    };
+
+    void WriteSampleEntry(std::vector<uint8_t> &vOut) {
+        size_t entry = BeginBox(vOut, eCodec == cdc::CODEC_TYPE_AV1 ? "av01" : eCodec == cdc::CODEC_TYPE_H265 ? "hvc1" : "avc1");
+        PutZeros(vOut, 6);
+        Put16(vOut, 1);                 // data_reference_index
+        PutZeros(vOut, 16);             // pre_defined, reserved
+        Put16(vOut, nWidth);
+        Put16(vOut, nHeight);
+        Put32(vOut, 0x00480000);        // 72 dpi
+        Put32(vOut, 0x00480000);
+        Put32(vOut, 0);
+        Put16(vOut, 1);                 // frame_count
+        PutZeros(vOut, 32);             // compressorname
+        Put16(vOut, 0x0018);            // depth
+        Put16(vOut, 0xFFFF);            // pre_defined = -1
+        size_t config = BeginBox(vOut, eCodec == cdc::CODEC_TYPE_AV1 ? "av1C" : eCodec == cdc::CODEC_TYPE_H265 ? "hvcC" : "avcC");
+        vOut.insert(vOut.end(), vConfig.begin(), vConfig.end());
+        EndBox(vOut, config);
+        EndBox(vOut, entry);
+    }
+
+    bool BuildAvcC(const uint8_t *pData, size_t nSize) {
+        SplitNalUnits(pData, nSize, vNal, NAL_CODEC_H264);
+        std::vector<const NalUnit *> vSps, vPps;
+        for (const NalUnit &nal : vNal) {
+            if (nal.nType == H264_NAL_SPS && nal.nSize >= 4) {
+                vSps.push_back(&nal);
+            } else if (nal.nType == H264_NAL_PPS) {
+                vPps.push_back(&nal);
+            }
+        }
+        if (vSps.empty() || vPps.empty()) {
+            return false;
+        }
+
+        std::vector<uint8_t> vRbsp;
+        NalToRbsp(vSps[0]->pData + 1, vSps[0]->nSize - 1, vRbsp);
+        // Emulation prevention bytes are gone, so the RBSP can be shorter than the NAL unit
+        if (vRbsp.size() < 4) {
+            return false;
+        }
+        uint8_t nProfile = vRbsp[0];
+        uint32_t nChromaFormat = 1, nBitDepthLuma = 8, nBitDepthChroma = 8;
+        BitReader br(vRbsp.data() + 3, vRbsp.size() - 3);
+        br.ReadUE();                    // seq_parameter_set_id
+        bool bHighProfile = nProfile == 100 || nProfile == 110 || nProfile == 122 || nProfile == 244 || nProfile == 44
+            || nProfile == 83 || nProfile == 86 || nProfile == 118 || nProfile == 128 || nProfile == 138 || nProfile == 139
+            || nProfile == 134 || nProfile == 135;
+        if (bHighProfile) {
+            nChromaFormat = br.ReadUE();
+            if (nChromaFormat == 3) {
+                br.ReadBit();           // separate_colour_plane_flag
+            }
+            nBitDepthLuma = br.ReadUE() + 8;
+            nBitDepthChroma = br.ReadUE() + 8;
+        }
+
+        vConfig.push_back(1);           // configurationVersion
+        vConfig.push_back(vRbsp[0]);    // AVCProfileIndication
+        vConfig.push_back(vRbsp[1]);    // profile_compatibility
+        vConfig.push_back(vRbsp[2]);    // AVCLevelIndication
+        vConfig.push_back(0xFF);        // lengthSizeMinusOne = 3
+        vConfig.push_back(0xE0 | (uint8_t)vSps.size());
+        for (const NalUnit *pNal : vSps) {
+            AppendParameterSet(*pNal);
+        }
+        vConfig.push_back((uint8_t)vPps.size());
+        for (const NalUnit *pNal : vPps) {
+            AppendParameterSet(*pNal);
+        }
+        if (nProfile == 100 || nProfile == 110 || nProfile == 122 || nProfile == 144) {
+            vConfig.push_back(0xFC | (uint8_t)nChromaFormat);
+            vConfig.push_back(0xF8 | (uint8_t)(nBitDepthLuma - 8));
+            vConfig.push_back(0xF8 | (uint8_t)(nBitDepthChroma - 8));
+            vConfig.push_back(0);       // numOfSequenceParameterSetExt
+        }
+        return !br.IsOverrun();
+    }
+
+    bool BuildHvcC(const uint8_t *pData, size_t nSize) {
+        SplitNalUnits(pData, nSize, vNal, NAL_CODEC_HEVC);
+        const NalUnit *pSps = NULL;
+        for (const NalUnit &nal : vNal) {
+            if (nal.nType == HEVC_NAL_SPS) {
+                pSps = &nal;
+                break;
+            }
+        }
+        if (!pSps || pSps->nSize < 15) {
+            return false;
+        }
+
+        // sps_video_parameter_set_id, sps_max_sub_layers_minus1 and the nesting flag share the first byte;
+        // the general part of profile_tier_level() follows byte aligned and maps 1:1 onto hvcC
+        std::vector<uint8_t> vRbsp;
+        NalToRbsp(pSps->pData + 2, pSps->nSize - 2, vRbsp);
+        // The fixed 13 bytes of profile_tier_level() may contain emulation prevention bytes
+        if (vRbsp.size() < 14) {
+            return false;
+        }
+        int nMaxSubLayersMinus1 = (vRbsp[0] >> 1) & 7;
+        bool bTemporalIdNested = vRbsp[0] & 1;
+
+        BitReader br(vRbsp.data() + 13, vRbsp.size() - 13);
+        uint32_t aSubLayerFlags[8] = {};
+        for (int i = 0; i < nMaxSubLayersMinus1; i++) {
+            aSubLayerFlags[i] = br.ReadBits(2);
+        }
+        if (nMaxSubLayersMinus1 > 0) {
+            br.SkipBits(2 * (8 - nMaxSubLayersMinus1));
+        }
+        for (int i = 0; i < nMaxSubLayersMinus1; i++) {
+            br.SkipBits(((aSubLayerFlags[i] & 2) ? 88 : 0) + ((aSubLayerFlags[i] & 1) ? 8 : 0));
+        }
+        br.ReadUE();                    // sps_seq_parameter_set_id
+        uint32_t nChromaFormat = br.ReadUE();
+        if (nChromaFormat == 3) {
+            br.ReadBit();
+        }
+        br.ReadUE();                    // pic_width_in_luma_samples
+        br.ReadUE();                    // pic_height_in_luma_samples
+        if (br.ReadBit()) {             // conformance_window_flag
+            for (int i = 0; i < 4; i++) {
+                br.ReadUE();
+            }
+        }
+        uint32_t nBitDepthLuma = br.ReadUE() + 8;
+        uint32_t nBitDepthChroma = br.ReadUE() + 8;
+        if (br.IsOverrun()) {
+            return false;
+        }
+
+        vConfig.push_back(1);
+        vConfig.insert(vConfig.end(), vRbsp.begin() + 1, vRbsp.begin() + 13);
+        vConfig.push_back(0xF0);        // min_spatial_segmentation_idc = 0
+        vConfig.push_back(0x00);
+        vConfig.push_back(0xFC);        // parallelismType = 0
+        vConfig.push_back(0xFC | (uint8_t)nChromaFormat);
+        vConfig.push_back(0xF8 | (uint8_t)(nBitDepthLuma - 8));
+        vConfig.push_back(0xF8 | (uint8_t)(nBitDepthChroma - 8));
+        vConfig.push_back(0);           // avgFrameRate
+        vConfig.push_back(0);
+        vConfig.push_back((uint8_t)(((nMaxSubLayersMinus1 + 1) << 3) | (bTemporalIdNested << 2) | 3));
+
+        const uint8_t aArrayTypes[] = {HEVC_NAL_VPS, HEVC_NAL_SPS, HEVC_NAL_PPS};
+        size_t nArrayCountPos = vConfig.size();
+        vConfig.push_back(0);
+        for (uint8_t nType : aArrayTypes) {
+            size_t nCount = 0;
+            for (const NalUnit &nal : vNal) {
+                nCount += nal.nType == nType;
+            }
+            if (!nCount) {
+                continue;
+            }
+            vConfig[nArrayCountPos]++;
+            vConfig.push_back(0x80 | nType); // array_completeness = 1
+            vConfig.push_back((uint8_t)(nCount >> 8));
+            vConfig.push_back((uint8_t)nCount);
+            for (const NalUnit &nal : vNal) {
+                if (nal.nType == nType) {
+                    AppendParameterSet(nal);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool BuildAv1C(const uint8_t *pData, size_t nSize) {
+        const uint8_t *p = pData, *pEnd = pData + nSize;
+        ObuUnit obu;
+        while (p < pEnd && ParseObu(p, pEnd, obu)) {
+            if (obu.nType == OBU_SEQUENCE_HEADER) {
+                Av1SequenceHeader seq;
+                if (!ParseSequenceHeader(obu.pPayload, obu.nPayloadSize, seq)) {
+                    return false;
+                }
+                vConfig.push_back(0x81);    // marker, version 1
+                vConfig.push_back((uint8_t)((seq.nProfile << 5) | seq.nLevelIdx));
+                vConfig.push_back((uint8_t)((seq.nTier << 7) | ((seq.nBitDepth > 8) << 6) | ((seq.nBitDepth == 12) << 5)
+                    | (seq.bMonochrome << 4) | (seq.nSubsamplingX << 3) | (seq.nSubsamplingY << 2) | seq.nChromaSamplePosition));
+                vConfig.push_back(0);       // no initial_presentation_delay
+                vConfig.insert(vConfig.end(), obu.pData, obu.pData + obu.nSize);
+                return true;
+            }
+            p += obu.nSize;
+        }
+        return false;
+    }
+
+    void AppendParameterSet(const NalUnit &nal) {
+        vConfig.push_back((uint8_t)(nal.nSize >> 8));
+        vConfig.push_back((uint8_t)nal.nSize);
+        vConfig.insert(vConfig.end(), nal.pData, nal.pData + nal.nSize);
+    }
+
+    static size_t BeginBox(std::vector<uint8_t> &v, const char *szType) {
+        size_t nStart = v.size();
+        Put32(v, 0);
+        PutFourCC(v, szType);
+        return nStart;
+    }
+    static size_t BeginFullBox(std::vector<uint8_t> &v, const char *szType, uint8_t nVersion, uint32_t nFlags) {
+        size_t nStart = BeginBox(v, szType);
+        Put32(v, ((uint32_t)nVersion << 24) | nFlags);
+        return nStart;
+    }
+    static void EndBox(std::vector<uint8_t> &v, size_t nStart) {
+        Put32(v.data() + nStart, (uint32_t)(v.size() - nStart));
+    }
+
+    static void Put16(std::vector<uint8_t> &v, uint32_t n) {
+        v.push_back((uint8_t)(n >> 8));
+        v.push_back((uint8_t)n);
+    }
+    static void Put32(std::vector<uint8_t> &v, uint32_t n) {
+        uint8_t a[4];
+        Put32(a, n);
+        v.insert(v.end(), a, a + 4);
+    }
+    static void PutFourCC(std::vector<uint8_t> &v, const char *szType) {
+        v.insert(v.end(), szType, szType + 4);
+    }
+    static void PutZeros(std::vector<uint8_t> &v, size_t n) {
+        v.insert(v.end(), n, 0);
+    }
+    static void PutMatrix(std::vector<uint8_t> &v) {
+        const uint32_t aMatrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+        for (uint32_t n : aMatrix) {
+            Put32(v, n);
+        }
+    }
+
+    static uint8_t *Put32(uint8_t *p, uint32_t n) {
+        p[0] = (uint8_t)(n >> 24);
+        p[1] = (uint8_t)(n >> 16);
+        p[2] = (uint8_t)(n >> 8);
+        p[3] = (uint8_t)n;
+        return p + 4;
+    }
+    static uint8_t *Put64(uint8_t *p, uint64_t n) {
+        return Put32(Put32(p, (uint32_t)(n >> 32)), (uint32_t)n);
+    }
+    // mfhd, tfhd and tfdt, the trun with nSamples entries, and the moof and traf headers
+    static size_t GetMoofSize(size_t nSamples) {
+        return 8 + 16 + 8 + 16 + 20 + 8 + 4 + 4 + 4 + nSamples * 16;
+    }
+    static uint8_t *PutBoxHeader(uint8_t *p, size_t nSize, const char *szType) {
+        p = Put32(p, (uint32_t)nSize);
+        memcpy(p, szType, 4);
+        return p + 4;
+    }
+
+private:
+    static const uint32_t nTrackId = 1;
+    cdc::CodecType eCodec;
+    uint32_t nWidth, nHeight;
+    uint32_t nTimescale;
+    uint32_t nDefaultSampleDuration;
+    uint32_t nSequenceNumber = 0;
+    std::vector<uint8_t> vConfig;       /*!< avcC/hvcC/av1C payload */
+    std::vector<Sample> vSamples;       /*!< Samples of the fragment being built, capacity is reused */
+    const std::vector<uint8_t> *pFragmentOut = NULL;    /*!< Buffer the fragment is built in */
+    size_t nFragmentStart = 0;          /*!< Offset of its moof in that buffer */
+    size_t nReservedSamples = 0;        /*!< trun entries the reserved moof has room for */
+    std::vector<NalUnit> vNal;
+};
@@ -0,0 +1,758 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "ColorSpaceMath.h"
+#include "HostSimd.h"
+
+//---------------------------------------------------------------------------
+//! \file HostColorConvert.h
+//! \brief CPU conversions for frames in host memory: I420 <-> NV12, I010 <-> P010 and
+//! BGRA <-> NV12 with BT.601/709/2020 matrices.
+//!
+//! Every conversion is a loop over row kernels picked once at run time from the best
+//! instruction set the CPU has (AVX2, SSE4.1, NEON, or plain C++). All variants use the
+//! same fixed-point arithmetic and give bit-identical output. Frames of 4K and above are
+//! split into row bands converted on several threads. Pitches are in bytes throughout.
+//---------------------------------------------------------------------------
+
+// Frames with at least this many pixels are converted by several threads
+#define HOST_COLOR_MT_MIN_PIXELS (3840 * 2160)
+#define HOST_COLOR_MAX_THREADS 8
+
+/**
+* @brief Q14 weights in B, G, R order. Y = (w . bgr + nYBias) >> 14; chroma is computed from the sum of a 2x2 block,
+* C = (w . bgr_sum + nCBias) >> 16.
+*/
+struct HostRgbToYuvCoeffs {
+    int16_t anY[3], anU[3], anV[3];
+    int32_t nYBias, nCBias;
+};
+
+/**
+* @brief Q13 weights; y, u and v have their offsets removed, e.g. R = (nY * y + nRV * v + 4096) >> 13.
+*/
+struct HostYuvToRgbCoeffs {
+    int16_t nY, nRV, nGU, nGV, nBU;
+    int16_t nYOffset;
+};
+
+inline int16_t RoundToFixed(float f, int nFracBits) {
+    f *= (float)(1 << nFracBits);
+    return (int16_t)(f < 0.0f ? f - 0.5f : f + 0.5f);
+}
+
+inline HostRgbToYuvCoeffs MakeHostRgbToYuvCoeffs(int iMatrix, bool bFullRange) {
+    RgbToYuvMatrix mat = MakeRgbToYuvMatrix(iMatrix, bFullRange);
+    HostRgbToYuvCoeffs c;
+    int16_t *apRow[3] = {c.anY, c.anU, c.anV};
+    for (int i = 0; i < 3; i++) {
+        apRow[i][0] = RoundToFixed(mat.m[i][2], 14);
+        apRow[i][1] = RoundToFixed(mat.m[i][1], 14);
+        apRow[i][2] = RoundToFixed(mat.m[i][0], 14);
+    }
+    c.nYBias = ((int32_t)mat.fOffsetY << 14) + (1 << 13);
+    c.nCBias = ((int32_t)mat.fOffsetC << 16) + (1 << 15);
+    return c;
+}
+
+inline HostYuvToRgbCoeffs MakeHostYuvToRgbCoeffs(int iMatrix, bool bFullRange) {
+    YuvToRgbMatrix mat = MakeYuvToRgbMatrix(iMatrix, bFullRange);
+    HostYuvToRgbCoeffs c;
+    c.nY = RoundToFixed(mat.m[0][0], 13);
+    c.nRV = RoundToFixed(mat.m[0][2], 13);
+    c.nGU = RoundToFixed(mat.m[1][1], 13);
+    c.nGV = RoundToFixed(mat.m[1][2], 13);
+    c.nBU = RoundToFixed(mat.m[2][1], 13);
+    c.nYOffset = (int16_t)mat.fOffsetY;
+    return c;
+}
+
+inline uint8_t ClampFixedToUint8(int32_t n) {
+    return n < 0 ? 0 : (n > 255 ? 255 : (uint8_t)n);
+}
+
+/**
+* @brief Row kernels of one instruction set. n counts chroma pairs for the (de)interleavers and samples for ShiftRow16.
+* The BGRA to NV12 kernel takes two source rows and writes both luma rows and their chroma row.
+*/
+struct HostColorKernels {
+    void (*InterleaveUv8)(const uint8_t *pU, const uint8_t *pV, uint8_t *pUv, int n);
+    void (*DeinterleaveUv8)(const uint8_t *pUv, uint8_t *pU, uint8_t *pV, int n);
+    // Interleaving shifts left by nShift, deinterleaving shifts right; I010 <-> P010 uses 6
+    void (*InterleaveUv16)(const uint16_t *pU, const uint16_t *pV, uint16_t *pUv, int n, int nShift);
+    void (*DeinterleaveUv16)(const uint16_t *pUv, uint16_t *pU, uint16_t *pV, int n, int nShift);
+    // nShift > 0 shifts left, < 0 right; pSrc may equal pDst
+    void (*ShiftRow16)(const uint16_t *pSrc, uint16_t *pDst, int n, int nShift);
+    void (*BgraToNv12Rows)(const uint8_t *pBgra0, const uint8_t *pBgra1, uint8_t *pY0, uint8_t *pY1, uint8_t *pUv, int nWidth,
+        const HostRgbToYuvCoeffs &c);
+    void (*Nv12ToBgraRow)(const uint8_t *pY, const uint8_t *pUv, uint8_t *pBgra, int nWidth, const HostYuvToRgbCoeffs &c);
+};
+
+inline void InterleaveUv8Scalar(const uint8_t *pU, const uint8_t *pV, uint8_t *pUv, int n) {
+    for (int i = 0; i < n; i++) {
+        pUv[2 * i] = pU[i];
+        pUv[2 * i + 1] = pV[i];
+    }
+}
+
+inline void DeinterleaveUv8Scalar(const uint8_t *pUv, uint8_t *pU, uint8_t *pV, int n) {
+    for (int i = 0; i < n; i++) {
+        pU[i] = pUv[2 * i];
+        pV[i] = pUv[2 * i + 1];
+    }
+}
+
+inline void InterleaveUv16Scalar(const uint16_t *pU, const uint16_t *pV, uint16_t *pUv, int n, int nShift) {
+    for (int i = 0; i < n; i++) {
+        pUv[2 * i] = (uint16_t)(pU[i] << nShift);
+        pUv[2 * i + 1] = (uint16_t)(pV[i] << nShift);
+    }
+}
+
+inline void DeinterleaveUv16Scalar(const uint16_t *pUv, uint16_t *pU, uint16_t *pV, int n, int nShift) {
+    for (int i = 0; i < n; i++) {
+        pU[i] = pUv[2 * i] >> nShift;
+        pV[i] = pUv[2 * i + 1] >> nShift;
+    }
+}
+
+inline void ShiftRow16Scalar(const uint16_t *pSrc, uint16_t *pDst, int n, int nShift) {
+    for (int i = 0; i < n; i++) {
+        pDst[i] = nShift >= 0 ? (uint16_t)(pSrc[i] << nShift) : (uint16_t)(pSrc[i] >> -nShift);
+    }
+}
+
+/**
+* @brief Also finishes the columns left over by the SIMD kernels. An odd last column is replicated into the chroma sum.
+*/
+inline void BgraToNv12RowsScalar(const uint8_t *pBgra0, const uint8_t *pBgra1, uint8_t *pY0, uint8_t *pY1, uint8_t *pUv, int nWidth,
+    const HostRgbToYuvCoeffs &c) {
+    for (int x = 0; x < nWidth; x += 2) {
+        int x1 = x + 1 < nWidth ? x + 1 : x;
+        const uint8_t *ap[4] = {pBgra0 + 4 * x, pBgra0 + 4 * x1, pBgra1 + 4 * x, pBgra1 + 4 * x1};
+        uint8_t *apY[4] = {pY0 + x, pY0 + x1, pY1 + x, pY1 + x1};
+        int32_t anSum[3] = {};
+        for (int i = 0; i < 4; i++) {
+            const uint8_t *p = ap[i];
+            *apY[i] = ClampFixedToUint8((c.anY[0] * p[0] + c.anY[1] * p[1] + c.anY[2] * p[2] + c.nYBias) >> 14);
+            anSum[0] += p[0];
+            anSum[1] += p[1];
+            anSum[2] += p[2];
+        }
+        pUv[x] = ClampFixedToUint8((c.anU[0] * anSum[0] + c.anU[1] * anSum[1] + c.anU[2] * anSum[2] + c.nCBias) >> 16);
+        pUv[x + 1] = ClampFixedToUint8((c.anV[0] * anSum[0] + c.anV[1] * anSum[1] + c.anV[2] * anSum[2] + c.nCBias) >> 16);
+    }
+}
+
+inline void Nv12ToBgraRowScalar(const uint8_t *pY, const uint8_t *pUv, uint8_t *pBgra, int nWidth, const HostYuvToRgbCoeffs &c) {
+    for (int x = 0; x < nWidth; x++) {
+        int32_t y = c.nY * (pY[x] - c.nYOffset), u = pUv[x / 2 * 2] - 128, v = pUv[x / 2 * 2 + 1] - 128;
+        uint8_t *p = pBgra + 4 * x;
+        p[0] = ClampFixedToUint8((y + c.nBU * u + 4096) >> 13);
+        p[1] = ClampFixedToUint8((y + c.nGU * u + c.nGV * v + 4096) >> 13);
+        p[2] = ClampFixedToUint8((y + c.nRV * v + 4096) >> 13);
+        p[3] = 255;
+    }
+}
+
+#if defined(HOSTCC_X86)
+HOSTCC_TARGET_SSE41 inline void InterleaveUv8Sse41(const uint8_t *pU, const uint8_t *pV, uint8_t *pUv, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i u = _mm_loadu_si128((const __m128i *)(pU + i)), v = _mm_loadu_si128((const __m128i *)(pV + i));
+        _mm_storeu_si128((__m128i *)(pUv + 2 * i), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i *)(pUv + 2 * i + 16), _mm_unpackhi_epi8(u, v));
+    }
+    InterleaveUv8Scalar(pU + i, pV + i, pUv + 2 * i, n - i);
+}
+
+HOSTCC_TARGET_SSE41 inline void DeinterleaveUv8Sse41(const uint8_t *pUv, uint8_t *pU, uint8_t *pV, int n) {
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pUv + 2 * i)), b = _mm_loadu_si128((const __m128i *)(pUv + 2 * i + 16));
+        _mm_storeu_si128((__m128i *)(pU + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(pV + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+    DeinterleaveUv8Scalar(pUv + 2 * i, pU + i, pV + i, n - i);
+}
+
+HOSTCC_TARGET_SSE41 inline void InterleaveUv16Sse41(const uint16_t *pU, const uint16_t *pV, uint16_t *pUv, int n, int nShift) {
+    const __m128i shift = _mm_cvtsi32_si128(nShift);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i u = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(pU + i)), shift);
+        __m128i v = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(pV + i)), shift);
+        _mm_storeu_si128((__m128i *)(pUv + 2 * i), _mm_unpacklo_epi16(u, v));
+        _mm_storeu_si128((__m128i *)(pUv + 2 * i + 8), _mm_unpackhi_epi16(u, v));
+    }
+    InterleaveUv16Scalar(pU + i, pV + i, pUv + 2 * i, n - i, nShift);
+}
+
+HOSTCC_TARGET_SSE41 inline void DeinterleaveUv16Sse41(const uint16_t *pUv, uint16_t *pU, uint16_t *pV, int n, int nShift) {
+    const __m128i shift = _mm_cvtsi32_si128(nShift), mask = _mm_set1_epi32(0xFFFF);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(pUv + 2 * i)), shift);
+        __m128i b = _mm_srl_epi16(_mm_loadu_si128((const __m128i *)(pUv + 2 * i + 8)), shift);
+        _mm_storeu_si128((__m128i *)(pU + i), _mm_packus_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(pV + i), _mm_packus_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16)));
+    }
+    DeinterleaveUv16Scalar(pUv + 2 * i, pU + i, pV + i, n - i, nShift);
+}
+
+HOSTCC_TARGET_SSE41 inline void ShiftRow16Sse41(const uint16_t *pSrc, uint16_t *pDst, int n, int nShift) {
+    const __m128i shift = _mm_cvtsi32_si128(nShift >= 0 ? nShift : -nShift);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pSrc + i));
+        _mm_storeu_si128((__m128i *)(pDst + i), nShift >= 0 ? _mm_sll_epi16(a, shift) : _mm_srl_epi16(a, shift));
+    }
+    ShiftRow16Scalar(pSrc + i, pDst + i, n - i, nShift);
+}
+
+// Luma of 8 BGRA pixels held in a0 (pixels 0-3) and a1 (4-7), in the low 8 bytes of the result
+HOSTCC_TARGET_SSE41 inline __m128i BgraToLuma8Sse41(__m128i a0, __m128i a1, __m128i coeff, __m128i bias) {
+    __m128i s0 = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(a0), coeff), _mm_madd_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a0, 8)), coeff));
+    __m128i s1 = _mm_hadd_epi32(_mm_madd_epi16(_mm_cvtepu8_epi16(a1), coeff), _mm_madd_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a1, 8)), coeff));
+    s0 = _mm_srai_epi32(_mm_add_epi32(s0, bias), 14);
+    s1 = _mm_srai_epi32(_mm_add_epi32(s1, bias), 14);
+    return _mm_packus_epi16(_mm_packs_epi32(s0, s1), _mm_setzero_si128());
+}
+
+// Interleaved UV of the four 2x2 blocks of 8 BGRA pixels on two rows, in the low 8 bytes of the result
+HOSTCC_TARGET_SSE41 inline __m128i BgraToChroma8Sse41(__m128i a0, __m128i a1, __m128i b0, __m128i b1, __m128i coeffU, __m128i coeffV,
+    __m128i bias) {
+    // Column sums of pixel pairs, then [block 2k | block 2k + 1] sums of B, G, R, A
+    __m128i s01 = _mm_add_epi16(_mm_cvtepu8_epi16(a0), _mm_cvtepu8_epi16(b0));
+    __m128i s23 = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a0, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(b0, 8)));
+    __m128i s45 = _mm_add_epi16(_mm_cvtepu8_epi16(a1), _mm_cvtepu8_epi16(b1));
+    __m128i s67 = _mm_add_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(a1, 8)), _mm_cvtepu8_epi16(_mm_srli_si128(b1, 8)));
+    __m128i blk01 = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+    __m128i blk23 = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+    __m128i u = _mm_hadd_epi32(_mm_madd_epi16(blk01, coeffU), _mm_madd_epi16(blk23, coeffU));
+    __m128i v = _mm_hadd_epi32(_mm_madd_epi16(blk01, coeffV), _mm_madd_epi16(blk23, coeffV));
+    u = _mm_srai_epi32(_mm_add_epi32(u, bias), 16);
+    v = _mm_srai_epi32(_mm_add_epi32(v, bias), 16);
+    __m128i uv = _mm_packs_epi32(_mm_unpacklo_epi32(u, v), _mm_unpackhi_epi32(u, v));
+    return _mm_packus_epi16(uv, _mm_setzero_si128());
+}
+
+HOSTCC_TARGET_SSE41 inline void BgraToNv12RowsSse41(const uint8_t *pBgra0, const uint8_t *pBgra1, uint8_t *pY0, uint8_t *pY1, uint8_t *pUv,
+    int nWidth, const HostRgbToYuvCoeffs &c) {
+    const __m128i coeffY = _mm_setr_epi16(c.anY[0], c.anY[1], c.anY[2], 0, c.anY[0], c.anY[1], c.anY[2], 0);
+    const __m128i coeffU = _mm_setr_epi16(c.anU[0], c.anU[1], c.anU[2], 0, c.anU[0], c.anU[1], c.anU[2], 0);
+    const __m128i coeffV = _mm_setr_epi16(c.anV[0], c.anV[1], c.anV[2], 0, c.anV[0], c.anV[1], c.anV[2], 0);
+    const __m128i biasY = _mm_set1_epi32(c.nYBias), biasC = _mm_set1_epi32(c.nCBias);
+    int x = 0;
+    for (; x + 8 <= nWidth; x += 8) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(pBgra0 + 4 * x)), a1 = _mm_loadu_si128((const __m128i *)(pBgra0 + 4 * x + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(pBgra1 + 4 * x)), b1 = _mm_loadu_si128((const __m128i *)(pBgra1 + 4 * x + 16));
+        _mm_storel_epi64((__m128i *)(pY0 + x), BgraToLuma8Sse41(a0, a1, coeffY, biasY));
+        _mm_storel_epi64((__m128i *)(pY1 + x), BgraToLuma8Sse41(b0, b1, coeffY, biasY));
+        _mm_storel_epi64((__m128i *)(pUv + x), BgraToChroma8Sse41(a0, a1, b0, b1, coeffU, coeffV, biasC));
+    }
+    BgraToNv12RowsScalar(pBgra0 + 4 * x, pBgra1 + 4 * x, pY0 + x, pY1 + x, pUv + x, nWidth - x, c);
+}
+
+HOSTCC_TARGET_SSE41 inline void Nv12ToBgraRowSse41(const uint8_t *pY, const uint8_t *pUv, uint8_t *pBgra, int nWidth, const HostYuvToRgbCoeffs &c) {
+    const __m128i yOffset = _mm_set1_epi16(c.nYOffset), cOffset = _mm_set1_epi16(128), zero = _mm_setzero_si128();
+    const __m128i coeffYR = _mm_setr_epi16(c.nY, c.nRV, c.nY, c.nRV, c.nY, c.nRV, c.nY, c.nRV);
+    const __m128i coeffYG = _mm_setr_epi16(c.nY, c.nGU, c.nY, c.nGU, c.nY, c.nGU, c.nY, c.nGU);
+    const __m128i coeffYB = _mm_setr_epi16(c.nY, c.nBU, c.nY, c.nBU, c.nY, c.nBU, c.nY, c.nBU);
+    const __m128i coeffG = _mm_setr_epi16(c.nGV, 0, c.nGV, 0, c.nGV, 0, c.nGV, 0);
+    const __m128i round = _mm_set1_epi32(4096), alpha = _mm_set1_epi16(255);
+    const __m128i dupU = _mm_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m128i dupV = _mm_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+    int x = 0;
+    for (; x + 8 <= nWidth; x += 8) {
+        __m128i y = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(pY + x))), yOffset);
+        __m128i uv = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(pUv + x))), cOffset);
+        __m128i u = _mm_shuffle_epi8(uv, dupU), v = _mm_shuffle_epi8(uv, dupV);
+        __m128i yvLo = _mm_unpacklo_epi16(y, v), yvHi = _mm_unpackhi_epi16(y, v);
+        __m128i yuLo = _mm_unpacklo_epi16(y, u), yuHi = _mm_unpackhi_epi16(y, u);
+        __m128i vLo = _mm_unpacklo_epi16(v, zero), vHi = _mm_unpackhi_epi16(v, zero);
+        __m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yvLo, coeffYR), round), 13),
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yvHi, coeffYR), round), 13));
+        __m128i g = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yuLo, coeffYG), _mm_madd_epi16(vLo, coeffG)), round), 13),
+            _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(yuHi, coeffYG), _mm_madd_epi16(vHi, coeffG)), round), 13));
+        __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuLo, coeffYB), round), 13),
+            _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuHi, coeffYB), round), 13));
+        __m128i br = _mm_packus_epi16(b, r), ga = _mm_packus_epi16(g, alpha);
+        __m128i bg = _mm_unpacklo_epi8(br, ga), ra = _mm_unpackhi_epi8(br, ga);
+        _mm_storeu_si128((__m128i *)(pBgra + 4 * x), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i *)(pBgra + 4 * x + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+    Nv12ToBgraRowScalar(pY + x, pUv + x, pBgra + 4 * x, nWidth - x, c);
+}
+
+HOSTCC_TARGET_AVX2 inline void InterleaveUv8Avx2(const uint8_t *pU, const uint8_t *pV, uint8_t *pUv, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i u = _mm256_loadu_si256((const __m256i *)(pU + i)), v = _mm256_loadu_si256((const __m256i *)(pV + i));
+        __m256i lo = _mm256_unpacklo_epi8(u, v), hi = _mm256_unpackhi_epi8(u, v);
+        _mm256_storeu_si256((__m256i *)(pUv + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pUv + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveUv8Sse41(pU + i, pV + i, pUv + 2 * i, n - i);
+}
+
+HOSTCC_TARGET_AVX2 inline void DeinterleaveUv8Avx2(const uint8_t *pUv, uint8_t *pU, uint8_t *pV, int n) {
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pUv + 2 * i)), b = _mm256_loadu_si256((const __m256i *)(pUv + 2 * i + 32));
+        // packus works within 128-bit lanes; 0xD8 puts the quarters back in order
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(pU + i), _mm256_permute4x64_epi64(u, 0xD8));
+        _mm256_storeu_si256((__m256i *)(pV + i), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    DeinterleaveUv8Sse41(pUv + 2 * i, pU + i, pV + i, n - i);
+}
+
+HOSTCC_TARGET_AVX2 inline void InterleaveUv16Avx2(const uint16_t *pU, const uint16_t *pV, uint16_t *pUv, int n, int nShift) {
+    const __m128i shift = _mm_cvtsi32_si128(nShift);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i u = _mm256_sll_epi16(_mm256_loadu_si256((const __m256i *)(pU + i)), shift);
+        __m256i v = _mm256_sll_epi16(_mm256_loadu_si256((const __m256i *)(pV + i)), shift);
+        __m256i lo = _mm256_unpacklo_epi16(u, v), hi = _mm256_unpackhi_epi16(u, v);
+        _mm256_storeu_si256((__m256i *)(pUv + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pUv + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    InterleaveUv16Sse41(pU + i, pV + i, pUv + 2 * i, n - i, nShift);
+}
+
+HOSTCC_TARGET_AVX2 inline void DeinterleaveUv16Avx2(const uint16_t *pUv, uint16_t *pU, uint16_t *pV, int n, int nShift) {
+    const __m128i shift = _mm_cvtsi32_si128(nShift);
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(pUv + 2 * i)), shift);
+        __m256i b = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)(pUv + 2 * i + 16)), shift);
+        __m256i u = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *)(pU + i), _mm256_permute4x64_epi64(u, 0xD8));
+        _mm256_storeu_si256((__m256i *)(pV + i), _mm256_permute4x64_epi64(v, 0xD8));
+    }
+    DeinterleaveUv16Sse41(pUv + 2 * i, pU + i, pV + i, n - i, nShift);
+}
+
+HOSTCC_TARGET_AVX2 inline void ShiftRow16Avx2(const uint16_t *pSrc, uint16_t *pDst, int n, int nShift) {
+    const __m128i shift = _mm_cvtsi32_si128(nShift >= 0 ? nShift : -nShift);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pSrc + i));
+        _mm256_storeu_si256((__m256i *)(pDst + i), nShift >= 0 ? _mm256_sll_epi16(a, shift) : _mm256_srl_epi16(a, shift));
+    }
+    ShiftRow16Sse41(pSrc + i, pDst + i, n - i, nShift);
+}
+
+// Luma of 16 BGRA pixels held in a0 (pixels 0-7) and a1 (8-15)
+HOSTCC_TARGET_AVX2 inline __m128i BgraToLuma16Avx2(__m256i a0, __m256i a1, __m256i coeff, __m256i bias) {
+    __m256i m0 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a0)), coeff);
+    __m256i m1 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a0, 1)), coeff);
+    __m256i m2 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a1)), coeff);
+    __m256i m3 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a1, 1)), coeff);
+    // Lanes hold pixels [0 1 4 5 | 2 3 6 7] and [8 9 12 13 | 10 11 14 15]
+    __m256i s0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(m0, m1), bias), 14);
+    __m256i s1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_hadd_epi32(m2, m3), bias), 14);
+    __m256i y = _mm256_packus_epi16(_mm256_packs_epi32(s0, s1), _mm256_setzero_si256());
+    return _mm_unpacklo_epi16(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+}
+
+/**
+* @brief Luma at 16 pixels per step; chroma goes through the 128-bit block helper, which is not worth widening.
+*/
+HOSTCC_TARGET_AVX2 inline void BgraToNv12RowsAvx2(const uint8_t *pBgra0, const uint8_t *pBgra1, uint8_t *pY0, uint8_t *pY1, uint8_t *pUv,
+    int nWidth, const HostRgbToYuvCoeffs &c) {
+    const __m256i coeffY = _mm256_setr_epi16(c.anY[0], c.anY[1], c.anY[2], 0, c.anY[0], c.anY[1], c.anY[2], 0,
+        c.anY[0], c.anY[1], c.anY[2], 0, c.anY[0], c.anY[1], c.anY[2], 0);
+    const __m128i coeffU = _mm_setr_epi16(c.anU[0], c.anU[1], c.anU[2], 0, c.anU[0], c.anU[1], c.anU[2], 0);
+    const __m128i coeffV = _mm_setr_epi16(c.anV[0], c.anV[1], c.anV[2], 0, c.anV[0], c.anV[1], c.anV[2], 0);
+    const __m256i biasY = _mm256_set1_epi32(c.nYBias);
+    const __m128i biasC = _mm_set1_epi32(c.nCBias);
+    int x = 0;
+    for (; x + 16 <= nWidth; x += 16) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(pBgra0 + 4 * x)), a1 = _mm256_loadu_si256((const __m256i *)(pBgra0 + 4 * x + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(pBgra1 + 4 * x)), b1 = _mm256_loadu_si256((const __m256i *)(pBgra1 + 4 * x + 32));
+        _mm_storeu_si128((__m128i *)(pY0 + x), BgraToLuma16Avx2(a0, a1, coeffY, biasY));
+        _mm_storeu_si128((__m128i *)(pY1 + x), BgraToLuma16Avx2(b0, b1, coeffY, biasY));
+        __m128i uv0 = BgraToChroma8Sse41(_mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1), _mm256_castsi256_si128(b0),
+            _mm256_extracti128_si256(b0, 1), coeffU, coeffV, biasC);
+        __m128i uv1 = BgraToChroma8Sse41(_mm256_castsi256_si128(a1), _mm256_extracti128_si256(a1, 1), _mm256_castsi256_si128(b1),
+            _mm256_extracti128_si256(b1, 1), coeffU, coeffV, biasC);
+        _mm_storeu_si128((__m128i *)(pUv + x), _mm_unpacklo_epi64(uv0, uv1));
+    }
+    BgraToNv12RowsSse41(pBgra0 + 4 * x, pBgra1 + 4 * x, pY0 + x, pY1 + x, pUv + x, nWidth - x, c);
+}
+
+HOSTCC_TARGET_AVX2 inline void Nv12ToBgraRowAvx2(const uint8_t *pY, const uint8_t *pUv, uint8_t *pBgra, int nWidth, const HostYuvToRgbCoeffs &c) {
+    const __m256i yOffset = _mm256_set1_epi16(c.nYOffset), cOffset = _mm256_set1_epi16(128), zero = _mm256_setzero_si256();
+    const __m256i coeffYR = _mm256_set1_epi32((int32_t)(uint16_t)c.nY | ((int32_t)c.nRV << 16));
+    const __m256i coeffYG = _mm256_set1_epi32((int32_t)(uint16_t)c.nY | ((int32_t)c.nGU << 16));
+    const __m256i coeffYB = _mm256_set1_epi32((int32_t)(uint16_t)c.nY | ((int32_t)c.nBU << 16));
+    const __m256i coeffG = _mm256_set1_epi32((int32_t)(uint16_t)c.nGV);
+    const __m256i round = _mm256_set1_epi32(4096), alpha = _mm256_set1_epi16(255);
+    const __m256i dupU = _mm256_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13, 0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m256i dupV = _mm256_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15, 2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+    int x = 0;
+    for (; x + 16 <= nWidth; x += 16) {
+        // Lane 0 holds pixels 0-7 and their chroma, lane 1 pixels 8-15
+        __m256i y = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pY + x))), yOffset);
+        __m256i uv = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pUv + x))), cOffset);
+        __m256i u = _mm256_shuffle_epi8(uv, dupU), v = _mm256_shuffle_epi8(uv, dupV);
+        __m256i yvLo = _mm256_unpacklo_epi16(y, v), yvHi = _mm256_unpackhi_epi16(y, v);
+        __m256i yuLo = _mm256_unpacklo_epi16(y, u), yuHi = _mm256_unpackhi_epi16(y, u);
+        __m256i vLo = _mm256_unpacklo_epi16(v, zero), vHi = _mm256_unpackhi_epi16(v, zero);
+        __m256i r = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yvLo, coeffYR), round), 13),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yvHi, coeffYR), round), 13));
+        __m256i g = _mm256_packs_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuLo, coeffYG), _mm256_madd_epi16(vLo, coeffG)), round), 13),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuHi, coeffYG), _mm256_madd_epi16(vHi, coeffG)), round), 13));
+        __m256i b = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuLo, coeffYB), round), 13),
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuHi, coeffYB), round), 13));
+        __m256i br = _mm256_packus_epi16(b, r), ga = _mm256_packus_epi16(g, alpha);
+        __m256i bg = _mm256_unpacklo_epi8(br, ga), ra = _mm256_unpackhi_epi8(br, ga);
+        __m256i lo = _mm256_unpacklo_epi16(bg, ra), hi = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256((__m256i *)(pBgra + 4 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pBgra + 4 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    Nv12ToBgraRowSse41(pY + x, pUv + x, pBgra + 4 * x, nWidth - x, c);
+}
+#endif
+
+#if defined(HOSTCC_NEON)
+inline void InterleaveUv8Neon(const uint8_t *pU, const uint8_t *pV, uint8_t *pUv, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv = {{vld1q_u8(pU + i), vld1q_u8(pV + i)}};
+        vst2q_u8(pUv + 2 * i, uv);
+    }
+    InterleaveUv8Scalar(pU + i, pV + i, pUv + 2 * i, n - i);
+}
+
+inline void DeinterleaveUv8Neon(const uint8_t *pUv, uint8_t *pU, uint8_t *pV, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(pUv + 2 * i);
+        vst1q_u8(pU + i, uv.val[0]);
+        vst1q_u8(pV + i, uv.val[1]);
+    }
+    DeinterleaveUv8Scalar(pUv + 2 * i, pU + i, pV + i, n - i);
+}
+
+inline void InterleaveUv16Neon(const uint16_t *pU, const uint16_t *pV, uint16_t *pUv, int n, int nShift) {
+    const int16x8_t shift = vdupq_n_s16((int16_t)nShift);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t uv = {{vshlq_u16(vld1q_u16(pU + i), shift), vshlq_u16(vld1q_u16(pV + i), shift)}};
+        vst2q_u16(pUv + 2 * i, uv);
+    }
+    InterleaveUv16Scalar(pU + i, pV + i, pUv + 2 * i, n - i, nShift);
+}
+
+inline void DeinterleaveUv16Neon(const uint16_t *pUv, uint16_t *pU, uint16_t *pV, int n, int nShift) {
+    const int16x8_t shift = vdupq_n_s16((int16_t)-nShift);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t uv = vld2q_u16(pUv + 2 * i);
+        vst1q_u16(pU + i, vshlq_u16(uv.val[0], shift));
+        vst1q_u16(pV + i, vshlq_u16(uv.val[1], shift));
+    }
+    DeinterleaveUv16Scalar(pUv + 2 * i, pU + i, pV + i, n - i, nShift);
+}
+
+inline void ShiftRow16Neon(const uint16_t *pSrc, uint16_t *pDst, int n, int nShift) {
+    const int16x8_t shift = vdupq_n_s16((int16_t)nShift);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u16(pDst + i, vshlq_u16(vld1q_u16(pSrc + i), shift));
+    }
+    ShiftRow16Scalar(pSrc + i, pDst + i, n - i, nShift);
+}
+
+// w0 * a + w1 * b + w2 * c + bias over 4 lanes
+inline int32x4_t WeightedSum3Neon(int16x4_t a, int16x4_t b, int16x4_t c, const int16_t *pWeight, int32x4_t bias) {
+    int32x4_t s = vmlal_n_s16(bias, a, pWeight[0]);
+    s = vmlal_n_s16(s, b, pWeight[1]);
+    return vmlal_n_s16(s, c, pWeight[2]);
+}
+
+inline uint8x8_t BgraToLuma8Neon(uint8x8x4_t p, const HostRgbToYuvCoeffs &c) {
+    int32x4_t bias = vdupq_n_s32(c.nYBias);
+    int16x8_t b = vreinterpretq_s16_u16(vmovl_u8(p.val[0])), g = vreinterpretq_s16_u16(vmovl_u8(p.val[1]));
+    int16x8_t r = vreinterpretq_s16_u16(vmovl_u8(p.val[2]));
+    int32x4_t lo = WeightedSum3Neon(vget_low_s16(b), vget_low_s16(g), vget_low_s16(r), c.anY, bias);
+    int32x4_t hi = WeightedSum3Neon(vget_high_s16(b), vget_high_s16(g), vget_high_s16(r), c.anY, bias);
+    return vqmovun_s16(vcombine_s16(vqshrn_n_s32(lo, 14), vqshrn_n_s32(hi, 14)));
+}
+
+inline void BgraToNv12RowsNeon(const uint8_t *pBgra0, const uint8_t *pBgra1, uint8_t *pY0, uint8_t *pY1, uint8_t *pUv, int nWidth,
+    const HostRgbToYuvCoeffs &c) {
+    const int32x4_t biasC = vdupq_n_s32(c.nCBias);
+    int x = 0;
+    for (; x + 8 <= nWidth; x += 8) {
+        uint8x8x4_t a = vld4_u8(pBgra0 + 4 * x), b = vld4_u8(pBgra1 + 4 * x);
+        vst1_u8(pY0 + x, BgraToLuma8Neon(a, c));
+        vst1_u8(pY1 + x, BgraToLuma8Neon(b, c));
+        // Pairwise sums across the row, plus the row below: one B, G, R sum per 2x2 block
+        int16x4_t sb = vreinterpret_s16_u16(vadd_u16(vpaddl_u8(a.val[0]), vpaddl_u8(b.val[0])));
+        int16x4_t sg = vreinterpret_s16_u16(vadd_u16(vpaddl_u8(a.val[1]), vpaddl_u8(b.val[1])));
+        int16x4_t sr = vreinterpret_s16_u16(vadd_u16(vpaddl_u8(a.val[2]), vpaddl_u8(b.val[2])));
+        int16x4_t u = vqshrn_n_s32(WeightedSum3Neon(sb, sg, sr, c.anU, biasC), 16);
+        int16x4_t v = vqshrn_n_s32(WeightedSum3Neon(sb, sg, sr, c.anV, biasC), 16);
+        uint8x8_t uv = vqmovun_s16(vcombine_s16(u, v));
+        vst1_u8(pUv + x, vzip_u8(uv, vext_u8(uv, uv, 4)).val[0]);
+    }
+    BgraToNv12RowsScalar(pBgra0 + 4 * x, pBgra1 + 4 * x, pY0 + x, pY1 + x, pUv + x, nWidth - x, c);
+}
+
+// B, G, R of 4 pixels; y is already scaled by nY
+inline void YuvToBgra4Neon(int32x4_t y, int16x4_t u, int16x4_t v, const HostYuvToRgbCoeffs &c, int16x4_t &b, int16x4_t &g, int16x4_t &r) {
+    b = vqrshrn_n_s32(vmlal_n_s16(y, u, c.nBU), 13);
+    g = vqrshrn_n_s32(vmlal_n_s16(vmlal_n_s16(y, u, c.nGU), v, c.nGV), 13);
+    r = vqrshrn_n_s32(vmlal_n_s16(y, v, c.nRV), 13);
+}
+
+inline void Nv12ToBgraRowNeon(const uint8_t *pY, const uint8_t *pUv, uint8_t *pBgra, int nWidth, const HostYuvToRgbCoeffs &c) {
+    const int16x8_t yOffset = vdupq_n_s16(c.nYOffset), cOffset = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 8 <= nWidth; x += 8) {
+        int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pY + x))), yOffset);
+        // Four chroma pairs cover eight pixels: split them into U and V, then repeat each for its two pixels
+        uint8x8_t uvPairs = vld1_u8(pUv + x);
+        uint8x8x2_t uv = vuzp_u8(uvPairs, uvPairs);
+        uint8x8x2_t uDup = vzip_u8(uv.val[0], uv.val[0]), vDup = vzip_u8(uv.val[1], uv.val[1]);
+        int16x8_t u = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uDup.val[0])), cOffset);
+        int16x8_t v = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vDup.val[0])), cOffset);
+        int16x4_t bLo, gLo, rLo, bHi, gHi, rHi;
+        YuvToBgra4Neon(vmull_n_s16(vget_low_s16(y), c.nY), vget_low_s16(u), vget_low_s16(v), c, bLo, gLo, rLo);
+        YuvToBgra4Neon(vmull_n_s16(vget_high_s16(y), c.nY), vget_high_s16(u), vget_high_s16(v), c, bHi, gHi, rHi);
+        uint8x8x4_t bgra = {{vqmovun_s16(vcombine_s16(bLo, bHi)), vqmovun_s16(vcombine_s16(gLo, gHi)),
+            vqmovun_s16(vcombine_s16(rLo, rHi)), vdup_n_u8(255)}};
+        vst4_u8(pBgra + 4 * x, bgra);
+    }
+    Nv12ToBgraRowScalar(pY + x, pUv + x, pBgra + 4 * x, nWidth - x, c);
+}
+#endif
+
+/**
+* @brief Kernels for eLevel, or for the best level below it that this build has. HOST_SIMD_SCALAR always works.
+*/
+inline const HostColorKernels &GetHostColorKernels(HOST_SIMD_LEVEL eLevel) {
+    static const HostColorKernels scalar = {InterleaveUv8Scalar, DeinterleaveUv8Scalar, InterleaveUv16Scalar, DeinterleaveUv16Scalar,
+        ShiftRow16Scalar, BgraToNv12RowsScalar, Nv12ToBgraRowScalar};
+#if defined(HOSTCC_X86)
+    static const HostColorKernels sse41 = {InterleaveUv8Sse41, DeinterleaveUv8Sse41, InterleaveUv16Sse41, DeinterleaveUv16Sse41,
+        ShiftRow16Sse41, BgraToNv12RowsSse41, Nv12ToBgraRowSse41};
+    static const HostColorKernels avx2 = {InterleaveUv8Avx2, DeinterleaveUv8Avx2, InterleaveUv16Avx2, DeinterleaveUv16Avx2,
+        ShiftRow16Avx2, BgraToNv12RowsAvx2, Nv12ToBgraRowAvx2};
+    if (eLevel == HOST_SIMD_AVX2) {
+        return avx2;
+    }
+    if (eLevel == HOST_SIMD_SSE41) {
+        return sse41;
+    }
+#elif defined(HOSTCC_NEON)
+    static const HostColorKernels neon = {InterleaveUv8Neon, DeinterleaveUv8Neon, InterleaveUv16Neon, DeinterleaveUv16Neon,
+        ShiftRow16Neon, BgraToNv12RowsNeon, Nv12ToBgraRowNeon};
+    if (eLevel == HOST_SIMD_NEON) {
+        return neon;
+    }
+#endif
+    return scalar;
+}
+
+/**
+* @brief Kernels of the best level this CPU supports, detected on first use.
+*/
+inline const HostColorKernels &GetHostColorKernels() {
+    static const HostColorKernels &kernels = GetHostColorKernels(DetectHostSimdLevel());
+    return kernels;
+}
+
+/**
+* @brief Calls fn(iBegin, iEnd) over [0, nRows), split into bands on up to HOST_COLOR_MAX_THREADS threads when the frame
+* has at least HOST_COLOR_MT_MIN_PIXELS pixels. The calling thread takes the first band.
+*/
+template<class Fn>
+inline void ForEachRowBand(int nRows, int64_t nPixels, const Fn &fn) {
+    int nThreads = 1;
+    if (nPixels >= HOST_COLOR_MT_MIN_PIXELS) {
+        nThreads = (int)std::thread::hardware_concurrency();
+        nThreads = nThreads < HOST_COLOR_MAX_THREADS ? nThreads : HOST_COLOR_MAX_THREADS;
+        nThreads = nThreads < nRows ? nThreads : nRows;
+    }
+    if (nThreads <= 1) {
+        fn(0, nRows);
+        return;
+    }
+    std::vector<std::thread> vThread;
+    for (int i = 1; i < nThreads; i++) {
+        vThread.emplace_back([&fn, i, nThreads, nRows]() {
+            fn((int)((int64_t)nRows * i / nThreads), (int)((int64_t)nRows * (i + 1) / nThreads));
+        });
+    }
+    fn(0, nRows / nThreads);
+    for (std::thread &t : vThread) {
+        t.join();
+    }
+}
+
+inline void CopyPlaneRows(const uint8_t *pSrc, int nSrcPitch, uint8_t *pDst, int nDstPitch, int nRowBytes, int iBegin, int iEnd) {
+    if (pSrc == pDst && nSrcPitch == nDstPitch) {
+        return;
+    }
+    for (int y = iBegin; y < iEnd; y++) {
+        memcpy(pDst + (size_t)y * nDstPitch, pSrc + (size_t)y * nSrcPitch, nRowBytes);
+    }
+}
+
+/**
+* @brief I420 to NV12 into caller buffers. pDstY may be pSrcY, in which case luma is left alone.
+*/
+inline void I420ToNv12Host(const uint8_t *pSrcY, int nSrcYPitch, const uint8_t *pSrcU, const uint8_t *pSrcV, int nSrcUvPitch,
+    uint8_t *pDstY, int nDstYPitch, uint8_t *pDstUv, int nDstUvPitch, int nWidth, int nHeight) {
+    const HostColorKernels &k = GetHostColorKernels();
+    int nChromaWidth = (nWidth + 1) / 2;
+    ForEachRowBand((nHeight + 1) / 2, (int64_t)nWidth * nHeight, [&](int iBegin, int iEnd) {
+        CopyPlaneRows(pSrcY, nSrcYPitch, pDstY, nDstYPitch, nWidth, 2 * iBegin, 2 * iEnd < nHeight ? 2 * iEnd : nHeight);
+        for (int y = iBegin; y < iEnd; y++) {
+            k.InterleaveUv8(pSrcU + (size_t)y * nSrcUvPitch, pSrcV + (size_t)y * nSrcUvPitch, pDstUv + (size_t)y * nDstUvPitch, nChromaWidth);
+        }
+    });
+}
+
+inline void Nv12ToI420Host(const uint8_t *pSrcY, int nSrcYPitch, const uint8_t *pSrcUv, int nSrcUvPitch, uint8_t *pDstY, int nDstYPitch,
+    uint8_t *pDstU, uint8_t *pDstV, int nDstUvPitch, int nWidth, int nHeight) {
+    const HostColorKernels &k = GetHostColorKernels();
+    int nChromaWidth = (nWidth + 1) / 2;
+    ForEachRowBand((nHeight + 1) / 2, (int64_t)nWidth * nHeight, [&](int iBegin, int iEnd) {
+        CopyPlaneRows(pSrcY, nSrcYPitch, pDstY, nDstYPitch, nWidth, 2 * iBegin, 2 * iEnd < nHeight ? 2 * iEnd : nHeight);
+        for (int y = iBegin; y < iEnd; y++) {
+            k.DeinterleaveUv8(pSrcUv + (size_t)y * nSrcUvPitch, pDstU + (size_t)y * nDstUvPitch, pDstV + (size_t)y * nDstUvPitch, nChromaWidth);
+        }
+    });
+}
+
+/**
+* @brief Contiguous frames, as YuvConverter lays them out: luma rows of nPitch bytes, then planar chroma with a pitch of
+* (nPitch + 1) / 2, or interleaved chroma with a pitch of nPitch. Needs a copy of the chroma planes as scratch.
+*/
+inline void I420ToNv12InPlace(uint8_t *pFrame, int nPitch, int nWidth, int nHeight) {
+    int nChromaPitch = (nPitch + 1) / 2, nChromaHeight = (nHeight + 1) / 2;
+    uint8_t *pChroma = pFrame + (size_t)nPitch * nHeight;
+    std::vector<uint8_t> vScratch(pChroma, pChroma + (size_t)nChromaPitch * nChromaHeight * 2);
+    I420ToNv12Host(pFrame, nPitch, vScratch.data(), vScratch.data() + (size_t)nChromaPitch * nChromaHeight, nChromaPitch,
+        pFrame, nPitch, pChroma, nPitch, nWidth, nHeight);
+}
+
+inline void Nv12ToI420InPlace(uint8_t *pFrame, int nPitch, int nWidth, int nHeight) {
+    int nChromaPitch = (nPitch + 1) / 2, nChromaHeight = (nHeight + 1) / 2;
+    uint8_t *pChroma = pFrame + (size_t)nPitch * nHeight;
+    std::vector<uint8_t> vScratch(pChroma, pChroma + (size_t)nPitch * nChromaHeight);
+    Nv12ToI420Host(pFrame, nPitch, vScratch.data(), nPitch, pFrame, nPitch, pChroma, pChroma + (size_t)nChromaPitch * nChromaHeight,
+        nChromaPitch, nWidth, nHeight);
+}
+
+/**
+* @brief I010 (10-bit values in the low bits of 16-bit planar samples) to P010 (MSB-aligned, interleaved chroma).
+* pDstY may be pSrcY; luma is shifted in place then.
+*/
+inline void I010ToP010Host(const uint16_t *pSrcY, int nSrcYPitch, const uint16_t *pSrcU, const uint16_t *pSrcV, int nSrcUvPitch,
+    uint16_t *pDstY, int nDstYPitch, uint16_t *pDstUv, int nDstUvPitch, int nWidth, int nHeight) {
+    const HostColorKernels &k = GetHostColorKernels();
+    int nChromaWidth = (nWidth + 1) / 2;
+    ForEachRowBand((nHeight + 1) / 2, (int64_t)nWidth * nHeight, [&](int iBegin, int iEnd) {
+        for (int y = 2 * iBegin; y < 2 * iEnd && y < nHeight; y++) {
+            k.ShiftRow16((const uint16_t *)((const uint8_t *)pSrcY + (size_t)y * nSrcYPitch),
+                (uint16_t *)((uint8_t *)pDstY + (size_t)y * nDstYPitch), nWidth, 6);
+        }
+        for (int y = iBegin; y < iEnd; y++) {
+            k.InterleaveUv16((const uint16_t *)((const uint8_t *)pSrcU + (size_t)y * nSrcUvPitch),
+                (const uint16_t *)((const uint8_t *)pSrcV + (size_t)y * nSrcUvPitch),
+                (uint16_t *)((uint8_t *)pDstUv + (size_t)y * nDstUvPitch), nChromaWidth, 6);
+        }
+    });
+}
+
+inline void P010ToI010Host(const uint16_t *pSrcY, int nSrcYPitch, const uint16_t *pSrcUv, int nSrcUvPitch, uint16_t *pDstY, int nDstYPitch,
+    uint16_t *pDstU, uint16_t *pDstV, int nDstUvPitch, int nWidth, int nHeight) {
+    const HostColorKernels &k = GetHostColorKernels();
+    int nChromaWidth = (nWidth + 1) / 2;
+    ForEachRowBand((nHeight + 1) / 2, (int64_t)nWidth * nHeight, [&](int iBegin, int iEnd) {
+        for (int y = 2 * iBegin; y < 2 * iEnd && y < nHeight; y++) {
+            k.ShiftRow16((const uint16_t *)((const uint8_t *)pSrcY + (size_t)y * nSrcYPitch),
+                (uint16_t *)((uint8_t *)pDstY + (size_t)y * nDstYPitch), nWidth, -6);
+        }
+        for (int y = iBegin; y < iEnd; y++) {
+            k.DeinterleaveUv16((const uint16_t *)((const uint8_t *)pSrcUv + (size_t)y * nSrcUvPitch),
+                (uint16_t *)((uint8_t *)pDstU + (size_t)y * nDstUvPitch), (uint16_t *)((uint8_t *)pDstV + (size_t)y * nDstUvPitch),
+                nChromaWidth, 6);
+        }
+    });
+}
+
+/**
+* @brief Contiguous 16-bit frames laid out like I420ToNv12InPlace(), with nPitch in bytes.
+*/
+inline void I010ToP010InPlace(uint16_t *pFrame, int nPitch, int nWidth, int nHeight) {
+    int nChromaPitch = (nPitch / 2 + 1) / 2 * 2, nChromaHeight = (nHeight + 1) / 2;
+    uint8_t *pChroma = (uint8_t *)pFrame + (size_t)nPitch * nHeight;
+    std::vector<uint16_t> vScratch((size_t)nChromaPitch * nChromaHeight);
+    memcpy(vScratch.data(), pChroma, vScratch.size() * 2);
+    I010ToP010Host(pFrame, nPitch, vScratch.data(), vScratch.data() + vScratch.size() / 2, nChromaPitch, pFrame, nPitch,
+        (uint16_t *)pChroma, nPitch, nWidth, nHeight);
+}
+
+inline void P010ToI010InPlace(uint16_t *pFrame, int nPitch, int nWidth, int nHeight) {
+    int nChromaPitch = (nPitch / 2 + 1) / 2 * 2, nChromaHeight = (nHeight + 1) / 2;
+    uint8_t *pChroma = (uint8_t *)pFrame + (size_t)nPitch * nHeight;
+    std::vector<uint16_t> vScratch((size_t)nPitch / 2 * nChromaHeight);
+    memcpy(vScratch.data(), pChroma, vScratch.size() * 2);
+    P010ToI010Host(pFrame, nPitch, vScratch.data(), nPitch, pFrame, nPitch, (uint16_t *)pChroma,
+        (uint16_t *)(pChroma + (size_t)nChromaPitch * nChromaHeight), nChromaPitch, nWidth, nHeight);
+}
+
+/**
+* @brief BGRA (bytes B, G, R, A) to NV12. Chroma is converted from the average colour of each 2x2 block; odd edges are
+* replicated. Fixed point, so values may differ by one from the float reference Rgb32ToNv12Host().
+*/
+inline void BgraToNv12Host(const uint8_t *pBgra, int nBgraPitch, uint8_t *pDstY, int nDstYPitch, uint8_t *pDstUv, int nDstUvPitch,
+    int nWidth, int nHeight, int iMatrix = ColorSpaceStandard_BT709, bool bFullRange = false) {
+    const HostColorKernels &k = GetHostColorKernels();
+    HostRgbToYuvCoeffs c = MakeHostRgbToYuvCoeffs(iMatrix, bFullRange);
+    ForEachRowBand((nHeight + 1) / 2, (int64_t)nWidth * nHeight, [&](int iBegin, int iEnd) {
+        std::vector<uint8_t> vDummy;
+        for (int y = iBegin; y < iEnd; y++) {
+            const uint8_t *pBgra0 = pBgra + (size_t)2 * y * nBgraPitch;
+            uint8_t *pY0 = pDstY + (size_t)2 * y * nDstYPitch, *pY1 = pY0 + nDstYPitch;
+            const uint8_t *pBgra1 = pBgra0 + nBgraPitch;
+            if (2 * y + 1 >= nHeight) {
+                // Odd height: the last row stands in for the missing one, whose luma goes to scratch
+                vDummy.resize(nWidth);
+                pBgra1 = pBgra0;
+                pY1 = vDummy.data();
+            }
+            k.BgraToNv12Rows(pBgra0, pBgra1, pY0, pY1, pDstUv + (size_t)y * nDstUvPitch, nWidth, c);
+        }
+    });
+}
+
+inline void Nv12ToBgraHost(const uint8_t *pSrcY, int nSrcYPitch, const uint8_t *pSrcUv, int nSrcUvPitch, uint8_t *pBgra, int nBgraPitch,
+    int nWidth, int nHeight, int iMatrix = ColorSpaceStandard_BT709, bool bFullRange = false) {
+    const HostColorKernels &k = GetHostColorKernels();
+    HostYuvToRgbCoeffs c = MakeHostYuvToRgbCoeffs(iMatrix, bFullRange);
+    ForEachRowBand(nHeight, (int64_t)nWidth * nHeight, [&](int iBegin, int iEnd) {
+        for (int y = iBegin; y < iEnd; y++) {
+            k.Nv12ToBgraRow(pSrcY + (size_t)y * nSrcYPitch, pSrcUv + (size_t)(y / 2) * nSrcUvPitch, pBgra + (size_t)y * nBgraPitch, nWidth, c);
+        }
+    });
+}
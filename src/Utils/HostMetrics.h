@@ -0,0 +1,481 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include "HostColorConvert.h"
+#include "MetricsMath.h"
+
+//---------------------------------------------------------------------------
+//! \file HostMetrics.h
+//! \brief CPU implementation of the FrameMetricsEngine metrics (PSNR, SSIM, MS-SSIM) for
+//! frames in host memory, for offline QC and tests without a GPU.
+//!
+//! Planes are first brought to planar, LSB-aligned samples with the HostColorConvert.h
+//! kernels. Squared errors and the 4x4 block sums SSIM windows are built from then run
+//! on row kernels picked at run time like HostColorConvert.h (AVX2, SSE4.1 or plain
+//! C++; other CPUs use plain C++), in row bands on several threads for 4K frames.
+//! The sums are identical to the GPU ones.
+//---------------------------------------------------------------------------
+
+/**
+* @brief Row kernels. The 16-bit SIMD variants take samples of at most 12 bits; deeper ones use the scalar kernels.
+*/
+struct HostMetricsKernels {
+    uint64_t (*Sse8)(const uint8_t *pA, const uint8_t *pB, int n);
+    uint64_t (*Sse16)(const uint16_t *pA, const uint16_t *pB, int n);
+    // s1, s2, ss and s12 of nBlocks adjacent 4x4 blocks whose top rows start at pA and pB
+    void (*SsimBlocks8)(const uint8_t *pA, int nPitchA, const uint8_t *pB, int nPitchB, int nBlocks, int64_t (*pSums)[4]);
+    void (*SsimBlocks16)(const uint16_t *pA, int nPitchA, const uint16_t *pB, int nPitchB, int nBlocks, int64_t (*pSums)[4]);
+};
+
+template<class T>
+inline uint64_t SseScalar(const T *pA, const T *pB, int n) {
+    uint64_t nSse = 0;
+    for (int i = 0; i < n; i++) {
+        int64_t d = (int64_t)pA[i] - pB[i];
+        nSse += (uint64_t)(d * d);
+    }
+    return nSse;
+}
+
+template<class T>
+inline void SsimBlocksScalar(const T *pA, int nPitchA, const T *pB, int nPitchB, int nBlocks, int64_t (*pSums)[4]) {
+    for (int i = 0; i < nBlocks; i++) {
+        int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+        for (int y = 0; y < 4; y++) {
+            const T *a = (const T *)((const uint8_t *)pA + (size_t)y * nPitchA) + 4 * i;
+            const T *b = (const T *)((const uint8_t *)pB + (size_t)y * nPitchB) + 4 * i;
+            for (int x = 0; x < 4; x++) {
+                s1 += a[x];
+                s2 += b[x];
+                ss += (int64_t)a[x] * a[x] + (int64_t)b[x] * b[x];
+                s12 += (int64_t)a[x] * b[x];
+            }
+        }
+        pSums[i][0] = s1;
+        pSums[i][1] = s2;
+        pSums[i][2] = ss;
+        pSums[i][3] = s12;
+    }
+}
+
+inline uint64_t Sse8Scalar(const uint8_t *pA, const uint8_t *pB, int n) {
+    return SseScalar(pA, pB, n);
+}
+
+inline uint64_t Sse16Scalar(const uint16_t *pA, const uint16_t *pB, int n) {
+    return SseScalar(pA, pB, n);
+}
+
+inline void SsimBlocks8Scalar(const uint8_t *pA, int nPitchA, const uint8_t *pB, int nPitchB, int nBlocks, int64_t (*pSums)[4]) {
+    SsimBlocksScalar(pA, nPitchA, pB, nPitchB, nBlocks, pSums);
+}
+
+inline void SsimBlocks16Scalar(const uint16_t *pA, int nPitchA, const uint16_t *pB, int nPitchB, int nBlocks, int64_t (*pSums)[4]) {
+    SsimBlocksScalar(pA, nPitchA, pB, nPitchB, nBlocks, pSums);
+}
+
+#if defined(HOSTCC_X86)
+HOSTCC_TARGET_SSE41 inline uint64_t HorizontalSum64Sse41(__m128i v) {
+    uint64_t an[2];
+    _mm_storeu_si128((__m128i *)an, v);
+    return an[0] + an[1];
+}
+
+// Adds the four 32-bit lanes of v, which are not negative, to the two 64-bit lanes of acc
+HOSTCC_TARGET_SSE41 inline __m128i Widen32To64Sse41(__m128i acc, __m128i v) {
+    return _mm_add_epi64(acc, _mm_add_epi64(_mm_cvtepu32_epi64(v), _mm_cvtepu32_epi64(_mm_srli_si128(v, 8))));
+}
+
+HOSTCC_TARGET_SSE41 inline uint64_t Sse8Sse41(const uint8_t *pA, const uint8_t *pB, int n) {
+    __m128i zero = _mm_setzero_si128(), acc64 = zero;
+    int i = 0;
+    while (i + 16 <= n) {
+        // 2048 iterations add at most 2^29 to a lane
+        __m128i acc = zero;
+        for (int nEnd = i + 16 * 2048 < n ? i + 16 * 2048 : n; i + 16 <= nEnd; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(pA + i)), b = _mm_loadu_si128((const __m128i *)(pB + i));
+            __m128i d0 = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            __m128i d1 = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(d0, d0), _mm_madd_epi16(d1, d1)));
+        }
+        acc64 = Widen32To64Sse41(acc64, acc);
+    }
+    return HorizontalSum64Sse41(acc64) + SseScalar(pA + i, pB + i, n - i);
+}
+
+HOSTCC_TARGET_SSE41 inline uint64_t Sse16Sse41(const uint16_t *pA, const uint16_t *pB, int n) {
+    __m128i zero = _mm_setzero_si128(), acc64 = zero;
+    int i = 0;
+    while (i + 8 <= n) {
+        // 32 iterations of 12-bit differences add less than 2^31 to a lane
+        __m128i acc = zero;
+        for (int nEnd = i + 8 * 32 < n ? i + 8 * 32 : n; i + 8 <= nEnd; i += 8) {
+            __m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(pA + i)), _mm_loadu_si128((const __m128i *)(pB + i)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(d, d));
+        }
+        acc64 = Widen32To64Sse41(acc64, acc);
+    }
+    return HorizontalSum64Sse41(acc64) + SseScalar(pA + i, pB + i, n - i);
+}
+
+// Turns per-column sums of 4 rows (s1, s2 as 16-bit lanes; ss, s12 as 32-bit pair sums) into sums of 4x4 blocks
+HOSTCC_TARGET_SSE41 inline void StoreSsimBlocksSse41(__m128i s1, __m128i s2, __m128i ss, __m128i s12, int64_t (*pSums)[4]) {
+    __m128i one = _mm_set1_epi16(1);
+    int32_t an[8];
+    _mm_storeu_si128((__m128i *)an, _mm_hadd_epi32(_mm_madd_epi16(s1, one), _mm_madd_epi16(s2, one)));
+    _mm_storeu_si128((__m128i *)(an + 4), _mm_hadd_epi32(ss, s12));
+    for (int i = 0; i < 2; i++) {
+        pSums[i][0] = an[i];
+        pSums[i][1] = an[2 + i];
+        pSums[i][2] = an[4 + i];
+        pSums[i][3] = an[6 + i];
+    }
+}
+
+HOSTCC_TARGET_SSE41 inline void SsimBlocks8Sse41(const uint8_t *pA, int nPitchA, const uint8_t *pB, int nPitchB, int nBlocks,
+    int64_t (*pSums)[4]) {
+    int i = 0;
+    for (; i + 2 <= nBlocks; i += 2) {
+        __m128i s1 = _mm_setzero_si128(), s2 = s1, ss = s1, s12 = s1;
+        for (int y = 0; y < 4; y++) {
+            __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(pA + (size_t)y * nPitchA + 4 * i)));
+            __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(pB + (size_t)y * nPitchB + 4 * i)));
+            s1 = _mm_add_epi16(s1, a);
+            s2 = _mm_add_epi16(s2, b);
+            ss = _mm_add_epi32(ss, _mm_add_epi32(_mm_madd_epi16(a, a), _mm_madd_epi16(b, b)));
+            s12 = _mm_add_epi32(s12, _mm_madd_epi16(a, b));
+        }
+        StoreSsimBlocksSse41(s1, s2, ss, s12, pSums + i);
+    }
+    SsimBlocksScalar(pA + 4 * i, nPitchA, pB + 4 * i, nPitchB, nBlocks - i, pSums + i);
+}
+
+HOSTCC_TARGET_SSE41 inline void SsimBlocks16Sse41(const uint16_t *pA, int nPitchA, const uint16_t *pB, int nPitchB, int nBlocks,
+    int64_t (*pSums)[4]) {
+    int i = 0;
+    for (; i + 2 <= nBlocks; i += 2) {
+        __m128i s1 = _mm_setzero_si128(), s2 = s1, ss = s1, s12 = s1;
+        for (int y = 0; y < 4; y++) {
+            __m128i a = _mm_loadu_si128((const __m128i *)((const uint8_t *)pA + (size_t)y * nPitchA) + i / 2);
+            __m128i b = _mm_loadu_si128((const __m128i *)((const uint8_t *)pB + (size_t)y * nPitchB) + i / 2);
+            s1 = _mm_add_epi16(s1, a);
+            s2 = _mm_add_epi16(s2, b);
+            ss = _mm_add_epi32(ss, _mm_add_epi32(_mm_madd_epi16(a, a), _mm_madd_epi16(b, b)));
+            s12 = _mm_add_epi32(s12, _mm_madd_epi16(a, b));
+        }
+        StoreSsimBlocksSse41(s1, s2, ss, s12, pSums + i);
+    }
+    SsimBlocksScalar(pA + 4 * i, nPitchA, pB + 4 * i, nPitchB, nBlocks - i, pSums + i);
+}
+
+HOSTCC_TARGET_AVX2 inline __m256i Widen32To64Avx2(__m256i acc, __m256i v) {
+    return _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)),
+        _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1))));
+}
+
+HOSTCC_TARGET_AVX2 inline uint64_t HorizontalSum64Avx2(__m256i v) {
+    uint64_t an[2];
+    _mm_storeu_si128((__m128i *)an, _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+    return an[0] + an[1];
+}
+
+HOSTCC_TARGET_AVX2 inline uint64_t Sse8Avx2(const uint8_t *pA, const uint8_t *pB, int n) {
+    __m256i acc64 = _mm256_setzero_si256();
+    int i = 0;
+    while (i + 32 <= n) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int nEnd = i + 32 * 2048 < n ? i + 32 * 2048 : n; i + 32 <= nEnd; i += 32) {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(pA + i)), a1 = _mm_loadu_si128((const __m128i *)(pA + i + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(pB + i)), b1 = _mm_loadu_si128((const __m128i *)(pB + i + 16));
+            __m256i d0 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a0), _mm256_cvtepu8_epi16(b0));
+            __m256i d1 = _mm256_sub_epi16(_mm256_cvtepu8_epi16(a1), _mm256_cvtepu8_epi16(b1));
+            acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_madd_epi16(d0, d0), _mm256_madd_epi16(d1, d1)));
+        }
+        acc64 = Widen32To64Avx2(acc64, acc);
+    }
+    return HorizontalSum64Avx2(acc64) + SseScalar(pA + i, pB + i, n - i);
+}
+
+HOSTCC_TARGET_AVX2 inline uint64_t Sse16Avx2(const uint16_t *pA, const uint16_t *pB, int n) {
+    __m256i acc64 = _mm256_setzero_si256();
+    int i = 0;
+    while (i + 16 <= n) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int nEnd = i + 16 * 32 < n ? i + 16 * 32 : n; i + 16 <= nEnd; i += 16) {
+            __m256i d = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(pA + i)), _mm256_loadu_si256((const __m256i *)(pB + i)));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+        }
+        acc64 = Widen32To64Avx2(acc64, acc);
+    }
+    return HorizontalSum64Avx2(acc64) + SseScalar(pA + i, pB + i, n - i);
+}
+
+// The horizontal adds work within 128-bit halves, so each half holds two blocks laid out as in StoreSsimBlocksSse41()
+HOSTCC_TARGET_AVX2 inline void StoreSsimBlocksAvx2(__m256i s1, __m256i s2, __m256i ss, __m256i s12, int64_t (*pSums)[4]) {
+    __m256i one = _mm256_set1_epi16(1);
+    int32_t an[16];
+    _mm256_storeu_si256((__m256i *)an, _mm256_hadd_epi32(_mm256_madd_epi16(s1, one), _mm256_madd_epi16(s2, one)));
+    _mm256_storeu_si256((__m256i *)(an + 8), _mm256_hadd_epi32(ss, s12));
+    for (int h = 0; h < 2; h++) {
+        for (int i = 0; i < 2; i++) {
+            pSums[2 * h + i][0] = an[4 * h + i];
+            pSums[2 * h + i][1] = an[4 * h + 2 + i];
+            pSums[2 * h + i][2] = an[8 + 4 * h + i];
+            pSums[2 * h + i][3] = an[8 + 4 * h + 2 + i];
+        }
+    }
+}
+
+HOSTCC_TARGET_AVX2 inline void SsimBlocks8Avx2(const uint8_t *pA, int nPitchA, const uint8_t *pB, int nPitchB, int nBlocks,
+    int64_t (*pSums)[4]) {
+    int i = 0;
+    for (; i + 4 <= nBlocks; i += 4) {
+        __m256i s1 = _mm256_setzero_si256(), s2 = s1, ss = s1, s12 = s1;
+        for (int y = 0; y < 4; y++) {
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pA + (size_t)y * nPitchA + 4 * i)));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pB + (size_t)y * nPitchB + 4 * i)));
+            s1 = _mm256_add_epi16(s1, a);
+            s2 = _mm256_add_epi16(s2, b);
+            ss = _mm256_add_epi32(ss, _mm256_add_epi32(_mm256_madd_epi16(a, a), _mm256_madd_epi16(b, b)));
+            s12 = _mm256_add_epi32(s12, _mm256_madd_epi16(a, b));
+        }
+        StoreSsimBlocksAvx2(s1, s2, ss, s12, pSums + i);
+    }
+    SsimBlocks8Sse41(pA + 4 * i, nPitchA, pB + 4 * i, nPitchB, nBlocks - i, pSums + i);
+}
+
+HOSTCC_TARGET_AVX2 inline void SsimBlocks16Avx2(const uint16_t *pA, int nPitchA, const uint16_t *pB, int nPitchB, int nBlocks,
+    int64_t (*pSums)[4]) {
+    int i = 0;
+    for (; i + 4 <= nBlocks; i += 4) {
+        __m256i s1 = _mm256_setzero_si256(), s2 = s1, ss = s1, s12 = s1;
+        for (int y = 0; y < 4; y++) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)((const uint8_t *)pA + (size_t)y * nPitchA) + i / 4);
+            __m256i b = _mm256_loadu_si256((const __m256i *)((const uint8_t *)pB + (size_t)y * nPitchB) + i / 4);
+            s1 = _mm256_add_epi16(s1, a);
+            s2 = _mm256_add_epi16(s2, b);
+            ss = _mm256_add_epi32(ss, _mm256_add_epi32(_mm256_madd_epi16(a, a), _mm256_madd_epi16(b, b)));
+            s12 = _mm256_add_epi32(s12, _mm256_madd_epi16(a, b));
+        }
+        StoreSsimBlocksAvx2(s1, s2, ss, s12, pSums + i);
+    }
+    SsimBlocks16Sse41(pA + 4 * i, nPitchA, pB + 4 * i, nPitchB, nBlocks - i, pSums + i);
+}
+#endif
+
+/**
+* @brief Kernels for eLevel, or for the best level below it that this build has.
+*/
+inline const HostMetricsKernels &GetHostMetricsKernels(HOST_SIMD_LEVEL eLevel) {
+    static const HostMetricsKernels scalar = {Sse8Scalar, Sse16Scalar, SsimBlocks8Scalar, SsimBlocks16Scalar};
+#if defined(HOSTCC_X86)
+    static const HostMetricsKernels sse41 = {Sse8Sse41, Sse16Sse41, SsimBlocks8Sse41, SsimBlocks16Sse41};
+    static const HostMetricsKernels avx2 = {Sse8Avx2, Sse16Avx2, SsimBlocks8Avx2, SsimBlocks16Avx2};
+    if (eLevel == HOST_SIMD_AVX2) {
+        return avx2;
+    }
+    if (eLevel == HOST_SIMD_SSE41) {
+        return sse41;
+    }
+#endif
+    return scalar;
+}
+
+inline const HostMetricsKernels &GetHostMetricsKernels() {
+    static const HostMetricsKernels &kernels = GetHostMetricsKernels(DetectHostSimdLevel());
+    return kernels;
+}
+
+/**
+* @brief A plane with planar, LSB-aligned samples, either borrowed from the frame or converted into vBuffer.
+*/
+struct HostMetricsPlane {
+    const uint8_t *p;
+    int nPitch, nWidth, nHeight;
+    bool b16;
+    std::vector<uint8_t> vBuffer;
+
+    MetricsPlane ToMetricsPlane() const {
+        return {p, nPitch, nWidth, nHeight, 1, b16 ? 2 : 1, 0};
+    }
+};
+
+/**
+* @brief Converts the planes of a frame for the row kernels; interleaved chroma is split with one pass over both planes.
+*/
+inline void PrepareHostMetricsPlanes(const MetricsPlane *aPlane, int nPlanes, HostMetricsPlane *aOut) {
+    const HostColorKernels &k = GetHostColorKernels();
+    for (int i = 0; i < nPlanes; i++) {
+        const MetricsPlane &src = aPlane[i];
+        HostMetricsPlane &dst = aOut[i];
+        dst.nWidth = src.nWidth;
+        dst.nHeight = src.nHeight;
+        dst.b16 = src.nBytesPerSample == 2;
+        if (src.nStep == 1 && (!dst.b16 || !src.nShift)) {
+            dst.p = src.p;
+            dst.nPitch = src.nPitch;
+            continue;
+        }
+        dst.nPitch = src.nWidth * src.nBytesPerSample;
+        dst.vBuffer.resize((size_t)dst.nPitch * src.nHeight);
+        dst.p = dst.vBuffer.data();
+    }
+
+    bool bSplitChroma = nPlanes == 3 && aPlane[1].nStep == 2;
+    ForEachRowBand(aPlane[0].nHeight, (int64_t)aPlane[0].nWidth * aPlane[0].nHeight, [&](int iBegin, int iEnd) {
+        for (int i = 0; i < nPlanes; i++) {
+            const MetricsPlane &src = aPlane[i];
+            if (aOut[i].vBuffer.empty() || (i == 2 && bSplitChroma)) {
+                continue;
+            }
+            for (int y = iBegin; y < iEnd && y < src.nHeight; y++) {
+                const uint8_t *pSrc = src.p + (size_t)y * src.nPitch;
+                uint8_t *pDst = aOut[i].vBuffer.data() + (size_t)y * aOut[i].nPitch;
+                uint8_t *pDstV = bSplitChroma && i == 1 ? aOut[2].vBuffer.data() + (size_t)y * aOut[2].nPitch : nullptr;
+                if (!pDstV) {
+                    k.ShiftRow16((const uint16_t *)pSrc, (uint16_t *)pDst, src.nWidth, -src.nShift);
+                } else if (aOut[i].b16) {
+                    k.DeinterleaveUv16((const uint16_t *)pSrc, (uint16_t *)pDst, (uint16_t *)pDstV, src.nWidth, src.nShift);
+                } else {
+                    k.DeinterleaveUv8(pSrc, pDst, pDstV, src.nWidth);
+                }
+            }
+        }
+    });
+}
+
+inline uint64_t PlaneSseHost(const HostMetricsKernels &k, const HostMetricsPlane &a, const HostMetricsPlane &b) {
+    std::mutex m;
+    uint64_t nSse = 0;
+    ForEachRowBand(a.nHeight, (int64_t)a.nWidth * a.nHeight, [&](int iBegin, int iEnd) {
+        uint64_t nBand = 0;
+        for (int y = iBegin; y < iEnd; y++) {
+            const uint8_t *pA = a.p + (size_t)y * a.nPitch, *pB = b.p + (size_t)y * b.nPitch;
+            nBand += a.b16 ? k.Sse16((const uint16_t *)pA, (const uint16_t *)pB, a.nWidth) : k.Sse8(pA, pB, a.nWidth);
+        }
+        std::lock_guard<std::mutex> lock(m);
+        nSse += nBand;
+    });
+    return nSse;
+}
+
+/**
+* @brief Adds the SSIM and contrast-structure sums of all windows of a plane. Each window is the sum of 2x2 block sums.
+*/
+inline void PlaneSsimHost(const HostMetricsKernels &k, const HostMetricsPlane &a, const HostMetricsPlane &b, double fC1, double fC2,
+    int64_t &nSsim, int64_t &nCs) {
+    int nWindowsX = GetSsimWindowsX(a.nWidth), nWindowsY = GetSsimWindowsY(a.nHeight);
+    if (!nWindowsX || !nWindowsY) {
+        return;
+    }
+    int nBlocks = nWindowsX + 1;
+    std::mutex m;
+    ForEachRowBand(nWindowsY, (int64_t)a.nWidth * a.nHeight, [&](int iBegin, int iEnd) {
+        std::vector<int64_t> vRow0((size_t)nBlocks * 4), vRow1((size_t)nBlocks * 4);
+        int64_t (*pRow0)[4] = (int64_t (*)[4])vRow0.data(), (*pRow1)[4] = (int64_t (*)[4])vRow1.data();
+        auto blockRow = [&](int r, int64_t (*pSums)[4]) {
+            const uint8_t *pA = a.p + (size_t)4 * r * a.nPitch, *pB = b.p + (size_t)4 * r * b.nPitch;
+            if (a.b16) {
+                k.SsimBlocks16((const uint16_t *)pA, a.nPitch, (const uint16_t *)pB, b.nPitch, nBlocks, pSums);
+            } else {
+                k.SsimBlocks8(pA, a.nPitch, pB, b.nPitch, nBlocks, pSums);
+            }
+        };
+        int64_t nBandSsim = 0, nBandCs = 0;
+        blockRow(iBegin, pRow0);
+        for (int wy = iBegin; wy < iEnd; wy++) {
+            blockRow(wy + 1, pRow1);
+            for (int wx = 0; wx < nWindowsX; wx++) {
+                int64_t anSums[4], nWindowSsim, nWindowCs;
+                for (int j = 0; j < 4; j++) {
+                    anSums[j] = pRow0[wx][j] + pRow0[wx + 1][j] + pRow1[wx][j] + pRow1[wx + 1][j];
+                }
+                SsimFromSums(anSums, fC1, fC2, nWindowSsim, nWindowCs);
+                nBandSsim += nWindowSsim;
+                nBandCs += nWindowCs;
+            }
+            int64_t (*pTmp)[4] = pRow0;
+            pRow0 = pRow1;
+            pRow1 = pTmp;
+        }
+        std::lock_guard<std::mutex> lock(m);
+        nSsim += nBandSsim;
+        nCs += nBandCs;
+    });
+}
+
+inline void DownsampleHostMetricsPlane(const HostMetricsPlane &src, HostMetricsPlane &dst) {
+    dst.nWidth = src.nWidth / 2;
+    dst.nHeight = src.nHeight / 2;
+    dst.nPitch = dst.nWidth * 2;
+    dst.b16 = true;
+    dst.vBuffer.resize((size_t)dst.nPitch * dst.nHeight);
+    dst.p = dst.vBuffer.data();
+    MetricsPlane plane = src.ToMetricsPlane();
+    uint16_t *pDst = (uint16_t *)dst.vBuffer.data();
+    ForEachRowBand(dst.nHeight, (int64_t)src.nWidth * src.nHeight, [&](int iBegin, int iEnd) {
+        for (int y = iBegin; y < iEnd; y++) {
+            for (int x = 0; x < dst.nWidth; x++) {
+                pDst[(size_t)y * dst.nWidth + x] = DownsampleMetricsSample(plane, x, y);
+            }
+        }
+    });
+}
+
+/**
+* @brief The sums FrameMetricsEngine would produce for the same frames, with the given kernels.
+*/
+inline MetricsSums ComputeMetricsSumsHost(const HostMetricsKernels &kernels, const MetricsPlane *aRef, const MetricsPlane *aDis,
+    int nPlanes, int nBitDepth, uint32_t nFlags) {
+    MetricsSums sums = {};
+    // The 16-bit SIMD kernels take at most 12 bits
+    const HostMetricsKernels &k = nBitDepth > 12 ? GetHostMetricsKernels(HOST_SIMD_SCALAR) : kernels;
+    HostMetricsPlane aRefPlane[3], aDisPlane[3];
+    PrepareHostMetricsPlanes(aRef, nPlanes, aRefPlane);
+    PrepareHostMetricsPlanes(aDis, nPlanes, aDisPlane);
+
+    if (nFlags & METRICS_PSNR) {
+        for (int i = 0; i < nPlanes; i++) {
+            sums.anSse[i] = PlaneSseHost(k, aRefPlane[i], aDisPlane[i]);
+        }
+    }
+    double fC1, fC2;
+    GetSsimConstants(nBitDepth, fC1, fC2);
+    if (nFlags & (METRICS_SSIM | METRICS_MS_SSIM)) {
+        for (int i = 0; i < ((nFlags & METRICS_SSIM) ? nPlanes : 1); i++) {
+            PlaneSsimHost(k, aRefPlane[i], aDisPlane[i], fC1, fC2, sums.anSsim[i], sums.anCs[i]);
+        }
+    }
+    if (nFlags & METRICS_MS_SSIM) {
+        HostMetricsPlane ref[2], dis[2];
+        const HostMetricsPlane *pRef = &aRefPlane[0], *pDis = &aDisPlane[0];
+        for (int s = 1; s < METRICS_MS_SSIM_SCALES; s++) {
+            DownsampleHostMetricsPlane(*pRef, ref[s & 1]);
+            DownsampleHostMetricsPlane(*pDis, dis[s & 1]);
+            pRef = &ref[s & 1];
+            pDis = &dis[s & 1];
+            if (!GetSsimWindowsX(pRef->nWidth) || !GetSsimWindowsY(pRef->nHeight)) {
+                break;
+            }
+            PlaneSsimHost(k, *pRef, *pDis, fC1, fC2, sums.anSsim[2 + s], sums.anCs[2 + s]);
+        }
+    }
+    return sums;
+}
+
+/**
+* @brief CPU counterpart of FrameMetricsEngine::Compute() and GetResult() for frames in host memory.
+*/
+inline FrameMetrics ComputeFrameMetricsHost(const uint8_t *pRef, int nRefPitch, const uint8_t *pDis, int nDisPitch, int nWidth, int nHeight,
+    METRICS_FORMAT eFormat, int nBitDepth, uint32_t nFlags) {
+    nBitDepth = GetMetricsBitDepth(eFormat, nBitDepth);
+    MetricsPlane aRef[3], aDis[3];
+    GetMetricsPlanes(eFormat, nBitDepth, pRef, nRefPitch, nWidth, nHeight, aRef);
+    GetMetricsPlanes(eFormat, nBitDepth, pDis, nDisPitch, nWidth, nHeight, aDis);
+    int nPlanes = (nFlags & METRICS_LUMA_ONLY) ? 1 : 3;
+    MetricsSums sums = ComputeMetricsSumsHost(GetHostMetricsKernels(), aRef, aDis, nPlanes, nBitDepth, nFlags);
+    return MakeFrameMetrics(sums, aRef, nPlanes, nBitDepth, nFlags);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+//---------------------------------------------------------------------------
+//! \file HostSimd.h
+//! \brief Instruction set detection shared by the CPU kernels in HostColorConvert.h,
+//! HostMetrics.h and NalUnitSplitter.h.
+//!
+//! Kernels for every level are compiled into the same binary with per-function target
+//! attributes, so no -mavx2 or /arch flag is needed; callers pick a level at run time
+//! with DetectHostSimdLevel().
+//---------------------------------------------------------------------------
+
+// Host code only: under nvcc every level falls back to the scalar kernels
+#if !defined(__CUDACC__) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define HOSTCC_X86 1
+#if defined(__x86_64__) || defined(_M_X64)
+// SSE2 is part of the base instruction set and needs no detection
+#define HOSTCC_X86_64 1
+#endif
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define HOSTCC_TARGET_SSE2
+#define HOSTCC_TARGET_SSE41
+#define HOSTCC_TARGET_AVX2
+#else
+#define HOSTCC_TARGET_SSE2 __attribute__((target("sse2")))
+#define HOSTCC_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define HOSTCC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif !defined(__CUDACC__) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define HOSTCC_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef enum {
+    HOST_SIMD_SCALAR = 0,
+    HOST_SIMD_SSE41,
+    HOST_SIMD_AVX2,
+    HOST_SIMD_NEON,
+} HOST_SIMD_LEVEL;
+
+inline const char *GetHostSimdLevelName(HOST_SIMD_LEVEL eLevel) {
+    static const char *aszName[] = {"scalar", "sse4.1", "avx2", "neon"};
+    return aszName[eLevel];
+}
+
+inline HOST_SIMD_LEVEL DetectHostSimdLevel() {
+#if defined(HOSTCC_NEON)
+    return HOST_SIMD_NEON;
+#elif defined(HOSTCC_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int an[4];
+    __cpuid(an, 0);
+    int nMaxLeaf = an[0];
+    __cpuid(an, 1);
+    bool bSse41 = (an[2] & (1 << 19)) != 0;
+    // AVX state must also be enabled by the OS
+    bool bAvx = (an[2] & (1 << 27)) && (an[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    bool bAvx2 = false;
+    if (bAvx && nMaxLeaf >= 7) {
+        __cpuidex(an, 7, 0);
+        bAvx2 = (an[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool bSse41 = __builtin_cpu_supports("sse4.1");
+    bool bAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    return bAvx2 ? HOST_SIMD_AVX2 : (bSse41 ? HOST_SIMD_SSE41 : HOST_SIMD_SCALAR);
+#else
+    return HOST_SIMD_SCALAR;
+#endif
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <codec/codec.h>
+#include "NvCodecUtils.h"
+#include "Av1ObuParser.h"
+
+//---------------------------------------------------------------------------
+//! \file IVFReader.h
+//! \brief Reads IVF files without FFmpeg.
+//!
+//! The file is memory mapped and frames are returned as pointers into the mapping, so reading
+//! costs no copies and keyframe indexing only touches the 12-byte frame headers and the first
+//! OBUs of each frame.
+//---------------------------------------------------------------------------
+
+/**
+* @brief One IVF frame. For AV1 this is one temporal unit.
+*/
+struct IVFFrame {
+    const uint8_t *pData;
+    uint32_t nSize;
+    int64_t nPts;
+    uint64_t nOffset; /*!< File offset of the 12-byte frame header */
+};
+
+class IVFReader {
+public:
+    IVFReader(const char *szFilePath) : file(szFilePath) {
+        if (!file.GetBuffer(&pBuf, &nSize) || nSize < 32) {
+            LOG(ERROR) << "Unable to read IVF file: " << szFilePath;
+            pBuf = NULL;
+            return;
+        }
+        if (pBuf[0] != 'D' || pBuf[1] != 'K' || pBuf[2] != 'I' || pBuf[3] != 'F') {
+            LOG(ERROR) << "Not an IVF file: " << szFilePath;
+            pBuf = NULL;
+            return;
+        }
+        nHeaderSize = GetLe16(pBuf + 6);
+        nFourCC = GetLe32(pBuf + 8);
+        nWidth = GetLe16(pBuf + 12);
+        nHeight = GetLe16(pBuf + 14);
+        nFrameRateNum = GetLe32(pBuf + 16);
+        nFrameRateDen = GetLe32(pBuf + 20);
+        nFrameCount = GetLe32(pBuf + 24);
+        if (nHeaderSize < 32 || nHeaderSize > nSize) {
+            nHeaderSize = 32;
+        }
+        nPos = nHeaderSize;
+    }
+
+    bool IsValid() const {
+        return pBuf != NULL;
+    }
+    uint32_t GetFourCC() const {
+        return nFourCC;
+    }
+    bool IsAV1() const {
+        return nFourCC == MAKE_FOURCC('A', 'V', '0', '1');
+    }
+    uint32_t GetWidth() const {
+        return nWidth;
+    }
+    uint32_t GetHeight() const {
+        return nHeight;
+    }
+    uint32_t GetFrameRateNum() const {
+        return nFrameRateNum;
+    }
+    uint32_t GetFrameRateDen() const {
+        return nFrameRateDen;
+    }
+    /**
+    *   @brief  Frame count stored in the file header. Writers that do not patch the header leave a placeholder here.
+    */
+    uint32_t GetHeaderFrameCount() const {
+        return nFrameCount;
+    }
+
+    /**
+    *   @brief  Returns the next frame as a pointer into the mapped file.
+    */
+    bool ReadFrame(IVFFrame &frame) {
+        if (!pBuf || nSize - nPos < 12) {
+            return false;
+        }
+        uint32_t nFrameSize = GetLe32(pBuf + nPos);
+        if (nFrameSize > nSize - nPos - 12) {
+            LOG(WARNING) << "Truncated IVF frame at offset " << nPos;
+            return false;
+        }
+        frame.nOffset = nPos;
+        frame.nSize = nFrameSize;
+        frame.nPts = (int64_t)((uint64_t)GetLe32(pBuf + nPos + 4) | ((uint64_t)GetLe32(pBuf + nPos + 8) << 32));
+        frame.pData = pBuf + nPos + 12;
+        nPos += 12 + (uint64_t)nFrameSize;
+        return true;
+    }
+
+    /**
+    *   @brief  Returns the next frame as a CodecPacket that can be passed to cdc::Decoder::DecodePacket().
+    *   The packet data points into the mapped file and stays valid for the lifetime of the reader.
+    */
+    bool ReadPacket(cdc::CodecPacket &packet) {
+        IVFFrame frame;
+        if (!ReadFrame(frame)) {
+            return false;
+        }
+        UpdateSequenceHeader(frame);
+        packet.data = const_cast<uint8_t *>(frame.pData);
+        packet.size = frame.nSize;
+        packet.timestamp = (uint64_t)frame.nPts;
+        packet.keyFrame = IsAV1() && IsKeyFrameTemporalUnit(frame.pData, frame.nSize, bHaveSequenceHeader ? &seq : NULL);
+        return true;
+    }
+
+    /**
+    *   @brief  Positions the reader at a frame header offset, e.g. one returned by BuildKeyFrameIndex().
+    */
+    bool Seek(uint64_t nOffset) {
+        if (!pBuf || nOffset < nHeaderSize || nOffset > nSize) {
+            return false;
+        }
+        nPos = nOffset;
+        return true;
+    }
+    void Rewind() {
+        nPos = nHeaderSize;
+    }
+
+    /**
+    *   @brief  Scans the whole file and returns the frames that start with a shown key frame.
+    *   Only frame headers and the leading OBU headers are read. The read position is preserved.
+    */
+    void BuildKeyFrameIndex(std::vector<IVFFrame> &vKeyFrames) {
+        vKeyFrames.clear();
+        uint64_t nSavedPos = nPos;
+        Rewind();
+        IVFFrame frame;
+        while (ReadFrame(frame)) {
+            UpdateSequenceHeader(frame);
+            if (IsKeyFrameTemporalUnit(frame.pData, frame.nSize, bHaveSequenceHeader ? &seq : NULL)) {
+                vKeyFrames.push_back(frame);
+            }
+        }
+        nPos = nSavedPos;
+    }
+
+    /**
+    *   @brief  Returns the most recent AV1 sequence header seen by ReadPacket() or BuildKeyFrameIndex().
+    */
+    bool GetSequenceHeader(Av1SequenceHeader &seqHeader) const {
+        if (!bHaveSequenceHeader) {
+            return false;
+        }
+        seqHeader = seq;
+        return true;
+    }
+
+private:
+    void UpdateSequenceHeader(const IVFFrame &frame) {
+        // The sequence header, when present, precedes the frame OBUs of a temporal unit. A corrupt one must not
+        // replace the last good header, which keyframe detection keeps using
+        Av1SequenceHeader parsed;
+        if (IsAV1() && FindSequenceHeader(frame.pData, frame.nSize, parsed)) {
+            seq = parsed;
+            bHaveSequenceHeader = true;
+        }
+    }
+
+    static uint32_t GetLe16(const uint8_t *p) {
+        return p[0] | (p[1] << 8);
+    }
+    static uint32_t GetLe32(const uint8_t *p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+private:
+    MappedFileReader file;
+    const uint8_t *pBuf = NULL;
+    uint64_t nSize = 0;
+    uint64_t nPos = 0;
+    uint32_t nHeaderSize = 32;
+    uint32_t nFourCC = 0;
+    uint32_t nWidth = 0, nHeight = 0;
+    uint32_t nFrameRateNum = 0, nFrameRateDen = 0;
+    uint32_t nFrameCount = 0;
+    Av1SequenceHeader seq = {};
+    bool bHaveSequenceHeader = false;
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <codec/codec.h>
+#include "NvCodecUtils.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <errno.h>
+#include <limits.h>
+#endif
+
+//---------------------------------------------------------------------------
+//! \file IVFWriter.h
+//! \brief Buffered IVF writer for raw AV1 (or VP8/VP9) frames.
+//!
+//! Frame headers are written straight into a fixed staging buffer. Small frames are copied
+//! after their header; large frames are referenced in place and go out together with the
+//! staged bytes in one writev() call. The frame count in the file header is patched on Close().
+//---------------------------------------------------------------------------
+
+class IVFWriter {
+public:
+    /**
+    *   @brief  Creates the file and stages the file header.
+    *   @param  nBufferSize     Staging buffer size. Frames up to nBufferSize / 4 bytes are copied, larger ones are written from the caller's memory.
+    */
+    IVFWriter(const char *szFilePath, uint32_t nFourCC, uint32_t nWidth, uint32_t nHeight, uint32_t nFrameRateNum, uint32_t nFrameRateDen,
+        size_t nBufferSize = 1 << 20) : vStaging(nBufferSize < 4096 ? 4096 : nBufferSize) {
+        nCopyThreshold = vStaging.size() / 4;
+#ifdef _WIN32
+        fp = fopen(szFilePath, "wb");
+        bool bOpened = fp != NULL;
+#else
+        fd = open(szFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool bOpened = fd >= 0;
+#endif
+        if (!bOpened) {
+            LOG(ERROR) << "Unable to open output file: " << szFilePath;
+            return;
+        }
+        Append(vStaging.data(), IVFUtils::WriteFileHeader(vStaging.data(), nFourCC, nWidth, nHeight, nFrameRateNum, nFrameRateDen, 0));
+    }
+
+    ~IVFWriter() {
+        Close();
+    }
+
+    bool IsValid() const {
+#ifdef _WIN32
+        return fp != NULL;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    /**
+    *   @brief  Writes one frame. Returns once pData is no longer referenced.
+    */
+    bool WriteFrame(const uint8_t *pData, size_t nSize, int64_t nPts) {
+        if (!IsValid()) {
+            return false;
+        }
+        bool bReferenced = StageFrame(pData, nSize, nPts);
+        // The caller's buffer is only guaranteed valid for the duration of the call
+        return bReferenced ? Flush() : !bError;
+    }
+
+    bool WriteFrame(const cdc::CodecPacket &packet) {
+        return WriteFrame((const uint8_t *)packet.data, packet.size, (int64_t)packet.timestamp);
+    }
+
+    /**
+    *   @brief  Writes a batch of frames with as few system calls as the staging buffer and IOV_MAX allow.
+    */
+    bool WriteFrames(const cdc::CodecPacket *pPackets, size_t nPackets) {
+        if (!IsValid()) {
+            return false;
+        }
+        bool bReferenced = false;
+        for (size_t i = 0; i < nPackets; i++) {
+            bReferenced |= StageFrame((const uint8_t *)pPackets[i].data, pPackets[i].size, (int64_t)pPackets[i].timestamp);
+        }
+        return bReferenced ? Flush() : !bError;
+    }
+
+    /**
+    *   @brief  Writes all staged bytes to the file.
+    */
+    bool Flush() {
+        if (!IsValid()) {
+            return false;
+        }
+#ifdef _WIN32
+        for (const IoVec &iov : vIov) {
+            if (fwrite(iov.iov_base, 1, iov.iov_len, fp) != iov.iov_len) {
+                bError = true;
+                break;
+            }
+        }
+#else
+        size_t iFirst = 0;
+        while (iFirst < vIov.size() && !bError) {
+            int nIov = (int)std::min(vIov.size() - iFirst, (size_t)IOV_MAX);
+            ssize_t nWritten = writev(fd, &vIov[iFirst], nIov);
+            if (nWritten < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                bError = true;
+                break;
+            }
+            // Short write: drop the entries written completely and trim the partially written one
+            while (iFirst < vIov.size() && (size_t)nWritten >= vIov[iFirst].iov_len) {
+                nWritten -= vIov[iFirst++].iov_len;
+            }
+            if (nWritten > 0) {
+                vIov[iFirst].iov_base = (uint8_t *)vIov[iFirst].iov_base + nWritten;
+                vIov[iFirst].iov_len -= nWritten;
+            }
+        }
+#endif
+        if (bError) {
+            LOG(ERROR) << "IVF write failed after " << nFrameCount << " frames";
+        }
+        vIov.clear();
+        nStaged = 0;
+        return !bError;
+    }
+
+    /**
+    *   @brief  Flushes, writes the final frame count into the file header and closes the file.
+    */
+    bool Close() {
+        if (!IsValid()) {
+            return false;
+        }
+        bool bOk = Flush();
+        uint8_t frameCount[4];
+        IVFUtils::PutFrameCount(frameCount, nFrameCount);
+#ifdef _WIN32
+        bool bPatched = fseek(fp, IVFUtils::nFrameCountOffset, SEEK_SET) == 0 && fwrite(frameCount, 1, 4, fp) == 4;
+        bOk = fclose(fp) == 0 && bOk;
+        fp = NULL;
+#else
+        bool bPatched = pwrite(fd, frameCount, 4, IVFUtils::nFrameCountOffset) == 4;
+        bOk = close(fd) == 0 && bOk;
+        fd = -1;
+#endif
+        if (!bPatched) {
+            // Pipes and other unseekable outputs keep the placeholder count
+            LOG(WARNING) << "Unable to patch IVF frame count";
+        }
+        return bOk;
+    }
+
+    uint32_t GetFrameCount() const {
+        return nFrameCount;
+    }
+
+private:
+#ifdef _WIN32
+    struct IoVec {
+        void *iov_base;
+        size_t iov_len;
+    };
+#else
+    typedef struct iovec IoVec;
+#endif
+
+    /**
+    *   @brief  Stages the frame header and payload. Returns true if the payload is referenced rather than copied.
+    */
+    bool StageFrame(const uint8_t *pData, size_t nSize, int64_t nPts) {
+        bool bCopy = nSize <= nCopyThreshold;
+        if (vStaging.size() - nStaged < IVFUtils::nFrameHeaderSize + (bCopy ? nSize : 0)) {
+            Flush();
+        }
+        uint8_t *pDst = vStaging.data() + nStaged;
+        uint32_t nHeader = IVFUtils::WriteFrameHeader(pDst, nSize, nPts);
+        if (bCopy) {
+            memcpy(pDst + nHeader, pData, nSize);
+            Append(pDst, nHeader + nSize);
+        } else {
+            Append(pDst, nHeader);
+            vIov.push_back(IoVec{(void *)pData, nSize});
+        }
+        nFrameCount++;
+        return !bCopy;
+    }
+
+    void Append(uint8_t *p, size_t nSize) {
+        // Staged bytes are contiguous, so consecutive copies share one iovec
+        if (!vIov.empty() && (uint8_t *)vIov.back().iov_base + vIov.back().iov_len == p) {
+            vIov.back().iov_len += nSize;
+        } else {
+            vIov.push_back(IoVec{p, nSize});
+        }
+        nStaged = p + nSize - vStaging.data();
+    }
+
+private:
+#ifdef _WIN32
+    FILE *fp = NULL;
+#else
+    int fd = -1;
+#endif
+    std::vector<uint8_t> vStaging;
+    size_t nStaged = 0;
+    size_t nCopyThreshold = 0;
+    std::vector<IoVec> vIov;
+    uint32_t nFrameCount = 0;
+    bool bError = false;
+};
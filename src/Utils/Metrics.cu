@@ -25,75 +25,214 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include "Metrics.h"      
+#include "Metrics.h"
+
+#define METRICS_BLOCK_X 32
+#define METRICS_BLOCK_Y 8
+// Rows of blocks per launch; each thread loops over the remaining rows, which keeps the number of atomics small
+#define METRICS_MAX_GRID_Y 16
+
+struct MetricsPlanes {
+    MetricsPlane a[3];
+};
+
+// Adds v over the block to *p with one atomic. Every thread of the block must call it.
+static __device__ void BlockAtomicAdd(unsigned long long v, unsigned long long *p) {
+    __shared__ unsigned long long anWarp[METRICS_BLOCK_X * METRICS_BLOCK_Y / 32];
+    int iThread = threadIdx.y * blockDim.x + threadIdx.x;
+    for (int i = 16; i > 0; i >>= 1) {
+        v += __shfl_down_sync(0xffffffff, v, i);
+    }
+    // A previous call may still be reading anWarp
+    __syncthreads();
+    if (iThread % 32 == 0) {
+        anWarp[iThread / 32] = v;
+    }
+    __syncthreads();
+    if (iThread == 0) {
+        unsigned long long nSum = 0;
+        for (int i = 0; i < (int)(blockDim.x * blockDim.y / 32); i++) {
+            nSum += anWarp[i];
+        }
+        if (nSum) {
+            atomicAdd(p, nSum);
+        }
+    }
+}
 
-__global__ void squaredErrorKernel(const uint8_t* image1, const uint8_t* image2, uint32_t width, uint32_t height, uint32_t pitch, float* sse) {
-    extern __shared__ float sdata[];
+// Plane blockIdx.z; each thread takes 4 samples of every gridDim.y * blockDim.y-th row
+static __global__ void MetricsSseKernel(MetricsPlanes ref, MetricsPlanes dis, MetricsSums *pSums) {
+    const MetricsPlane &a = ref.a[blockIdx.z], &b = dis.a[blockIdx.z];
+    unsigned long long nSse = 0;
+    int x0 = (blockIdx.x * blockDim.x + threadIdx.x) * 4;
+    for (int y = blockIdx.y * blockDim.y + threadIdx.y; y < a.nHeight; y += gridDim.y * blockDim.y) {
+        for (int x = x0; x < x0 + 4 && x < a.nWidth; x++) {
+            long long d = (long long)LoadMetricsSample(a, x, y) - (long long)LoadMetricsSample(b, x, y);
+            nSse += (unsigned long long)(d * d);
+        }
+    }
+    BlockAtomicAdd(nSse, (unsigned long long *)&pSums->anSse[blockIdx.z]);
+}
 
-    unsigned int tid = threadIdx.x;
-    unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
-    unsigned int stride = gridDim.x * blockDim.x;
+// One thread per window column; plane blockIdx.z adds to SSIM pass iPass + blockIdx.z
+static __global__ void MetricsSsimKernel(MetricsPlanes ref, MetricsPlanes dis, double fC1, double fC2, MetricsSums *pSums, int iPass) {
+    const MetricsPlane &a = ref.a[blockIdx.z], &b = dis.a[blockIdx.z];
+    int nWindowsX = GetSsimWindowsX(a.nWidth), nWindowsY = GetSsimWindowsY(a.nHeight);
+    long long nSsim = 0, nCs = 0;
+    int wx = blockIdx.x * blockDim.x + threadIdx.x;
+    for (int wy = blockIdx.y * blockDim.y + threadIdx.y; wx < nWindowsX && wy < nWindowsY; wy += gridDim.y * blockDim.y) {
+        int64_t anSums[4], nWindowSsim, nWindowCs;
+        SsimWindowSums(a, b, 4 * wx, 4 * wy, anSums);
+        SsimFromSums(anSums, fC1, fC2, nWindowSsim, nWindowCs);
+        nSsim += nWindowSsim;
+        nCs += nWindowCs;
+    }
+    // Fixed-point sums may be negative; two's complement addition gives the same bits
+    BlockAtomicAdd((unsigned long long)nSsim, (unsigned long long *)&pSums->anSsim[iPass + blockIdx.z]);
+    BlockAtomicAdd((unsigned long long)nCs, (unsigned long long *)&pSums->anCs[iPass + blockIdx.z]);
+}
 
-    float sum = 0.0f;
+// Next MS-SSIM scale of the reference (blockIdx.z 0, from src.a[0]) and distorted (1, from src.a[1]) luma
+static __global__ void MetricsDownsampleKernel(MetricsPlanes src, uint16_t *dpRef, uint16_t *dpDis, int nWidth, int nHeight) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x, y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= nWidth || y >= nHeight) {
+        return;
+    }
+    (blockIdx.z ? dpDis : dpRef)[(size_t)y * nWidth + x] = DownsampleMetricsSample(src.a[blockIdx.z], x, y);
+}
 
-    // Accumulate squared error for this thread's part of the image
-    while (idx < width * height) {
-        int row = idx / width;
-        int col = idx % width;
-        
-        int idx1 = row * pitch + col;
-        int idx2 = row * pitch + col;
+static int MetricsGridY(int nRows) {
+    int n = (nRows + METRICS_BLOCK_Y - 1) / METRICS_BLOCK_Y;
+    return n < METRICS_MAX_GRID_Y ? n : METRICS_MAX_GRID_Y;
+}
 
-        float diff = static_cast<float>(image1[idx1]) - static_cast<float>(image2[idx2]);
-        sum += diff * diff;
-        idx += stride;
+static void LaunchMetricsSsim(const MetricsPlanes &ref, const MetricsPlanes &dis, int nPlanes, double fC1, double fC2, MetricsSums *dpSums,
+    int iPass, cudaStream_t stream) {
+    int nWindowsX = GetSsimWindowsX(ref.a[0].nWidth), nWindowsY = GetSsimWindowsY(ref.a[0].nHeight);
+    if (!nWindowsX || !nWindowsY) {
+        return;
     }
+    dim3 block(METRICS_BLOCK_X, METRICS_BLOCK_Y);
+    dim3 grid((nWindowsX + block.x - 1) / block.x, MetricsGridY(nWindowsY), nPlanes);
+    MetricsSsimKernel<<<grid, block, 0, stream>>>(ref, dis, fC1, fC2, dpSums, iPass);
+}
 
-    // Store the result in shared memory
-    sdata[tid] = sum;
-    __syncthreads();
-
-    // Reduce within the block
-    for (unsigned int s = blockDim.x / 2; s > 0; s >>= 1) {
-        if (tid < s) {
-            sdata[tid] += sdata[tid + s];
+FrameMetricsEngine::FrameMetricsEngine(int nMaxWidth, int nMaxHeight, uint32_t nFlags)
+    : nMaxWidth(nMaxWidth), nMaxHeight(nMaxHeight), nMaxFlags(nFlags) {
+    if (!ck(cudaMalloc(&dpSums, sizeof(MetricsSums)))) {
+        dpSums = nullptr;
+    }
+    if (!ck(cudaMallocHost(&pSums, sizeof(MetricsSums)))) {
+        pSums = nullptr;
+    }
+    if (!ck(cudaEventCreateWithFlags(&event, cudaEventDisableTiming))) {
+        event = nullptr;
+    }
+    if (nFlags & METRICS_MS_SSIM) {
+        // Reference and distorted luma at scales 1 and up, packed without padding
+        size_t nSamples = 0;
+        for (int s = 1, w = nMaxWidth / 2, h = nMaxHeight / 2; s < METRICS_MS_SSIM_SCALES; s++, w /= 2, h /= 2) {
+            nSamples += (size_t)w * h;
+        }
+        if (nSamples && !ck(cudaMalloc(&dpPyramid, 2 * nSamples * sizeof(uint16_t)))) {
+            dpPyramid = nullptr;
         }
-        __syncthreads();
     }
+}
 
-    // Write the result of this block to the output array
-    if (tid == 0) {
-        atomicAdd(sse, sdata[0]);
+FrameMetricsEngine::~FrameMetricsEngine() {
+    if (event) {
+        ck(cudaEventDestroy(event));
     }
+    ck(cudaFree(dpPyramid));
+    ck(cudaFreeHost(pSums));
+    ck(cudaFree(dpSums));
 }
 
-void squaredError(uint8_t* image1, uint8_t* image2, uint32_t width, uint32_t height, uint32_t pitch, float &sse) {
-    int threadsPerBlock = 256;
-    int blocksPerGrid = (width * height + threadsPerBlock - 1) / threadsPerBlock;
-    int sharedMemSize = threadsPerBlock * sizeof(float);
-    float *sseDevice;
-
-    ck(cudaMalloc(&sseDevice, sizeof(float)));
-    ck(cudaMemset(sseDevice, 0, sizeof(float)));
+bool FrameMetricsEngine::Compute(const uint8_t *dpRef, int nRefPitch, const uint8_t *dpDis, int nDisPitch, int nWidth, int nHeight,
+    METRICS_FORMAT eFormat, int nBitDepth, uint32_t nFlags, cudaStream_t stream) {
+    bPending = false;
+    if (!dpSums || !pSums || !event) {
+        LOG(ERROR) << "FrameMetricsEngine: scratch allocation failed";
+        return false;
+    }
+    if (nWidth <= 0 || nHeight <= 0 || nWidth > nMaxWidth || nHeight > nMaxHeight) {
+        LOG(ERROR) << "FrameMetricsEngine: frame " << nWidth << "x" << nHeight << " outside " << nMaxWidth << "x" << nMaxHeight;
+        return false;
+    }
+    if ((nFlags & METRICS_MS_SSIM) && !dpPyramid) {
+        LOG(ERROR) << "FrameMetricsEngine: MS-SSIM was not enabled at creation";
+        return false;
+    }
 
-    squaredErrorKernel<<<blocksPerGrid, threadsPerBlock, sharedMemSize>>>(image1, image2, width, height, pitch, sseDevice);
-    CudaCheckError();
-    ck(cudaDeviceSynchronize());
+    this->nBitDepth = GetMetricsBitDepth(eFormat, nBitDepth);
+    this->nFlags = nFlags;
+    nPlanes = (nFlags & METRICS_LUMA_ONLY) ? 1 : 3;
+    MetricsPlanes ref, dis;
+    GetMetricsPlanes(eFormat, this->nBitDepth, dpRef, nRefPitch, nWidth, nHeight, ref.a);
+    GetMetricsPlanes(eFormat, this->nBitDepth, dpDis, nDisPitch, nWidth, nHeight, dis.a);
+    for (int i = 0; i < 3; i++) {
+        aPlane[i] = ref.a[i];
+    }
 
-    ck(cudaMemcpy(&sse, sseDevice, sizeof(float), cudaMemcpyDeviceToHost));
-    ck(cudaFree(sseDevice));
+    ck(cudaMemsetAsync(dpSums, 0, sizeof(MetricsSums), stream));
+    dim3 block(METRICS_BLOCK_X, METRICS_BLOCK_Y);
+    if (nFlags & METRICS_PSNR) {
+        dim3 grid((nWidth + 4 * block.x - 1) / (4 * block.x), MetricsGridY(nHeight), nPlanes);
+        MetricsSseKernel<<<grid, block, 0, stream>>>(ref, dis, dpSums);
+    }
+    double fC1, fC2;
+    GetSsimConstants(this->nBitDepth, fC1, fC2);
+    if (nFlags & (METRICS_SSIM | METRICS_MS_SSIM)) {
+        // MS-SSIM alone still needs the full-resolution luma pass
+        LaunchMetricsSsim(ref, dis, (nFlags & METRICS_SSIM) ? nPlanes : 1, fC1, fC2, dpSums, 0, stream);
+    }
+    if (nFlags & METRICS_MS_SSIM) {
+        MetricsPlanes src;
+        src.a[0] = ref.a[0];
+        src.a[1] = dis.a[0];
+        uint16_t *dpScale = dpPyramid;
+        for (int s = 1, w = nWidth / 2, h = nHeight / 2; s < METRICS_MS_SSIM_SCALES; s++, w /= 2, h /= 2) {
+            if (!GetSsimWindowsX(w) || !GetSsimWindowsY(h)) {
+                break;
+            }
+            uint16_t *dpRefScale = dpScale, *dpDisScale = dpScale + (size_t)w * h;
+            dpScale += 2 * (size_t)w * h;
+            dim3 grid((w + block.x - 1) / block.x, (h + block.y - 1) / block.y, 2);
+            MetricsDownsampleKernel<<<grid, block, 0, stream>>>(src, dpRefScale, dpDisScale, w, h);
+
+            MetricsPlanes refScale, disScale;
+            refScale.a[0] = {(const uint8_t *)dpRefScale, w * 2, w, h, 1, 2, 0};
+            disScale.a[0] = {(const uint8_t *)dpDisScale, w * 2, w, h, 1, 2, 0};
+            LaunchMetricsSsim(refScale, disScale, 1, fC1, fC2, dpSums, 2 + s, stream);
+            src.a[0] = refScale.a[0];
+            src.a[1] = disScale.a[0];
+        }
+    }
+    ck(cudaMemcpyAsync(pSums, dpSums, sizeof(MetricsSums), cudaMemcpyDeviceToHost, stream));
+    ck(cudaEventRecord(event, stream));
+    bPending = ck(cudaGetLastError());
+    return bPending;
 }
 
-void calcPSNRY(uint8_t* ref, uint8_t* dis, uint32_t width, uint32_t height, uint32_t pitch, float &psnr) { 
-    float sse = 0.0f;
-    float mse = 0.0f;
-    uint32_t MAX = 255;
+bool FrameMetricsEngine::IsResultReady() {
+    return bPending && cudaEventQuery(event) == cudaSuccess;
+}
 
-    squaredError(ref, dis, width, height, pitch, sse);
-    mse = sse / (width * height);
-    if (mse) 
-        psnr = 10.0f * log10f(MAX * MAX / mse);
-    else
-        psnr = 100.0;
+bool FrameMetricsEngine::GetResult(FrameMetrics &metrics) {
+    if (!bPending || !ck(cudaEventSynchronize(event))) {
+        return false;
+    }
+    bPending = false;
+    metrics = MakeFrameMetrics(*pSums, aPlane, nPlanes, nBitDepth, nFlags);
+    return true;
+}
 
-}
\ No newline at end of file
+void calcPSNRY(uint8_t* ref, uint8_t* dis, uint32_t width, uint32_t height, uint32_t pitch, float &psnr) {
+    FrameMetricsEngine engine((int)width, (int)height, METRICS_PSNR);
+    FrameMetrics metrics;
+    if (engine.Compute(ref, (int)pitch, dis, (int)pitch, (int)width, (int)height, METRICS_FORMAT_NV12, 8, METRICS_PSNR | METRICS_LUMA_ONLY)
+        && engine.GetResult(metrics)) {
+        psnr = (float)metrics.adPsnr[0];
+    }
+}
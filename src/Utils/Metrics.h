@@ -31,5 +31,51 @@
 #include <stdio.h>
 #include <math.h>
 #include "NvCodecUtils.h"
+#include "MetricsMath.h"
 
+/**
+* @brief PSNR, SSIM and MS-SSIM of decoded or reconstructed frames against their source, computed on the GPU into
+* scratch allocated once per session. Compute() only enqueues work and a copy of the sums to pinned memory on the
+* caller's stream; GetResult() waits for that copy. Sums are integer or fixed point, so results do not depend on
+* thread scheduling and match ComputeFrameMetricsHost() (HostMetrics.h). One computation may be in flight at a time;
+* not thread safe. Create and destroy with the CUDA context current.
+*/
+class FrameMetricsEngine {
+public:
+    /**
+    *   @param  nFlags  Metrics later calls may ask for; MS-SSIM needs a luma pyramid of about nMaxWidth * nMaxHeight samples
+    */
+    FrameMetricsEngine(int nMaxWidth, int nMaxHeight, uint32_t nFlags = METRICS_PSNR | METRICS_SSIM);
+    ~FrameMetricsEngine();
+
+    /**
+    * @brief Enqueues the metrics of dpDis against dpRef, two frames of eFormat with chroma after luma.
+    *   @param  nBitDepth  Significant bits of 16-bit formats; ignored for 8-bit ones
+    *   @param  nFlags     METRICS_FLAGS
+    */
+    bool Compute(const uint8_t *dpRef, int nRefPitch, const uint8_t *dpDis, int nDisPitch, int nWidth, int nHeight, METRICS_FORMAT eFormat,
+        int nBitDepth, uint32_t nFlags, CUstream_st *stream = nullptr);
+    // Whether the last Compute() has finished, without blocking
+    bool IsResultReady();
+    // Waits for the last Compute(); false if there is none or it failed
+    bool GetResult(FrameMetrics &metrics);
+
+private:
+    FrameMetricsEngine(const FrameMetricsEngine &) = delete;
+    FrameMetricsEngine &operator=(const FrameMetricsEngine &) = delete;
+
+    int nMaxWidth, nMaxHeight;
+    uint32_t nMaxFlags;
+    MetricsSums *dpSums = nullptr, *pSums = nullptr;
+    uint16_t *dpPyramid = nullptr;
+    cudaEvent_t event = nullptr;
+
+    // Everything MakeFrameMetrics() needs for the computation in flight
+    MetricsPlane aPlane[3];
+    int nPlanes = 0, nBitDepth = 8;
+    uint32_t nFlags = 0;
+    bool bPending = false;
+};
+
+// Luma PSNR of two 8-bit frames with the same pitch. Allocates on every call; use FrameMetricsEngine on hot paths.
 void calcPSNRY(uint8_t* ref, uint8_t* dis, uint32_t width, uint32_t height, uint32_t pitch, float &psnr);
\ No newline at end of file
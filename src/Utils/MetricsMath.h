@@ -0,0 +1,210 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ColorSpaceMath.h"
+
+//---------------------------------------------------------------------------
+//! \file MetricsMath.h
+//! \brief Per-sample and per-window math of the frame quality metrics, shared by
+//! FrameMetricsEngine (Metrics.cu) and the CPU implementation in HostMetrics.h.
+//!
+//! Squared errors are summed as integers. SSIM is evaluated on 8x8 windows every 4
+//! samples from integer sums; each window value is computed in double from exact
+//! operands and added in 32.32 fixed point, so the totals do not depend on the order
+//! in which threads add them and both implementations give identical results.
+//! MS-SSIM uses the same windows on a 2x2-averaged luma pyramid of up to five scales.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    METRICS_FORMAT_NV12 = 0,                /*!< 8-bit 4:2:0, interleaved chroma */
+    METRICS_FORMAT_P016,                    /*!< 16-bit MSB-aligned 4:2:0, interleaved chroma (P010 with nBitDepth 10) */
+    METRICS_FORMAT_YUV444,                  /*!< 8-bit, three full planes */
+    METRICS_FORMAT_YUV444P16,               /*!< 16-bit MSB-aligned, three full planes */
+} METRICS_FORMAT;
+
+typedef enum {
+    METRICS_PSNR = 1,
+    METRICS_SSIM = 2,
+    METRICS_MS_SSIM = 4,                    /*!< Luma only */
+    METRICS_LUMA_ONLY = 8,                  /*!< Skip the chroma planes */
+} METRICS_FLAGS;
+
+#define METRICS_MS_SSIM_SCALES 5
+// SSIM passes: Y, U and V at full resolution, then luma at scales 1 to METRICS_MS_SSIM_SCALES - 1
+#define METRICS_SSIM_PASSES (3 + METRICS_MS_SSIM_SCALES - 1)
+#define METRICS_FIXED_ONE 4294967296.0
+
+/**
+* @brief One plane to measure. nStep is 2 for interleaved chroma; 16-bit samples are shifted right by nShift.
+*/
+struct MetricsPlane {
+    const uint8_t *p;
+    int nPitch;
+    int nWidth, nHeight;
+    int nStep;
+    int nBytesPerSample;
+    int nShift;
+};
+
+/**
+* @brief What both implementations accumulate, before it is turned into FrameMetrics.
+*/
+struct MetricsSums {
+    uint64_t anSse[3];
+    int64_t anSsim[METRICS_SSIM_PASSES];    /*!< Sum of window SSIM in 32.32 fixed point */
+    int64_t anCs[METRICS_SSIM_PASSES];      /*!< Sum of window contrast-structure terms, same units */
+};
+
+/**
+* @brief Metrics of one frame; values that were not requested are 0. PSNR of identical planes is reported as 100.
+*/
+struct FrameMetrics {
+    double adPsnr[3];                       /*!< Y, U, V */
+    double dPsnrYuv;                        /*!< From the squared error summed over all measured samples */
+    double adSsim[3];
+    double dMsSsim;
+};
+
+inline int GetMetricsBitDepth(METRICS_FORMAT eFormat, int nBitDepth) {
+    return eFormat == METRICS_FORMAT_NV12 || eFormat == METRICS_FORMAT_YUV444 ? 8 : nBitDepth;
+}
+
+/**
+* @brief Planes of a contiguous frame with chroma after luma, as the decoder and encoder lay them out.
+*/
+inline void GetMetricsPlanes(METRICS_FORMAT eFormat, int nBitDepth, const uint8_t *pFrame, int nPitch, int nWidth, int nHeight,
+    MetricsPlane *aPlane) {
+    int nBytes = eFormat == METRICS_FORMAT_NV12 || eFormat == METRICS_FORMAT_YUV444 ? 1 : 2;
+    int nShift = nBytes == 2 ? 16 - nBitDepth : 0;
+    aPlane[0] = {pFrame, nPitch, nWidth, nHeight, 1, nBytes, nShift};
+    if (eFormat == METRICS_FORMAT_YUV444 || eFormat == METRICS_FORMAT_YUV444P16) {
+        aPlane[1] = {pFrame + (size_t)nPitch * nHeight, nPitch, nWidth, nHeight, 1, nBytes, nShift};
+        aPlane[2] = {pFrame + (size_t)nPitch * nHeight * 2, nPitch, nWidth, nHeight, 1, nBytes, nShift};
+    } else {
+        const uint8_t *pUv = pFrame + (size_t)nPitch * nHeight;
+        aPlane[1] = {pUv, nPitch, (nWidth + 1) / 2, (nHeight + 1) / 2, 2, nBytes, nShift};
+        aPlane[2] = {pUv + nBytes, nPitch, (nWidth + 1) / 2, (nHeight + 1) / 2, 2, nBytes, nShift};
+    }
+}
+
+inline COLORSPACE_HD uint32_t LoadMetricsSample(const MetricsPlane &plane, int x, int y) {
+    const uint8_t *pRow = plane.p + (size_t)y * plane.nPitch;
+    return plane.nBytesPerSample == 1 ? pRow[x * plane.nStep] : ((const uint16_t *)pRow)[x * plane.nStep] >> plane.nShift;
+}
+
+/**
+* @brief Rounded average of the 2x2 block at (2 * x, 2 * y); one sample of the next MS-SSIM scale.
+*/
+inline COLORSPACE_HD uint16_t DownsampleMetricsSample(const MetricsPlane &plane, int x, int y) {
+    uint32_t n = LoadMetricsSample(plane, 2 * x, 2 * y) + LoadMetricsSample(plane, 2 * x + 1, 2 * y)
+        + LoadMetricsSample(plane, 2 * x, 2 * y + 1) + LoadMetricsSample(plane, 2 * x + 1, 2 * y + 1);
+    return (uint16_t)((n + 2) >> 2);
+}
+
+inline COLORSPACE_HD int GetSsimWindowsX(int nWidth) {
+    return nWidth >= 8 ? nWidth / 4 - 1 : 0;
+}
+
+inline COLORSPACE_HD int GetSsimWindowsY(int nHeight) {
+    return nHeight >= 8 ? nHeight / 4 - 1 : 0;
+}
+
+/**
+* @brief Sums s1, s2, ss (both images) and s12 of the 8x8 window at (x0, y0).
+*/
+inline COLORSPACE_HD void SsimWindowSums(const MetricsPlane &a, const MetricsPlane &b, int x0, int y0, int64_t *pSums) {
+    int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+    for (int y = y0; y < y0 + 8; y++) {
+        for (int x = x0; x < x0 + 8; x++) {
+            int64_t va = LoadMetricsSample(a, x, y), vb = LoadMetricsSample(b, x, y);
+            s1 += va;
+            s2 += vb;
+            ss += va * va + vb * vb;
+            s12 += va * vb;
+        }
+    }
+    pSums[0] = s1;
+    pSums[1] = s2;
+    pSums[2] = ss;
+    pSums[3] = s12;
+}
+
+/**
+* @brief SSIM constants C1 and C2 scaled by the squared window area, for samples of nBitDepth bits.
+*/
+inline void GetSsimConstants(int nBitDepth, double &fC1, double &fC2) {
+    double fPeak = (double)((1 << nBitDepth) - 1);
+    fC1 = 0.01 * 0.01 * fPeak * fPeak * 64 * 64;
+    fC2 = 0.03 * 0.03 * fPeak * fPeak * 64 * 64;
+}
+
+inline COLORSPACE_HD int64_t ToMetricsFixed(double f) {
+    return (int64_t)floor(f * METRICS_FIXED_ONE + 0.5);
+}
+
+/**
+* @brief SSIM and contrast-structure term of one window, as 32.32 fixed point. All products of the sums are exact in double.
+*/
+inline COLORSPACE_HD void SsimFromSums(const int64_t *pSums, double fC1, double fC2, int64_t &nSsim, int64_t &nCs) {
+    double s1 = (double)pSums[0], s2 = (double)pSums[1];
+    double fVars = (double)(pSums[2] * 64 - pSums[0] * pSums[0] - pSums[1] * pSums[1]);
+    double fCovar = (double)(pSums[3] * 64 - pSums[0] * pSums[1]);
+    double fCs = (2 * fCovar + fC2) / (fVars + fC2);
+    double fLuminance = (2 * s1 * s2 + fC1) / (s1 * s1 + s2 * s2 + fC1);
+    nSsim = ToMetricsFixed(fLuminance * fCs);
+    nCs = ToMetricsFixed(fCs);
+}
+
+inline double PsnrFromSse(uint64_t nSse, double fSamples, int nBitDepth) {
+    double fPeak = (double)((1 << nBitDepth) - 1);
+    return nSse ? 10.0 * log10(fPeak * fPeak * fSamples / (double)nSse) : 100.0;
+}
+
+/**
+* @brief Final metrics from the sums of a frame whose luma is aPlane[0].nWidth x nHeight.
+*/
+inline FrameMetrics MakeFrameMetrics(const MetricsSums &sums, const MetricsPlane *aPlane, int nPlanes, int nBitDepth, uint32_t nFlags) {
+    FrameMetrics m = {};
+    if (nFlags & METRICS_PSNR) {
+        uint64_t nSse = 0;
+        double fSamples = 0;
+        for (int i = 0; i < nPlanes; i++) {
+            double fPlane = (double)aPlane[i].nWidth * aPlane[i].nHeight;
+            m.adPsnr[i] = PsnrFromSse(sums.anSse[i], fPlane, nBitDepth);
+            nSse += sums.anSse[i];
+            fSamples += fPlane;
+        }
+        m.dPsnrYuv = PsnrFromSse(nSse, fSamples, nBitDepth);
+    }
+    if (nFlags & METRICS_SSIM) {
+        for (int i = 0; i < nPlanes; i++) {
+            double fWindows = (double)GetSsimWindowsX(aPlane[i].nWidth) * GetSsimWindowsY(aPlane[i].nHeight);
+            m.adSsim[i] = fWindows ? sums.anSsim[i] / METRICS_FIXED_ONE / fWindows : 0;
+        }
+    }
+    if (nFlags & METRICS_MS_SSIM) {
+        static const double afWeight[METRICS_MS_SSIM_SCALES] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+        double afCs[METRICS_MS_SSIM_SCALES], afSsim[METRICS_MS_SSIM_SCALES], fWeightSum = 0;
+        int nScales = 0;
+        for (int nWidth = aPlane[0].nWidth, nHeight = aPlane[0].nHeight; nScales < METRICS_MS_SSIM_SCALES;
+            nScales++, nWidth /= 2, nHeight /= 2) {
+            double fWindows = (double)GetSsimWindowsX(nWidth) * GetSsimWindowsY(nHeight);
+            if (!fWindows) {
+                break;
+            }
+            int iPass = nScales ? 2 + nScales : 0;
+            afCs[nScales] = sums.anCs[iPass] / METRICS_FIXED_ONE / fWindows;
+            afSsim[nScales] = sums.anSsim[iPass] / METRICS_FIXED_ONE / fWindows;
+            fWeightSum += afWeight[nScales];
+        }
+        // Frames too small for all scales use the ones they have, with the weights renormalized
+        m.dMsSsim = nScales ? 1.0 : 0.0;
+        for (int i = 0; i < nScales; i++) {
+            double f = i == nScales - 1 ? afSsim[i] : afCs[i];
+            m.dMsSsim *= pow(f > 0 ? f : 0, afWeight[i] / fWeightSum);
+        }
+    }
+    return m;
+}
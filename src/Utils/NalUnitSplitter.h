@@ -0,0 +1,300 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <codec/codec.h>
+#include "HostSimd.h"
+
+//---------------------------------------------------------------------------
+//! \file NalUnitSplitter.h
+//! \brief Splits H.264/HEVC Annex-B byte streams into NAL units.
+//!
+//! The start code search uses an SSE2 kernel on every x86-64 CPU and an AVX2 one where the
+//! CPU supports it (see HostSimd.h), and a scalar scan elsewhere. NAL units are returned as
+//! spans into the caller's buffer; nothing is copied.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    NAL_CODEC_H264 = 0,
+    NAL_CODEC_HEVC = 1,
+} NAL_CODEC;
+
+typedef enum {
+    H264_NAL_SLICE = 1,
+    H264_NAL_IDR = 5,
+    H264_NAL_SEI = 6,
+    H264_NAL_SPS = 7,
+    H264_NAL_PPS = 8,
+    H264_NAL_AUD = 9,
+} H264_NAL_TYPE;
+
+typedef enum {
+    HEVC_NAL_BLA_W_LP = 16,
+    HEVC_NAL_IDR_W_RADL = 19,
+    HEVC_NAL_IDR_N_LP = 20,
+    HEVC_NAL_CRA = 21,
+    HEVC_NAL_IRAP_RESERVED_23 = 23,
+    HEVC_NAL_VPS = 32,
+    HEVC_NAL_SPS = 33,
+    HEVC_NAL_PPS = 34,
+    HEVC_NAL_AUD = 35,
+    HEVC_NAL_SEI_PREFIX = 39,
+} HEVC_NAL_TYPE;
+
+/**
+* @brief A NAL unit inside an Annex-B buffer. pData points at the NAL header, past the start code.
+*/
+struct NalUnit {
+    const uint8_t *pData;   /*!< First byte of the NAL unit header */
+    uint32_t nSize;         /*!< NAL unit size in bytes, start code and trailing zero bytes excluded */
+    uint32_t nOffset;       /*!< Offset of the start code from the beginning of the scanned buffer */
+    uint8_t nStartCodeSize; /*!< 3 for 00 00 01, 4 for 00 00 00 01 */
+    uint8_t nType;          /*!< nal_unit_type */
+};
+
+inline NAL_CODEC GetNalCodec(cdc::CodecType eCodecType) {
+    return eCodecType == cdc::CODEC_TYPE_H265 ? NAL_CODEC_HEVC : NAL_CODEC_H264;
+}
+
+inline uint8_t GetNalType(const uint8_t *pNalHeader, NAL_CODEC eCodec) {
+    return eCodec == NAL_CODEC_HEVC ? (pNalHeader[0] >> 1) & 0x3F : pNalHeader[0] & 0x1F;
+}
+
+inline bool IsKeyFrameNal(uint8_t nType, NAL_CODEC eCodec) {
+    // HEVC: every IRAP picture (BLA/IDR/CRA) is a random access point
+    return eCodec == NAL_CODEC_HEVC ? (nType >= HEVC_NAL_BLA_W_LP && nType <= HEVC_NAL_IRAP_RESERVED_23) : nType == H264_NAL_IDR;
+}
+
+inline bool IsParameterSetNal(uint8_t nType, NAL_CODEC eCodec) {
+    return eCodec == NAL_CODEC_HEVC ? (nType >= HEVC_NAL_VPS && nType <= HEVC_NAL_PPS) : (nType == H264_NAL_SPS || nType == H264_NAL_PPS);
+}
+
+inline bool IsAudNal(uint8_t nType, NAL_CODEC eCodec) {
+    return eCodec == NAL_CODEC_HEVC ? nType == HEVC_NAL_AUD : nType == H264_NAL_AUD;
+}
+
+inline bool IsSliceNal(uint8_t nType, NAL_CODEC eCodec) {
+    return eCodec == NAL_CODEC_HEVC ? nType < HEVC_NAL_VPS : (nType >= H264_NAL_SLICE && nType <= H264_NAL_IDR);
+}
+
+/**
+* @brief Scalar start code search. Returns a pointer to the first 00 00 01 triple at or after p, or pEnd.
+*/
+inline const uint8_t *FindStartCodeScalar(const uint8_t *p, const uint8_t *pEnd) {
+    // Look at the third byte of each candidate: anything above 1 rules out a start code
+    // beginning at p, p + 1 or p + 2, so the scan can advance by three.
+    while (pEnd - p >= 3) {
+        if (p[2] > 1) {
+            p += 3;
+        } else if (p[2] == 0) {
+            p++;
+        } else {
+            if (p[0] == 0 && p[1] == 0) {
+                return p;
+            }
+            p += 3;
+        }
+    }
+    return pEnd;
+}
+
+#if defined(HOSTCC_X86)
+inline int NalCountTrailingZeros(uint32_t nMask) {
+#ifdef _MSC_VER
+    unsigned long nIndex;
+    _BitScanForward(&nIndex, nMask);
+    return (int)nIndex;
+#else
+    return __builtin_ctz(nMask);
+#endif
+}
+
+// A start code begins wherever a byte and the next one are zero and the one after that is 1. SSE2 only, so x86-64
+// builds use it on every CPU; 32-bit builds only when the CPU reports SSE4.1, which implies it
+HOSTCC_TARGET_SSE2 inline const uint8_t *FindStartCodeSse2(const uint8_t *p, const uint8_t *pEnd) {
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+    while (pEnd - p >= 18) {
+        __m128i b0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(p + 1));
+        __m128i b2 = _mm_loadu_si128((const __m128i *)(p + 2));
+        __m128i m = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(b0, b1), zero), _mm_cmpeq_epi8(b2, one));
+        uint32_t nMask = (uint32_t)_mm_movemask_epi8(m);
+        if (nMask) {
+            return p + NalCountTrailingZeros(nMask);
+        }
+        p += 16;
+    }
+    return FindStartCodeScalar(p, pEnd);
+}
+
+HOSTCC_TARGET_AVX2 inline const uint8_t *FindStartCodeAvx2(const uint8_t *p, const uint8_t *pEnd) {
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi8(1);
+    while (pEnd - p >= 34) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(p + 1));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *)(p + 2));
+        __m256i m = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(b0, b1), zero), _mm256_cmpeq_epi8(b2, one));
+        uint32_t nMask = (uint32_t)_mm256_movemask_epi8(m);
+        if (nMask) {
+            return p + NalCountTrailingZeros(nMask);
+        }
+        p += 32;
+    }
+    return FindStartCodeSse2(p, pEnd);
+}
+#endif
+
+typedef const uint8_t *(*NalStartCodeScanner)(const uint8_t *p, const uint8_t *pEnd);
+
+/**
+* @brief Start code search for eLevel, or for the best level below it that this build has. Every one gives the same result.
+* The kernel below AVX2 needs only SSE2; HOST_SIMD_SSE41 selects it.
+*/
+inline NalStartCodeScanner GetNalStartCodeScanner(HOST_SIMD_LEVEL eLevel) {
+#if defined(HOSTCC_X86)
+    if (eLevel == HOST_SIMD_AVX2) {
+        return FindStartCodeAvx2;
+    }
+    if (eLevel == HOST_SIMD_SSE41) {
+        return FindStartCodeSse2;
+    }
+#endif
+    return FindStartCodeScalar;
+}
+
+inline const char *GetNalStartCodeScannerName(HOST_SIMD_LEVEL eLevel) {
+    return eLevel == HOST_SIMD_SSE41 ? "sse2" : GetHostSimdLevelName(eLevel);
+}
+
+/**
+* @brief Levels with a distinct scanner that runs on this CPU, scalar first and the fastest last.
+*/
+inline std::vector<HOST_SIMD_LEVEL> GetNalStartCodeLevels() {
+    std::vector<HOST_SIMD_LEVEL> vLevel = {HOST_SIMD_SCALAR};
+#if defined(HOSTCC_X86)
+    HOST_SIMD_LEVEL eBest = DetectHostSimdLevel();
+#if defined(HOSTCC_X86_64)
+    vLevel.push_back(HOST_SIMD_SSE41);
+#else
+    if (eBest >= HOST_SIMD_SSE41) {
+        vLevel.push_back(HOST_SIMD_SSE41);
+    }
+#endif
+    if (eBest == HOST_SIMD_AVX2) {
+        vLevel.push_back(HOST_SIMD_AVX2);
+    }
+#endif
+    return vLevel;
+}
+
+/**
+* @brief Returns a pointer to the first 00 00 01 triple at or after p, or pEnd if there is none.
+*/
+inline const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *pEnd) {
+    static const NalStartCodeScanner pfnScan = GetNalStartCodeScanner(GetNalStartCodeLevels().back());
+    return pfnScan(p, pEnd);
+}
+
+/**
+* @brief Splits an Annex-B buffer into NAL units. Bytes before the first start code are ignored.
+*  @return Number of NAL units written to vNal
+*/
+inline size_t SplitNalUnits(const uint8_t *pBuf, size_t nBuf, std::vector<NalUnit> &vNal, NAL_CODEC eCodec) {
+    vNal.clear();
+    const uint8_t *pEnd = pBuf + nBuf;
+    const uint8_t *p = FindStartCode(pBuf, pEnd);
+    while (p < pEnd) {
+        const uint8_t *pNal = p + 3;
+        const uint8_t *pNext = FindStartCode(pNal, pEnd);
+
+        // Zero bytes before the next start code are trailing_zero_8bits or the leading
+        // byte of a 4-byte start code, not NAL payload
+        const uint8_t *pNalEnd = pNext;
+        while (pNalEnd > pNal && pNalEnd[-1] == 0) {
+            pNalEnd--;
+        }
+
+        if (pNalEnd > pNal) {
+            NalUnit nal;
+            nal.nStartCodeSize = (p > pBuf && p[-1] == 0) ? 4 : 3;
+            nal.nOffset = (uint32_t)(p - pBuf) - (nal.nStartCodeSize - 3);
+            nal.pData = pNal;
+            nal.nSize = (uint32_t)(pNalEnd - pNal);
+            nal.nType = GetNalType(pNal, eCodec);
+            vNal.push_back(nal);
+        }
+        p = pNext;
+    }
+    return vNal.size();
+}
+
+inline size_t SplitNalUnits(const cdc::CodecPacket &packet, std::vector<NalUnit> &vNal, NAL_CODEC eCodec) {
+    return SplitNalUnits((const uint8_t *)packet.data, packet.size, vNal, eCodec);
+}
+
+/**
+* @brief Returns true if the access unit contains an IDR (H.264) or IRAP (HEVC) slice.
+*  Stops at the first slice, so it is cheap to call on every packet.
+*/
+inline bool ContainsKeyFrame(const uint8_t *pBuf, size_t nBuf, NAL_CODEC eCodec) {
+    const uint8_t *pEnd = pBuf + nBuf;
+    for (const uint8_t *p = FindStartCode(pBuf, pEnd); p < pEnd; p = FindStartCode(p + 3, pEnd)) {
+        if (pEnd - p <= 3) {
+            break;
+        }
+        uint8_t nType = GetNalType(p + 3, eCodec);
+        if (IsSliceNal(nType, eCodec)) {
+            return IsKeyFrameNal(nType, eCodec);
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Collects the VPS/SPS/PPS NAL units of vNal into vParamSets.
+*/
+inline void ExtractParameterSets(const std::vector<NalUnit> &vNal, NAL_CODEC eCodec, std::vector<NalUnit> &vParamSets) {
+    vParamSets.clear();
+    for (const NalUnit &nal : vNal) {
+        if (IsParameterSetNal(nal.nType, eCodec)) {
+            vParamSets.push_back(nal);
+        }
+    }
+}
+
+/**
+* @brief Copies the NAL units of vNal to pDst with 4-byte start codes, dropping access unit delimiters.
+*  pDst must hold at least the size of the source buffer plus one byte per NAL unit.
+*  @return Number of bytes written
+*/
+inline size_t StripAudNalUnits(const std::vector<NalUnit> &vNal, NAL_CODEC eCodec, uint8_t *pDst) {
+    static const uint8_t aStartCode[4] = {0, 0, 0, 1};
+    uint8_t *p = pDst;
+    for (const NalUnit &nal : vNal) {
+        if (IsAudNal(nal.nType, eCodec)) {
+            continue;
+        }
+        memcpy(p, aStartCode, sizeof(aStartCode));
+        memcpy(p + sizeof(aStartCode), nal.pData, nal.nSize);
+        p += sizeof(aStartCode) + nal.nSize;
+    }
+    return p - pDst;
+}
+
+/**
+* @brief Copies a NAL unit payload to vRbsp with emulation prevention bytes (00 00 03) removed, for header parsing.
+*/
+inline void NalToRbsp(const uint8_t *pNal, size_t nNal, std::vector<uint8_t> &vRbsp) {
+    vRbsp.clear();
+    vRbsp.reserve(nNal);
+    int nZeros = 0;
+    for (size_t i = 0; i < nNal; i++) {
+        if (nZeros >= 2 && pNal[i] == 3) {
+            nZeros = 0;
+            continue;
+        }
+        nZeros = pNal[i] == 0 ? nZeros + 1 : 0;
+        vRbsp.push_back(pNal[i]);
+    }
+}
@@ -46,6 +46,12 @@
 #include <list>
 #include <vector>
 #include <condition_variable>
+#include <atomic>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 extern simplelogger::Logger *logger;
 
@@ -220,55 +226,84 @@ private:
 #endif
 
 /**
-* @brief Utility class to allocate buffer memory. Helps avoid I/O during the encode/decode loop in case of performance tests.
+* @brief Utility class to map a file into memory. Pages are loaded on first access, so large
+* files are available immediately and the mapping is shared with other processes reading
+* the same file.
 */
-class BufferedFileReader {
+class MappedFileReader {
 public:
     /**
-    * @brief Constructor function to allocate appropriate memory and copy file contents into it
+    *   @param  bSequential     Hint that the file is read front to back, which enables aggressive readahead
+    *   @param  bCopyOnWrite    Map pages private and writable. Writes stay in this process and never reach the file.
     */
-    BufferedFileReader(const char *szFileName, bool bPartial = false) {
-        struct _stat64 st;
-
-        if (_stat64(szFileName, &st) != 0) {
+    MappedFileReader(const char *szFileName, bool bSequential = true, bool bCopyOnWrite = false) {
+#ifdef _WIN32
+        hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, bSequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            LOG(ERROR) << "Unable to open input file: " << szFileName;
             return;
         }
-        
-        nSize = st.st_size;
-        while (nSize) {
-            try {
-                pBuf = new uint8_t[(size_t)nSize];
-                if (nSize != st.st_size) {
-                    LOG(WARNING) << "File is too large - only " << std::setprecision(4) << 100.0 * nSize / st.st_size << "% is loaded"; 
-                }
-                break;
-            } catch(std::bad_alloc) {
-                if (!bPartial) {
-                    LOG(ERROR) << "Failed to allocate memory in BufferedReader";
-                    return;
-                }
-                nSize = (uint32_t)(nSize * 0.9);
-            }
+        LARGE_INTEGER liSize;
+        if (!GetFileSizeEx(hFile, &liSize) || liSize.QuadPart == 0) {
+            return;
         }
-
-        std::ifstream fpIn(szFileName, std::ifstream::in | std::ifstream::binary);
-        if (!fpIn)
-        {
+        hMapping = CreateFileMappingA(hFile, NULL, bCopyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (!hMapping) {
+            LOG(ERROR) << "Unable to map input file: " << szFileName;
+            return;
+        }
+        pBuf = (uint8_t *)MapViewOfFile(hMapping, bCopyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        if (!pBuf) {
+            LOG(ERROR) << "Unable to map input file: " << szFileName;
+            return;
+        }
+        nSize = (uint64_t)liSize.QuadPart;
+        bWritable = bCopyOnWrite;
+#else
+        fd = open(szFileName, O_RDONLY);
+        if (fd < 0) {
             LOG(ERROR) << "Unable to open input file: " << szFileName;
             return;
         }
-
-        std::streamsize nRead = fpIn.read(reinterpret_cast<char*>(pBuf), nSize).gcount();
-        fpIn.close();
-
-        assert(nRead == nSize);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            return;
+        }
+        void *p = mmap(NULL, (size_t)st.st_size, bCopyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, bCopyOnWrite ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            LOG(ERROR) << "Unable to map input file: " << szFileName;
+            return;
+        }
+        pBuf = (uint8_t *)p;
+        nSize = (uint64_t)st.st_size;
+        bWritable = bCopyOnWrite;
+        madvise(pBuf, (size_t)nSize, bSequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
     }
-    ~BufferedFileReader() {
+    ~MappedFileReader() {
+#ifdef _WIN32
+        if (pBuf) {
+            UnmapViewOfFile(pBuf);
+        }
+        if (hMapping) {
+            CloseHandle(hMapping);
+        }
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+        }
+#else
         if (pBuf) {
-            delete[] pBuf;
+            munmap(pBuf, (size_t)nSize);
+        }
+        if (fd >= 0) {
+            close(fd);
         }
+#endif
     }
-    bool GetBuffer(uint8_t **ppBuf, uint64_t *pnSize) {
+    MappedFileReader(const MappedFileReader &) = delete;
+    MappedFileReader &operator=(const MappedFileReader &) = delete;
+
+    bool GetBuffer(const uint8_t **ppBuf, uint64_t *pnSize) const {
         if (!pBuf) {
             return false;
         }
@@ -278,127 +313,206 @@ public:
         return true;
     }
 
+    /**
+    *   @brief  Returns the mapping for writing. Only valid for copy-on-write mappings.
+    */
+    bool GetWritableBuffer(uint8_t **ppBuf, uint64_t *pnSize) {
+        if (!pBuf || !bWritable) {
+            return false;
+        }
+
+        *ppBuf = pBuf;
+        *pnSize = nSize;
+        return true;
+    }
+
+    /**
+    *   @brief  Asks the OS to start reading a range in the background so later accesses do not fault.
+    */
+    void WillNeed(uint64_t nOffset, uint64_t nLength) const {
+        if (!pBuf || nOffset >= nSize) {
+            return;
+        }
+        if (nLength > nSize - nOffset) {
+            nLength = nSize - nOffset;
+        }
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range = {pBuf + nOffset, (SIZE_T)nLength};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+        // madvise() wants a page aligned start address
+        uint64_t nPageMask = (uint64_t)sysconf(_SC_PAGESIZE) - 1;
+        uint64_t nAligned = nOffset & ~nPageMask;
+        madvise(pBuf + nAligned, (size_t)(nLength + nOffset - nAligned), MADV_WILLNEED);
+#endif
+    }
+
 private:
     uint8_t *pBuf = NULL;
     uint64_t nSize = 0;
+    bool bWritable = false;
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#else
+    int fd = -1;
+#endif
 };
 
-#ifdef __NVCUVID_H__
 /**
-* @brief Template class to facilitate color space conversion
+* @brief Utility class to provide the contents of a file as a buffer. Helps avoid I/O during the encode/decode loop in case of performance tests.
+* The file is mapped copy-on-write rather than read into a heap allocation, so it costs no RSS until pages are touched,
+* the first bytes are available without waiting for the whole file, and clean pages are shared between processes.
 */
-template<typename T>
-class YuvConverter {
+class BufferedFileReader {
 public:
-    YuvConverter(int nWidth, int nHeight, uint8_t nChromaFormat) :
-        nWidth(nWidth), nHeight(nHeight), nChromaFormat(nChromaFormat)
-    {
-        if (nChromaFormat == cudaVideoChromaFormat_420) {
-            pQuad = new T[((nWidth + 1) / 2) * ((nHeight + 1) / 2)];
-        } else {
-            pQuad = new T[((nWidth + 1) / 2) * nHeight];
-        }
+    /**
+    * @brief Constructor function to map the file. There is no partial load mode; a mapping never needs to fall back to one.
+    */
+    BufferedFileReader(const char *szFileName) : file(szFileName, true, true) {
     }
-    ~YuvConverter() {
-        delete[] pQuad;
+
+    bool GetBuffer(uint8_t **ppBuf, uint64_t *pnSize) {
+        return file.GetWritableBuffer(ppBuf, pnSize);
     }
-    void PlanarToUVInterleaved(T *pFrame, int nPitch = 0) {
-        if (nPitch == 0) {
-            nPitch = nWidth;
-        }
 
-        // sizes of source surface plane
-        int nSizePlaneY = nPitch * nHeight;
-        int nSizePlaneU = ((nPitch + 1) / 2) * ((nHeight + 1) / 2);
-        int nSizePlaneV = nSizePlaneU;
+private:
+    MappedFileReader file;
+};
 
-        T *puv = pFrame + nSizePlaneY;
-        if (nPitch == nWidth) {
-            memcpy(pQuad, puv, nSizePlaneU * sizeof(T));
-        } else {
-            for (int i = 0; i < (nHeight + 1) / 2; i++) {
-                memcpy(pQuad + ((nWidth + 1) / 2) * i, puv + ((nPitch + 1) / 2) * i, ((nWidth + 1) / 2) * sizeof(T));
-            }
+/**
+* @brief MSB-first bit reader over a byte buffer, for parsing bitstream headers.
+* Reads past the end return zeros and set the overrun flag instead of faulting.
+*/
+class BitReader {
+public:
+    BitReader(const uint8_t *pBuf, size_t nSize) : pBuf(pBuf), nSizeInBits((uint64_t)nSize * 8) {}
+
+    uint32_t ReadBits(int nBits) {
+        uint32_t nValue = 0;
+        for (int i = 0; i < nBits; i++) {
+            nValue = (nValue << 1) | ReadBit();
         }
-        T *pv = puv + nSizePlaneU;
-        for (int y = 0; y < (nHeight + 1) / 2; y++) {
-            for (int x = 0; x < (nWidth + 1) / 2; x++) {
-                puv[y * nPitch + x * 2] = pQuad[y * ((nWidth + 1) / 2) + x];
-                puv[y * nPitch + x * 2 + 1] = pv[y * ((nPitch + 1) / 2) + x];
-            }
+        return nValue;
+    }
+    uint32_t ReadBit() {
+        if (nPos >= nSizeInBits) {
+            bOverrun = true;
+            return 0;
         }
+        uint32_t nBit = (pBuf[nPos >> 3] >> (7 - (nPos & 7))) & 1;
+        nPos++;
+        return nBit;
     }
-    void UVInterleavedToPlanar(T *pFrame, int nPitch = 0) {
-        if (nPitch == 0) {
-            nPitch = nWidth;
+    // Unsigned Exp-Golomb code, ue(v) in H.264/HEVC
+    uint32_t ReadUE() {
+        int nLeadingZeros = 0;
+        while (!ReadBit() && !bOverrun && nLeadingZeros < 32) {
+            nLeadingZeros++;
         }
-
-        // sizes of source surface plane
-        int nSizePlaneY = nPitch * nHeight;
-        int nSizePlaneU = (nChromaFormat == cudaVideoChromaFormat_420) ? (((nPitch + 1) / 2) * ((nHeight + 1) / 2)) : (((nPitch + 1) / 2) * nHeight);
-        int nSizePlaneV = nSizePlaneU;
-
-        T *puv = pFrame + nSizePlaneY,
-            *pu = puv, 
-            *pv = puv + nSizePlaneU;
-
-        // split chroma from interleave to planar
-        int nChromaHeight = (nChromaFormat == cudaVideoChromaFormat_420) ? (nHeight + 1) / 2 : nHeight;
-        for (int y = 0; y < nChromaHeight; y++) {
-            for (int x = 0; x < (nWidth + 1) / 2; x++) {
-                pu[y * ((nPitch + 1) / 2) + x] = puv[y * nPitch + x * 2];
-                pQuad[y * ((nWidth + 1) / 2) + x] = puv[y * nPitch + x * 2 + 1];
-            }
+        if (nLeadingZeros >= 32) {
+            bOverrun = true;
+            return 0;
         }
-        if (nPitch == nWidth) {
-            memcpy(pv, pQuad, nSizePlaneV * sizeof(T));
-        } else {
-            for (int i = 0; i < nChromaHeight; i++) {
-                memcpy(pv + ((nPitch + 1) / 2) * i, pQuad + ((nWidth + 1) / 2) * i, ((nWidth + 1) / 2) * sizeof(T));
-            }
+        return ((1u << nLeadingZeros) - 1) + ReadBits(nLeadingZeros);
+    }
+    // Variable length unsigned code, uvlc() in AV1
+    uint32_t ReadUvlc() {
+        int nLeadingZeros = 0;
+        while (!ReadBit() && !bOverrun) {
+            nLeadingZeros++;
         }
+        if (nLeadingZeros >= 32) {
+            return 0xFFFFFFFF;
+        }
+        return ((1u << nLeadingZeros) - 1) + ReadBits(nLeadingZeros);
+    }
+    void SkipBits(uint64_t nBits) {
+        nPos += nBits;
+        if (nPos > nSizeInBits) {
+            nPos = nSizeInBits;
+            bOverrun = true;
+        }
+    }
+    uint64_t GetPosition() const {
+        return nPos;
+    }
+    bool IsOverrun() const {
+        return bOverrun;
     }
 
 private:
-    T *pQuad;
-    int nWidth, nHeight, nChromaFormat;
+    const uint8_t *pBuf;
+    uint64_t nSizeInBits;
+    uint64_t nPos = 0;
+    bool bOverrun = false;
 };
-#endif
 
 /**
 * @brief Class for writing IVF format header for AV1 codec
 */
 class IVFUtils {
 public:
+    static const uint32_t nFileHeaderSize = 32;
+    static const uint32_t nFrameHeaderSize = 12;
+    static const uint32_t nFrameCountOffset = 24;
+
     void WriteFileHeader(std::vector<uint8_t> &vPacket, uint32_t nFourCC, uint32_t nWidth, uint32_t nHeight, uint32_t nFrameRateNum, uint32_t nFrameRateDen, uint32_t nFrameCnt)
     {
-        char header[32];
-
-        header[0] = 'D';
-        header[1] = 'K';
-        header[2] = 'I';
-        header[3] = 'F';
-        mem_put_le16(header + 4, 0);                    // version
-        mem_put_le16(header + 6, 32);                   // header size
-        mem_put_le32(header + 8, nFourCC);              // fourcc
-        mem_put_le16(header + 12, nWidth);              // width
-        mem_put_le16(header + 14, nHeight);             // height
-        mem_put_le32(header + 16, nFrameRateNum);       // rate
-        mem_put_le32(header + 20, nFrameRateDen);       // scale
-        mem_put_le32(header + 24, nFrameCnt);           // length
-        mem_put_le32(header + 28, 0);                   // unused
-
-        vPacket.insert(vPacket.end(), &header[0], &header[32]);
+        uint8_t header[nFileHeaderSize];
+        WriteFileHeader(header, nFourCC, nWidth, nHeight, nFrameRateNum, nFrameRateDen, nFrameCnt);
+        vPacket.insert(vPacket.end(), &header[0], &header[nFileHeaderSize]);
     }
     
     void WriteFrameHeader(std::vector<uint8_t> &vPacket,  size_t nFrameSize, int64_t pts)
     {
-        char header[12];
-        mem_put_le32(header, (int)nFrameSize);
-        mem_put_le32(header + 4, (int)(pts & 0xFFFFFFFF));
-        mem_put_le32(header + 8, (int)(pts >> 32));
-        
-        vPacket.insert(vPacket.end(), &header[0], &header[12]);
+        uint8_t header[nFrameHeaderSize];
+        WriteFrameHeader(header, nFrameSize, pts);
+        vPacket.insert(vPacket.end(), &header[0], &header[nFrameHeaderSize]);
+    }
+
+    /**
+    *   @brief  Writes the 32-byte file header in place.
+    *   @return Number of bytes written
+    */
+    static uint32_t WriteFileHeader(uint8_t *pHeader, uint32_t nFourCC, uint32_t nWidth, uint32_t nHeight, uint32_t nFrameRateNum, uint32_t nFrameRateDen, uint32_t nFrameCnt)
+    {
+        pHeader[0] = 'D';
+        pHeader[1] = 'K';
+        pHeader[2] = 'I';
+        pHeader[3] = 'F';
+        mem_put_le16(pHeader + 4, 0);                    // version
+        mem_put_le16(pHeader + 6, nFileHeaderSize);      // header size
+        mem_put_le32(pHeader + 8, nFourCC);              // fourcc
+        mem_put_le16(pHeader + 12, nWidth);              // width
+        mem_put_le16(pHeader + 14, nHeight);             // height
+        mem_put_le32(pHeader + 16, nFrameRateNum);       // rate
+        mem_put_le32(pHeader + 20, nFrameRateDen);       // scale
+        mem_put_le32(pHeader + 24, nFrameCnt);           // length
+        mem_put_le32(pHeader + 28, 0);                   // unused
+        return nFileHeaderSize;
+    }
+
+    /**
+    *   @brief  Writes the 12-byte frame header in place.
+    *   @return Number of bytes written
+    */
+    static uint32_t WriteFrameHeader(uint8_t *pHeader, size_t nFrameSize, int64_t pts)
+    {
+        mem_put_le32(pHeader, (int)nFrameSize);
+        mem_put_le32(pHeader + 4, (int)(pts & 0xFFFFFFFF));
+        mem_put_le32(pHeader + 8, (int)(pts >> 32));
+        return nFrameHeaderSize;
+    }
+
+    /**
+    *   @brief  Encodes a frame count for the length field at nFrameCountOffset of the file header.
+    */
+    static void PutFrameCount(uint8_t *pFrameCount, uint32_t nFrameCnt)
+    {
+        mem_put_le32(pFrameCount, nFrameCnt);
     }
     
 private:
@@ -456,16 +570,18 @@ class ConcurrentQueue
         // automatically try to acquire mutex once it wakes up
         // (which will happen on notify_one)
         std::unique_lock<std::mutex> lock(m_mutex);
-        auto wasEmpty = m_List.empty();
 
         while (full()) {
             m_cond.wait(lock);
         }
 
+        // Checked after waiting: the consumers may have drained the list and gone to sleep meanwhile.
+        // Producers and consumers share m_cond, so wake all of them to be sure a consumer gets it.
+        auto wasEmpty = m_List.empty();
         m_List.push_back(value);
-        if (wasEmpty && !m_List.empty()) {
+        if (wasEmpty) {
             lock.unlock();
-            m_cond.notify_one();
+            m_cond.notify_all();
         }
     }
 
@@ -481,7 +597,7 @@ class ConcurrentQueue
 
         if (wasFull && !full()) {
             lock.unlock();
-            m_cond.notify_one();
+            m_cond.notify_all();
         }
 
         return data;
@@ -525,6 +641,455 @@ private:
     size_t maxSize;
 };
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define RING_QUEUE_PAUSE() _mm_pause()
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define RING_QUEUE_PAUSE() __asm__ __volatile__("yield")
+#else
+#define RING_QUEUE_PAUSE() ((void)0)
+#endif
+
+/**
+* @brief How the spinning and timed variants of the ring queues wait: a few dozen CPU pauses,
+* then yields, and for the timed variants short sleeps until the deadline.
+*/
+class RingQueueBackoff {
+public:
+    void Spin() {
+        if (nSpins < 64) {
+            nSpins++;
+            RING_QUEUE_PAUSE();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    // Returns false once tDeadline has passed
+    bool WaitUntil(std::chrono::steady_clock::time_point tDeadline) {
+        auto tNow = std::chrono::steady_clock::now();
+        if (tNow >= tDeadline) {
+            return false;
+        }
+        if (nSpins < 64) {
+            nSpins++;
+            RING_QUEUE_PAUSE();
+        } else if (nSpins < 96) {
+            nSpins++;
+            std::this_thread::yield();
+        } else {
+            auto tSleep = std::chrono::duration_cast<std::chrono::nanoseconds>(tDeadline - tNow);
+            std::this_thread::sleep_for(tSleep < std::chrono::microseconds(50) ? tSleep : std::chrono::microseconds(50));
+        }
+        return true;
+    }
+
+private:
+    int nSpins = 0;
+};
+
+/**
+* @brief Bounded lock-free queue for exactly one producer thread and one consumer thread.
+* The blocking variants sleep in std::atomic::wait() rather than on a mutex, so the fast
+* path is two atomic loads and one store. The Spin variants never sleep, for threads that
+* own a core; the For variants give up after a timeout.
+*/
+template<typename T>
+class SpscRingQueue {
+public:
+    /**
+    *   @param  nCapacity   Rounded up to a power of two
+    */
+    SpscRingQueue(size_t nCapacity) {
+        size_t n = 1;
+        while (n < nCapacity) {
+            n <<= 1;
+        }
+        vSlots.resize(n);
+        nMask = n - 1;
+    }
+    SpscRingQueue(const SpscRingQueue &) = delete;
+    SpscRingQueue &operator=(const SpscRingQueue &) = delete;
+
+    /**
+    *   @brief  Producer only. Returns false without touching item if the queue is full.
+    */
+    bool TryPush(T &&item) {
+        uint64_t t = tail.load(std::memory_order_relaxed) & ~CLOSED;
+        if (t - head.load(std::memory_order_acquire) > nMask) {
+            return false;
+        }
+        vSlots[t & nMask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        // Only a consumer that found the queue empty at t can be asleep on tail. The fence pairs with the one in Pop().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (head.load(std::memory_order_relaxed) == t) {
+            tail.notify_one();
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Producer only. Waits while the queue is full.
+    *   @return true if the producer had to wait
+    */
+    bool Push(T &&item) {
+        bool bStalled = false;
+        while (!TryPush(std::move(item))) {
+            bStalled = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t h = head.load(std::memory_order_acquire);
+            if ((tail.load(std::memory_order_relaxed) & ~CLOSED) - h > nMask) {
+                head.wait(h, std::memory_order_acquire);
+            }
+        }
+        return bStalled;
+    }
+
+    /**
+    *   @brief  Producer only. Busy-waits while the queue is full.
+    *   @return true if the producer had to wait
+    */
+    bool PushSpin(T &&item) {
+        RingQueueBackoff backoff;
+        bool bStalled = false;
+        while (!TryPush(std::move(item))) {
+            bStalled = true;
+            backoff.Spin();
+        }
+        return bStalled;
+    }
+
+    /**
+    *   @brief  Producer only. Returns false without touching item if the queue stays full for timeout.
+    */
+    template<class Rep, class Period>
+    bool PushFor(T &&item, const std::chrono::duration<Rep, Period> &timeout) {
+        auto tDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        RingQueueBackoff backoff;
+        while (!TryPush(std::move(item))) {
+            if (!backoff.WaitUntil(tDeadline)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Consumer only. Returns false if the queue is empty.
+    */
+    bool TryPop(T &item) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h == (tail.load(std::memory_order_acquire) & ~CLOSED)) {
+            return false;
+        }
+        item = std::move(vSlots[h & nMask]);
+        head.store(h + 1, std::memory_order_release);
+        // Only a producer that found the queue full can be asleep on head. The fence pairs with the one in Push().
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if ((tail.load(std::memory_order_relaxed) & ~CLOSED) - h > nMask) {
+            head.notify_one();
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Consumer only. Waits for an item; returns false once the queue is closed and drained.
+    */
+    bool Pop(T &item) {
+        while (!TryPop(item)) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t t = tail.load(std::memory_order_acquire);
+            if (t & CLOSED) {
+                return TryPop(item);
+            }
+            if (t == head.load(std::memory_order_relaxed)) {
+                tail.wait(t, std::memory_order_acquire);
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Consumer only. Busy-waits for an item; returns false once the queue is closed and drained.
+    */
+    bool PopSpin(T &item) {
+        RingQueueBackoff backoff;
+        while (!TryPop(item)) {
+            if (tail.load(std::memory_order_acquire) & CLOSED) {
+                return TryPop(item);
+            }
+            backoff.Spin();
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Consumer only. Returns false if no item arrives within timeout or the queue is closed and drained.
+    */
+    template<class Rep, class Period>
+    bool PopFor(T &item, const std::chrono::duration<Rep, Period> &timeout) {
+        auto tDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        RingQueueBackoff backoff;
+        while (!TryPop(item)) {
+            if (tail.load(std::memory_order_acquire) & CLOSED) {
+                return TryPop(item);
+            }
+            if (!backoff.WaitUntil(tDeadline)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Producer only. Wakes the consumer; Pop() fails after the remaining items are drained.
+    */
+    void Close() {
+        // The closed flag lives in tail so that a consumer sleeping on tail sees a changed value
+        tail.fetch_or(CLOSED, std::memory_order_release);
+        tail.notify_all();
+    }
+
+    size_t Size() const {
+        return (size_t)((tail.load(std::memory_order_acquire) & ~CLOSED) - head.load(std::memory_order_acquire));
+    }
+    size_t Capacity() const {
+        return nMask + 1;
+    }
+
+private:
+    static const uint64_t CLOSED = 1ull << 63;
+    alignas(64) std::atomic<uint64_t> head{0}; /*!< Next slot to pop, written by the consumer */
+    alignas(64) std::atomic<uint64_t> tail{0}; /*!< Next slot to push, written by the producer */
+    alignas(64) std::vector<T> vSlots;
+    size_t nMask;
+};
+
+/**
+* @brief Bounded lock-free queue for any number of producer and consumer threads. Each slot
+* carries a sequence number that says whether it is free for the push of this lap or holds
+* the item of this lap, so producers and consumers only contend on their own index.
+* Waiting works as in SpscRingQueue: Push() and Pop() sleep in std::atomic::wait(), the
+* Spin variants busy-wait and the For variants give up after a timeout.
+*/
+template<typename T>
+class MpmcRingQueue {
+public:
+    /**
+    *   @param  nCapacity   Rounded up to a power of two, at least 2
+    */
+    MpmcRingQueue(size_t nCapacity) : vSlots(RoundUpCapacity(nCapacity)) {
+        nMask = vSlots.size() - 1;
+        for (size_t i = 0; i < vSlots.size(); i++) {
+            vSlots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+    MpmcRingQueue(const MpmcRingQueue &) = delete;
+    MpmcRingQueue &operator=(const MpmcRingQueue &) = delete;
+
+    /**
+    *   @brief  Returns false without touching item if the queue is full.
+    */
+    bool TryPush(T &&item) {
+        uint64_t tRaw = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            uint64_t t = tRaw & ~CLOSED;
+            Slot &slot = vSlots[t & nMask];
+            uint64_t nSeq = slot.seq.load(std::memory_order_acquire);
+            if (nSeq == t) {
+                // The closed flag is carried along; pushes are only expected before Close()
+                if (tail.compare_exchange_weak(tRaw, tRaw + 1, std::memory_order_relaxed)) {
+                    slot.item = std::move(item);
+                    slot.seq.store(t + 1, std::memory_order_release);
+                    // Consumers only sleep once they have taken every item; the fence pairs with the one in Pop().
+                    // All of them are woken because a single one might stop popping before draining the queue.
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (head.load(std::memory_order_relaxed) == t) {
+                        tail.notify_all();
+                    }
+                    return true;
+                }
+            } else if ((int64_t)(nSeq - t) < 0) {
+                // The consumer of the previous lap has not taken this slot yet
+                return false;
+            } else {
+                tRaw = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+    *   @brief  Waits while the queue is full.
+    *   @return true if the producer had to wait
+    */
+    bool Push(T &&item) {
+        RingQueueBackoff backoff;
+        bool bStalled = false;
+        while (!TryPush(std::move(item))) {
+            bStalled = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t h = head.load(std::memory_order_acquire);
+            if ((tail.load(std::memory_order_relaxed) & ~CLOSED) - h > nMask) {
+                head.wait(h, std::memory_order_acquire);
+            } else {
+                // A consumer has claimed the slot and is still moving the item out
+                backoff.Spin();
+            }
+        }
+        return bStalled;
+    }
+
+    /**
+    *   @brief  Busy-waits while the queue is full.
+    *   @return true if the producer had to wait
+    */
+    bool PushSpin(T &&item) {
+        RingQueueBackoff backoff;
+        bool bStalled = false;
+        while (!TryPush(std::move(item))) {
+            bStalled = true;
+            backoff.Spin();
+        }
+        return bStalled;
+    }
+
+    /**
+    *   @brief  Returns false without touching item if the queue stays full for timeout.
+    */
+    template<class Rep, class Period>
+    bool PushFor(T &&item, const std::chrono::duration<Rep, Period> &timeout) {
+        auto tDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        RingQueueBackoff backoff;
+        while (!TryPush(std::move(item))) {
+            if (!backoff.WaitUntil(tDeadline)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Returns false if the queue is empty.
+    */
+    bool TryPop(T &item) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = vSlots[h & nMask];
+            uint64_t nSeq = slot.seq.load(std::memory_order_acquire);
+            if (nSeq == h + 1) {
+                if (head.compare_exchange_weak(h, h + 1, std::memory_order_relaxed)) {
+                    item = std::move(slot.item);
+                    slot.seq.store(h + nMask + 1, std::memory_order_release);
+                    // Producers only sleep on a full queue, so only the pop that ends it has to wake them
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if ((tail.load(std::memory_order_relaxed) & ~CLOSED) - h > nMask) {
+                        head.notify_all();
+                    }
+                    return true;
+                }
+            } else if ((int64_t)(nSeq - (h + 1)) < 0) {
+                // Not pushed yet, or claimed by a producer that is still moving the item in
+                return false;
+            } else {
+                h = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+    *   @brief  Waits for an item; returns false once the queue is closed and drained.
+    */
+    bool Pop(T &item) {
+        RingQueueBackoff backoff;
+        while (!TryPop(item)) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint64_t tRaw = tail.load(std::memory_order_acquire);
+            if ((tRaw & ~CLOSED) == head.load(std::memory_order_relaxed)) {
+                if (tRaw & CLOSED) {
+                    return false;
+                }
+                tail.wait(tRaw, std::memory_order_acquire);
+            } else {
+                backoff.Spin();
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Busy-waits for an item; returns false once the queue is closed and drained.
+    */
+    bool PopSpin(T &item) {
+        RingQueueBackoff backoff;
+        while (!TryPop(item)) {
+            if (IsClosedAndDrained()) {
+                return false;
+            }
+            backoff.Spin();
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Returns false if no item arrives within timeout or the queue is closed and drained.
+    */
+    template<class Rep, class Period>
+    bool PopFor(T &item, const std::chrono::duration<Rep, Period> &timeout) {
+        auto tDeadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        RingQueueBackoff backoff;
+        while (!TryPop(item)) {
+            if (IsClosedAndDrained() || !backoff.WaitUntil(tDeadline)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Call once every producer is done. Wakes the consumers; popping fails after the remaining items are drained.
+    */
+    void Close() {
+        tail.fetch_or(CLOSED, std::memory_order_release);
+        tail.notify_all();
+    }
+
+    // Approximate while other threads push or pop
+    size_t Size() const {
+        uint64_t h = head.load(std::memory_order_acquire), t = tail.load(std::memory_order_acquire) & ~CLOSED;
+        return t > h ? (size_t)(t - h) : 0;
+    }
+    size_t Capacity() const {
+        return nMask + 1;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        T item;
+    };
+
+    // A single slot cannot tell "free for lap n + 1" from "holds the item of lap n", so at least two
+    static size_t RoundUpCapacity(size_t nCapacity) {
+        size_t n = 2;
+        while (n < nCapacity) {
+            n <<= 1;
+        }
+        return n;
+    }
+
+    bool IsClosedAndDrained() const {
+        uint64_t tRaw = tail.load(std::memory_order_acquire);
+        return (tRaw & CLOSED) && (tRaw & ~CLOSED) == head.load(std::memory_order_acquire);
+    }
+
+    static const uint64_t CLOSED = 1ull << 63;
+    alignas(64) std::atomic<uint64_t> head{0}; /*!< Next slot to pop, claimed by consumers */
+    alignas(64) std::atomic<uint64_t> tail{0}; /*!< Next slot to push, claimed by producers; bit 63 is the closed flag */
+    alignas(64) std::vector<Slot> vSlots;
+    size_t nMask;
+};
+
 inline void CheckInputFile(const char *szInFilePath) {
     std::ifstream fpIn(szInFilePath, std::ios::in | std::ios::binary);
     if (fpIn.fail()) {
@@ -543,70 +1108,115 @@ inline void ValidateResolution(int nWidth, int nHeight) {
     }
 }
 
+// Color conversions keep no global state: the matrix travels with each launch, so sessions may convert
+// concurrently on their own streams. A null stream is the legacy default stream.
+struct CUstream_st;
+
 template <class COLOR32>
-void Nv12ToColor32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv12ToColor32(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR24>
-void Nv12ToColor24(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv12ToColor24(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR64>
-void Nv12ToColor64(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv12ToColor64(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void P016ToColor32(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P016ToColor32(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR24>
-void P016ToColor24(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P016ToColor24(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR64>
-void P016ToColor64(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P016ToColor64(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void Nv16ToColor32(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv16ToColor32(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR24>
-void Nv16ToColor24(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv16ToColor24(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR64>
-void Nv16ToColor64(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv16ToColor64(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void P216ToColor32(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P216ToColor32(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR64>
-void P216ToColor64(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P216ToColor64(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR24>
-void P216ToColor24(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P216ToColor24(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void YUV444ToColor32(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void YUV444ToColor32(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR24>
-void YUV444ToColor24(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void YUV444ToColor24(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR64>
-void YUV444ToColor64(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void YUV444ToColor64(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void YUV444P16ToColor32(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void YUV444P16ToColor32(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR24>
-void YUV444P16ToColor24(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void YUV444P16ToColor24(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR64>
-void YUV444P16ToColor64(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void YUV444P16ToColor64(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void Nv12ToColorPlanar(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv12ToColorPlanar(uint8_t *dpNv12, int nNv12Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR32>
-void P016ToColorPlanar(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P016ToColorPlanar(uint8_t *dpP016, int nP016Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void Nv16ToColorPlanar(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void Nv16ToColorPlanar(uint8_t *dpNv16, int nNv16Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR32>
-void P216ToColorPlanar(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void P216ToColorPlanar(uint8_t *dpP216, int nP216Pitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
 
 template <class COLOR32>
-void YUV444ToColorPlanar(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0);
+void YUV444ToColorPlanar(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
 template <class COLOR32>
-void YUV444P16ToColorPlanar(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+void YUV444P16ToColorPlanar(uint8_t *dpYUV444, int nPitch, uint8_t *dpBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
+
+void Bgra64ToP016(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpP016, int nP016Pitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0, CUstream_st *stream = nullptr);
+template <class COLOR32>
+void Color32ToNv12(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpNv12, int nNv12Pitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, uint8_t *dpNv12UV = nullptr, CUstream_st *stream = nullptr);
+template <class COLOR32>
+void Color32ToYuv444(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpYuv444, int nYuv444Pitch, int nWidth, int nHeight, int iMatrix = 0, bool video_full_range = 0, CUstream_st *stream = nullptr);
+
+void ConvertUInt8ToUInt16(uint8_t *dpUInt8, uint16_t *dpUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight, CUstream_st *stream = nullptr);
+void ConvertUInt16ToUInt8(uint16_t *dpUInt16, uint8_t *dpUInt8, int nSrcPitch, int nDestPitch, int nWidth, int nHeight, CUstream_st *stream = nullptr);
 
-void Bgra64ToP016(uint8_t *dpBgra, int nBgraPitch, uint8_t *dpP016, int nP016Pitch, int nWidth, int nHeight, int iMatrix = 4, bool video_full_range = 0);
+/**
+* @brief Texture objects of NV12/P016 surfaces, kept across calls. Decoders cycle through a fixed set of surfaces,
+* so after the first few frames every lookup is a hit. Entries are keyed by address, pitch, size and sampling mode;
+* the least recently used one is dropped when the cache is full. Not thread safe: use one cache per session.
+* Must be destroyed with the CUDA context that created the textures current.
+*/
+class Nv12TextureCache {
+public:
+    Nv12TextureCache(int nMaxEntries = 32) : nMaxEntries(nMaxEntries) {}
+    ~Nv12TextureCache();
 
-void ConvertUInt8ToUInt16(uint8_t *dpUInt8, uint16_t *dpUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight);
-void ConvertUInt16ToUInt8(uint16_t *dpUInt16, uint8_t *dpUInt8, int nSrcPitch, int nDestPitch, int nWidth, int nHeight);
+    /**
+    * @brief Luma texture of the first nHeight rows, and a two-channel texture over the whole surface whose chroma
+    * starts at row nHeight.
+    *   @param  bLinear  Linear filtering with normalized float reads; otherwise point sampling of raw samples
+    */
+    bool GetTextures(const uint8_t *dpSrc, int nPitch, int nWidth, int nHeight, int nBytesPerSample, bool bLinear,
+        unsigned long long &texY, unsigned long long &texUv);
+    void Clear();
+
+private:
+    Nv12TextureCache(const Nv12TextureCache &) = delete;
+    Nv12TextureCache &operator=(const Nv12TextureCache &) = delete;
+
+    struct Entry {
+        const uint8_t *dpSrc;
+        int nPitch, nWidth, nHeight, nBytesPerSample;
+        bool bLinear;
+        unsigned long long texY, texUv;
+        uint64_t nLastUse;
+    };
+    std::vector<Entry> vEntry;
+    uint64_t nUseCount = 0;
+    int nMaxEntries;
+};
 
-void ResizeNv12(unsigned char *dpDstNv12, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char *dpDstNv12UV = nullptr);
-void ResizeP016(unsigned char *dpDstP016, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcP016, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char *dpDstP016UV = nullptr);
+// With pCache the source textures are looked up instead of being created and destroyed on every call
+void ResizeNv12(unsigned char *dpDstNv12, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char *dpDstNv12UV = nullptr, Nv12TextureCache *pCache = nullptr);
+void ResizeP016(unsigned char *dpDstP016, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcP016, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char *dpDstP016UV = nullptr, Nv12TextureCache *pCache = nullptr);
 
 void ScaleYUV420(unsigned char *dpDstY, unsigned char* dpDstU, unsigned char* dpDstV, int nDstPitch, int nDstChromaPitch, int nDstWidth, int nDstHeight,
     unsigned char *dpSrcY, unsigned char* dpSrcU, unsigned char* dpSrcV, int nSrcPitch, int nSrcChromaPitch, int nSrcWidth, int nSrcHeight, bool bSemiplanar);
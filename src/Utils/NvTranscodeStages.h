@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vector>
+#include <cuda.h>
+#include "NvCodecUtils.h"
+#include "FFmpegDemuxer.h"
+#include "FFmpegMuxer.h"
+#include "NvDecoder/NvDecoder.h"
+#include "NvEncoder/NvEncoderCuda.h"
+#include "TranscodePipeline.h"
+
+//---------------------------------------------------------------------------
+//! \file NvTranscodeStages.h
+//! \brief TranscodePipeline backends for FFmpegDemuxer, NVDEC, ResizeNv12, NVENC and FFmpegMuxer.
+//!
+//! Decoded frames are NvDecoder's own device surfaces, held with GetLockedFrame() until
+//! the next stage is done with them, so pictures stay in video memory from the decoder
+//! to the encoder's input buffer. All stages must share one CUDA context.
+//---------------------------------------------------------------------------
+
+class DemuxerTranscodeSource : public TranscodeSource {
+public:
+    DemuxerTranscodeSource(FFmpegDemuxer *pDemuxer) : pDemuxer(pDemuxer) {}
+
+    /**
+    *   @brief  Starts the transcode at nTargetPts (video stream time base): the demuxer goes to the keyframe before it
+    *   and pDecoder, which wraps the decode stage, drops the frames in between. Call before TranscodePipeline::Run().
+    */
+    bool Seek(int64_t nTargetPts, SeekTranscodeDecoder *pDecoder) {
+        if (!pDemuxer->Seek(nTargetPts)) {
+            return false;
+        }
+        pDecoder->SetSeekTarget(pDemuxer->GetSeekTarget());
+        return true;
+    }
+
+    bool Read(TranscodePacket &packet) {
+        uint8_t *pVideo = NULL;
+        int nVideoBytes = 0, bVideo = 0;
+        int64_t nPts = 0, nDts = 0;
+        do {
+            if (!pDemuxer->Demux(&pVideo, &nVideoBytes, &nPts, &nDts, &bVideo)) {
+                return false;
+            }
+        } while (!bVideo);
+        packet.vData.assign(pVideo, pVideo + nVideoBytes);
+        packet.nPts = nPts;
+        packet.nDts = nDts;
+        packet.bKeyFrame = false;
+        return true;
+    }
+
+private:
+    FFmpegDemuxer *pDemuxer;
+};
+
+/**
+* @brief Hands out NvDecoder's device surfaces without copying. The decoder must be created with bUseDeviceFrame = true.
+* NvDecoder::UnlockFrame() is not safe against a Decode() in progress on another thread (HandlePictureDisplay() updates
+* the timestamp list without the frame lock), so the consuming stage only queues released surfaces here and they are
+* unlocked on the decode thread before the next packet.
+*/
+class NvDecoderTranscodeStage : public TranscodeDecoder, public TranscodeFrameOwner {
+public:
+    /**
+    *   @param  nMaxLockedFrames    At least the number of frames the pipeline can hold, 2 * nQueueSize + 4
+    */
+    NvDecoderTranscodeStage(NvDecoder *pDecoder, int nMaxLockedFrames = 32) : pDecoder(pDecoder), qReleased(nMaxLockedFrames) {}
+
+    ~NvDecoderTranscodeStage() {
+        UnlockReleasedFrames();
+    }
+
+    bool Decode(const TranscodePacket *pPacket, std::vector<TranscodeFrame> &vFrames) {
+        UnlockReleasedFrames();
+        int nFrameReturned = 0;
+        try {
+            nFrameReturned = pPacket ? pDecoder->Decode(pPacket->vData.data(), (int)pPacket->vData.size(), 0, pPacket->nPts)
+                : pDecoder->Decode(NULL, 0);
+        } catch (std::exception &e) {
+            LOG(ERROR) << e.what();
+            return false;
+        }
+        for (int i = 0; i < nFrameReturned; i++) {
+            TranscodeFrame frame;
+            frame.pData = pDecoder->GetLockedFrame(&frame.nPts);
+            frame.nPitch = pDecoder->GetDeviceFramePitch();
+            frame.nWidth = pDecoder->GetWidth();
+            frame.nHeight = pDecoder->GetHeight();
+            frame.pOwner = this;
+            vFrames.push_back(frame);
+        }
+        return true;
+    }
+
+    // Called from the consuming stage's thread
+    void ReleaseFrame(const TranscodeFrame &frame) {
+        uint8_t *pFrame = frame.pData;
+        if (!qReleased.TryPush(std::move(pFrame))) {
+            LOG(ERROR) << "More decoded frames in flight than nMaxLockedFrames; surface not returned to the decoder";
+        }
+    }
+
+private:
+    void UnlockReleasedFrames() {
+        uint8_t *pFrame = NULL;
+        while (qReleased.TryPop(pFrame)) {
+            pDecoder->UnlockFrame(&pFrame);
+        }
+    }
+
+    NvDecoder *pDecoder;
+    SpscRingQueue<uint8_t *> qReleased;     /*!< consuming stage -> decode thread */
+};
+
+/**
+* @brief Scales NV12 into a ring of device surfaces owned by the stage.
+*/
+class NvResizeTranscodeStage : public TranscodeProcessor, public TranscodeFrameOwner {
+public:
+    /**
+    *   @param  nSurfaces   Must exceed the pipeline queue size by at least 2
+    */
+    NvResizeTranscodeStage(CUcontext cuContext, int nWidth, int nHeight, int nSurfaces)
+        : cuContext(cuContext), nWidth(nWidth), nHeight(nHeight), qFree(nSurfaces) {
+        ck(cuCtxPushCurrent(cuContext));
+        for (int i = 0; i < nSurfaces; i++) {
+            CUdeviceptr dpFrame = 0;
+            ck(cuMemAllocPitch(&dpFrame, &nPitch, nWidth, nHeight * 3 / 2, 16));
+            vdpFrame.push_back(dpFrame);
+            qFree.TryPush(std::move(i));
+        }
+        ck(cuCtxPopCurrent(NULL));
+    }
+
+    ~NvResizeTranscodeStage() {
+        cuCtxPushCurrent(cuContext);
+        texCache.Clear();
+        for (CUdeviceptr dpFrame : vdpFrame) {
+            cuMemFree(dpFrame);
+        }
+        cuCtxPopCurrent(NULL);
+    }
+
+    bool Process(TranscodeFrame &in, TranscodeFrame &out) {
+        int iSlot = -1;
+        // Blocks while all surfaces are queued for the encoder
+        qFree.Pop(iSlot);
+        out = in;
+        out.pData = (uint8_t *)vdpFrame[iSlot];
+        out.nPitch = (int)nPitch;
+        out.nWidth = nWidth;
+        out.nHeight = nHeight;
+        out.pOwner = this;
+        out.iSlot = iSlot;
+
+        ck(cuCtxPushCurrent(cuContext));
+        ResizeNv12(out.pData, out.nPitch, nWidth, nHeight, in.pData, in.nPitch, in.nWidth, in.nHeight, NULL, &texCache);
+        // The decoder may refill the source surface as soon as it is released
+        bool bOk = ck(cuStreamSynchronize(0));
+        ck(cuCtxPopCurrent(NULL));
+        ::ReleaseFrame(in);
+        return bOk;
+    }
+
+    void ReleaseFrame(const TranscodeFrame &frame) {
+        int iSlot = frame.iSlot;
+        qFree.TryPush(std::move(iSlot));
+    }
+
+private:
+    CUcontext cuContext;
+    int nWidth, nHeight;
+    size_t nPitch = 0;
+    std::vector<CUdeviceptr> vdpFrame;
+    SpscRingQueue<int> qFree;
+    Nv12TextureCache texCache;
+};
+
+/**
+* @brief Copies device frames into NVENC's input buffers and returns the bitstream. The encoder must be created
+* for NV12 at the size of the incoming frames.
+*/
+class NvEncoderTranscodeStage : public TranscodeEncoder {
+public:
+    NvEncoderTranscodeStage(NvEncoderCuda *pEncoder, CUcontext cuContext) : pEncoder(pEncoder), cuContext(cuContext) {
+        NV_ENC_CONFIG encodeConfig = {};
+        encodeConfig.version = NV_ENC_CONFIG_VER;
+        NV_ENC_INITIALIZE_PARAMS initializeParams = {};
+        initializeParams.version = NV_ENC_INITIALIZE_PARAMS_VER;
+        initializeParams.encodeConfig = &encodeConfig;
+        pEncoder->GetInitializeParams(&initializeParams);
+        // Output runs frameIntervalP - 1 frames behind the input once B-frames are reordered
+        dtsQueue = TranscodeDtsQueue(encodeConfig.frameIntervalP - 1);
+    }
+
+    bool Encode(TranscodeFrame *pFrame, std::vector<TranscodePacket> &vPackets) {
+        try {
+            if (pFrame) {
+                const NvEncInputFrame *pInput = pEncoder->GetNextInputFrame();
+                NvEncoderCuda::CopyToDeviceFrame(cuContext, pFrame->pData, pFrame->nPitch, (CUdeviceptr)pInput->inputPtr,
+                    pInput->pitch, pFrame->nWidth, pFrame->nHeight, CU_MEMORYTYPE_DEVICE, pInput->bufferFormat,
+                    pInput->chromaOffsets, pInput->numChromaPlanes);
+                ReleaseFrame(*pFrame);
+                NV_ENC_PIC_PARAMS picParams = {};
+                picParams.version = NV_ENC_PIC_PARAMS_VER;
+                picParams.inputTimeStamp = (uint64_t)pFrame->nPts;
+                dtsQueue.PushInput(pFrame->nPts);
+                pEncoder->EncodeFrame(vOutput, &picParams);
+            } else {
+                pEncoder->EndEncode(vOutput);
+            }
+        } catch (std::exception &e) {
+            LOG(ERROR) << e.what();
+            return false;
+        }
+
+        for (NvEncOutputFrame &output : vOutput) {
+            TranscodePacket packet;
+            packet.vData = std::move(output.frame);
+            packet.nPts = (int64_t)output.timeStamp;
+            packet.bKeyFrame = output.pictureType == NV_ENC_PIC_TYPE_IDR || output.pictureType == NV_ENC_PIC_TYPE_I;
+            packet.nDts = dtsQueue.PopDts(packet.nPts);
+            vPackets.push_back(std::move(packet));
+        }
+        vOutput.clear();
+        return true;
+    }
+
+private:
+    NvEncoderCuda *pEncoder;
+    CUcontext cuContext;
+    std::vector<NvEncOutputFrame> vOutput;
+    TranscodeDtsQueue dtsQueue;
+};
+
+class MuxerTranscodeSink : public TranscodeSink {
+public:
+    MuxerTranscodeSink(FFmpegMuxer *pMuxer, int iStream = 0) : pMuxer(pMuxer), iStream(iStream) {}
+
+    bool Write(const TranscodePacket &packet) {
+        return pMuxer->Mux((uint8_t *)packet.vData.data(), (unsigned int)packet.vData.size(), packet.nPts, packet.nDts,
+            iStream, packet.bKeyFrame);
+    }
+
+private:
+    FFmpegMuxer *pMuxer;
+    int iStream;
+};
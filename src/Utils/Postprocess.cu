@@ -0,0 +1,121 @@
+#include <cuda_runtime.h>
+#include "Postprocess.h"
+
+Nv12TextureCache::~Nv12TextureCache() {
+    Clear();
+}
+
+void Nv12TextureCache::Clear() {
+    for (Entry &e : vEntry) {
+        cudaDestroyTextureObject(e.texY);
+        cudaDestroyTextureObject(e.texUv);
+    }
+    vEntry.clear();
+}
+
+bool Nv12TextureCache::GetTextures(const uint8_t *dpSrc, int nPitch, int nWidth, int nHeight, int nBytesPerSample, bool bLinear,
+    unsigned long long &texY, unsigned long long &texUv) {
+    nUseCount++;
+    for (Entry &e : vEntry) {
+        if (e.dpSrc == dpSrc && e.nPitch == nPitch && e.nWidth == nWidth && e.nHeight == nHeight
+            && e.nBytesPerSample == nBytesPerSample && e.bLinear == bLinear) {
+            e.nLastUse = nUseCount;
+            texY = e.texY;
+            texUv = e.texUv;
+            return true;
+        }
+    }
+
+    cudaResourceDesc resDesc = {};
+    resDesc.resType = cudaResourceTypePitch2D;
+    resDesc.res.pitch2D.devPtr = (void *)dpSrc;
+    resDesc.res.pitch2D.desc = nBytesPerSample == 1 ? cudaCreateChannelDesc<unsigned char>() : cudaCreateChannelDesc<unsigned short>();
+    resDesc.res.pitch2D.width = nWidth;
+    resDesc.res.pitch2D.height = nHeight;
+    resDesc.res.pitch2D.pitchInBytes = nPitch;
+
+    cudaTextureDesc texDesc = {};
+    texDesc.filterMode = bLinear ? cudaFilterModeLinear : cudaFilterModePoint;
+    texDesc.readMode = bLinear ? cudaReadModeNormalizedFloat : cudaReadModeElementType;
+
+    Entry e = {dpSrc, nPitch, nWidth, nHeight, nBytesPerSample, bLinear, 0, 0, nUseCount};
+    if (!ck(cudaCreateTextureObject(&e.texY, &resDesc, &texDesc, NULL))) {
+        return false;
+    }
+    resDesc.res.pitch2D.desc = nBytesPerSample == 1 ? cudaCreateChannelDesc<uchar2>() : cudaCreateChannelDesc<ushort2>();
+    resDesc.res.pitch2D.width = nWidth / 2;
+    resDesc.res.pitch2D.height = nHeight * 3 / 2;
+    if (!ck(cudaCreateTextureObject(&e.texUv, &resDesc, &texDesc, NULL))) {
+        cudaDestroyTextureObject(e.texY);
+        return false;
+    }
+
+    if ((int)vEntry.size() >= nMaxEntries) {
+        size_t iOldest = 0;
+        for (size_t i = 1; i < vEntry.size(); i++) {
+            if (vEntry[i].nLastUse < vEntry[iOldest].nLastUse) {
+                iOldest = i;
+            }
+        }
+        cudaDestroyTextureObject(vEntry[iOldest].texY);
+        cudaDestroyTextureObject(vEntry[iOldest].texUv);
+        vEntry.erase(vEntry.begin() + iOldest);
+    }
+    vEntry.push_back(e);
+    texY = e.texY;
+    texUv = e.texUv;
+    return true;
+}
+
+template<POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType>
+static __global__ void Nv12PostprocessKernel(cudaTextureObject_t texY, cudaTextureObject_t texUv, int nSrcHeight, void *pDst,
+    int nDstPitch, PostprocessParams params, YuvToRgbMatrix mat) {
+    int x = blockIdx.x * blockDim.x + threadIdx.x,
+        y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= params.nDstWidth || y >= params.nDstHeight) {
+        return;
+    }
+
+    Nv12TexFetchY fetchY = {texY};
+    Nv12TexFetchUv fetchUv = {texUv, nSrcHeight};
+    float afValue[3];
+    PostprocessPixel(params, mat, fetchY, fetchUv, x, y, afValue);
+    StorePostprocessPixel<eLayout, eType>(pDst, nDstPitch, params.nDstHeight, x, y, afValue);
+}
+
+template<POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType>
+static void LaunchNv12Postprocess(cudaTextureObject_t texY, cudaTextureObject_t texUv, int nSrcHeight, void *dpDst, int nDstPitch,
+    const PostprocessParams &params, const YuvToRgbMatrix &mat, cudaStream_t stream) {
+    dim3 block(32, 8);
+    dim3 grid((params.nDstWidth + block.x - 1) / block.x, (params.nDstHeight + block.y - 1) / block.y);
+    Nv12PostprocessKernel<eLayout, eType> <<<grid, block, 0, stream>>>(texY, texUv, nSrcHeight, dpDst, nDstPitch, params, mat);
+}
+
+void Nv12Postprocess(uint8_t *dpNv12, int nNv12Pitch, int nSrcWidth, int nSrcHeight, void *dpDst, int nDstPitch,
+    const PostprocessParams &params, POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType, Nv12TextureCache *pCache, cudaStream_t stream) {
+    PostprocessParams p = ResolvePostprocessParams(params, nSrcWidth, nSrcHeight);
+    if (p.nDstWidth <= 0 || p.nDstHeight <= 0 || nDstPitch % GetPostprocessSampleSize(eType)) {
+        LOG(ERROR) << "Nv12Postprocess: invalid output " << p.nDstWidth << "x" << p.nDstHeight << ", pitch " << nDstPitch;
+        return;
+    }
+    YuvToRgbMatrix mat = MakeYuvToRgbMatrix(p.iMatrix, p.bFullRange);
+
+    Nv12TextureCache localCache(1);
+    unsigned long long texY = 0, texUv = 0;
+    if (!(pCache ? pCache : &localCache)->GetTextures(dpNv12, nNv12Pitch, nSrcWidth, nSrcHeight, 1, false, texY, texUv)) {
+        return;
+    }
+
+#define NV12_POSTPROCESS_CASE(L, T) \
+    if (eLayout == L && eType == T) { \
+        LaunchNv12Postprocess<L, T>(texY, texUv, nSrcHeight, dpDst, nDstPitch, p, mat, stream); \
+    }
+    NV12_POSTPROCESS_CASE(POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_U8)
+    NV12_POSTPROCESS_CASE(POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_F16)
+    NV12_POSTPROCESS_CASE(POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_F32)
+    NV12_POSTPROCESS_CASE(POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_U8)
+    NV12_POSTPROCESS_CASE(POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F16)
+    NV12_POSTPROCESS_CASE(POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F32)
+#undef NV12_POSTPROCESS_CASE
+    ck(cudaGetLastError());
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include "NvCodecUtils.h"
+#include "PostprocessMath.h"
+
+//---------------------------------------------------------------------------
+//! \file Postprocess.h
+//! \brief GPU NV12 crop + resize + RGB + normalize kernel in Postprocess.cu.
+//---------------------------------------------------------------------------
+
+/**
+* @brief Crop, bilinear resize, conversion to RGB and per-channel normalization of an NV12 frame in one launch that reads
+* each source sample once per tap and writes the tensor once. Nv12PostprocessHost() is the CPU reference.
+*   @param  nDstPitch  Bytes per output row; planes of a planar output are nDstPitch * nDstHeight bytes apart
+*/
+void Nv12Postprocess(uint8_t *dpNv12, int nNv12Pitch, int nSrcWidth, int nSrcHeight, void *dpDst, int nDstPitch,
+    const PostprocessParams &params, POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType, Nv12TextureCache *pCache = nullptr, CUstream_st *stream = nullptr);
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ColorSpaceMath.h"
+
+//---------------------------------------------------------------------------
+//! \file PostprocessMath.h
+//! \brief Per-pixel math of the fused NV12 crop + resize + RGB + normalize kernel (Postprocess.cu).
+//!
+//! Sampling is done in software from point fetches, so the kernel (texture fetches) and
+//! Nv12PostprocessHost() (plain loads) compute the same values and the CPU version can be
+//! used as a reference on machines without a GPU.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    POSTPROCESS_LAYOUT_PLANAR = 0,          /*!< Three planes, nDstPitch * nDstHeight bytes apart (CHW) */
+    POSTPROCESS_LAYOUT_INTERLEAVED,         /*!< Three channels per pixel (HWC) */
+} POSTPROCESS_LAYOUT;
+
+typedef enum {
+    POSTPROCESS_TYPE_U8 = 0,                /*!< Rounded and clamped to [0, 255] */
+    POSTPROCESS_TYPE_F16,                   /*!< IEEE half, stored as its 16-bit pattern */
+    POSTPROCESS_TYPE_F32,
+} POSTPROCESS_TYPE;
+
+/**
+* @brief Crop rectangle in source pixels, output size, colour conversion and per-channel normalization
+* out = rgb * afScale[c] + afBias[c], with rgb in [0, 255] and c in output channel order.
+*/
+struct PostprocessParams {
+    int nCropX = 0, nCropY = 0;
+    int nCropWidth = 0, nCropHeight = 0;    /*!< 0 selects the whole source */
+    int nDstWidth = 0, nDstHeight = 0;
+    int iMatrix = ColorSpaceStandard_BT709;
+    bool bFullRange = false;
+    bool bBgr = false;                      /*!< Output channels B, G, R instead of R, G, B */
+    float afScale[3] = {1.0f, 1.0f, 1.0f};
+    float afBias[3] = {0.0f, 0.0f, 0.0f};
+};
+
+inline size_t GetPostprocessSampleSize(POSTPROCESS_TYPE eType) {
+    return eType == POSTPROCESS_TYPE_U8 ? 1 : (eType == POSTPROCESS_TYPE_F16 ? 2 : 4);
+}
+
+/**
+* @brief Fills in a zero crop size and clips the crop rectangle to the source.
+*/
+inline PostprocessParams ResolvePostprocessParams(PostprocessParams params, int nSrcWidth, int nSrcHeight) {
+    params.nCropX = params.nCropX < 0 ? 0 : (params.nCropX >= nSrcWidth ? nSrcWidth - 1 : params.nCropX);
+    params.nCropY = params.nCropY < 0 ? 0 : (params.nCropY >= nSrcHeight ? nSrcHeight - 1 : params.nCropY);
+    if (params.nCropWidth <= 0 || params.nCropX + params.nCropWidth > nSrcWidth) {
+        params.nCropWidth = nSrcWidth - params.nCropX;
+    }
+    if (params.nCropHeight <= 0 || params.nCropY + params.nCropHeight > nSrcHeight) {
+        params.nCropHeight = nSrcHeight - params.nCropY;
+    }
+    return params;
+}
+
+inline COLORSPACE_HD float ClampFloat(float f, float fMin, float fMax) {
+    return f < fMin ? fMin : (f > fMax ? fMax : f);
+}
+
+/**
+* @brief Bilinear sample of N channels at (x, y) in pixel units with pixel centres at integers. Coordinates are
+* clamped to [xMin, xMax] x [yMin, yMax]; fetch(x, y, pOut) loads the N channels of one pixel.
+*/
+#if defined(__CUDACC__)
+#pragma nv_exec_check_disable
+#endif
+template<int N, class Fetch>
+inline COLORSPACE_HD void SampleBilinear(const Fetch &fetch, float x, float y, int xMin, int xMax, int yMin, int yMax, float *pOut) {
+    x = ClampFloat(x, (float)xMin, (float)xMax);
+    y = ClampFloat(y, (float)yMin, (float)yMax);
+    int x0 = (int)x, y0 = (int)y;
+    int x1 = x0 < xMax ? x0 + 1 : x0, y1 = y0 < yMax ? y0 + 1 : y0;
+    float fx = x - x0, fy = y - y0;
+    float a[N], b[N], c[N], d[N];
+    fetch(x0, y0, a);
+    fetch(x1, y0, b);
+    fetch(x0, y1, c);
+    fetch(x1, y1, d);
+    for (int i = 0; i < N; i++) {
+        float top = a[i] + (b[i] - a[i]) * fx;
+        float bottom = c[i] + (d[i] - c[i]) * fx;
+        pOut[i] = top + (bottom - top) * fy;
+    }
+}
+
+/**
+* @brief Normalized output channels of destination pixel (dx, dy). Chroma is sampled at the matching position of the
+* half-resolution plane (centre siting). params must have been through ResolvePostprocessParams().
+*   @param  fetchY   fetch(x, y, pOut) with one channel, x and y in luma pixels
+*   @param  fetchUv  fetch(x, y, pOut) with channels U and V, x and y in chroma pixels
+*/
+#if defined(__CUDACC__)
+#pragma nv_exec_check_disable
+#endif
+template<class FetchY, class FetchUv>
+inline COLORSPACE_HD void PostprocessPixel(const PostprocessParams &params, const YuvToRgbMatrix &mat, const FetchY &fetchY,
+    const FetchUv &fetchUv, int dx, int dy, float *pOut) {
+    float sx = params.nCropX + (dx + 0.5f) * params.nCropWidth / params.nDstWidth - 0.5f;
+    float sy = params.nCropY + (dy + 0.5f) * params.nCropHeight / params.nDstHeight - 0.5f;
+    float fLuma, afChroma[2];
+    SampleBilinear<1>(fetchY, sx, sy, params.nCropX, params.nCropX + params.nCropWidth - 1,
+        params.nCropY, params.nCropY + params.nCropHeight - 1, &fLuma);
+    SampleBilinear<2>(fetchUv, (sx + 0.5f) * 0.5f - 0.5f, (sy + 0.5f) * 0.5f - 0.5f,
+        params.nCropX / 2, (params.nCropX + params.nCropWidth - 1) / 2,
+        params.nCropY / 2, (params.nCropY + params.nCropHeight - 1) / 2, afChroma);
+
+    float fy = fLuma - mat.fOffsetY, fu = afChroma[0] - mat.fOffsetC, fv = afChroma[1] - mat.fOffsetC;
+    float afRgb[3];
+    for (int i = 0; i < 3; i++) {
+        afRgb[i] = ClampFloat(mat.m[i][0] * fy + mat.m[i][1] * fu + mat.m[i][2] * fv, 0.0f, 255.0f);
+    }
+    for (int c = 0; c < 3; c++) {
+        pOut[c] = afRgb[params.bBgr ? 2 - c : c] * params.afScale[c] + params.afBias[c];
+    }
+}
+
+/**
+* @brief Round-to-nearest-even float to IEEE half conversion, identical on host and device.
+*/
+inline COLORSPACE_HD uint16_t FloatToHalf(float f) {
+    union {
+        float f;
+        uint32_t u;
+    } bits;
+    bits.f = f;
+    uint32_t x = bits.u;
+    uint32_t nSign = (x >> 16) & 0x8000;
+    uint32_t nMant = x & 0x7FFFFF;
+    int nExp = (int)((x >> 23) & 0xFF);
+    if (nExp == 0xFF) {
+        return (uint16_t)(nSign | 0x7C00 | (nMant ? 0x200 : 0));
+    }
+    nExp = nExp - 127 + 15;
+    if (nExp >= 31) {
+        return (uint16_t)(nSign | 0x7C00);
+    }
+    if (nExp <= 0) {
+        if (nExp < -10) {
+            return (uint16_t)nSign;
+        }
+        nMant |= 0x800000;
+        int nShift = 14 - nExp;
+        uint32_t h = nMant >> nShift, nRem = nMant & ((1u << nShift) - 1), nHalf = 1u << (nShift - 1);
+        if (nRem > nHalf || (nRem == nHalf && (h & 1))) {
+            h++;
+        }
+        return (uint16_t)(nSign | h);
+    }
+    // A carry out of the mantissa correctly bumps the exponent
+    uint32_t h = ((uint32_t)nExp << 10) | (nMant >> 13), nRem = nMant & 0x1FFF;
+    if (nRem > 0x1000 || (nRem == 0x1000 && (h & 1))) {
+        h++;
+    }
+    return (uint16_t)(nSign | h);
+}
+
+template<POSTPROCESS_TYPE eType>
+inline COLORSPACE_HD void StorePostprocessSample(void *pDst, size_t iSample, float f) {
+    if (eType == POSTPROCESS_TYPE_U8) {
+        ((uint8_t *)pDst)[iSample] = ClampToUint8(f);
+    } else if (eType == POSTPROCESS_TYPE_F16) {
+        ((uint16_t *)pDst)[iSample] = FloatToHalf(f);
+    } else {
+        ((float *)pDst)[iSample] = f;
+    }
+}
+
+/**
+* @brief Writes the three channels of (dx, dy); nDstPitch is in bytes and must be a multiple of the sample size.
+*/
+template<POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType>
+inline COLORSPACE_HD void StorePostprocessPixel(void *pDst, int nDstPitch, int nDstHeight, int dx, int dy, const float *pValue) {
+    const size_t nSampleSize = eType == POSTPROCESS_TYPE_U8 ? 1 : (eType == POSTPROCESS_TYPE_F16 ? 2 : 4);
+    size_t nRow = nDstPitch / nSampleSize;
+    for (int c = 0; c < 3; c++) {
+        size_t iSample = eLayout == POSTPROCESS_LAYOUT_PLANAR ? c * nRow * nDstHeight + dy * nRow + dx : dy * nRow + dx * 3 + c;
+        StorePostprocessSample<eType>(pDst, iSample, pValue[c]);
+    }
+}
+
+struct Nv12HostFetchY {
+    const uint8_t *pNv12;
+    int nPitch;
+    void operator()(int x, int y, float *pOut) const {
+        pOut[0] = pNv12[(size_t)y * nPitch + x];
+    }
+};
+
+struct Nv12HostFetchUv {
+    const uint8_t *pUv;
+    int nPitch;
+    void operator()(int x, int y, float *pOut) const {
+        const uint8_t *p = pUv + (size_t)y * nPitch + x * 2;
+        pOut[0] = p[0];
+        pOut[1] = p[1];
+    }
+};
+
+#if defined(__CUDACC__)
+// Point-sampled textures from Nv12TextureCache; the chroma texture spans the whole surface
+struct Nv12TexFetchY {
+    cudaTextureObject_t tex;
+    __device__ void operator()(int x, int y, float *pOut) const {
+        pOut[0] = tex2D<unsigned char>(tex, x + 0.5f, y + 0.5f);
+    }
+};
+
+struct Nv12TexFetchUv {
+    cudaTextureObject_t tex;
+    int nHeight;
+    __device__ void operator()(int x, int y, float *pOut) const {
+        uchar2 uv = tex2D<uchar2>(tex, x + 0.5f, nHeight + y + 0.5f);
+        pOut[0] = uv.x;
+        pOut[1] = uv.y;
+    }
+};
+#endif
+
+template<POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType>
+inline void Nv12PostprocessHost(const uint8_t *pNv12, int nNv12Pitch, int nSrcWidth, int nSrcHeight, void *pDst, int nDstPitch,
+    const PostprocessParams &params) {
+    PostprocessParams p = ResolvePostprocessParams(params, nSrcWidth, nSrcHeight);
+    YuvToRgbMatrix mat = MakeYuvToRgbMatrix(p.iMatrix, p.bFullRange);
+    Nv12HostFetchY fetchY = {pNv12, nNv12Pitch};
+    Nv12HostFetchUv fetchUv = {pNv12 + (size_t)nNv12Pitch * nSrcHeight, nNv12Pitch};
+    float afValue[3];
+    for (int y = 0; y < p.nDstHeight; y++) {
+        for (int x = 0; x < p.nDstWidth; x++) {
+            PostprocessPixel(p, mat, fetchY, fetchUv, x, y, afValue);
+            StorePostprocessPixel<eLayout, eType>(pDst, nDstPitch, p.nDstHeight, x, y, afValue);
+        }
+    }
+}
+
+/**
+* @brief CPU reference for Nv12Postprocess(); chroma follows the luma plane at nNv12Pitch * nSrcHeight.
+*/
+inline void Nv12PostprocessHost(const uint8_t *pNv12, int nNv12Pitch, int nSrcWidth, int nSrcHeight, void *pDst, int nDstPitch,
+    const PostprocessParams &params, POSTPROCESS_LAYOUT eLayout, POSTPROCESS_TYPE eType) {
+#define POSTPROCESS_HOST_CASE(L, T) \
+    if (eLayout == L && eType == T) { \
+        Nv12PostprocessHost<L, T>(pNv12, nNv12Pitch, nSrcWidth, nSrcHeight, pDst, nDstPitch, params); \
+        return; \
+    }
+    POSTPROCESS_HOST_CASE(POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_U8)
+    POSTPROCESS_HOST_CASE(POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_F16)
+    POSTPROCESS_HOST_CASE(POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_F32)
+    POSTPROCESS_HOST_CASE(POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_U8)
+    POSTPROCESS_HOST_CASE(POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F16)
+    POSTPROCESS_HOST_CASE(POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F32)
+#undef POSTPROCESS_HOST_CASE
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+//---------------------------------------------------------------------------
+//! \file QualitySearch.h
+//! \brief Picks the QP or CQ of every iteration of the constant quality encoding in
+//! NvEncoderCudaIterative, and counts how many iterations frames take.
+//!
+//! Quality falls as the parameter rises. Until one encode of a frame is above and one
+//! below the target window, the next parameter is the last one moved by its quality
+//! error over a dB-per-step slope learned on earlier frames. Once the window is
+//! bracketed, the secant through the two bracket ends is used, kept strictly inside
+//! the bracket so the search narrows like a bisection. Each frame starts from the
+//! parameter the previous one settled on, moved toward the centre of the window.
+//---------------------------------------------------------------------------
+
+#define QUALITY_SEARCH_MAX_ITERATIONS 32
+
+typedef enum {
+    QUALITY_SEARCH_FIXED_STEP = 0,          /*!< Step by QualitySearchConfig::nStep until the window is hit and keep the last encode */
+    QUALITY_SEARCH_SECANT,                  /*!< Slope-predicted steps, then secant within the bracket; keeps the best encode */
+} QUALITY_SEARCH_MODE;
+
+struct QualitySearchConfig {
+    int nMinParam = 1, nMaxParam = 51;
+    double dDefaultSlope = 0.5;             /*!< Quality lost per parameter step until frames were measured; about 0.5 dB for QP and CQ */
+    double dMinQuality = 0, dMaxQuality = 0;/*!< Target window, both ends excluded */
+    int nStep = 1;                          /*!< Step of QUALITY_SEARCH_FIXED_STEP */
+    int nMaxIterations = 1;
+    QUALITY_SEARCH_MODE eMode = QUALITY_SEARCH_SECANT;
+};
+
+struct QualitySearchStats {
+    uint64_t nFrames = 0;
+    uint64_t nIterations = 0;
+    uint64_t nFramesInWindow = 0;
+    uint64_t anFramesByIterations[QUALITY_SEARCH_MAX_ITERATIONS + 1] = {};
+
+    double GetIterationsPerFrame() const {
+        return nFrames ? (double)nIterations / nFrames : 0.0;
+    }
+};
+
+/**
+* @brief Per-frame parameter search. Call StartFrame(), then AddResult() after every encode of the frame until it
+* returns false, then FinishFrame() for the encode to keep. Not thread safe.
+*/
+class QualityParamSearch {
+public:
+    void SetConfig(const QualitySearchConfig &config) {
+        this->config = config;
+    }
+
+    const QualitySearchConfig &GetConfig() const {
+        return config;
+    }
+
+    /**
+    * @brief Parameter to submit a new frame with, given the one the encoder is configured with.
+    */
+    int GetSeedParam(int nCurrentParam) const {
+        if (!bHistory) {
+            return nCurrentParam;
+        }
+        if (config.eMode == QUALITY_SEARCH_FIXED_STEP) {
+            return ClampParam(nLastRequested);
+        }
+        double dSlope = dLearnedSlope > 0 ? dLearnedSlope : GetDefaultSlope();
+        return ClampParam(nLastParam + (int)lround((dLastQuality - GetTarget()) / dSlope));
+    }
+
+    void StartFrame() {
+        vResult.clear();
+    }
+
+    /**
+    * @brief Records the encode of the next iteration of the current frame.
+    *   @param  nNextParam  Parameter of the next iteration when true is returned
+    */
+    bool AddResult(int nParam, double dQuality, int &nNextParam) {
+        Result r = {nParam, dQuality};
+        vResult.push_back(r);
+        nLastRequested = nParam;
+        if (IsInWindow(dQuality)) {
+            return false;
+        }
+
+        bool bMore = config.eMode == QUALITY_SEARCH_FIXED_STEP ? NextFixedStep(r, nNextParam) : NextSecant(nNextParam);
+        if (bMore) {
+            nLastRequested = nNextParam;
+        }
+        return bMore && (int)vResult.size() < config.nMaxIterations;
+    }
+
+    /**
+    * @brief Index of the iteration to keep. Updates what later frames start from and the statistics.
+    */
+    int FinishFrame() {
+        if (vResult.empty()) {
+            return 0;
+        }
+        int iBest = (int)vResult.size() - 1;
+        if (config.eMode == QUALITY_SEARCH_SECANT) {
+            iBest = GetBestResult();
+            double dFrameSlope = GetFrameSlope();
+            if (dFrameSlope > 0) {
+                dLearnedSlope = dLearnedSlope > 0 ? 0.5 * (dLearnedSlope + dFrameSlope) : dFrameSlope;
+            }
+        }
+
+        const Result &best = vResult[iBest];
+        bHistory = true;
+        nLastParam = best.nParam;
+        dLastQuality = best.dQuality;
+
+        int nIterations = (int)vResult.size();
+        stats.nFrames++;
+        stats.nIterations += nIterations;
+        stats.nFramesInWindow += IsInWindow(best.dQuality) ? 1 : 0;
+        stats.anFramesByIterations[nIterations < QUALITY_SEARCH_MAX_ITERATIONS ? nIterations : QUALITY_SEARCH_MAX_ITERATIONS]++;
+        return iBest;
+    }
+
+    const QualitySearchStats &GetStats() const {
+        return stats;
+    }
+
+    void ResetStats() {
+        stats = QualitySearchStats();
+    }
+
+private:
+    struct Result {
+        int nParam;
+        double dQuality;
+    };
+
+    bool IsInWindow(double dQuality) const {
+        return dQuality > config.dMinQuality && dQuality < config.dMaxQuality;
+    }
+
+    double GetTarget() const {
+        return 0.5 * (config.dMinQuality + config.dMaxQuality);
+    }
+
+    int ClampParam(int nParam) const {
+        return nParam < config.nMinParam ? config.nMinParam : (nParam > config.nMaxParam ? config.nMaxParam : nParam);
+    }
+
+    double GetDefaultSlope() const {
+        return config.dDefaultSlope > 0 ? config.dDefaultSlope : 0.5;
+    }
+
+    // Quality lost per parameter step: the frame's own measurement, else what earlier frames gave
+    double GetSlope() const {
+        double dSlope = GetFrameSlope();
+        if (dSlope <= 0) {
+            dSlope = dLearnedSlope;
+        }
+        return dSlope > 0 ? dSlope : GetDefaultSlope();
+    }
+
+    // Secant slope of the last two encodes of the frame, 0 if they do not give a usable one
+    double GetFrameSlope() const {
+        if (vResult.size() < 2) {
+            return 0.0;
+        }
+        const Result &a = vResult[vResult.size() - 2], &b = vResult.back();
+        if (a.nParam == b.nParam) {
+            return 0.0;
+        }
+        double dSlope = (a.dQuality - b.dQuality) / (b.nParam - a.nParam);
+        double dDefault = GetDefaultSlope();
+        if (dSlope <= 0) {
+            return 0.0;
+        }
+        return dSlope < 0.1 * dDefault ? 0.1 * dDefault : (dSlope > 10 * dDefault ? 10 * dDefault : dSlope);
+    }
+
+    bool NextFixedStep(const Result &r, int &nNextParam) const {
+        int nParam = r.nParam + (r.dQuality < config.dMinQuality ? -config.nStep : config.nStep);
+        if (nParam < config.nMinParam || nParam > config.nMaxParam) {
+            return false;
+        }
+        nNextParam = nParam;
+        return true;
+    }
+
+    bool NextSecant(int &nNextParam) const {
+        // Largest parameter known to be too good and smallest known to be too bad
+        int iLow = -1, iHigh = -1;
+        for (int i = 0; i < (int)vResult.size(); i++) {
+            const Result &r = vResult[i];
+            if (r.dQuality >= config.dMaxQuality && (iLow < 0 || r.nParam > vResult[iLow].nParam)) {
+                iLow = i;
+            }
+            if (r.dQuality <= config.dMinQuality && (iHigh < 0 || r.nParam < vResult[iHigh].nParam)) {
+                iHigh = i;
+            }
+        }
+        int nLow = iLow < 0 ? config.nMinParam : vResult[iLow].nParam + 1;
+        int nHigh = iHigh < 0 ? config.nMaxParam : vResult[iHigh].nParam - 1;
+        if (nLow > nHigh) {
+            return false;
+        }
+
+        const Result &last = vResult.back();
+        double dTarget = GetTarget(), dParam;
+        if (iLow >= 0 && iHigh >= 0 && vResult[iLow].dQuality > vResult[iHigh].dQuality) {
+            const Result &a = vResult[iLow], &b = vResult[iHigh];
+            dParam = a.nParam + (a.dQuality - dTarget) * (b.nParam - a.nParam) / (a.dQuality - b.dQuality);
+        } else {
+            dParam = last.nParam + (last.dQuality - dTarget) / GetSlope();
+        }
+        int nParam = (int)lround(dParam);
+        if (nParam == last.nParam) {
+            nParam += last.dQuality > dTarget ? 1 : -1;
+        }
+        nParam = nParam < nLow ? nLow : (nParam > nHigh ? nHigh : nParam);
+        for (const Result &r : vResult) {
+            if (r.nParam == nParam) {
+                return false;
+            }
+        }
+        nNextParam = nParam;
+        return true;
+    }
+
+    // The encode in the window, else the lowest quality above the window's lower end, else the highest quality
+    int GetBestResult() const {
+        int iBest = 0;
+        for (int i = 1; i < (int)vResult.size(); i++) {
+            double dBest = vResult[iBest].dQuality, d = vResult[i].dQuality;
+            bool bBestEnough = dBest > config.dMinQuality, bEnough = d > config.dMinQuality;
+            if (IsInWindow(d) || (!IsInWindow(dBest) && (bEnough != bBestEnough ? bEnough : (bEnough ? d < dBest : d > dBest)))) {
+                iBest = i;
+            }
+        }
+        return iBest;
+    }
+
+    QualitySearchConfig config;
+    std::vector<Result> vResult;
+
+    // Carried from frame to frame
+    bool bHistory = false;
+    int nLastParam = 0, nLastRequested = 0;
+    double dLastQuality = 0;
+    double dLearnedSlope = 0;
+
+    QualitySearchStats stats;
+};
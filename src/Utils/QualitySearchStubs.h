@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+#include "QualitySearch.h"
+
+//---------------------------------------------------------------------------
+//! \file QualitySearchStubs.h
+//! \brief A stand-in for the iterative encoder, so QualityParamSearch can be run and
+//! checked on machines without a GPU.
+//---------------------------------------------------------------------------
+
+/**
+* @brief Stand-in for NvEncoderCudaIterative: PSNR falls with the QP along a slightly curved line
+* whose level and slope change at every scene cut.
+*/
+class StubQualityEncoder {
+public:
+    StubQualityEncoder(int nFrames, uint32_t nSeed) {
+        std::mt19937 rng(nSeed);
+        std::uniform_real_distribution<double> level(46.0, 58.0), slope(0.35, 0.75), drift(-0.15, 0.15);
+        std::uniform_int_distribution<int> sceneLength(20, 90);
+        double dLevel = 0, dSlope = 0;
+        for (int i = 0, nNextCut = 0; i < nFrames; i++) {
+            if (i == nNextCut) {
+                dLevel = level(rng);
+                dSlope = slope(rng);
+                nNextCut += sceneLength(rng);
+            }
+            dLevel += drift(rng);
+            vFrame.push_back({dLevel, dSlope});
+        }
+    }
+
+    int GetFrames() const {
+        return (int)vFrame.size();
+    }
+
+    double GetPsnr(int iFrame, int nQp) const {
+        const Frame &f = vFrame[iFrame];
+        // Deterministic measurement noise of a few hundredths of a dB
+        double dNoise = ((iFrame * 7919 + nQp * 104729) % 101 - 50) * 0.001;
+        return f.dLevel - f.dSlope * nQp - 0.004 * (nQp - 30) * (nQp - 30) + dNoise;
+    }
+
+private:
+    struct Frame {
+        double dLevel, dSlope;
+    };
+    std::vector<Frame> vFrame;
+};
+
+/**
+* @brief Searches every frame of the encoder the way NvEncoderCudaIterative::EncodeFrameConstantQuality does.
+*   @param  vKeptQuality    Receives the quality of the encode kept for each frame
+*/
+inline QualitySearchStats RunQualitySearch(const StubQualityEncoder &encoder, const QualitySearchConfig &config, int nInitialQp,
+    std::vector<double> &vKeptQuality) {
+    QualityParamSearch search;
+    search.SetConfig(config);
+    vKeptQuality.clear();
+    int nQp = nInitialQp;
+    std::vector<double> vPsnr;
+    for (int i = 0; i < encoder.GetFrames(); i++) {
+        nQp = search.GetSeedParam(nQp);
+        search.StartFrame();
+        vPsnr.clear();
+        for (;;) {
+            vPsnr.push_back(encoder.GetPsnr(i, nQp));
+            int nNextQp = 0;
+            if (!search.AddResult(nQp, vPsnr.back(), nNextQp)) {
+                break;
+            }
+            nQp = nNextQp;
+        }
+        vKeptQuality.push_back(vPsnr[search.FinishFrame()]);
+    }
+    return search.GetStats();
+}
@@ -26,7 +26,7 @@
  */
 
 #include <cuda_runtime.h>
-#include "NvCodecUtils.h"
+#include "ScaleLadder.h"
 
 template<typename YuvUnitx2>
 static __global__ void Resize(cudaTextureObject_t texY, cudaTextureObject_t texUv,
@@ -57,47 +57,90 @@ static __global__ void Resize(cudaTextureObject_t texY, cudaTextureObject_t texU
 }
 
 template <typename YuvUnitx2>
-static void Resize(unsigned char *dpDst, unsigned char* dpDstUV, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight) {
-    cudaResourceDesc resDesc = {};
-    resDesc.resType = cudaResourceTypePitch2D;
-    resDesc.res.pitch2D.devPtr = dpSrc;
-    resDesc.res.pitch2D.desc = cudaCreateChannelDesc<decltype(YuvUnitx2::x)>();
-    resDesc.res.pitch2D.width = nSrcWidth;
-    resDesc.res.pitch2D.height = nSrcHeight;
-    resDesc.res.pitch2D.pitchInBytes = nSrcPitch;
-
-    cudaTextureDesc texDesc = {};
-    texDesc.filterMode = cudaFilterModeLinear;
-    texDesc.readMode = cudaReadModeNormalizedFloat;
-
-    cudaTextureObject_t texY=0;
-    ck(cudaCreateTextureObject(&texY, &resDesc, &texDesc, NULL));
-
-    resDesc.res.pitch2D.desc = cudaCreateChannelDesc<YuvUnitx2>();
-    resDesc.res.pitch2D.width = nSrcWidth / 2;
-    resDesc.res.pitch2D.height = nSrcHeight * 3 / 2;
-
-    cudaTextureObject_t texUv=0;
-    ck(cudaCreateTextureObject(&texUv, &resDesc, &texDesc, NULL));
+static void Resize(unsigned char *dpDst, unsigned char* dpDstUV, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight, Nv12TextureCache *pCache) {
+    Nv12TextureCache localCache(1);
+    unsigned long long texY = 0, texUv = 0;
+    if (!(pCache ? pCache : &localCache)->GetTextures(dpSrc, nSrcPitch, nSrcWidth, nSrcHeight, sizeof(decltype(YuvUnitx2::x)), true, texY, texUv)) {
+        return;
+    }
 
     Resize<YuvUnitx2> << <dim3((nDstWidth + 31) / 32, (nDstHeight + 31) / 32), dim3(16, 16) >> >(texY, texUv, dpDst, dpDstUV,
         nDstPitch, nDstWidth, nDstHeight, 1.0f * nDstWidth / nSrcWidth, 1.0f * nDstHeight / nSrcHeight);
-
-    ck(cudaDestroyTextureObject(texY));
-    ck(cudaDestroyTextureObject(texUv));
 }
 
-void ResizeNv12(unsigned char *dpDstNv12, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char* dpDstNv12UV)
+void ResizeNv12(unsigned char *dpDstNv12, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char* dpDstNv12UV, Nv12TextureCache *pCache)
 {
     unsigned char* dpDstUV = dpDstNv12UV ? dpDstNv12UV : dpDstNv12 + (nDstPitch*nDstHeight);
-    return Resize<uchar2>(dpDstNv12, dpDstUV, nDstPitch, nDstWidth, nDstHeight, dpSrcNv12, nSrcPitch, nSrcWidth, nSrcHeight);
+    return Resize<uchar2>(dpDstNv12, dpDstUV, nDstPitch, nDstWidth, nDstHeight, dpSrcNv12, nSrcPitch, nSrcWidth, nSrcHeight, pCache);
 }
 
 
-void ResizeP016(unsigned char *dpDstP016, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcP016, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char* dpDstP016UV)
+void ResizeP016(unsigned char *dpDstP016, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *dpSrcP016, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char* dpDstP016UV, Nv12TextureCache *pCache)
 {
     unsigned char* dpDstUV = dpDstP016UV ? dpDstP016UV : dpDstP016 + (nDstPitch*nDstHeight);
-    return Resize<ushort2>(dpDstP016, dpDstUV, nDstPitch, nDstWidth, nDstHeight, dpSrcP016, nSrcPitch, nSrcWidth, nSrcHeight);
+    return Resize<ushort2>(dpDstP016, dpDstUV, nDstPitch, nDstWidth, nDstHeight, dpSrcP016, nSrcPitch, nSrcWidth, nSrcHeight, pCache);
+}
+
+// Rungs of one launch; blocks [aiFirstBlock[r], aiFirstBlock[r + 1]) of the 1D grid cover rung r
+struct ScaleLadderGrid {
+    ScaleLadderRung aRung[SCALE_LADDER_MAX_RUNGS];
+    int anBlocksX[SCALE_LADDER_MAX_RUNGS];
+    int aiFirstBlock[SCALE_LADDER_MAX_RUNGS + 1];
+    int nRungs;
+};
+
+template<SCALE_FILTER eFilter>
+static __global__ void ResizeNv12LadderKernel(cudaTextureObject_t texY, cudaTextureObject_t texUv, int nSrcWidth, int nSrcHeight,
+    ScaleLadderGrid grid) {
+    int r = 0;
+    while (r + 1 < grid.nRungs && (int)blockIdx.x >= grid.aiFirstBlock[r + 1]) {
+        r++;
+    }
+    int iBlock = blockIdx.x - grid.aiFirstBlock[r];
+    int ix = (iBlock % grid.anBlocksX[r]) * blockDim.x + threadIdx.x,
+        iy = (iBlock / grid.anBlocksX[r]) * blockDim.y + threadIdx.y;
+    const ScaleLadderRung &rung = grid.aRung[r];
+    if (ix >= (rung.nWidth + 1) / 2 || iy >= (rung.nHeight + 1) / 2) {
+        return;
+    }
+
+    Nv12TexFetchY fetchY = {texY};
+    Nv12TexFetchUv fetchUv = {texUv, nSrcHeight};
+    ScaleNv12Block<eFilter>(fetchY, fetchUv, nSrcWidth, nSrcHeight, rung, ix, iy);
+}
+
+void ResizeNv12Ladder(uint8_t *dpSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, const ScaleLadderRung *pRungs, int nRungs,
+    SCALE_FILTER eFilter, Nv12TextureCache *pCache, cudaStream_t stream) {
+    Nv12TextureCache localCache(1);
+    unsigned long long texY = 0, texUv = 0;
+    if (!(pCache ? pCache : &localCache)->GetTextures(dpSrcNv12, nSrcPitch, nSrcWidth, nSrcHeight, 1, false, texY, texUv)) {
+        return;
+    }
+
+    dim3 block(16, 8);
+    for (int iFirst = 0; iFirst < nRungs; iFirst += SCALE_LADDER_MAX_RUNGS) {
+        ScaleLadderGrid grid = {};
+        grid.nRungs = nRungs - iFirst < SCALE_LADDER_MAX_RUNGS ? nRungs - iFirst : SCALE_LADDER_MAX_RUNGS;
+        for (int r = 0; r < grid.nRungs; r++) {
+            grid.aRung[r] = pRungs[iFirst + r];
+            grid.anBlocksX[r] = ((grid.aRung[r].nWidth + 1) / 2 + block.x - 1) / block.x;
+            int nBlocksY = ((grid.aRung[r].nHeight + 1) / 2 + block.y - 1) / block.y;
+            grid.aiFirstBlock[r + 1] = grid.aiFirstBlock[r] + grid.anBlocksX[r] * nBlocksY;
+        }
+        int nBlocks = grid.aiFirstBlock[grid.nRungs];
+        switch (eFilter) {
+        case SCALE_FILTER_NEAREST:
+            ResizeNv12LadderKernel<SCALE_FILTER_NEAREST> <<<nBlocks, block, 0, stream>>>(texY, texUv, nSrcWidth, nSrcHeight, grid);
+            break;
+        case SCALE_FILTER_BILINEAR:
+            ResizeNv12LadderKernel<SCALE_FILTER_BILINEAR> <<<nBlocks, block, 0, stream>>>(texY, texUv, nSrcWidth, nSrcHeight, grid);
+            break;
+        case SCALE_FILTER_BOX:
+            ResizeNv12LadderKernel<SCALE_FILTER_BOX> <<<nBlocks, block, 0, stream>>>(texY, texUv, nSrcWidth, nSrcHeight, grid);
+            break;
+        }
+    }
+    ck(cudaGetLastError());
 }
 
 static __global__ void Scale(cudaTextureObject_t texSrc,
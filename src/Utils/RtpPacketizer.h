@@ -0,0 +1,558 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <codec/codec.h>
+#include "NvCodecUtils.h"
+#include "NalUnitSplitter.h"
+#include "Av1ObuParser.h"
+
+#ifdef _WIN32
+struct RtpIoVec {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#include <sys/uio.h>
+typedef struct iovec RtpIoVec;
+#endif
+
+//---------------------------------------------------------------------------
+//! \file RtpPacketizer.h
+//! \brief RTP payload formats for H.264 (RFC 6184), HEVC (RFC 7798) and AV1 (AV1 RTP specification).
+//!
+//! RtpPacketizer writes RTP and payload headers into fixed-size slabs from a pool that is recycled
+//! on every access unit, and references NAL/OBU payload directly in the encoded buffer, so each
+//! RtpPacket is a two-entry scatter/gather list ready for sendmsg()/sendmmsg(). Small units are
+//! aggregated (STAP-A, AP, multi-OBU) by copying them into the slab; large ones are fragmented
+//! (FU-A, FU, OBU fragments) without copying. RtpDepacketizer reverses this for loopback testing.
+//---------------------------------------------------------------------------
+
+struct RtpPacket {
+    RtpIoVec aIov[2];       /*!< [0] slab with RTP header and payload headers, [1] optional slice of the encoded buffer */
+    int nIov;
+    uint32_t nSize;         /*!< Total bytes over aIov */
+    uint16_t nSequence;
+    bool bMarker;           /*!< Last packet of the access unit */
+};
+
+/**
+* @brief Pool of fixed-size buffers. Slabs are handed out in order and all become free again on Reset(),
+* so a packetizer reaches a steady state in which it never allocates.
+*/
+class RtpSlabPool {
+public:
+    RtpSlabPool(size_t nSlabSize, size_t nSlabsPerChunk = 64) : nSlabSize(nSlabSize), nSlabsPerChunk(nSlabsPerChunk) {}
+
+    uint8_t *Acquire() {
+        size_t iChunk = nUsed / nSlabsPerChunk;
+        if (iChunk == vChunks.size()) {
+            vChunks.emplace_back(new uint8_t[nSlabSize * nSlabsPerChunk]);
+        }
+        return vChunks[iChunk].get() + (nUsed++ % nSlabsPerChunk) * nSlabSize;
+    }
+    void Reset() {
+        nUsed = 0;
+    }
+    size_t GetSlabSize() const {
+        return nSlabSize;
+    }
+    size_t GetCapacity() const {
+        return vChunks.size() * nSlabsPerChunk;
+    }
+
+private:
+    size_t nSlabSize, nSlabsPerChunk;
+    size_t nUsed = 0;
+    std::vector<std::unique_ptr<uint8_t[]>> vChunks;
+};
+
+class RtpPacketizer {
+public:
+    static const int nRtpHeaderSize = 12;
+    static constexpr size_t nMinMtu = 64;   /*!< Smaller values are raised to this; the RTP and FU headers alone take 15 bytes */
+
+    /**
+    *   @param  nMtu    Maximum RTP packet size (RTP header included, UDP/IP headers excluded), at least nMinMtu
+    */
+    RtpPacketizer(cdc::CodecType eCodec, uint8_t nPayloadType, uint32_t nSsrc, size_t nMtu = 1200, uint16_t nInitialSequence = 0)
+        : eCodec(eCodec), nPayloadType(nPayloadType & 0x7F), nSsrc(nSsrc), nMaxPayload(ClampMtu(nMtu) - nRtpHeaderSize),
+        nSequence(nInitialSequence), slabs(ClampMtu(nMtu)) {
+        if (nMtu < nMinMtu) {
+            LOG(ERROR) << "MTU of " << nMtu << " bytes is too small for RTP, using " << nMinMtu;
+        }
+    }
+
+    /**
+    *   @brief  Packetizes one access unit (Annex-B for H.264/HEVC, a temporal unit of OBUs for AV1).
+    *   Packets, and the slabs they reference, stay valid until the next call; aIov[1] points into pData,
+    *   which must stay alive until the packets are sent.
+    *   @param  nTimestamp  RTP timestamp, 90 kHz for video
+    *   @return Number of packets in vPackets
+    */
+    size_t Packetize(const uint8_t *pData, size_t nSize, uint32_t nTimestamp, std::vector<RtpPacket> &vPackets) {
+        vPackets.clear();
+        slabs.Reset();
+        this->nTimestamp = nTimestamp;
+        bNewSequence = false;
+        if (!CollectUnits(pData, nSize)) {
+            return 0;
+        }
+
+        size_t nAggHeader = eCodec == cdc::CODEC_TYPE_AV1 ? 1 : eCodec == cdc::CODEC_TYPE_H265 ? 2 : 1;
+        for (size_t i = 0; i < vUnits.size();) {
+            size_t j = i, nTotal = nAggHeader;
+            while (j < vUnits.size() && nTotal + AggregatedSize(vUnits[j]) <= nMaxPayload) {
+                nTotal += AggregatedSize(vUnits[j++]);
+            }
+            if (j - i >= 2) {
+                WriteAggregate(vPackets, i, j);
+                i = j;
+                continue;
+            }
+            const Unit &unit = vUnits[i++];
+            if (unit.Size() + (eCodec == cdc::CODEC_TYPE_AV1 ? 1 : 0) <= nMaxPayload) {
+                WriteSingle(vPackets, unit);
+            } else {
+                WriteFragments(vPackets, unit);
+            }
+        }
+        if (!vPackets.empty()) {
+            RtpPacket &last = vPackets.back();
+            last.bMarker = true;
+            ((uint8_t *)last.aIov[0].iov_base)[1] |= 0x80;
+        }
+        return vPackets.size();
+    }
+
+    size_t Packetize(const cdc::CodecPacket &packet, uint32_t nTimestamp, std::vector<RtpPacket> &vPackets) {
+        return Packetize((const uint8_t *)packet.data, packet.size, nTimestamp, vPackets);
+    }
+
+    uint16_t GetNextSequence() const {
+        return nSequence;
+    }
+
+private:
+    /**
+    *   @brief  A NAL unit, or an OBU with its size field removed: nHeader header bytes followed by the body.
+    *   For NAL units aHeader[] mirrors the first bytes of pBody[-nHeader]; for OBUs the header is modified.
+    */
+    struct Unit {
+        uint8_t aHeader[2];
+        uint8_t nHeader;
+        const uint8_t *pBody;
+        size_t nBody;
+        size_t Size() const {
+            return nHeader + nBody;
+        }
+    };
+
+    bool CollectUnits(const uint8_t *pData, size_t nSize) {
+        vUnits.clear();
+        if (eCodec == cdc::CODEC_TYPE_AV1) {
+            const uint8_t *p = pData, *pEnd = pData + nSize;
+            ObuUnit obu;
+            while (p < pEnd && ParseObu(p, pEnd, obu)) {
+                p += obu.nSize;
+                // Temporal delimiters are implied by the RTP timestamp and must not be sent
+                if (obu.nType == OBU_TEMPORAL_DELIMITER || obu.nType == OBU_TILE_LIST) {
+                    continue;
+                }
+                bNewSequence |= obu.nType == OBU_SEQUENCE_HEADER;
+                Unit unit;
+                unit.aHeader[0] = obu.pData[0] & ~0x02;     // obu_has_size_field = 0
+                unit.aHeader[1] = obu.bHasExtension ? obu.pData[1] : 0;
+                unit.nHeader = obu.bHasExtension ? 2 : 1;
+                unit.pBody = obu.pPayload;
+                unit.nBody = obu.nPayloadSize;
+                vUnits.push_back(unit);
+            }
+            return !vUnits.empty();
+        }
+
+        NAL_CODEC eNalCodec = GetNalCodec(eCodec);
+        uint8_t nHeader = eCodec == cdc::CODEC_TYPE_H265 ? 2 : 1;
+        SplitNalUnits(pData, nSize, vNal, eNalCodec);
+        for (const NalUnit &nal : vNal) {
+            if (IsAudNal(nal.nType, eNalCodec) || nal.nSize <= nHeader) {
+                continue;
+            }
+            Unit unit;
+            unit.aHeader[0] = nal.pData[0];
+            unit.aHeader[1] = nHeader == 2 ? nal.pData[1] : 0;
+            unit.nHeader = nHeader;
+            unit.pBody = nal.pData + nHeader;
+            unit.nBody = nal.nSize - nHeader;
+            vUnits.push_back(unit);
+        }
+        return !vUnits.empty();
+    }
+
+    size_t AggregatedSize(const Unit &unit) const {
+        if (eCodec == cdc::CODEC_TYPE_AV1) {
+            uint8_t aLeb[8];
+            return WriteLeb128(aLeb, unit.Size()) + unit.Size();
+        }
+        return 2 + unit.Size();
+    }
+
+    uint8_t *BeginPacket(std::vector<RtpPacket> &vPackets) {
+        uint8_t *pSlab = slabs.Acquire();
+        pSlab[0] = 0x80;                    // V=2, no padding, extension or CSRCs
+        pSlab[1] = nPayloadType;
+        pSlab[2] = (uint8_t)(nSequence >> 8);
+        pSlab[3] = (uint8_t)nSequence;
+        PutBe32(pSlab + 4, nTimestamp);
+        PutBe32(pSlab + 8, nSsrc);
+
+        RtpPacket packet = {};
+        packet.aIov[0].iov_base = pSlab;
+        packet.nIov = 1;
+        packet.nSequence = nSequence++;
+        vPackets.push_back(packet);
+        return pSlab + nRtpHeaderSize;
+    }
+
+    void EndPacket(std::vector<RtpPacket> &vPackets, const uint8_t *pSlabEnd, const uint8_t *pBody, size_t nBody) {
+        RtpPacket &packet = vPackets.back();
+        packet.aIov[0].iov_len = pSlabEnd - (const uint8_t *)packet.aIov[0].iov_base;
+        if (nBody) {
+            packet.aIov[1].iov_base = (void *)pBody;
+            packet.aIov[1].iov_len = nBody;
+            packet.nIov = 2;
+        }
+        packet.nSize = (uint32_t)(packet.aIov[0].iov_len + nBody);
+    }
+
+    /**
+    *   @brief  Units i..j-1 copied into one STAP-A / AP / multi-OBU packet.
+    */
+    void WriteAggregate(std::vector<RtpPacket> &vPackets, size_t i, size_t j) {
+        uint8_t *p = BeginPacket(vPackets);
+        if (eCodec == cdc::CODEC_TYPE_AV1) {
+            *p++ = AggregationHeader(false, false, 0, vPackets.size() == 1);
+        } else if (eCodec == cdc::CODEC_TYPE_H265) {
+            // F is OR-ed, LayerId and TID are the lowest of the aggregated units
+            uint8_t nF = 0, nLayerId = 0x3F, nTid = 7;
+            for (size_t k = i; k < j; k++) {
+                nF |= vUnits[k].aHeader[0] & 0x80;
+                nLayerId = std::min(nLayerId, (uint8_t)(((vUnits[k].aHeader[0] & 1) << 5) | (vUnits[k].aHeader[1] >> 3)));
+                nTid = std::min(nTid, (uint8_t)(vUnits[k].aHeader[1] & 7));
+            }
+            *p++ = (uint8_t)(nF | (48 << 1) | (nLayerId >> 5));
+            *p++ = (uint8_t)((nLayerId << 3) | nTid);
+        } else {
+            uint8_t nF = 0, nNri = 0;
+            for (size_t k = i; k < j; k++) {
+                nF |= vUnits[k].aHeader[0] & 0x80;
+                nNri = std::max(nNri, (uint8_t)(vUnits[k].aHeader[0] & 0x60));
+            }
+            *p++ = (uint8_t)(nF | nNri | 24);
+        }
+        for (size_t k = i; k < j; k++) {
+            const Unit &unit = vUnits[k];
+            if (eCodec == cdc::CODEC_TYPE_AV1) {
+                p += WriteLeb128(p, unit.Size());
+            } else {
+                *p++ = (uint8_t)(unit.Size() >> 8);
+                *p++ = (uint8_t)unit.Size();
+            }
+            memcpy(p, unit.aHeader, unit.nHeader);
+            memcpy(p + unit.nHeader, unit.pBody, unit.nBody);
+            p += unit.Size();
+        }
+        EndPacket(vPackets, p, NULL, 0);
+    }
+
+    void WriteSingle(std::vector<RtpPacket> &vPackets, const Unit &unit) {
+        uint8_t *p = BeginPacket(vPackets);
+        if (eCodec == cdc::CODEC_TYPE_AV1) {
+            *p++ = AggregationHeader(false, false, 1, vPackets.size() == 1);
+            memcpy(p, unit.aHeader, unit.nHeader);
+            EndPacket(vPackets, p + unit.nHeader, unit.pBody, unit.nBody);
+        } else {
+            // A NAL unit is contiguous in the encoded buffer, header included
+            EndPacket(vPackets, p, unit.pBody - unit.nHeader, unit.Size());
+        }
+    }
+
+    void WriteFragments(std::vector<RtpPacket> &vPackets, const Unit &unit) {
+        size_t nPos = 0;
+        while (nPos < unit.nBody) {
+            bool bFirst = nPos == 0;
+            uint8_t *p = BeginPacket(vPackets);
+            size_t nChunk;
+            if (eCodec == cdc::CODEC_TYPE_AV1) {
+                // The OBU header travels in the first fragment only
+                size_t nOverhead = 1 + (bFirst ? unit.nHeader : 0);
+                nChunk = std::min(unit.nBody - nPos, nMaxPayload - nOverhead);
+                bool bLast = nPos + nChunk == unit.nBody;
+                *p++ = AggregationHeader(!bFirst, !bLast, 1, vPackets.size() == 1);
+                if (bFirst) {
+                    memcpy(p, unit.aHeader, unit.nHeader);
+                    p += unit.nHeader;
+                }
+            } else if (eCodec == cdc::CODEC_TYPE_H265) {
+                nChunk = std::min(unit.nBody - nPos, nMaxPayload - 3);
+                bool bLast = nPos + nChunk == unit.nBody;
+                *p++ = (uint8_t)((unit.aHeader[0] & 0x81) | (49 << 1));
+                *p++ = unit.aHeader[1];
+                *p++ = (uint8_t)((bFirst << 7) | (bLast << 6) | ((unit.aHeader[0] >> 1) & 0x3F));
+            } else {
+                nChunk = std::min(unit.nBody - nPos, nMaxPayload - 2);
+                bool bLast = nPos + nChunk == unit.nBody;
+                *p++ = (uint8_t)((unit.aHeader[0] & 0xE0) | 28);
+                *p++ = (uint8_t)((bFirst << 7) | (bLast << 6) | (unit.aHeader[0] & 0x1F));
+            }
+            EndPacket(vPackets, p, unit.pBody + nPos, nChunk);
+            nPos += nChunk;
+        }
+    }
+
+    static size_t ClampMtu(size_t nMtu) {
+        return std::max(nMtu, nMinMtu);
+    }
+
+    uint8_t AggregationHeader(bool bContinuation, bool bContinues, int nW, bool bFirstPacket) const {
+        return (uint8_t)((bContinuation << 7) | (bContinues << 6) | (nW << 4) | ((bFirstPacket && bNewSequence) << 3));
+    }
+
+    static void PutBe32(uint8_t *p, uint32_t n) {
+        p[0] = (uint8_t)(n >> 24);
+        p[1] = (uint8_t)(n >> 16);
+        p[2] = (uint8_t)(n >> 8);
+        p[3] = (uint8_t)n;
+    }
+
+private:
+    cdc::CodecType eCodec;
+    uint8_t nPayloadType;
+    uint32_t nSsrc;
+    size_t nMaxPayload;
+    uint16_t nSequence;
+    uint32_t nTimestamp = 0;
+    bool bNewSequence = false;
+    RtpSlabPool slabs;
+    std::vector<Unit> vUnits;
+    std::vector<NalUnit> vNal;
+};
+
+/**
+* @brief Reassembles access units from RTP packets produced by RtpPacketizer (or any sender using the same
+* payload formats). Output is Annex-B for H.264/HEVC and a temporal unit of sized OBUs for AV1.
+* An access unit with a sequence number gap is dropped as a whole.
+*/
+class RtpDepacketizer {
+public:
+    RtpDepacketizer(cdc::CodecType eCodec) : eCodec(eCodec) {}
+
+    /**
+    *   @return true when the packet completed an access unit, which GetFrame() then returns until the next call
+    */
+    bool Push(const uint8_t *pPacket, size_t nPacket) {
+        if (bFrameReady) {
+            vFrame.clear();
+            bFrameReady = false;
+        }
+        if (nPacket < RtpPacketizer::nRtpHeaderSize || (pPacket[0] >> 6) != 2) {
+            return false;
+        }
+        size_t nHeader = RtpPacketizer::nRtpHeaderSize + 4 * (pPacket[0] & 0x0F);
+        if (pPacket[0] & 0x10) {
+            // A header extension too short for its own length field must not be read as payload
+            if (nPacket < nHeader + 4) {
+                return false;
+            }
+            nHeader += 4 + 4 * ((pPacket[nHeader + 2] << 8) | pPacket[nHeader + 3]);
+        }
+        size_t nPadding = (pPacket[0] & 0x20) ? pPacket[nPacket - 1] : 0;
+        if (nPacket < nHeader + nPadding + 1) {
+            return false;
+        }
+        bool bMarker = pPacket[1] & 0x80;
+        uint16_t nSeq = (uint16_t)((pPacket[2] << 8) | pPacket[3]);
+        uint32_t nTs = ((uint32_t)pPacket[4] << 24) | (pPacket[5] << 16) | (pPacket[6] << 8) | pPacket[7];
+
+        uint16_t nLost = bStarted ? (uint16_t)(nSeq - nLastSeq - 1) : 0;
+        nLostPackets += nLost;
+        if (bStarted && nTs != nTimestamp && (!vFrame.empty() || bDamaged)) {
+            // The marker packet of the previous access unit was lost. If it is the only packet missing, this
+            // packet starts the new access unit and none of it is lost
+            DiscardFrame();
+            nLost = nLost == 1 ? 0 : nLost;
+        }
+        bDamaged |= nLost != 0;
+        bStarted = true;
+        nLastSeq = nSeq;
+        nTimestamp = nTs;
+
+        const uint8_t *p = pPacket + nHeader;
+        size_t n = nPacket - nHeader - nPadding;
+        bool bOk = eCodec == cdc::CODEC_TYPE_AV1 ? DepacketizeAv1(p, n) : DepacketizeNal(p, n);
+        bDamaged |= !bOk;
+
+        if (!bMarker) {
+            return false;
+        }
+        if (bDamaged || vFrame.empty()) {
+            DiscardFrame();
+            return false;
+        }
+        bFrameReady = true;
+        return true;
+    }
+
+    const std::vector<uint8_t> &GetFrame() const {
+        return vFrame;
+    }
+    uint32_t GetTimestamp() const {
+        return nTimestamp;
+    }
+    uint64_t GetLostPackets() const {
+        return nLostPackets;
+    }
+    uint64_t GetDroppedFrames() const {
+        return nDroppedFrames;
+    }
+
+private:
+    void DiscardFrame() {
+        if (!vFrame.empty() || bDamaged) {
+            nDroppedFrames++;
+        }
+        vFrame.clear();
+        vObu.clear();
+        bDamaged = false;
+        bInFragment = false;
+    }
+
+    void AppendNal(const uint8_t *p, size_t n) {
+        static const uint8_t aStartCode[4] = {0, 0, 0, 1};
+        vFrame.insert(vFrame.end(), aStartCode, aStartCode + 4);
+        vFrame.insert(vFrame.end(), p, p + n);
+    }
+
+    bool DepacketizeNal(const uint8_t *p, size_t n) {
+        bool bHevc = eCodec == cdc::CODEC_TYPE_H265;
+        size_t nNalHeader = bHevc ? 2 : 1;
+        if (n < nNalHeader) {
+            return false;
+        }
+        int nType = bHevc ? (p[0] >> 1) & 0x3F : p[0] & 0x1F;
+        int nAggType = bHevc ? 48 : 24, nFuType = bHevc ? 49 : 28;
+
+        if (nType == nAggType) {
+            for (size_t nPos = nNalHeader; nPos < n;) {
+                if (n - nPos < 2) {
+                    return false;
+                }
+                size_t nSize = (p[nPos] << 8) | p[nPos + 1];
+                nPos += 2;
+                if (!nSize || n - nPos < nSize) {
+                    return false;
+                }
+                AppendNal(p + nPos, nSize);
+                nPos += nSize;
+            }
+            return true;
+        }
+        if (nType == nFuType) {
+            if (n < nNalHeader + 2) {
+                return false;
+            }
+            uint8_t nFuHeader = p[nNalHeader];
+            bool bStart = nFuHeader & 0x80;
+            if (bStart) {
+                uint8_t aHeader[2];
+                if (bHevc) {
+                    aHeader[0] = (uint8_t)((p[0] & 0x81) | ((nFuHeader & 0x3F) << 1));
+                    aHeader[1] = p[1];
+                } else {
+                    aHeader[0] = (uint8_t)((p[0] & 0xE0) | (nFuHeader & 0x1F));
+                }
+                AppendNal(aHeader, nNalHeader);
+                bInFragment = true;
+            } else if (!bInFragment) {
+                return false;
+            }
+            vFrame.insert(vFrame.end(), p + nNalHeader + 1, p + n);
+            if (nFuHeader & 0x40) {
+                bInFragment = false;
+            }
+            return true;
+        }
+        AppendNal(p, n);
+        return true;
+    }
+
+    bool DepacketizeAv1(const uint8_t *p, size_t n) {
+        const uint8_t *pEnd = p + n;
+        uint8_t nAggHeader = *p++;
+        bool bContinuation = nAggHeader & 0x80, bContinues = nAggHeader & 0x40;
+        int nW = (nAggHeader >> 4) & 3;
+        if (vFrame.empty()) {
+            // Temporal delimiter, dropped by the sender
+            vFrame.push_back(0x12);
+            vFrame.push_back(0x00);
+        }
+        if (bContinuation != !vObu.empty()) {
+            return false;
+        }
+        for (int iElement = 0; p < pEnd; iElement++) {
+            uint64_t nSize = pEnd - p;
+            if (nW == 0 || iElement + 1 < nW) {
+                if (!ReadLeb128(p, pEnd, nSize) || nSize > (uint64_t)(pEnd - p)) {
+                    return false;
+                }
+            }
+            vObu.insert(vObu.end(), p, p + nSize);
+            p += nSize;
+            if (p == pEnd && bContinues) {
+                break;
+            }
+            if (!AppendObu()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+    *   @brief  Restores obu_has_size_field on the OBU collected in vObu and appends it to the frame.
+    */
+    bool AppendObu() {
+        if (vObu.empty()) {
+            return false;
+        }
+        size_t nHeader = (vObu[0] & 0x04) ? 2 : 1;
+        if (vObu.size() < nHeader) {
+            return false;
+        }
+        uint8_t aLeb[8];
+        vFrame.push_back(vObu[0] | 0x02);
+        if (nHeader == 2) {
+            vFrame.push_back(vObu[1]);
+        }
+        int nLeb = WriteLeb128(aLeb, vObu.size() - nHeader);
+        vFrame.insert(vFrame.end(), aLeb, aLeb + nLeb);
+        vFrame.insert(vFrame.end(), vObu.begin() + nHeader, vObu.end());
+        vObu.clear();
+        return true;
+    }
+
+private:
+    cdc::CodecType eCodec;
+    std::vector<uint8_t> vFrame;
+    std::vector<uint8_t> vObu;      /*!< AV1 OBU being reassembled from fragments */
+    bool bFrameReady = false;
+    bool bStarted = false;
+    bool bDamaged = false;
+    bool bInFragment = false;
+    uint16_t nLastSeq = 0;
+    uint32_t nTimestamp = 0;
+    uint64_t nLostPackets = 0, nDroppedFrames = 0;
+};
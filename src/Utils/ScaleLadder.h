@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include "NvCodecUtils.h"
+#include "ScaleLadderMath.h"
+
+//---------------------------------------------------------------------------
+//! \file ScaleLadder.h
+//! \brief GPU NV12 rendition ladder scaler in Resize.cu.
+//---------------------------------------------------------------------------
+
+/**
+* @brief Scales one NV12 frame to every rung of an ABR ladder in a single launch per SCALE_LADDER_MAX_RUNGS rungs. All
+* rungs read the source through one cached texture, so taps shared between renditions mostly hit the texture cache.
+* ResizeNv12LadderHost() is the CPU reference.
+*/
+void ResizeNv12Ladder(uint8_t *dpSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, const ScaleLadderRung *pRungs, int nRungs,
+    SCALE_FILTER eFilter = SCALE_FILTER_BILINEAR, Nv12TextureCache *pCache = nullptr, CUstream_st *stream = nullptr);
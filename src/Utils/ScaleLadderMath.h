@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PostprocessMath.h"
+
+//---------------------------------------------------------------------------
+//! \file ScaleLadderMath.h
+//! \brief Per-block math of the NV12 rendition ladder scaler (ResizeNv12Ladder() in Resize.cu).
+//!
+//! One thread produces a 2x2 luma block and its chroma pair for one rung. The same code
+//! runs on the CPU in ResizeNv12LadderHost(), which is the reference for the kernel.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    SCALE_FILTER_NEAREST = 0,
+    SCALE_FILTER_BILINEAR,
+    SCALE_FILTER_BOX,                       /*!< Average of the source pixels under the output pixel; for downscaling */
+} SCALE_FILTER;
+
+#define SCALE_LADDER_MAX_RUNGS 8
+
+/**
+* @brief One rendition. dpDstUV may be NULL, in which case chroma follows luma at nPitch * nHeight.
+*/
+struct ScaleLadderRung {
+    uint8_t *dpDst;
+    uint8_t *dpDstUV;
+    int nPitch;
+    int nWidth, nHeight;
+};
+
+/**
+* @brief Filters N channels of output pixel (dx, dy); fxScale and fyScale are source over destination size.
+*/
+#if defined(__CUDACC__)
+#pragma nv_exec_check_disable
+#endif
+template<SCALE_FILTER eFilter, int N, class Fetch>
+inline COLORSPACE_HD void SampleScaled(const Fetch &fetch, int dx, int dy, float fxScale, float fyScale, int nSrcWidth, int nSrcHeight,
+    float *pOut) {
+    if (eFilter == SCALE_FILTER_NEAREST) {
+        int sx = (int)((dx + 0.5f) * fxScale), sy = (int)((dy + 0.5f) * fyScale);
+        fetch(sx < nSrcWidth ? sx : nSrcWidth - 1, sy < nSrcHeight ? sy : nSrcHeight - 1, pOut);
+    } else if (eFilter == SCALE_FILTER_BILINEAR) {
+        SampleBilinear<N>(fetch, (dx + 0.5f) * fxScale - 0.5f, (dy + 0.5f) * fyScale - 0.5f, 0, nSrcWidth - 1, 0, nSrcHeight - 1, pOut);
+    } else {
+        int x0 = (int)(dx * fxScale), x1 = (int)((dx + 1) * fxScale);
+        int y0 = (int)(dy * fyScale), y1 = (int)((dy + 1) * fyScale);
+        x0 = x0 < nSrcWidth - 1 ? x0 : nSrcWidth - 1;
+        y0 = y0 < nSrcHeight - 1 ? y0 : nSrcHeight - 1;
+        x1 = x1 > x0 ? (x1 < nSrcWidth ? x1 : nSrcWidth) : x0 + 1;
+        y1 = y1 > y0 ? (y1 < nSrcHeight ? y1 : nSrcHeight) : y0 + 1;
+        float afSum[N] = {}, afTap[N];
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                fetch(x, y, afTap);
+                for (int i = 0; i < N; i++) {
+                    afSum[i] += afTap[i];
+                }
+            }
+        }
+        float fNorm = 1.0f / ((x1 - x0) * (y1 - y0));
+        for (int i = 0; i < N; i++) {
+            pOut[i] = afSum[i] * fNorm;
+        }
+    }
+}
+
+/**
+* @brief Writes the 2x2 luma block at (2 * ix, 2 * iy) of a rung and the chroma pair (ix, iy). Odd rung sizes are handled.
+*/
+#if defined(__CUDACC__)
+#pragma nv_exec_check_disable
+#endif
+template<SCALE_FILTER eFilter, class FetchY, class FetchUv>
+inline COLORSPACE_HD void ScaleNv12Block(const FetchY &fetchY, const FetchUv &fetchUv, int nSrcWidth, int nSrcHeight,
+    const ScaleLadderRung &rung, int ix, int iy) {
+    float fxScale = (float)nSrcWidth / rung.nWidth, fyScale = (float)nSrcHeight / rung.nHeight;
+    for (int y = 2 * iy; y < 2 * iy + 2 && y < rung.nHeight; y++) {
+        for (int x = 2 * ix; x < 2 * ix + 2 && x < rung.nWidth; x++) {
+            float fLuma;
+            SampleScaled<eFilter, 1>(fetchY, x, y, fxScale, fyScale, nSrcWidth, nSrcHeight, &fLuma);
+            rung.dpDst[(size_t)y * rung.nPitch + x] = ClampToUint8(fLuma);
+        }
+    }
+
+    int nSrcChromaWidth = (nSrcWidth + 1) / 2, nSrcChromaHeight = (nSrcHeight + 1) / 2;
+    int nDstChromaWidth = (rung.nWidth + 1) / 2, nDstChromaHeight = (rung.nHeight + 1) / 2;
+    float afUv[2];
+    SampleScaled<eFilter, 2>(fetchUv, ix, iy, (float)nSrcChromaWidth / nDstChromaWidth, (float)nSrcChromaHeight / nDstChromaHeight,
+        nSrcChromaWidth, nSrcChromaHeight, afUv);
+    uint8_t *pUv = (rung.dpDstUV ? rung.dpDstUV : rung.dpDst + (size_t)rung.nPitch * rung.nHeight) + (size_t)iy * rung.nPitch + ix * 2;
+    pUv[0] = ClampToUint8(afUv[0]);
+    pUv[1] = ClampToUint8(afUv[1]);
+}
+
+template<SCALE_FILTER eFilter>
+inline void ResizeNv12LadderHost(const uint8_t *pSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight, const ScaleLadderRung *pRungs,
+    int nRungs) {
+    Nv12HostFetchY fetchY = {pSrc, nSrcPitch};
+    Nv12HostFetchUv fetchUv = {pSrc + (size_t)nSrcPitch * nSrcHeight, nSrcPitch};
+    for (int r = 0; r < nRungs; r++) {
+        for (int iy = 0; iy < (pRungs[r].nHeight + 1) / 2; iy++) {
+            for (int ix = 0; ix < (pRungs[r].nWidth + 1) / 2; ix++) {
+                ScaleNv12Block<eFilter>(fetchY, fetchUv, nSrcWidth, nSrcHeight, pRungs[r], ix, iy);
+            }
+        }
+    }
+}
+
+/**
+* @brief CPU reference for ResizeNv12Ladder(); the rung pointers are host memory here.
+*/
+inline void ResizeNv12LadderHost(const uint8_t *pSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight, const ScaleLadderRung *pRungs,
+    int nRungs, SCALE_FILTER eFilter) {
+    switch (eFilter) {
+    case SCALE_FILTER_NEAREST:
+        ResizeNv12LadderHost<SCALE_FILTER_NEAREST>(pSrc, nSrcPitch, nSrcWidth, nSrcHeight, pRungs, nRungs);
+        break;
+    case SCALE_FILTER_BILINEAR:
+        ResizeNv12LadderHost<SCALE_FILTER_BILINEAR>(pSrc, nSrcPitch, nSrcWidth, nSrcHeight, pRungs, nRungs);
+        break;
+    case SCALE_FILTER_BOX:
+        ResizeNv12LadderHost<SCALE_FILTER_BOX>(pSrc, nSrcPitch, nSrcWidth, nSrcHeight, pRungs, nRungs);
+        break;
+    }
+}
@@ -0,0 +1,456 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include <codec/codec.h>
+#include "NvCodecUtils.h"
+#include "Fmp4Writer.h"
+#include "TsWriter.h"
+
+//---------------------------------------------------------------------------
+//! \file Segmenter.h
+//! \brief Cuts encoder output into HLS/DASH segments on key frame boundaries.
+//!
+//! Packets are muxed (MPEG-TS or fragmented MP4) on the caller's thread into in-memory
+//! chunks; a writer thread owns all file I/O, renames finished segments into place and
+//! republishes the playlist/manifest by writing a temporary file and renaming it over the
+//! old one, so readers of the output directory never see partial files.
+//---------------------------------------------------------------------------
+
+typedef enum {
+    SEGMENT_FORMAT_TS,          /*!< MPEG-TS segments, H.264/HEVC only */
+    SEGMENT_FORMAT_FMP4,        /*!< CMAF fragmented MP4 segments plus init.mp4 */
+} SEGMENT_FORMAT;
+
+struct SegmenterStats {
+    uint32_t nSegmentsWritten;
+    uint64_t nBytesWritten;
+    uint64_t nPacketsDropped;       /*!< Packets before the first key frame */
+    uint64_t nProducerStalls;       /*!< Chunks that waited for the writer thread */
+    bool bFailed;                   /*!< A file operation failed; later packets are rejected */
+};
+
+class Segmenter {
+public:
+    /**
+    *   @param  szOutputDir         Created if missing; receives segments, init.mp4, playlist.m3u8 and manifest.mpd
+    *   @param  nTimescale          Units per second of the timestamps passed to AddPacket()
+    *   @param  fTargetDuration     Segments are cut at the key frame closest to this duration, in seconds
+    *   @param  nPlaylistSize       Sliding window of segments listed in the playlist; 0 keeps all (event/VOD)
+    *   @param  bDashManifest       Also publish a DASH MPD (fragmented MP4 only)
+    *   @param  nQueueSize          Chunks in flight between the caller and the writer thread
+    */
+    Segmenter(const char *szOutputDir, SEGMENT_FORMAT eFormat, cdc::CodecType eCodec, int nWidth, int nHeight, uint32_t nTimescale,
+        double fTargetDuration, int nPlaylistSize = 0, bool bDashManifest = false, int nQueueSize = 64)
+        : outputDir(szOutputDir), eFormat(eFormat), nWidth(nWidth), nHeight(nHeight), nTimescale(nTimescale),
+        nTargetDuration((int64_t)(fTargetDuration * nTimescale)), nPlaylistSize(nPlaylistSize),
+        bDashManifest(bDashManifest && eFormat == SEGMENT_FORMAT_FMP4),
+        fmp4Writer(eCodec, nWidth, nHeight, nTimescale, nTimescale / 30), tsWriter(eCodec), qJobs(nQueueSize), qFreeBuffers(nQueueSize)
+    {
+        if (eFormat == SEGMENT_FORMAT_TS && !tsWriter.IsSupported()) {
+            bFailed = true;
+            return;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(outputDir, ec);
+        if (ec) {
+            LOG(ERROR) << "Unable to create output directory " << szOutputDir << ": " << ec.message();
+            bFailed = true;
+            return;
+        }
+        writer = std::thread(&Segmenter::WriterLoop, this);
+    }
+
+    ~Segmenter() {
+        Close();
+    }
+
+    /**
+    *   @brief  Sequence header from NvEncoder::GetSequenceParams(). Optional: the first key frame is used otherwise.
+    */
+    bool SetSequenceHeader(const uint8_t *pData, size_t nSize) {
+        tsWriter.SetParameterSets(pData, nSize);
+        bHasSequenceHeader = eFormat == SEGMENT_FORMAT_TS || fmp4Writer.SetSequenceHeader(pData, nSize);
+        return bHasSequenceHeader;
+    }
+
+    bool AddPacket(const cdc::CodecPacket &packet) {
+        return AddPacket((const uint8_t *)packet.data, packet.size, (int64_t)packet.timestamp, (int64_t)packet.timestamp, packet.keyFrame);
+    }
+
+    /**
+    *   @brief  Muxes one access unit into the current segment, rotating first if this key frame is the closest
+    *   cut point to the target duration. File I/O happens on the writer thread.
+    */
+    bool AddPacket(const uint8_t *pData, size_t nSize, int64_t nPts, int64_t nDts, bool bKeyFrame) {
+        if (bFailed || bClosed) {
+            return false;
+        }
+
+        if (bKeyFrame) {
+            if (bSegmentOpen) {
+                // Cutting now undershoots by target - elapsed; waiting a GOP overshoots by elapsed + gop - target
+                int64_t nElapsed = nDts - nSegmentStart, nGop = nDts - nLastKeyDts;
+                if (nElapsed + nGop / 2 >= nTargetDuration) {
+                    CloseSegment(nDts);
+                } else if (eFormat == SEGMENT_FORMAT_FMP4) {
+                    fmp4Writer.WriteFragment(vSegment, nDts);
+                    // A fragment being built must stay in vSegment, so fMP4 hands off data only between fragments
+                    if (vSegment.size() >= nChunkSize) {
+                        SubmitJob(JOB_APPEND, vSegment, 0, 0);
+                    }
+                }
+            }
+            if (!bHasSequenceHeader) {
+                SetSequenceHeader(pData, nSize);
+            }
+            if (!bSegmentOpen && !OpenSegment(nDts)) {
+                return false;
+            }
+            nLastKeyDts = nDts;
+        } else if (!bSegmentOpen) {
+            nPacketsDropped++;
+            return false;
+        }
+
+        bool bOk = eFormat == SEGMENT_FORMAT_FMP4 ? fmp4Writer.AddSample(vSegment, pData, nSize, nDts, nPts, bKeyFrame)
+            : tsWriter.WritePacket(vSegment, pData, nSize, ToTsTime(nPts), ToTsTime(nDts), bKeyFrame);
+        if (nLastDts != INT64_MIN && nDts > nLastDts) {
+            nLastDuration = nDts - nLastDts;
+        }
+        nLastDts = nDts;
+        if (eFormat == SEGMENT_FORMAT_TS && vSegment.size() >= nChunkSize) {
+            SubmitJob(JOB_APPEND, vSegment, 0, 0);
+        }
+        return bOk;
+    }
+
+    /**
+    *   @brief  Finishes the last segment, publishes the final playlist/manifest and stops the writer thread.
+    */
+    void Close() {
+        if (bClosed) {
+            return;
+        }
+        bClosed = true;
+        if (!writer.joinable()) {
+            return;
+        }
+        if (bSegmentOpen) {
+            CloseSegment(nLastDts + nLastDuration);
+        }
+        std::vector<uint8_t> vEmpty;
+        SubmitJob(JOB_END, vEmpty, 0, 0);
+        qJobs.Close();
+        writer.join();
+    }
+
+    SegmenterStats GetStats() const {
+        SegmenterStats stats = {};
+        stats.nSegmentsWritten = nSegmentsWritten.load();
+        stats.nBytesWritten = nBytesWritten.load();
+        stats.nPacketsDropped = nPacketsDropped.load();
+        stats.nProducerStalls = nProducerStalls.load();
+        stats.bFailed = bFailed.load();
+        return stats;
+    }
+
+private:
+    typedef enum {
+        JOB_INIT,               /*!< vData is init.mp4 */
+        JOB_APPEND,             /*!< Append vData to the open segment */
+        JOB_CLOSE,              /*!< Append vData, then publish segment nIndex */
+        JOB_END,                /*!< Publish the final playlist/manifest */
+    } JOB_TYPE;
+
+    struct SegmentJob {
+        JOB_TYPE eType = JOB_APPEND;
+        std::vector<uint8_t> vData;
+        uint32_t nIndex = 0;
+        int64_t nStart = 0;
+        int64_t nDuration = 0;
+    };
+
+    struct SegmentInfo {
+        uint32_t nIndex;
+        int64_t nStart;
+        int64_t nDuration;
+    };
+
+    bool OpenSegment(int64_t nDts) {
+        if (!bHasSequenceHeader) {
+            LOG(ERROR) << "No sequence header available for the first segment";
+            bFailed = true;
+            return false;
+        }
+        if (eFormat == SEGMENT_FORMAT_FMP4 && !bInitWritten) {
+            std::vector<uint8_t> vInit;
+            fmp4Writer.WriteInitSegment(vInit);
+            codecString = fmp4Writer.GetCodecString();
+            SubmitJob(JOB_INIT, vInit, 0, 0);
+            bInitWritten = true;
+        }
+        if (eFormat == SEGMENT_FORMAT_TS) {
+            tsWriter.WriteTables(vSegment);
+        }
+        if (nFirstStart == INT64_MIN) {
+            nFirstStart = nDts;
+        }
+        nSegmentStart = nDts;
+        bSegmentOpen = true;
+        return true;
+    }
+
+    void CloseSegment(int64_t nEndDts) {
+        if (eFormat == SEGMENT_FORMAT_FMP4) {
+            fmp4Writer.WriteFragment(vSegment, nEndDts);
+        }
+        SubmitJob(JOB_CLOSE, vSegment, nSegmentStart, nEndDts - nSegmentStart);
+        nSegmentIndex++;
+        bSegmentOpen = false;
+    }
+
+    /**
+    *   @brief  Hands vData to the writer thread and replaces it with a recycled buffer, so steady state does not allocate.
+    */
+    void SubmitJob(JOB_TYPE eType, std::vector<uint8_t> &vData, int64_t nStart, int64_t nDuration) {
+        SegmentJob job;
+        job.eType = eType;
+        job.vData = std::move(vData);
+        job.nIndex = nSegmentIndex;
+        job.nStart = nStart;
+        job.nDuration = nDuration;
+        if (qJobs.Push(std::move(job))) {
+            nProducerStalls++;
+        }
+        vData.clear();
+        qFreeBuffers.TryPop(vData);
+    }
+
+    void WriterLoop() {
+        SegmentJob job;
+        FILE *fp = NULL;
+        while (qJobs.Pop(job)) {
+            if (!bFailed && !job.vData.empty() && job.eType != JOB_INIT) {
+                if (!fp) {
+                    fp = fopen(TempPath(SegmentName(job.nIndex)).c_str(), "wb");
+                }
+                if (!fp || fwrite(job.vData.data(), 1, job.vData.size(), fp) != job.vData.size()) {
+                    LOG(ERROR) << "Unable to write segment " << SegmentName(job.nIndex);
+                    bFailed = true;
+                }
+                nBytesWritten += job.vData.size();
+            }
+
+            if (bFailed) {
+                // Keep draining so the producer never blocks on a dead writer
+            } else if (job.eType == JOB_INIT) {
+                bFailed = !PublishFile("init.mp4", job.vData.data(), job.vData.size());
+            } else if (job.eType == JOB_CLOSE) {
+                bool bOk = fp && fclose(fp) == 0;
+                fp = NULL;
+                bFailed = !bOk || !Publish(TempPath(SegmentName(job.nIndex)), SegmentName(job.nIndex));
+                if (!bFailed) {
+                    if (availabilityStartTime.empty()) {
+                        // The first segment becomes available now, which anchors the live timeline of the MPD
+                        char szTime[32];
+                        time_t t = time(NULL) - (time_t)(job.nDuration / nTimescale);
+                        strftime(szTime, sizeof(szTime), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+                        availabilityStartTime = szTime;
+                    }
+                    vSegments.push_back({job.nIndex, job.nStart, job.nDuration});
+                    nSegmentsWritten++;
+                    ExpireSegments();
+                    PublishManifests(false);
+                }
+            } else if (job.eType == JOB_END) {
+                PublishManifests(true);
+            }
+
+            job.vData.clear();
+            qFreeBuffers.TryPush(std::move(job.vData));
+        }
+        if (fp) {
+            fclose(fp);
+        }
+    }
+
+    void ExpireSegments() {
+        if (nPlaylistSize <= 0) {
+            return;
+        }
+        while ((int)vSegments.size() > nPlaylistSize) {
+            vExpired.push_back(vSegments.front().nIndex);
+            vSegments.pop_front();
+        }
+        // Expired segments stay on disk for one more window for clients that are still behind
+        while ((int)vExpired.size() > nPlaylistSize) {
+            std::error_code ec;
+            std::filesystem::remove(outputDir / SegmentName(vExpired.front()), ec);
+            vExpired.pop_front();
+        }
+    }
+
+    void PublishManifests(bool bEnd) {
+        if (vSegments.empty()) {
+            return;
+        }
+        std::string playlist = BuildPlaylist(bEnd);
+        bool bOk = PublishFile("playlist.m3u8", playlist.data(), playlist.size());
+        if (bDashManifest) {
+            std::string mpd = BuildMpd(bEnd);
+            bOk &= PublishFile("manifest.mpd", mpd.data(), mpd.size());
+        }
+        if (!bOk) {
+            bFailed = true;
+        }
+    }
+
+    std::string BuildPlaylist(bool bEnd) const {
+        double fMax = 0;
+        for (const SegmentInfo &seg : vSegments) {
+            fMax = std::max(fMax, (double)seg.nDuration / nTimescale);
+        }
+        char szLine[256];
+        std::string s = "#EXTM3U\n";
+        snprintf(szLine, sizeof(szLine), "#EXT-X-VERSION:%d\n#EXT-X-TARGETDURATION:%d\n#EXT-X-MEDIA-SEQUENCE:%u\n",
+            eFormat == SEGMENT_FORMAT_FMP4 ? 7 : 3, (int)(fMax + 0.999), vSegments.front().nIndex);
+        s += szLine;
+        if (!nPlaylistSize && bEnd) {
+            s += "#EXT-X-PLAYLIST-TYPE:VOD\n";
+        } else if (!nPlaylistSize) {
+            s += "#EXT-X-PLAYLIST-TYPE:EVENT\n";
+        }
+        s += "#EXT-X-INDEPENDENT-SEGMENTS\n";
+        if (eFormat == SEGMENT_FORMAT_FMP4) {
+            s += "#EXT-X-MAP:URI=\"init.mp4\"\n";
+        }
+        for (const SegmentInfo &seg : vSegments) {
+            snprintf(szLine, sizeof(szLine), "#EXTINF:%.3f,\n", (double)seg.nDuration / nTimescale);
+            s += szLine;
+            s += SegmentName(seg.nIndex) + "\n";
+        }
+        if (bEnd) {
+            s += "#EXT-X-ENDLIST\n";
+        }
+        return s;
+    }
+
+    std::string BuildMpd(bool bEnd) const {
+        int64_t nTotal = 0, nMax = 0;
+        for (const SegmentInfo &seg : vSegments) {
+            nTotal += seg.nDuration;
+            nMax = std::max(nMax, seg.nDuration);
+        }
+        char szBuf[512];
+        std::string s = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+            "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" profiles=\"urn:mpeg:dash:profile:isoff-live:2011\"";
+        if (bEnd) {
+            snprintf(szBuf, sizeof(szBuf), " type=\"static\" mediaPresentationDuration=\"PT%.3fS\"", (double)nTotal / nTimescale);
+        } else {
+            snprintf(szBuf, sizeof(szBuf), " type=\"dynamic\" availabilityStartTime=\"%s\" minimumUpdatePeriod=\"PT%.3fS\"",
+                availabilityStartTime.c_str(), (double)nMax / nTimescale);
+            if (nPlaylistSize) {
+                size_t n = strlen(szBuf);
+                snprintf(szBuf + n, sizeof(szBuf) - n, " timeShiftBufferDepth=\"PT%.3fS\"", (double)nTotal / nTimescale);
+            }
+        }
+        s += szBuf;
+        snprintf(szBuf, sizeof(szBuf), " minBufferTime=\"PT%.3fS\">\n <Period id=\"0\" start=\"PT0S\">\n"
+            "  <AdaptationSet mimeType=\"video/mp4\" segmentAlignment=\"true\" startWithSAP=\"1\">\n"
+            "   <Representation id=\"0\" codecs=\"%s\" width=\"%d\" height=\"%d\">\n"
+            "    <SegmentTemplate timescale=\"%u\" presentationTimeOffset=\"%lld\" initialization=\"init.mp4\" media=\"segment_$Number%%05d$.m4s\" startNumber=\"%u\">\n"
+            "     <SegmentTimeline>\n",
+            (double)nMax / nTimescale, codecString.c_str(), nWidth, nHeight, nTimescale, (long long)nFirstStart, vSegments.front().nIndex);
+        s += szBuf;
+        for (const SegmentInfo &seg : vSegments) {
+            snprintf(szBuf, sizeof(szBuf), "      <S t=\"%lld\" d=\"%lld\"/>\n", (long long)seg.nStart, (long long)seg.nDuration);
+            s += szBuf;
+        }
+        s += "     </SegmentTimeline>\n    </SegmentTemplate>\n   </Representation>\n  </AdaptationSet>\n </Period>\n</MPD>\n";
+        return s;
+    }
+
+    std::string SegmentName(uint32_t nIndex) const {
+        char szName[64];
+        snprintf(szName, sizeof(szName), "segment_%05u.%s", nIndex, eFormat == SEGMENT_FORMAT_FMP4 ? "m4s" : "ts");
+        return szName;
+    }
+
+    std::filesystem::path TempPath(const std::string &name) const {
+        return outputDir / (name + ".tmp");
+    }
+
+    bool PublishFile(const std::string &name, const void *pData, size_t nSize) {
+        std::filesystem::path tempPath = TempPath(name);
+        FILE *fp = fopen(tempPath.string().c_str(), "wb");
+        if (!fp) {
+            LOG(ERROR) << "Unable to open " << tempPath.string();
+            return false;
+        }
+        bool bOk = fwrite(pData, 1, nSize, fp) == nSize;
+        bOk &= fclose(fp) == 0;
+        return bOk && Publish(tempPath, name);
+    }
+
+    /**
+    *   @brief  Renames over the published file; std::filesystem::rename replaces atomically on POSIX and Windows.
+    */
+    bool Publish(const std::filesystem::path &tempPath, const std::string &name) {
+        std::error_code ec;
+        std::filesystem::rename(tempPath, outputDir / name, ec);
+        if (ec) {
+            LOG(ERROR) << "Unable to publish " << name << ": " << ec.message();
+            return false;
+        }
+        return true;
+    }
+
+    // Split like av_rescale(), so timestamps far from zero do not overflow the multiplication
+    int64_t ToTsTime(int64_t nTimestamp) const {
+        return nTimestamp / nTimescale * 90000 + nTimestamp % nTimescale * 90000 / nTimescale;
+    }
+
+private:
+    static const size_t nChunkSize = 1 << 20;     /*!< Segment data is handed to the writer in chunks of about this size */
+    std::filesystem::path outputDir;
+    SEGMENT_FORMAT eFormat;
+    int nWidth, nHeight;
+    uint32_t nTimescale;
+    int64_t nTargetDuration;
+    int nPlaylistSize;
+    bool bDashManifest;
+
+    // Producer state
+    Fmp4Writer fmp4Writer;
+    TsWriter tsWriter;
+    std::vector<uint8_t> vSegment;      /*!< Muxed data not yet handed to the writer */
+    bool bHasSequenceHeader = false;
+    bool bInitWritten = false;
+    bool bSegmentOpen = false;
+    bool bClosed = false;
+    uint32_t nSegmentIndex = 0;
+    int64_t nSegmentStart = 0, nFirstStart = INT64_MIN, nLastKeyDts = 0;
+    int64_t nLastDts = INT64_MIN, nLastDuration = 0;
+    std::string codecString;
+
+    // Shared
+    SpscRingQueue<SegmentJob> qJobs;
+    SpscRingQueue<std::vector<uint8_t>> qFreeBuffers;
+    std::atomic<bool> bFailed{false};
+    std::atomic<uint32_t> nSegmentsWritten{0};
+    std::atomic<uint64_t> nBytesWritten{0}, nPacketsDropped{0}, nProducerStalls{0};
+    std::thread writer;
+
+    // Writer state
+    std::deque<SegmentInfo> vSegments;  /*!< Segments listed in the playlist */
+    std::deque<uint32_t> vExpired;      /*!< Segments dropped from the playlist, deleted one window later */
+    std::string availabilityStartTime;
+};
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "NvCodecUtils.h"
+
+//---------------------------------------------------------------------------
+//! \file TranscodePipeline.h
+//! \brief Threaded demux -> decode -> process -> encode -> mux pipeline with bounded queues.
+//!
+//! Each stage runs on its own thread and talks to its neighbours through SpscRingQueue, so a
+//! slow stage blocks the one before it instead of letting memory grow. Frames are passed by
+//! reference to backend-owned surfaces (device memory for the NVDEC/NVENC backend in
+//! NvTranscodeStages.h), never copied to the host. The backends are abstract so the
+//! pipeline can be driven by the CPU stubs in TranscodeStubs.h.
+//---------------------------------------------------------------------------
+
+struct TranscodePacket {
+    std::vector<uint8_t> vData;
+    int64_t nPts = 0;
+    int64_t nDts = 0;
+    bool bKeyFrame = false;
+    bool bEndOfStream = false;
+};
+
+class TranscodeFrameOwner;
+
+/**
+* @brief Reference to a decoded or processed surface. Whoever consumes the frame hands it back with ReleaseFrame().
+*/
+struct TranscodeFrame {
+    uint8_t *pData = NULL;              /*!< Device pointer for GPU backends */
+    int nPitch = 0;
+    int nWidth = 0, nHeight = 0;
+    int64_t nPts = 0;
+    bool bEndOfStream = false;
+    TranscodeFrameOwner *pOwner = NULL;
+    int iSlot = -1;                     /*!< Owner-defined surface index */
+};
+
+class TranscodeFrameOwner {
+public:
+    virtual ~TranscodeFrameOwner() {}
+    /**
+    *   @brief  Called from the consuming stage's thread once it no longer reads the surface.
+    */
+    virtual void ReleaseFrame(const TranscodeFrame &frame) = 0;
+};
+
+inline void ReleaseFrame(TranscodeFrame &frame) {
+    if (frame.pOwner) {
+        frame.pOwner->ReleaseFrame(frame);
+        frame.pOwner = NULL;
+    }
+}
+
+class TranscodeSource {
+public:
+    virtual ~TranscodeSource() {}
+    /**
+    *   @brief  Fills packet with the next compressed video packet, reusing the capacity of packet.vData.
+    *   @return false at end of stream
+    */
+    virtual bool Read(TranscodePacket &packet) = 0;
+};
+
+class TranscodeDecoder {
+public:
+    virtual ~TranscodeDecoder() {}
+    /**
+    *   @brief  Decodes pPacket, or flushes when it is NULL, and appends the frames that became available.
+    */
+    virtual bool Decode(const TranscodePacket *pPacket, std::vector<TranscodeFrame> &vFrames) = 0;
+};
+
+/**
+* @brief Makes a keyframe seek frame accurate: frames before the seek target are decoded, since the frames after them
+* reference them, and then released instead of being passed on. Decoders return frames in display order, so
+* discarding stops at the first frame at or past the target.
+*/
+class SeekTranscodeDecoder : public TranscodeDecoder {
+public:
+    SeekTranscodeDecoder(TranscodeDecoder *pDecoder) : pDecoder(pDecoder) {}
+
+    /**
+    *   @brief  Call before TranscodePipeline::Run(), with the pts the source was positioned for.
+    */
+    void SetSeekTarget(int64_t nTargetPts) {
+        this->nTargetPts = nTargetPts;
+        bDiscarding = true;
+    }
+
+    uint64_t GetDiscardedFrames() const {
+        return nDiscarded;
+    }
+
+    bool Decode(const TranscodePacket *pPacket, std::vector<TranscodeFrame> &vFrames) {
+        size_t nFirst = vFrames.size();
+        if (!pDecoder->Decode(pPacket, vFrames)) {
+            return false;
+        }
+        if (!bDiscarding) {
+            return true;
+        }
+        size_t nKept = nFirst;
+        for (size_t i = nFirst; i < vFrames.size(); i++) {
+            if (bDiscarding && vFrames[i].nPts < nTargetPts) {
+                ReleaseFrame(vFrames[i]);
+                nDiscarded++;
+                continue;
+            }
+            bDiscarding = false;
+            vFrames[nKept++] = vFrames[i];
+        }
+        vFrames.resize(nKept);
+        return true;
+    }
+
+private:
+    TranscodeDecoder *pDecoder;
+    int64_t nTargetPts = 0;
+    bool bDiscarding = false;
+    uint64_t nDiscarded = 0;
+};
+
+class TranscodeProcessor {
+public:
+    virtual ~TranscodeProcessor() {}
+    /**
+    *   @brief  Produces out from in and releases in.
+    */
+    virtual bool Process(TranscodeFrame &in, TranscodeFrame &out) = 0;
+};
+
+class TranscodeEncoder {
+public:
+    virtual ~TranscodeEncoder() {}
+    /**
+    *   @brief  Encodes pFrame, or flushes when it is NULL, and appends the packets that became available.
+    *   The frame is released by the encoder as soon as it has been consumed.
+    */
+    virtual bool Encode(TranscodeFrame *pFrame, std::vector<TranscodePacket> &vPackets) = 0;
+};
+
+/**
+* @brief Decode timestamps for an encoder that reorders B-frames. Packets leave in decode order, nReorderDelay
+* frames behind the input (frameIntervalP - 1 for NVENC), so the n-th packet decodes at input pts n - nReorderDelay.
+* The first nReorderDelay packets get timestamps extrapolated back from the first input, one frame apart.
+* Inputs must arrive in presentation order.
+*/
+class TranscodeDtsQueue {
+public:
+    TranscodeDtsQueue(int nReorderDelay = 0) : nReorderDelay(nReorderDelay < 0 ? 0 : nReorderDelay) {}
+
+    void PushInput(int64_t nPts) {
+        if (nInputs == 1) {
+            nFrameDuration = nPts > dqInputPts.front() ? nPts - dqInputPts.front() : 1;
+        }
+        nInputs++;
+        dqInputPts.push_back(nPts);
+    }
+
+    /**
+    *   @brief  Timestamp of the next packet in decode order; nPts is returned when no input is pending.
+    */
+    int64_t PopDts(int64_t nPts) {
+        if (dqInputPts.empty()) {
+            return nPts;
+        }
+        if (nOutputs < nReorderDelay) {
+            return dqInputPts.front() - (nReorderDelay - nOutputs++) * nFrameDuration;
+        }
+        nOutputs++;
+        int64_t nDts = dqInputPts.front();
+        dqInputPts.pop_front();
+        return nDts;
+    }
+
+private:
+    int nReorderDelay;
+    std::deque<int64_t> dqInputPts;
+    int64_t nInputs = 0, nOutputs = 0;
+    int64_t nFrameDuration = 1;
+};
+
+class TranscodeSink {
+public:
+    virtual ~TranscodeSink() {}
+    virtual bool Write(const TranscodePacket &packet) = 0;
+    virtual bool Close() {
+        return true;
+    }
+};
+
+typedef enum {
+    TRANSCODE_STAGE_DEMUX = 0,
+    TRANSCODE_STAGE_DECODE,
+    TRANSCODE_STAGE_PROCESS,
+    TRANSCODE_STAGE_ENCODE,
+    TRANSCODE_STAGE_MUX,
+    TRANSCODE_STAGE_COUNT,
+} TRANSCODE_STAGE;
+
+/**
+* @brief Where a stage thread spent its time. Busy is time inside the backend; starved is waiting for input;
+* blocked is waiting for room downstream. The bottleneck is the busiest stage; the others spend their slack blocked or starved.
+*/
+struct TranscodeStageStats {
+    uint64_t nItems;
+    double fBusySeconds;
+    double fStarvedSeconds;
+    double fBlockedSeconds;
+    double fUtilization;                /*!< Busy time over pipeline wall time */
+};
+
+struct TranscodeStats {
+    TranscodeStageStats aStage[TRANSCODE_STAGE_COUNT];
+    TRANSCODE_STAGE eBottleneck;
+    double fWallSeconds;
+    bool bFailed;
+};
+
+class TranscodePipeline {
+public:
+    /**
+    *   @param  pProcessor  May be NULL; decoded frames then go straight to the encoder
+    *   @param  nQueueSize  Capacity of each inter-stage queue. Frames in flight are bounded by the frame queues,
+    *                       so GPU backends need at least 2 * nQueueSize + 4 surfaces per pool
+    */
+    TranscodePipeline(TranscodeSource *pSource, TranscodeDecoder *pDecoder, TranscodeProcessor *pProcessor, TranscodeEncoder *pEncoder,
+        TranscodeSink *pSink, int nQueueSize = 8)
+        : pSource(pSource), pDecoder(pDecoder), pProcessor(pProcessor), pEncoder(pEncoder), pSink(pSink),
+        qPackets(nQueueSize), qRecycledPackets(nQueueSize + 2), qDecoded(nQueueSize), qProcessed(nQueueSize), qEncoded(nQueueSize) {}
+
+    /**
+    *   @brief  Runs all stages to the end of the stream and waits for them. Call once.
+    *   @return false if a backend failed
+    */
+    bool Run() {
+        tStart = std::chrono::steady_clock::now();
+        std::vector<std::thread> vThreads;
+        vThreads.emplace_back(&TranscodePipeline::DemuxLoop, this);
+        vThreads.emplace_back(&TranscodePipeline::DecodeLoop, this);
+        if (pProcessor) {
+            vThreads.emplace_back(&TranscodePipeline::ProcessLoop, this);
+        }
+        vThreads.emplace_back(&TranscodePipeline::EncodeLoop, this);
+        vThreads.emplace_back(&TranscodePipeline::MuxLoop, this);
+        for (std::thread &t : vThreads) {
+            t.join();
+        }
+        nWallNs = ElapsedNs(tStart.load());
+        bFinished = true;
+        return !bFailed;
+    }
+
+    /**
+    *   @brief  Ends the stream early from any thread; stages flush what is already queued.
+    */
+    void Stop() {
+        bStop = true;
+    }
+
+    /**
+    *   @brief  Can be sampled while Run() is in progress.
+    */
+    TranscodeStats GetStats() const {
+        TranscodeStats stats = {};
+        stats.fWallSeconds = (bFinished ? nWallNs.load() : ElapsedNs(tStart.load())) * 1e-9;
+        stats.bFailed = bFailed;
+        stats.eBottleneck = TRANSCODE_STAGE_DEMUX;
+        for (int i = 0; i < TRANSCODE_STAGE_COUNT; i++) {
+            TranscodeStageStats &s = stats.aStage[i];
+            s.nItems = aCounters[i].nItems;
+            s.fBusySeconds = aCounters[i].nBusyNs * 1e-9;
+            s.fStarvedSeconds = aCounters[i].nStarvedNs * 1e-9;
+            s.fBlockedSeconds = aCounters[i].nBlockedNs * 1e-9;
+            s.fUtilization = stats.fWallSeconds > 0 ? s.fBusySeconds / stats.fWallSeconds : 0.0;
+            if (s.fBusySeconds > stats.aStage[stats.eBottleneck].fBusySeconds) {
+                stats.eBottleneck = (TRANSCODE_STAGE)i;
+            }
+        }
+        return stats;
+    }
+
+    static const char *GetStageName(TRANSCODE_STAGE eStage) {
+        static const char *aszNames[TRANSCODE_STAGE_COUNT] = {"demux", "decode", "process", "encode", "mux"};
+        return eStage < TRANSCODE_STAGE_COUNT ? aszNames[eStage] : "unknown";
+    }
+
+private:
+    struct StageCounters {
+        std::atomic<uint64_t> nItems{0};
+        std::atomic<uint64_t> nBusyNs{0}, nStarvedNs{0}, nBlockedNs{0};
+    };
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static uint64_t ElapsedNs(TimePoint t0) {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    template<typename T>
+    void Send(SpscRingQueue<T> &q, T &&item, TRANSCODE_STAGE eStage) {
+        TimePoint t0 = std::chrono::steady_clock::now();
+        q.Push(std::move(item));
+        aCounters[eStage].nBlockedNs += ElapsedNs(t0);
+    }
+
+    template<typename T>
+    bool Receive(SpscRingQueue<T> &q, T &item, TRANSCODE_STAGE eStage) {
+        TimePoint t0 = std::chrono::steady_clock::now();
+        bool bOk = q.Pop(item);
+        aCounters[eStage].nStarvedNs += ElapsedNs(t0);
+        return bOk;
+    }
+
+    void Fail(TRANSCODE_STAGE eStage) {
+        if (!bFailed.exchange(true)) {
+            LOG(ERROR) << "Transcode " << GetStageName(eStage) << " stage failed";
+        }
+        bStop = true;
+    }
+
+    void DemuxLoop() {
+        StageCounters &c = aCounters[TRANSCODE_STAGE_DEMUX];
+        while (!bStop) {
+            TranscodePacket packet;
+            // Reuse payload buffers the decode stage is done with
+            qRecycledPackets.TryPop(packet);
+            TimePoint t0 = std::chrono::steady_clock::now();
+            bool bOk = pSource->Read(packet);
+            c.nBusyNs += ElapsedNs(t0);
+            if (!bOk) {
+                break;
+            }
+            packet.bEndOfStream = false;
+            c.nItems++;
+            Send(qPackets, std::move(packet), TRANSCODE_STAGE_DEMUX);
+        }
+        TranscodePacket eos;
+        eos.bEndOfStream = true;
+        Send(qPackets, std::move(eos), TRANSCODE_STAGE_DEMUX);
+        qPackets.Close();
+    }
+
+    void DecodeLoop() {
+        StageCounters &c = aCounters[TRANSCODE_STAGE_DECODE];
+        SpscRingQueue<TranscodeFrame> &qOut = pProcessor ? qDecoded : qProcessed;
+        std::vector<TranscodeFrame> vFrames;
+        TranscodePacket packet;
+        bool bHealthy = true;
+        while (Receive(qPackets, packet, TRANSCODE_STAGE_DECODE)) {
+            bool bEos = packet.bEndOfStream;
+            vFrames.clear();
+            if (bHealthy) {
+                TimePoint t0 = std::chrono::steady_clock::now();
+                bHealthy = pDecoder->Decode(bEos ? NULL : &packet, vFrames);
+                c.nBusyNs += ElapsedNs(t0);
+                if (!bHealthy) {
+                    Fail(TRANSCODE_STAGE_DECODE);
+                }
+            }
+            if (!bEos) {
+                qRecycledPackets.TryPush(std::move(packet));
+            }
+            for (TranscodeFrame &frame : vFrames) {
+                c.nItems++;
+                Send(qOut, std::move(frame), TRANSCODE_STAGE_DECODE);
+            }
+            if (bEos) {
+                break;
+            }
+        }
+        TranscodeFrame eos;
+        eos.bEndOfStream = true;
+        Send(qOut, std::move(eos), TRANSCODE_STAGE_DECODE);
+        qOut.Close();
+    }
+
+    void ProcessLoop() {
+        StageCounters &c = aCounters[TRANSCODE_STAGE_PROCESS];
+        TranscodeFrame frame;
+        bool bHealthy = true;
+        while (Receive(qDecoded, frame, TRANSCODE_STAGE_PROCESS) && !frame.bEndOfStream) {
+            if (!bHealthy) {
+                ReleaseFrame(frame);
+                continue;
+            }
+            TranscodeFrame out;
+            TimePoint t0 = std::chrono::steady_clock::now();
+            bHealthy = pProcessor->Process(frame, out);
+            c.nBusyNs += ElapsedNs(t0);
+            if (!bHealthy) {
+                // Keep draining so upstream surfaces are returned and the decoder cannot block forever
+                ReleaseFrame(frame);
+                Fail(TRANSCODE_STAGE_PROCESS);
+                continue;
+            }
+            c.nItems++;
+            Send(qProcessed, std::move(out), TRANSCODE_STAGE_PROCESS);
+        }
+        TranscodeFrame eos;
+        eos.bEndOfStream = true;
+        Send(qProcessed, std::move(eos), TRANSCODE_STAGE_PROCESS);
+        qProcessed.Close();
+    }
+
+    void EncodeLoop() {
+        StageCounters &c = aCounters[TRANSCODE_STAGE_ENCODE];
+        std::vector<TranscodePacket> vPackets;
+        TranscodeFrame frame;
+        bool bHealthy = true;
+        while (Receive(qProcessed, frame, TRANSCODE_STAGE_ENCODE)) {
+            bool bEos = frame.bEndOfStream;
+            vPackets.clear();
+            if (bHealthy) {
+                TimePoint t0 = std::chrono::steady_clock::now();
+                bHealthy = pEncoder->Encode(bEos ? NULL : &frame, vPackets);
+                c.nBusyNs += ElapsedNs(t0);
+                if (!bHealthy) {
+                    Fail(TRANSCODE_STAGE_ENCODE);
+                }
+            }
+            // A healthy encoder has released the frame already
+            ReleaseFrame(frame);
+            for (TranscodePacket &packet : vPackets) {
+                c.nItems++;
+                Send(qEncoded, std::move(packet), TRANSCODE_STAGE_ENCODE);
+            }
+            if (bEos) {
+                break;
+            }
+        }
+        TranscodePacket eos;
+        eos.bEndOfStream = true;
+        Send(qEncoded, std::move(eos), TRANSCODE_STAGE_ENCODE);
+        qEncoded.Close();
+    }
+
+    void MuxLoop() {
+        StageCounters &c = aCounters[TRANSCODE_STAGE_MUX];
+        TranscodePacket packet;
+        bool bHealthy = true;
+        while (Receive(qEncoded, packet, TRANSCODE_STAGE_MUX) && !packet.bEndOfStream) {
+            if (!bHealthy) {
+                continue;
+            }
+            TimePoint t0 = std::chrono::steady_clock::now();
+            bHealthy = pSink->Write(packet);
+            c.nBusyNs += ElapsedNs(t0);
+            if (!bHealthy) {
+                Fail(TRANSCODE_STAGE_MUX);
+            } else {
+                c.nItems++;
+            }
+        }
+        if (!pSink->Close()) {
+            Fail(TRANSCODE_STAGE_MUX);
+        }
+    }
+
+private:
+    TranscodeSource *pSource;
+    TranscodeDecoder *pDecoder;
+    TranscodeProcessor *pProcessor;
+    TranscodeEncoder *pEncoder;
+    TranscodeSink *pSink;
+
+    SpscRingQueue<TranscodePacket> qPackets;            /*!< demux -> decode */
+    SpscRingQueue<TranscodePacket> qRecycledPackets;    /*!< decode -> demux, emptied payload buffers */
+    SpscRingQueue<TranscodeFrame> qDecoded;             /*!< decode -> process */
+    SpscRingQueue<TranscodeFrame> qProcessed;           /*!< process (or decode) -> encode */
+    SpscRingQueue<TranscodePacket> qEncoded;            /*!< encode -> mux */
+
+    StageCounters aCounters[TRANSCODE_STAGE_COUNT];
+    std::atomic<bool> bStop{false};
+    std::atomic<bool> bFailed{false};
+    std::atomic<bool> bFinished{false};
+    std::atomic<uint64_t> nWallNs{0};
+    std::atomic<TimePoint> tStart{std::chrono::steady_clock::now()};    /*!< Written by Run(), read by GetStats() */
+};
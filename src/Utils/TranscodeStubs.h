@@ -0,0 +1,254 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "TranscodePipeline.h"
+
+//---------------------------------------------------------------------------
+//! \file TranscodeStubs.h
+//! \brief Host-memory stand-ins for the TranscodePipeline backends.
+//!
+//! They exercise the pipeline (queues, surface recycling, flushing, statistics) on
+//! machines without a GPU. Each stage can burn a fixed amount of time per item to
+//! model a slow backend when checking bottleneck detection.
+//---------------------------------------------------------------------------
+
+inline void StubBusyWait(int nMicroseconds) {
+    if (nMicroseconds <= 0) {
+        return;
+    }
+    auto tEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(nMicroseconds);
+    while (std::chrono::steady_clock::now() < tEnd) {
+    }
+}
+
+/**
+* @brief Fixed set of host NV12 surfaces. Acquire() blocks while all of them are downstream, like a decoder
+* running out of output surfaces. One thread acquires and one thread releases.
+*/
+class StubFramePool : public TranscodeFrameOwner {
+public:
+    StubFramePool(int nWidth, int nHeight, int nSurfaces) : nWidth(nWidth), nHeight(nHeight), qFree(nSurfaces) {
+        vvSurface.resize(nSurfaces);
+        for (int i = 0; i < nSurfaces; i++) {
+            vvSurface[i].resize((size_t)nWidth * nHeight * 3 / 2);
+            qFree.TryPush(std::move(i));
+        }
+    }
+
+    TranscodeFrame Acquire(int64_t nPts) {
+        int iSlot = -1;
+        qFree.Pop(iSlot);
+        TranscodeFrame frame;
+        frame.pData = vvSurface[iSlot].data();
+        frame.nPitch = nWidth;
+        frame.nWidth = nWidth;
+        frame.nHeight = nHeight;
+        frame.nPts = nPts;
+        frame.pOwner = this;
+        frame.iSlot = iSlot;
+        return frame;
+    }
+
+    void ReleaseFrame(const TranscodeFrame &frame) {
+        int iSlot = frame.iSlot;
+        qFree.TryPush(std::move(iSlot));
+    }
+
+private:
+    int nWidth, nHeight;
+    std::vector<std::vector<uint8_t>> vvSurface;
+    SpscRingQueue<int> qFree;
+};
+
+/**
+* @brief Emits nFrames packets whose payload is the frame number, with a key frame every nGopLength.
+* Starting at nFirstFrame stands in for a demuxer that was seeked to that keyframe.
+*/
+class StubSource : public TranscodeSource {
+public:
+    StubSource(int nFrames, int nPacketSize = 4096, int nGopLength = 30, int nWorkMicroseconds = 0, int nFirstFrame = 0)
+        : nFrames(nFrames), nPacketSize(nPacketSize), nGopLength(nGopLength), nWorkMicroseconds(nWorkMicroseconds), iFrame(nFirstFrame) {}
+
+    bool Read(TranscodePacket &packet) {
+        if (iFrame >= nFrames) {
+            return false;
+        }
+        StubBusyWait(nWorkMicroseconds);
+        packet.vData.assign(nPacketSize, (uint8_t)iFrame);
+        packet.nPts = packet.nDts = iFrame;
+        packet.bKeyFrame = iFrame % nGopLength == 0;
+        iFrame++;
+        return true;
+    }
+
+private:
+    int nFrames, nPacketSize, nGopLength, nWorkMicroseconds;
+    int iFrame;
+};
+
+/**
+* @brief Fills a pooled surface with the first payload byte. With nDelay > 0 frames come out that many packets
+* late and are returned by the flush, like a decoder with a reorder queue.
+*/
+class StubDecoder : public TranscodeDecoder {
+public:
+    StubDecoder(int nWidth, int nHeight, int nSurfaces, int nDelay = 0, int nWorkMicroseconds = 0)
+        : pool(nWidth, nHeight, nSurfaces), nDelay(nDelay), nWorkMicroseconds(nWorkMicroseconds) {}
+
+    bool Decode(const TranscodePacket *pPacket, std::vector<TranscodeFrame> &vFrames) {
+        if (pPacket) {
+            if (pPacket->vData.empty()) {
+                return false;
+            }
+            StubBusyWait(nWorkMicroseconds);
+            vPending.push_back(*pPacket);
+        }
+        while (!vPending.empty() && (!pPacket || (int)vPending.size() > nDelay)) {
+            const TranscodePacket &packet = vPending.front();
+            TranscodeFrame frame = pool.Acquire(packet.nPts);
+            memset(frame.pData, packet.vData[0], (size_t)frame.nPitch * frame.nHeight * 3 / 2);
+            vFrames.push_back(frame);
+            vPending.erase(vPending.begin());
+        }
+        return true;
+    }
+
+private:
+    StubFramePool pool;
+    int nDelay, nWorkMicroseconds;
+    std::vector<TranscodePacket> vPending;
+};
+
+/**
+* @brief Nearest-neighbour NV12 scale into its own surface pool.
+*/
+class StubScaler : public TranscodeProcessor {
+public:
+    StubScaler(int nWidth, int nHeight, int nSurfaces, int nWorkMicroseconds = 0)
+        : pool(nWidth, nHeight, nSurfaces), nWorkMicroseconds(nWorkMicroseconds) {}
+
+    bool Process(TranscodeFrame &in, TranscodeFrame &out) {
+        StubBusyWait(nWorkMicroseconds);
+        out = pool.Acquire(in.nPts);
+        for (int y = 0; y < out.nHeight * 3 / 2; y++) {
+            bool bChroma = y >= out.nHeight;
+            int ySrc = bChroma ? in.nHeight + (y - out.nHeight) * in.nHeight / out.nHeight : y * in.nHeight / out.nHeight;
+            const uint8_t *pSrc = in.pData + (size_t)ySrc * in.nPitch;
+            uint8_t *pDst = out.pData + (size_t)y * out.nPitch;
+            for (int x = 0; x < out.nWidth; x++) {
+                // Chroma samples are interleaved UV pairs
+                int xSrc = bChroma ? (x / 2 * in.nWidth / out.nWidth) * 2 + (x & 1) : x * in.nWidth / out.nWidth;
+                pDst[x] = pSrc[xSrc];
+            }
+        }
+        ReleaseFrame(in);
+        return true;
+    }
+
+private:
+    StubFramePool pool;
+    int nWorkMicroseconds;
+};
+
+/**
+* @brief Emits an 8-byte packet per frame: the first luma sample and a checksum of the luma plane.
+* With nBFrames > 0 it reorders like NVENC with frameIntervalP = nBFrames + 1: every anchor frame is
+* emitted before the B-frames that precede it in presentation order. Key frames and the flush close the open group.
+*/
+class StubEncoder : public TranscodeEncoder {
+public:
+    StubEncoder(int nGopLength = 30, int nWorkMicroseconds = 0, int nBFrames = 0)
+        : nGopLength(nGopLength), nWorkMicroseconds(nWorkMicroseconds), nBFrames(nBFrames), dtsQueue(nBFrames) {}
+
+    bool Encode(TranscodeFrame *pFrame, std::vector<TranscodePacket> &vPackets) {
+        if (!pFrame) {
+            ClosePending(vPackets);
+            return true;
+        }
+        StubBusyWait(nWorkMicroseconds);
+        uint32_t nSum = 0;
+        for (int y = 0; y < pFrame->nHeight; y++) {
+            const uint8_t *p = pFrame->pData + (size_t)y * pFrame->nPitch;
+            for (int x = 0; x < pFrame->nWidth; x++) {
+                nSum += p[x];
+            }
+        }
+        TranscodePacket packet;
+        packet.vData.resize(8);
+        uint32_t nFirst = pFrame->pData[0];
+        memcpy(packet.vData.data(), &nFirst, 4);
+        memcpy(packet.vData.data() + 4, &nSum, 4);
+        packet.nPts = pFrame->nPts;
+        packet.bKeyFrame = nFrames++ % nGopLength == 0;
+        dtsQueue.PushInput(pFrame->nPts);
+        ReleaseFrame(*pFrame);
+
+        if (packet.bKeyFrame) {
+            // B-frames never reference across a key frame
+            ClosePending(vPackets);
+            Emit(packet, vPackets);
+        } else if ((int)vPending.size() == nBFrames) {
+            Emit(packet, vPackets);
+            for (TranscodePacket &pending : vPending) {
+                Emit(pending, vPackets);
+            }
+            vPending.clear();
+        } else {
+            vPending.push_back(std::move(packet));
+        }
+        return true;
+    }
+
+private:
+    // Codes the pending B-frames as a shorter group whose last frame becomes the anchor
+    void ClosePending(std::vector<TranscodePacket> &vPackets) {
+        if (vPending.empty()) {
+            return;
+        }
+        Emit(vPending.back(), vPackets);
+        vPending.pop_back();
+        for (TranscodePacket &pending : vPending) {
+            Emit(pending, vPackets);
+        }
+        vPending.clear();
+    }
+
+    void Emit(TranscodePacket &packet, std::vector<TranscodePacket> &vPackets) {
+        packet.nDts = dtsQueue.PopDts(packet.nPts);
+        vPackets.push_back(std::move(packet));
+    }
+
+    int nGopLength, nWorkMicroseconds, nBFrames;
+    int64_t nFrames = 0;
+    std::vector<TranscodePacket> vPending;  /*!< B-frames waiting for their anchor */
+    TranscodeDtsQueue dtsQueue;
+};
+
+/**
+* @brief Keeps every packet it is given.
+*/
+class StubSink : public TranscodeSink {
+public:
+    StubSink(int nWorkMicroseconds = 0) : nWorkMicroseconds(nWorkMicroseconds) {}
+
+    bool Write(const TranscodePacket &packet) {
+        StubBusyWait(nWorkMicroseconds);
+        vPackets.push_back(packet);
+        return true;
+    }
+
+    bool Close() {
+        bClosed = true;
+        return true;
+    }
+
+    std::vector<TranscodePacket> vPackets;
+    bool bClosed = false;
+
+private:
+    int nWorkMicroseconds;
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <codec/codec.h>
+#include "NvCodecUtils.h"
+#include "NalUnitSplitter.h"
+
+//---------------------------------------------------------------------------
+//! \file TsWriter.h
+//! \brief Minimal MPEG-TS packetizer for one H.264 or HEVC video elementary stream.
+//!
+//! Emits PAT/PMT with WriteTables() and one PES per access unit with WritePacket(),
+//! which is all an HLS segment needs. Key frames carry the random access indicator and
+//! get the parameter sets prepended if they do not carry their own. The PCR follows the
+//! DTS at least every nPcrInterval, with PCR-only packets between frames further apart,
+//! and PTS/DTS are written nMuxDelay ahead of it to leave the decoder buffering time.
+//---------------------------------------------------------------------------
+
+class TsWriter {
+public:
+    static const int nTsPacketSize = 188;
+    static const int64_t nPcrInterval = 3600;      /*!< 40 ms in 90 kHz units, well inside the 100 ms limit */
+    static const int64_t nMuxDelay = 63000;        /*!< 700 ms of PTS/DTS lead over the PCR, as libavformat's default */
+
+    TsWriter(cdc::CodecType eCodec) : eNalCodec(GetNalCodec(eCodec)), bSupported(eCodec != cdc::CODEC_TYPE_AV1) {
+        if (!bSupported) {
+            LOG(ERROR) << "AV1 in MPEG-TS is not supported, use fragmented MP4";
+        }
+    }
+
+    bool IsSupported() const {
+        return bSupported;
+    }
+
+    /**
+    *   @brief  Parameter sets (Annex-B) inserted before key frames that lack them.
+    */
+    void SetParameterSets(const uint8_t *pData, size_t nSize) {
+        vParamSets.clear();
+        SplitNalUnits(pData, nSize, vNal, eNalCodec);
+        for (const NalUnit &nal : vNal) {
+            if (IsParameterSetNal(nal.nType, eNalCodec)) {
+                vParamSets.insert(vParamSets.end(), aStartCode, aStartCode + 4);
+                vParamSets.insert(vParamSets.end(), nal.pData, nal.pData + nal.nSize);
+            }
+        }
+    }
+
+    /**
+    *   @brief  Appends PAT and PMT; each segment should start with them.
+    */
+    void WriteTables(std::vector<uint8_t> &vOut) {
+        const uint8_t aPat[] = {
+            0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+            0x00, 0x01, (uint8_t)(0xE0 | (nPmtPid >> 8)), (uint8_t)nPmtPid,
+        };
+        WriteSection(vOut, 0, aPat, sizeof(aPat), nPatCounter);
+
+        const uint8_t aPmt[] = {
+            0x02, 0xB0, 0x12, 0x00, 0x01, 0xC1, 0x00, 0x00,
+            (uint8_t)(0xE0 | (nVideoPid >> 8)), (uint8_t)nVideoPid,     // PCR_PID
+            0xF0, 0x00,
+            (uint8_t)(eNalCodec == NAL_CODEC_HEVC ? 0x24 : 0x1B),
+            (uint8_t)(0xE0 | (nVideoPid >> 8)), (uint8_t)nVideoPid,
+            0xF0, 0x00,
+        };
+        WriteSection(vOut, nPmtPid, aPmt, sizeof(aPmt), nPmtCounter);
+    }
+
+    /**
+    *   @brief  Appends one access unit as a PES split into TS packets.
+    *   @param  nPts, nDts  In 90 kHz units; the PCR is derived from nDts and the PES carries both plus nMuxDelay
+    */
+    bool WritePacket(std::vector<uint8_t> &vOut, const uint8_t *pData, size_t nSize, int64_t nPts, int64_t nDts, bool bKeyFrame) {
+        if (!bSupported || !nSize) {
+            return false;
+        }
+
+        bool bInject = false;
+        if (bKeyFrame && !vParamSets.empty()) {
+            SplitNalUnits(pData, nSize, vNal, eNalCodec);
+            bInject = true;
+            for (const NalUnit &nal : vNal) {
+                bInject &= !IsParameterSetNal(nal.nType, eNalCodec);
+            }
+        }
+
+        // Frames further apart than the PCR interval get PCR-only packets in between; a jump of more
+        // than a second is a discontinuity rather than a gap to fill
+        if (nLastPcr != INT64_MIN && nDts > nLastPcr && nDts - nLastPcr <= 90000) {
+            for (int64_t nPcr = nLastPcr + nPcrInterval; nPcr < nDts; nPcr += nPcrInterval) {
+                WritePcrPacket(vOut, nPcr);
+            }
+        }
+        // Half the interval keeps the next frame within it at any frame rate that does not need the packets above
+        bool bPcr = bKeyFrame || nLastPcr == INT64_MIN || nDts - nLastPcr >= nPcrInterval / 2 || nDts < nLastPcr;
+        if (bPcr) {
+            nLastPcr = nDts;
+        }
+
+        bool bDts = nDts != nPts;
+        vPes.clear();
+        const uint8_t aPesHeader[] = {0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, (uint8_t)(bDts ? 0xC0 : 0x80), (uint8_t)(bDts ? 10 : 5)};
+        vPes.insert(vPes.end(), aPesHeader, aPesHeader + sizeof(aPesHeader));
+        PutTimestamp(vPes, bDts ? 0x30 : 0x20, nPts + nMuxDelay);
+        if (bDts) {
+            PutTimestamp(vPes, 0x10, nDts + nMuxDelay);
+        }
+        if (bInject) {
+            vPes.insert(vPes.end(), vParamSets.begin(), vParamSets.end());
+        }
+        vPes.insert(vPes.end(), pData, pData + nSize);
+
+        // A PCR, and the random_access_indicator of a key frame, take 8 bytes of adaptation field in the first packet
+        size_t nFirstPayload = nTsPacketSize - 4 - (bPcr ? 8 : 0);
+        size_t nPackets = 1 + (vPes.size() > nFirstPayload ? (vPes.size() - nFirstPayload + 183) / 184 : 0);
+        size_t nStart = vOut.size();
+        vOut.resize(nStart + nPackets * nTsPacketSize);
+        uint8_t *p = vOut.data() + nStart;
+
+        size_t nPos = 0;
+        for (size_t i = 0; i < nPackets; i++, p += nTsPacketSize) {
+            size_t nRemaining = vPes.size() - nPos;
+            size_t nAdaptation = i == 0 && bPcr ? 8 : 0;
+            size_t nPayload = std::min(nRemaining, nTsPacketSize - 4 - nAdaptation);
+            if (nPayload + nAdaptation < nTsPacketSize - 4) {
+                // Stuffing goes into the adaptation field; at least the length byte is needed
+                nAdaptation = nTsPacketSize - 4 - nPayload;
+            }
+
+            p[0] = 0x47;
+            p[1] = (uint8_t)((i == 0 ? 0x40 : 0x00) | (nVideoPid >> 8));
+            p[2] = (uint8_t)nVideoPid;
+            p[3] = (uint8_t)((nAdaptation ? 0x30 : 0x10) | (nVideoCounter++ & 0x0F));
+            uint8_t *q = p + 4;
+            if (nAdaptation) {
+                q[0] = (uint8_t)(nAdaptation - 1);
+                if (nAdaptation > 1) {
+                    q[1] = 0x00;
+                    size_t nUsed = 2;
+                    if (i == 0 && bPcr) {
+                        q[1] = bKeyFrame ? 0x50 : 0x10;     // random_access_indicator, PCR_flag
+                        PutPcr(q + 2, nDts);
+                        nUsed = 8;
+                    }
+                    memset(q + nUsed, 0xFF, nAdaptation - nUsed);
+                }
+                q += nAdaptation;
+            }
+            memcpy(q, vPes.data() + nPos, nPayload);
+            nPos += nPayload;
+        }
+        return true;
+    }
+
+private:
+    // Adaptation field only, so the continuity counter does not advance
+    void WritePcrPacket(std::vector<uint8_t> &vOut, int64_t nPcr) {
+        size_t nStart = vOut.size();
+        vOut.resize(nStart + nTsPacketSize, 0xFF);
+        uint8_t *p = vOut.data() + nStart;
+        p[0] = 0x47;
+        p[1] = (uint8_t)(nVideoPid >> 8);
+        p[2] = (uint8_t)nVideoPid;
+        p[3] = (uint8_t)(0x20 | ((nVideoCounter - 1) & 0x0F));
+        p[4] = nTsPacketSize - 5;
+        p[5] = 0x10;                        // PCR_flag
+        PutPcr(p + 6, nPcr);
+    }
+
+    static void PutPcr(uint8_t *p, int64_t nPcr) {
+        uint64_t nBase = (uint64_t)nPcr & 0x1FFFFFFFFull;
+        p[0] = (uint8_t)(nBase >> 25);
+        p[1] = (uint8_t)(nBase >> 17);
+        p[2] = (uint8_t)(nBase >> 9);
+        p[3] = (uint8_t)(nBase >> 1);
+        p[4] = (uint8_t)((nBase << 7) | 0x7E);
+        p[5] = 0x00;
+    }
+
+    void WriteSection(std::vector<uint8_t> &vOut, uint16_t nPid, const uint8_t *pSection, size_t nSection, uint8_t &nCounter) {
+        size_t nStart = vOut.size();
+        vOut.resize(nStart + nTsPacketSize, 0xFF);
+        uint8_t *p = vOut.data() + nStart;
+        p[0] = 0x47;
+        p[1] = (uint8_t)(0x40 | (nPid >> 8));
+        p[2] = (uint8_t)nPid;
+        p[3] = (uint8_t)(0x10 | (nCounter++ & 0x0F));
+        p[4] = 0x00;                        // pointer_field
+        memcpy(p + 5, pSection, nSection);
+        uint32_t nCrc = Crc32Mpeg(pSection, nSection);
+        for (int i = 0; i < 4; i++) {
+            p[5 + nSection + i] = (uint8_t)(nCrc >> (24 - 8 * i));
+        }
+    }
+
+    static void PutTimestamp(std::vector<uint8_t> &v, uint8_t nPrefix, int64_t nTimestamp) {
+        uint64_t t = (uint64_t)nTimestamp & 0x1FFFFFFFFull;
+        v.push_back((uint8_t)(nPrefix | ((t >> 29) & 0x0E) | 1));
+        v.push_back((uint8_t)(t >> 22));
+        v.push_back((uint8_t)(((t >> 14) & 0xFE) | 1));
+        v.push_back((uint8_t)(t >> 7));
+        v.push_back((uint8_t)(((t << 1) & 0xFE) | 1));
+    }
+
+    static uint32_t Crc32Mpeg(const uint8_t *p, size_t n) {
+        uint32_t nCrc = 0xFFFFFFFF;
+        for (size_t i = 0; i < n; i++) {
+            nCrc ^= (uint32_t)p[i] << 24;
+            for (int b = 0; b < 8; b++) {
+                nCrc = (nCrc & 0x80000000) ? (nCrc << 1) ^ 0x04C11DB7 : nCrc << 1;
+            }
+        }
+        return nCrc;
+    }
+
+private:
+    static const uint16_t nPmtPid = 0x1000;
+    static const uint16_t nVideoPid = 0x100;
+    static constexpr uint8_t aStartCode[4] = {0, 0, 0, 1};
+    NAL_CODEC eNalCodec;
+    bool bSupported;
+    uint8_t nPatCounter = 0, nPmtCounter = 0, nVideoCounter = 0;
+    int64_t nLastPcr = INT64_MIN;
+    std::vector<uint8_t> vParamSets;
+    std::vector<uint8_t> vPes;              /*!< Reused PES assembly buffer */
+    std::vector<NalUnit> vNal;
+};
@@ -0,0 +1,616 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "NvCodecUtils.h"
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//---------------------------------------------------------------------------
+//! \file WorkStealingPool.h
+//! \brief Fixed set of worker threads shared by the encode, decode, mux and metrics work
+//! of many sessions, instead of one or more threads per session.
+//!
+//! Every worker owns a deque. Tasks submitted from a worker go to its own deque, others
+//! are spread over the workers round robin. A worker runs its deque in submission order
+//! and, once it is empty, steals from the back of the other deques, those of workers on
+//! its own NUMA node first. Workers can be pinned to a CPU each or to the CPUs of their
+//! node. Every task is timed from submission to start (queueing delay) and from start to
+//! end, per task class.
+//!
+//! WorkerStrand runs the tasks of one session one at a time and in order, which is what
+//! most pipeline stages need, without holding a worker while the session is idle. Tasks
+//! must not block on other tasks except through WorkStealingPool::Wait().
+//---------------------------------------------------------------------------
+
+typedef enum {
+    WORKER_TASK_GENERIC = 0,
+    WORKER_TASK_ENCODE,                     /*!< Encoder output drain */
+    WORKER_TASK_DECODE,                     /*!< Decode, frame map and copy */
+    WORKER_TASK_MUX,
+    WORKER_TASK_METRICS,
+    WORKER_TASK_CLASS_COUNT
+} WORKER_TASK_CLASS;
+
+typedef enum {
+    WORKER_AFFINITY_NONE = 0,               /*!< Workers run wherever the OS puts them */
+    WORKER_AFFINITY_CPU,                    /*!< Each worker is pinned to one CPU */
+    WORKER_AFFINITY_NODE,                   /*!< Each worker is pinned to the CPUs of one NUMA node */
+} WORKER_AFFINITY;
+
+struct WorkerPoolConfig {
+    int nWorkers = 0;                       /*!< 0 for one per usable CPU */
+    WORKER_AFFINITY eAffinity = WORKER_AFFINITY_NONE;
+    int iNumaNode = -1;                     /*!< Only use the CPUs of this node; -1 for all of them */
+};
+
+struct WorkerTaskClassStats {
+    uint64_t nTasks;
+    double fQueueMeanMs, fQueueP50Ms, fQueueP99Ms, fQueueMaxMs;
+    double fRunMeanMs, fRunMaxMs;
+};
+
+struct WorkerPoolStats {
+    WorkerTaskClassStats aClass[WORKER_TASK_CLASS_COUNT];
+    uint64_t nSteals;
+    int nWorkers;
+};
+
+struct HostCpu {
+    int iCpu;
+    int iNode;
+};
+
+// Four buckets per power of two of nanoseconds, so percentiles are within 25%
+#define WORKER_LATENCY_BUCKETS 160
+
+inline const char *GetWorkerTaskClassName(WORKER_TASK_CLASS eClass) {
+    static const char *aszName[WORKER_TASK_CLASS_COUNT] = {"generic", "encode", "decode", "mux", "metrics"};
+    return eClass < WORKER_TASK_CLASS_COUNT ? aszName[eClass] : "unknown";
+}
+
+#ifndef _WIN32
+// Parses a sysfs CPU list such as "0-3,8-11"
+inline std::vector<int> ParseCpuList(const char *szList) {
+    std::vector<int> vCpu;
+    const char *p = szList;
+    while (*p) {
+        char *pEnd = nullptr;
+        long nFirst = strtol(p, &pEnd, 10);
+        if (pEnd == p) {
+            break;
+        }
+        long nLast = nFirst;
+        p = pEnd;
+        if (*p == '-') {
+            nLast = strtol(p + 1, &pEnd, 10);
+            p = pEnd;
+        }
+        for (long i = nFirst; i <= nLast; i++) {
+            vCpu.push_back((int)i);
+        }
+        if (*p != ',') {
+            break;
+        }
+        p++;
+    }
+    return vCpu;
+}
+#endif
+
+/**
+* @brief CPUs this process may run on and their NUMA nodes. Without NUMA information every CPU is on node 0.
+*/
+inline std::vector<HostCpu> GetHostCpus() {
+    std::vector<HostCpu> vCpu;
+#ifdef _WIN32
+    DWORD_PTR nProcessMask = 0, nSystemMask = 0;
+    GetProcessAffinityMask(GetCurrentProcess(), &nProcessMask, &nSystemMask);
+    for (int i = 0; i < (int)sizeof(DWORD_PTR) * 8; i++) {
+        if (nProcessMask & ((DWORD_PTR)1 << i)) {
+            UCHAR nNode = 0;
+            if (!GetNumaProcessorNode((UCHAR)i, &nNode) || nNode == 0xFF) {
+                nNode = 0;
+            }
+            vCpu.push_back({i, nNode});
+        }
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &set)) {
+                vCpu.push_back({i, 0});
+            }
+        }
+    }
+    // Node ids can have gaps, so every possible one is tried
+    for (int iNode = 0; iNode < 1024; iNode++) {
+        char szPath[64], szList[4096];
+        snprintf(szPath, sizeof(szPath), "/sys/devices/system/node/node%d/cpulist", iNode);
+        FILE *fp = fopen(szPath, "r");
+        if (!fp) {
+            continue;
+        }
+        bool bRead = fgets(szList, sizeof(szList), fp) != nullptr;
+        fclose(fp);
+        for (int iCpu : bRead ? ParseCpuList(szList) : std::vector<int>()) {
+            for (HostCpu &cpu : vCpu) {
+                if (cpu.iCpu == iCpu) {
+                    cpu.iNode = iNode;
+                }
+            }
+        }
+    }
+#endif
+    if (vCpu.empty()) {
+        int n = (int)std::thread::hardware_concurrency();
+        for (int i = 0; i < (n > 0 ? n : 1); i++) {
+            vCpu.push_back({i, 0});
+        }
+    }
+    return vCpu;
+}
+
+/**
+* @brief Restricts a thread to the given CPUs. Returns false if the OS refused.
+*/
+inline bool SetThreadCpus(std::thread &t, const std::vector<int> &vCpu) {
+#ifdef _WIN32
+    DWORD_PTR nMask = 0;
+    for (int iCpu : vCpu) {
+        if (iCpu < (int)sizeof(DWORD_PTR) * 8) {
+            nMask |= (DWORD_PTR)1 << iCpu;
+        }
+    }
+    return nMask && SetThreadAffinityMask((HANDLE)t.native_handle(), nMask) != 0;
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int iCpu : vCpu) {
+        if (iCpu < CPU_SETSIZE) {
+            CPU_SET(iCpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(t.native_handle(), sizeof(set), &set) == 0;
+#endif
+}
+
+/**
+* @brief Tasks submitted with WorkStealingPool::Submit(WorkerTaskGroup &, ...) that can be waited for together.
+*/
+class WorkerTaskGroup {
+public:
+    WorkerTaskGroup() = default;
+    WorkerTaskGroup(const WorkerTaskGroup &) = delete;
+    WorkerTaskGroup &operator=(const WorkerTaskGroup &) = delete;
+
+private:
+    friend class WorkStealingPool;
+    std::mutex mtx;
+    std::condition_variable cvDone;
+    int64_t nPending = 0;
+};
+
+class WorkStealingPool {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    WorkStealingPool(const WorkerPoolConfig &config = WorkerPoolConfig()) {
+        std::vector<HostCpu> vCpu = GetHostCpus(), vNodeCpu;
+        for (const HostCpu &cpu : vCpu) {
+            if (config.iNumaNode < 0 || cpu.iNode == config.iNumaNode) {
+                vNodeCpu.push_back(cpu);
+            }
+        }
+        if (vNodeCpu.empty()) {
+            LOG(WARNING) << "No usable CPU on NUMA node " << config.iNumaNode << ", using all nodes";
+            vNodeCpu = vCpu;
+        }
+
+        int nWorkers = config.nWorkers > 0 ? config.nWorkers : (int)vNodeCpu.size();
+        for (int i = 0; i < nWorkers; i++) {
+            vWorkers.emplace_back(new Worker());
+            vWorkers.back()->cpu = vNodeCpu[i % vNodeCpu.size()];
+        }
+        for (int i = 0; i < nWorkers; i++) {
+            // Victims on the same node come first, each list starting after the thief so thieves spread out
+            for (int bSameNode = 1; bSameNode >= 0; bSameNode--) {
+                for (int j = 1; j < nWorkers; j++) {
+                    int iVictim = (i + j) % nWorkers;
+                    if ((vWorkers[iVictim]->cpu.iNode == vWorkers[i]->cpu.iNode) == (bSameNode != 0)) {
+                        vWorkers[i]->viVictim.push_back(iVictim);
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < nWorkers; i++) {
+            Worker &w = *vWorkers[i];
+            w.thread = std::thread(&WorkStealingPool::WorkerLoop, this, i);
+            std::vector<int> viCpu;
+            if (config.eAffinity == WORKER_AFFINITY_CPU) {
+                viCpu.push_back(w.cpu.iCpu);
+            } else if (config.eAffinity == WORKER_AFFINITY_NODE) {
+                for (const HostCpu &cpu : vNodeCpu) {
+                    if (cpu.iNode == w.cpu.iNode) {
+                        viCpu.push_back(cpu.iCpu);
+                    }
+                }
+            }
+            if (!viCpu.empty() && !SetThreadCpus(w.thread, viCpu)) {
+                LOG(WARNING) << "Could not set the CPU affinity of worker " << i;
+            }
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    /**
+    *   @brief  Runs the tasks still queued, then stops the workers. Nothing may be submitted from other threads meanwhile.
+    */
+    ~WorkStealingPool() {
+        bStop = true;
+        epoch.fetch_add(1);
+        epoch.notify_all();
+        for (std::unique_ptr<Worker> &w : vWorkers) {
+            w->thread.join();
+        }
+    }
+
+    void Submit(std::function<void()> fn, WORKER_TASK_CLASS eClass = WORKER_TASK_GENERIC) {
+        Submit(std::move(fn), eClass, std::chrono::steady_clock::now());
+    }
+
+    /**
+    *   @param  tEnqueue    Start of the queueing delay, for work that already waited elsewhere
+    */
+    void Submit(std::function<void()> fn, WORKER_TASK_CLASS eClass, TimePoint tEnqueue) {
+        Task task = {std::move(fn), eClass < WORKER_TASK_CLASS_COUNT ? eClass : WORKER_TASK_GENERIC, tEnqueue};
+        int iWorker = GetCurrentWorker();
+        if (iWorker < 0) {
+            iWorker = (int)(nNextWorker.fetch_add(1, std::memory_order_relaxed) % vWorkers.size());
+        }
+        Worker &w = *vWorkers[iWorker];
+        {
+            std::lock_guard<std::mutex> lock(w.mtx);
+            w.dqTasks.push_back(std::move(task));
+        }
+        // Pairs with WorkerLoop(): a worker either sees the new epoch or is counted in nSleeping
+        epoch.fetch_add(1);
+        if (nSleeping.load() > 0) {
+            epoch.notify_one();
+        }
+    }
+
+    void Submit(WorkerTaskGroup &group, std::function<void()> fn, WORKER_TASK_CLASS eClass = WORKER_TASK_GENERIC) {
+        {
+            std::lock_guard<std::mutex> lock(group.mtx);
+            group.nPending++;
+        }
+        Submit([&group, fn = std::move(fn)]() {
+            struct Done {
+                WorkerTaskGroup &group;
+                ~Done() {
+                    // Notified under the lock, so the waiter cannot destroy the group before this returns
+                    std::lock_guard<std::mutex> lock(group.mtx);
+                    if (--group.nPending == 0) {
+                        group.cvDone.notify_all();
+                    }
+                }
+            } done = {group};
+            fn();
+        }, eClass);
+    }
+
+    /**
+    *   @brief  Waits for every task of the group. On a worker thread of this pool, runs queued tasks meanwhile.
+    */
+    void Wait(WorkerTaskGroup &group) {
+        int iWorker = GetCurrentWorker();
+        std::unique_lock<std::mutex> lock(group.mtx);
+        while (group.nPending > 0) {
+            lock.unlock();
+            bool bRan = iWorker >= 0 && RunOne(iWorker);
+            lock.lock();
+            if (!bRan) {
+                // The remaining tasks are running on other workers
+                group.cvDone.wait(lock, [&group]() { return group.nPending == 0; });
+            }
+        }
+    }
+
+    /**
+    *   @brief  Index of the worker of this pool the caller runs on, -1 for other threads.
+    */
+    int GetCurrentWorker() const {
+        const CurrentWorker &current = GetCurrentWorkerSlot();
+        return current.pPool == this ? current.iWorker : -1;
+    }
+
+    int GetWorkerCount() const {
+        return (int)vWorkers.size();
+    }
+
+    const HostCpu &GetWorkerCpu(int iWorker) const {
+        return vWorkers[iWorker]->cpu;
+    }
+
+    WorkerPoolStats GetStats() const {
+        WorkerPoolStats stats = {};
+        stats.nWorkers = (int)vWorkers.size();
+        stats.nSteals = nSteals.load(std::memory_order_relaxed);
+        for (int i = 0; i < WORKER_TASK_CLASS_COUNT; i++) {
+            const ClassCounters &c = aCounters[i];
+            WorkerTaskClassStats &s = stats.aClass[i];
+            s.nTasks = c.nTasks.load(std::memory_order_relaxed);
+            if (!s.nTasks) {
+                continue;
+            }
+            s.fQueueMeanMs = c.nQueueNs.load(std::memory_order_relaxed) * 1e-6 / s.nTasks;
+            s.fQueueMaxMs = c.nQueueMaxNs.load(std::memory_order_relaxed) * 1e-6;
+            s.fQueueP50Ms = GetPercentileNs(c, 0.5) * 1e-6;
+            s.fQueueP99Ms = GetPercentileNs(c, 0.99) * 1e-6;
+            s.fRunMeanMs = c.nRunNs.load(std::memory_order_relaxed) * 1e-6 / s.nTasks;
+            s.fRunMaxMs = c.nRunMaxNs.load(std::memory_order_relaxed) * 1e-6;
+        }
+        return stats;
+    }
+
+    void ResetStats() {
+        nSteals = 0;
+        for (ClassCounters &c : aCounters) {
+            c.nTasks = 0;
+            c.nQueueNs = c.nQueueMaxNs = c.nRunNs = c.nRunMaxNs = 0;
+            for (std::atomic<uint64_t> &n : c.anQueueHistogram) {
+                n = 0;
+            }
+        }
+    }
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        WORKER_TASK_CLASS eClass;
+        TimePoint tEnqueue;
+    };
+
+    struct Worker {
+        alignas(64) std::mutex mtx;
+        std::deque<Task> dqTasks;
+        std::vector<int> viVictim;
+        HostCpu cpu = {};
+        std::thread thread;
+    };
+
+    struct ClassCounters {
+        std::atomic<uint64_t> nTasks{0};
+        std::atomic<uint64_t> nQueueNs{0}, nQueueMaxNs{0}, nRunNs{0}, nRunMaxNs{0};
+        std::atomic<uint64_t> anQueueHistogram[WORKER_LATENCY_BUCKETS] = {};
+    };
+
+    struct CurrentWorker {
+        const WorkStealingPool *pPool = nullptr;
+        int iWorker = -1;
+    };
+
+    static CurrentWorker &GetCurrentWorkerSlot() {
+        static thread_local CurrentWorker current;
+        return current;
+    }
+
+    static int GetLatencyBucket(uint64_t nNs) {
+        if (nNs < 4) {
+            return (int)nNs;
+        }
+        int nMsb = (int)std::bit_width(nNs) - 1;
+        int iBucket = 4 * (nMsb - 1) + (int)((nNs >> (nMsb - 2)) & 3);
+        return iBucket < WORKER_LATENCY_BUCKETS ? iBucket : WORKER_LATENCY_BUCKETS - 1;
+    }
+
+    // Upper end of the bucket the given fraction of the tasks falls in, at most the maximum
+    static uint64_t GetPercentileNs(const ClassCounters &c, double fFraction) {
+        uint64_t nTotal = 0;
+        for (const std::atomic<uint64_t> &n : c.anQueueHistogram) {
+            nTotal += n.load(std::memory_order_relaxed);
+        }
+        uint64_t nRank = (uint64_t)(fFraction * nTotal), nSeen = 0;
+        for (int i = 0; i < WORKER_LATENCY_BUCKETS; i++) {
+            nSeen += c.anQueueHistogram[i].load(std::memory_order_relaxed);
+            if (nSeen > nRank) {
+                uint64_t nUpper = i < 4 ? (uint64_t)i + 1 : (uint64_t)(4 + (i & 3) + 1) << (i / 4 - 1);
+                uint64_t nMax = c.nQueueMaxNs.load(std::memory_order_relaxed);
+                return nUpper < nMax ? nUpper : nMax;
+            }
+        }
+        return c.nQueueMaxNs.load(std::memory_order_relaxed);
+    }
+
+    static void UpdateMax(std::atomic<uint64_t> &nMax, uint64_t n) {
+        uint64_t nOld = nMax.load(std::memory_order_relaxed);
+        while (n > nOld && !nMax.compare_exchange_weak(nOld, n, std::memory_order_relaxed)) {
+        }
+    }
+
+    void WorkerLoop(int iWorker) {
+        GetCurrentWorkerSlot() = {this, iWorker};
+        for (;;) {
+            if (RunOne(iWorker)) {
+                continue;
+            }
+            nSleeping.fetch_add(1);
+            uint32_t nEpoch = epoch.load();
+            // Work submitted after this scan changes the epoch, so the wait below returns at once
+            if (RunOne(iWorker)) {
+                nSleeping.fetch_sub(1);
+                continue;
+            }
+            if (bStop) {
+                nSleeping.fetch_sub(1);
+                return;
+            }
+            epoch.wait(nEpoch);
+            nSleeping.fetch_sub(1);
+        }
+    }
+
+    // Runs the oldest task of the worker's own deque, else one stolen from another worker
+    bool RunOne(int iWorker) {
+        Task task;
+        Worker &w = *vWorkers[iWorker];
+        bool bFound = false;
+        {
+            std::lock_guard<std::mutex> lock(w.mtx);
+            if (!w.dqTasks.empty()) {
+                task = std::move(w.dqTasks.front());
+                w.dqTasks.pop_front();
+                bFound = true;
+            }
+        }
+        for (size_t i = 0; !bFound && i < w.viVictim.size(); i++) {
+            Worker &victim = *vWorkers[w.viVictim[i]];
+            // The newest task, at the end the owner is not working on
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            if (!victim.dqTasks.empty()) {
+                task = std::move(victim.dqTasks.back());
+                victim.dqTasks.pop_back();
+                bFound = true;
+                nSteals.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (bFound) {
+            Execute(task);
+        }
+        return bFound;
+    }
+
+    static uint64_t GetNs(std::chrono::steady_clock::duration d) {
+        int64_t n = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        return n > 0 ? (uint64_t)n : 0;
+    }
+
+    void Execute(Task &task) {
+        // The queueing delay is recorded before the task runs, so a task that is waited for is already counted
+        TimePoint tStart = std::chrono::steady_clock::now();
+        uint64_t nQueueNs = GetNs(tStart - task.tEnqueue);
+        ClassCounters &c = aCounters[task.eClass];
+        c.nTasks.fetch_add(1, std::memory_order_relaxed);
+        c.nQueueNs.fetch_add(nQueueNs, std::memory_order_relaxed);
+        UpdateMax(c.nQueueMaxNs, nQueueNs);
+        c.anQueueHistogram[GetLatencyBucket(nQueueNs)].fetch_add(1, std::memory_order_relaxed);
+
+        try {
+            task.fn();
+        } catch (const std::exception &e) {
+            LOG(ERROR) << GetWorkerTaskClassName(task.eClass) << " task failed: " << e.what();
+        } catch (...) {
+            LOG(ERROR) << GetWorkerTaskClassName(task.eClass) << " task failed";
+        }
+
+        uint64_t nRunNs = GetNs(std::chrono::steady_clock::now() - tStart);
+        c.nRunNs.fetch_add(nRunNs, std::memory_order_relaxed);
+        UpdateMax(c.nRunMaxNs, nRunNs);
+    }
+
+    std::vector<std::unique_ptr<Worker>> vWorkers;
+    std::atomic<uint64_t> nNextWorker{0};
+    alignas(64) std::atomic<uint32_t> epoch{0};     /*!< Bumped by every submission; idle workers wait on it */
+    std::atomic<int> nSleeping{0};
+    std::atomic<bool> bStop{false};
+    std::atomic<uint64_t> nSteals{0};
+    ClassCounters aCounters[WORKER_TASK_CLASS_COUNT];
+};
+
+/**
+* @brief Runs the tasks posted to it one at a time, in order, on a WorkStealingPool. Holds no worker while it has
+* nothing to run. The queueing delay of a task counts from Post().
+*/
+class WorkerStrand {
+public:
+    WorkerStrand(WorkStealingPool &pool, WORKER_TASK_CLASS eClass = WORKER_TASK_GENERIC) : pool(pool), eClass(eClass) {}
+    WorkerStrand(const WorkerStrand &) = delete;
+    WorkerStrand &operator=(const WorkerStrand &) = delete;
+
+    ~WorkerStrand() {
+        Drain();
+    }
+
+    void Post(std::function<void()> fn) {
+        std::unique_lock<std::mutex> lock(mtx);
+        dqItems.push_back({std::move(fn), std::chrono::steady_clock::now()});
+        if (!bScheduled) {
+            bScheduled = true;
+            WorkStealingPool::TimePoint tPost = dqItems.front().tPost;
+            lock.unlock();
+            pool.Submit([this]() { RunNext(); }, eClass, tPost);
+        }
+    }
+
+    /**
+    *   @brief  Waits until every posted task ran. Not from a task of this strand.
+    */
+    void Drain() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cvIdle.wait(lock, [this]() { return !bScheduled; });
+    }
+
+    size_t GetQueueDepth() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return dqItems.size();
+    }
+
+private:
+    struct Item {
+        std::function<void()> fn;
+        WorkStealingPool::TimePoint tPost;
+    };
+
+    void RunNext() {
+        std::unique_lock<std::mutex> lock(mtx);
+        Item item = std::move(dqItems.front());
+        dqItems.pop_front();
+        lock.unlock();
+
+        try {
+            item.fn();
+        } catch (const std::exception &e) {
+            LOG(ERROR) << GetWorkerTaskClassName(eClass) << " strand task failed: " << e.what();
+        } catch (...) {
+            LOG(ERROR) << GetWorkerTaskClassName(eClass) << " strand task failed";
+        }
+
+        lock.lock();
+        if (dqItems.empty()) {
+            bScheduled = false;
+            cvIdle.notify_all();
+            return;
+        }
+        // One task per submission puts the strand at the back of the line, so busy sessions cannot starve the others
+        WorkStealingPool::TimePoint tPost = dqItems.front().tPost;
+        lock.unlock();
+        pool.Submit([this]() { RunNext(); }, eClass, tPost);
+    }
+
+    WorkStealingPool &pool;
+    WORKER_TASK_CLASS eClass;
+    std::mutex mtx;
+    std::condition_variable cvIdle;
+    std::deque<Item> dqItems;
+    bool bScheduled = false;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "nvcuvid.h"
+#include "HostColorConvert.h"
+
+//---------------------------------------------------------------------------
+//! \file YuvConverter.h
+//! \brief Host-side chroma interleaving of decoded 4:2:0 and 4:2:2 frames, built on the row
+//! kernels of HostColorConvert.h.
+//---------------------------------------------------------------------------
+
+/**
+* @brief Template class to facilitate color space conversion
+*/
+template<typename T>
+class YuvConverter {
+public:
+    YuvConverter(int nWidth, int nHeight, uint8_t nChromaFormat) :
+        nWidth(nWidth), nHeight(nHeight), nChromaFormat(nChromaFormat)
+    {
+        if (nChromaFormat == cudaVideoChromaFormat_420) {
+            pQuad = new T[((nWidth + 1) / 2) * ((nHeight + 1) / 2)];
+        } else {
+            pQuad = new T[((nWidth + 1) / 2) * nHeight];
+        }
+    }
+    ~YuvConverter() {
+        delete[] pQuad;
+    }
+    void PlanarToUVInterleaved(T *pFrame, int nPitch = 0) {
+        if (nPitch == 0) {
+            nPitch = nWidth;
+        }
+
+        // sizes of source surface plane
+        int nSizePlaneY = nPitch * nHeight;
+        int nSizePlaneU = ((nPitch + 1) / 2) * ((nHeight + 1) / 2);
+        int nSizePlaneV = nSizePlaneU;
+
+        T *puv = pFrame + nSizePlaneY;
+        if (nPitch == nWidth) {
+            memcpy(pQuad, puv, nSizePlaneU * sizeof(T));
+        } else {
+            for (int i = 0; i < (nHeight + 1) / 2; i++) {
+                memcpy(pQuad + ((nWidth + 1) / 2) * i, puv + ((nPitch + 1) / 2) * i, ((nWidth + 1) / 2) * sizeof(T));
+            }
+        }
+        T *pv = puv + nSizePlaneU;
+        for (int y = 0; y < (nHeight + 1) / 2; y++) {
+            InterleaveRow(pQuad + y * ((nWidth + 1) / 2), pv + y * ((nPitch + 1) / 2), puv + y * nPitch, (nWidth + 1) / 2);
+        }
+    }
+    void UVInterleavedToPlanar(T *pFrame, int nPitch = 0) {
+        if (nPitch == 0) {
+            nPitch = nWidth;
+        }
+
+        // sizes of source surface plane
+        int nSizePlaneY = nPitch * nHeight;
+        int nSizePlaneU = (nChromaFormat == cudaVideoChromaFormat_420) ? (((nPitch + 1) / 2) * ((nHeight + 1) / 2)) : (((nPitch + 1) / 2) * nHeight);
+        int nSizePlaneV = nSizePlaneU;
+
+        T *puv = pFrame + nSizePlaneY,
+            *pu = puv, 
+            *pv = puv + nSizePlaneU;
+
+        // split chroma from interleave to planar
+        int nChromaHeight = (nChromaFormat == cudaVideoChromaFormat_420) ? (nHeight + 1) / 2 : nHeight;
+        for (int y = 0; y < nChromaHeight; y++) {
+            DeinterleaveRow(puv + y * nPitch, pu + y * ((nPitch + 1) / 2), pQuad + y * ((nWidth + 1) / 2), (nWidth + 1) / 2);
+        }
+        if (nPitch == nWidth) {
+            memcpy(pv, pQuad, nSizePlaneV * sizeof(T));
+        } else {
+            for (int i = 0; i < nChromaHeight; i++) {
+                memcpy(pv + ((nPitch + 1) / 2) * i, pQuad + ((nWidth + 1) / 2) * i, ((nWidth + 1) / 2) * sizeof(T));
+            }
+        }
+    }
+
+private:
+    // Row kernels from HostColorConvert.h. In place, a destination row can overlap the source row it is built from; the
+    // kernels load each block before storing it and stores never overtake loads, as with the scalar loops they replaced
+    static void InterleaveRow(const uint8_t *pU, const uint8_t *pV, uint8_t *pUv, int n) {
+        GetHostColorKernels().InterleaveUv8(pU, pV, pUv, n);
+    }
+    static void InterleaveRow(const uint16_t *pU, const uint16_t *pV, uint16_t *pUv, int n) {
+        GetHostColorKernels().InterleaveUv16(pU, pV, pUv, n, 0);
+    }
+    static void DeinterleaveRow(const uint8_t *pUv, uint8_t *pU, uint8_t *pV, int n) {
+        GetHostColorKernels().DeinterleaveUv8(pUv, pU, pV, n);
+    }
+    static void DeinterleaveRow(const uint16_t *pUv, uint16_t *pU, uint16_t *pV, int n) {
+        GetHostColorKernels().DeinterleaveUv16(pUv, pU, pV, n, 0);
+    }
+
+    T *pQuad;
+    int nWidth, nHeight, nChromaFormat;
+};
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+}
+#include "AnnexBConverter.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file AnnexBBench.cpp
+//! \brief Converts synthetic avcC samples to Annex-B with AnnexBConverter and with the
+//! h264_mp4toannexb bitstream filter FFmpegDemuxer used before, and reports samples and GB
+//! per second for each. Both paths start from a fresh packet every sample, as after
+//! av_read_frame(), and must produce the same NAL units.
+//!
+//! Usage: AnnexBBench [samples] [average sample size] [GOP length] [iterations]
+//---------------------------------------------------------------------------
+
+static const uint8_t aSps[] = {0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78, 0x02, 0x27, 0xE5, 0x84, 0x00};
+static const uint8_t aPps[] = {0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0};
+
+struct Sample {
+    std::vector<uint8_t> vData;
+};
+
+// An IDR every nGop samples and one or two slices with random payload per sample, 4-byte lengths
+static std::vector<Sample> MakeSamples(int nSamples, size_t nAverageSize, int nGop) {
+    std::mt19937 rng(3);
+    std::vector<Sample> vSamples(nSamples);
+    for (int i = 0; i < nSamples; i++) {
+        bool bKey = i % nGop == 0;
+        int nSlices = 1 + rng() % 2;
+        size_t nSize = (bKey ? 4 : 1) * (nAverageSize / 2 + rng() % nAverageSize);
+        std::vector<uint8_t> &v = vSamples[i].vData;
+        for (int iSlice = 0; iSlice < nSlices; iSlice++) {
+            uint32_t nNal = (uint32_t)(nSize / nSlices);
+            v.insert(v.end(), {(uint8_t)(nNal >> 24), (uint8_t)(nNal >> 16), (uint8_t)(nNal >> 8), (uint8_t)nNal});
+            v.push_back(bKey ? 0x65 : 0x41);
+            // first_mb_in_slice is 0 only for the first slice, or the filter takes each slice for a new picture
+            v.push_back(iSlice == 0 ? 0x88 : 0x4A);
+            for (uint32_t j = 2; j < nNal; j++) {
+                v.push_back((uint8_t)(0x80 | rng()));
+            }
+        }
+    }
+    return vSamples;
+}
+
+static std::vector<uint8_t> MakeAvcC() {
+    std::vector<uint8_t> v = {1, aSps[1], aSps[2], aSps[3], 0xFF, 0xE1, 0, sizeof(aSps)};
+    v.insert(v.end(), aSps, aSps + sizeof(aSps));
+    v.insert(v.end(), {1, 0, sizeof(aPps)});
+    v.insert(v.end(), aPps, aPps + sizeof(aPps));
+    return v;
+}
+
+// The filter uses 3-byte start codes where the converter writes 4, so outputs are compared NAL by NAL
+static void AppendNalUnits(const uint8_t *pData, size_t nSize, std::vector<uint8_t> &vNalUnits) {
+    std::vector<NalUnit> vNal;
+    SplitNalUnits(pData, nSize, vNal, NAL_CODEC_H264);
+    for (const NalUnit &nal : vNal) {
+        vNalUnits.push_back(0xFF);
+        vNalUnits.insert(vNalUnits.end(), nal.pData, nal.pData + nal.nSize);
+    }
+}
+
+template<class Fn>
+static double TimeSeconds(int nIterations, const Fn &fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nIterations; i++) {
+        fn();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char **argv) {
+    int nSamples = argc > 1 ? atoi(argv[1]) : 3000;
+    size_t nAverageSize = argc > 2 ? (size_t)atoi(argv[2]) : 20000;
+    int nGop = argc > 3 ? atoi(argv[3]) : 60;
+    int nIterations = argc > 4 ? atoi(argv[4]) : 10;
+    std::vector<Sample> vSamples = MakeSamples(nSamples, nAverageSize, nGop);
+    std::vector<uint8_t> vExtradata = MakeAvcC();
+    size_t nBytes = 0;
+    for (const Sample &s : vSamples) {
+        nBytes += s.vData.size();
+    }
+    printf("%d samples, %.1f MB, GOP %d\n", nSamples, nBytes / 1e6, nGop);
+
+    AnnexBConverter converter;
+    if (!converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264)) {
+        return 1;
+    }
+    AVPacket *pkt = av_packet_alloc();
+    std::vector<uint8_t> vNative, vFilter;
+    bool bOk = true;
+    auto convertNative = [&](bool bCollect) {
+        for (const Sample &s : vSamples) {
+            ck(av_new_packet(pkt, (int)s.vData.size()));
+            memcpy(pkt->data, s.vData.data(), s.vData.size());
+            const uint8_t *pOut = NULL;
+            size_t nOut = 0;
+            bOk &= converter.ToAnnexB(pkt->data, pkt->size, &pOut, &nOut);
+            if (bCollect) {
+                AppendNalUnits(pOut, nOut, vNative);
+            }
+            av_packet_unref(pkt);
+        }
+    };
+
+    const AVBitStreamFilter *pFilter = av_bsf_get_by_name("h264_mp4toannexb");
+    AVBSFContext *bsfc = NULL;
+    if (!pFilter) {
+        LOG(ERROR) << "h264_mp4toannexb is not available";
+        return 1;
+    }
+    ck(av_bsf_alloc(pFilter, &bsfc));
+    bsfc->par_in->codec_type = AVMEDIA_TYPE_VIDEO;
+    bsfc->par_in->codec_id = AV_CODEC_ID_H264;
+    bsfc->par_in->extradata = (uint8_t *)av_mallocz(vExtradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+    memcpy(bsfc->par_in->extradata, vExtradata.data(), vExtradata.size());
+    bsfc->par_in->extradata_size = (int)vExtradata.size();
+    ck(av_bsf_init(bsfc));
+    auto convertFilter = [&](bool bCollect) {
+        for (const Sample &s : vSamples) {
+            ck(av_new_packet(pkt, (int)s.vData.size()));
+            memcpy(pkt->data, s.vData.data(), s.vData.size());
+            ck(av_bsf_send_packet(bsfc, pkt));
+            while (av_bsf_receive_packet(bsfc, pkt) == 0) {
+                if (bCollect) {
+                    AppendNalUnits(pkt->data, pkt->size, vFilter);
+                }
+                av_packet_unref(pkt);
+            }
+        }
+    };
+
+    convertNative(true);
+    convertFilter(true);
+    bOk &= vNative == vFilter;
+
+    double fNative = TimeSeconds(nIterations, [&]() { convertNative(false); });
+    double fFilter = TimeSeconds(nIterations, [&]() { convertFilter(false); });
+    double fSamples = (double)nSamples * nIterations;
+    printf("AnnexBConverter:  %10.0f samples/s %6.2f GB/s\n", fSamples / fNative, nBytes * nIterations / fNative / 1e9);
+    printf("h264_mp4toannexb: %10.0f samples/s %6.2f GB/s\n", fSamples / fFilter, nBytes * nIterations / fFilter / 1e9);
+    printf("speedup %.2fx%s\n", fFilter / fNative, bOk ? "" : ", OUTPUT MISMATCH");
+
+    av_bsf_free(&bsfc);
+    av_packet_free(&pkt);
+    return bOk ? 0 : 1;
+}
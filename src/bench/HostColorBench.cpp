@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "HostColorConvert.h"
+
+//---------------------------------------------------------------------------
+//! \file HostColorBench.cpp
+//! \brief Times the HostColorConvert.h row kernels of every instruction set this CPU has,
+//! single-threaded, and the frame-level functions with their automatic dispatch and
+//! threading. Each SIMD variant is first checked to match the scalar one bit for bit.
+//!
+//! Usage: HostColorBench [width] [height] [iterations]
+//---------------------------------------------------------------------------
+
+static double TimeMs(int nIterations, const std::function<void()> &fn) {
+    fn();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nIterations; i++) {
+        fn();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / nIterations;
+}
+
+struct BenchFrames {
+    int nWidth, nHeight, nChromaWidth, nChromaHeight;
+    std::vector<uint8_t> vBgra, vY, vU, vV, vUv, vBgraOut;
+    std::vector<uint16_t> vY16, vU16, vV16, vUv16;
+};
+
+// Runs every row kernel of k over the whole frame on the calling thread
+static void RunKernels(const HostColorKernels &k, BenchFrames &f, int iKernel) {
+    int nWidth = f.nWidth, nChromaWidth = f.nChromaWidth;
+    HostRgbToYuvCoeffs rgb2yuv = MakeHostRgbToYuvCoeffs(ColorSpaceStandard_BT709, false);
+    HostYuvToRgbCoeffs yuv2rgb = MakeHostYuvToRgbCoeffs(ColorSpaceStandard_BT709, false);
+    for (int y = 0; y < f.nChromaHeight; y++) {
+        size_t iC = (size_t)y * nChromaWidth, iUv = (size_t)y * nChromaWidth * 2;
+        switch (iKernel) {
+        case 0:
+            k.InterleaveUv8(&f.vU[iC], &f.vV[iC], &f.vUv[iUv], nChromaWidth);
+            break;
+        case 1:
+            k.DeinterleaveUv8(&f.vUv[iUv], &f.vU[iC], &f.vV[iC], nChromaWidth);
+            break;
+        case 2:
+            k.ShiftRow16(&f.vY16[2 * y * (size_t)nWidth], &f.vY16[2 * y * (size_t)nWidth], 2 * nWidth, 6);
+            k.InterleaveUv16(&f.vU16[iC], &f.vV16[iC], &f.vUv16[iUv], nChromaWidth, 6);
+            break;
+        case 3:
+            k.ShiftRow16(&f.vY16[2 * y * (size_t)nWidth], &f.vY16[2 * y * (size_t)nWidth], 2 * nWidth, -6);
+            k.DeinterleaveUv16(&f.vUv16[iUv], &f.vU16[iC], &f.vV16[iC], nChromaWidth, 6);
+            break;
+        case 4:
+            k.BgraToNv12Rows(&f.vBgra[2 * y * (size_t)nWidth * 4], &f.vBgra[(2 * y + 1) * (size_t)nWidth * 4], &f.vY[2 * y * (size_t)nWidth],
+                &f.vY[(2 * y + 1) * (size_t)nWidth], &f.vUv[iUv], nWidth, rgb2yuv);
+            break;
+        case 5:
+            k.Nv12ToBgraRow(&f.vY[2 * y * (size_t)nWidth], &f.vUv[iUv], &f.vBgraOut[2 * y * (size_t)nWidth * 4], nWidth, yuv2rgb);
+            k.Nv12ToBgraRow(&f.vY[(2 * y + 1) * (size_t)nWidth], &f.vUv[iUv], &f.vBgraOut[(2 * y + 1) * (size_t)nWidth * 4], nWidth, yuv2rgb);
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    BenchFrames f;
+    f.nWidth = argc > 1 ? atoi(argv[1]) & ~1 : 3840;
+    f.nHeight = argc > 2 ? atoi(argv[2]) & ~1 : 2160;
+    int nIterations = argc > 3 ? atoi(argv[3]) : 20;
+    f.nChromaWidth = f.nWidth / 2;
+    f.nChromaHeight = f.nHeight / 2;
+    size_t nPixels = (size_t)f.nWidth * f.nHeight, nChroma = nPixels / 4;
+    f.vBgra.resize(nPixels * 4);
+    f.vBgraOut.resize(nPixels * 4);
+    f.vY.resize(nPixels);
+    f.vU.resize(nChroma);
+    f.vV.resize(nChroma);
+    f.vUv.resize(nChroma * 2);
+    f.vY16.resize(nPixels);
+    f.vU16.resize(nChroma);
+    f.vV16.resize(nChroma);
+    f.vUv16.resize(nChroma * 2);
+    srand(1);
+    for (uint8_t &b : f.vBgra) {
+        b = (uint8_t)rand();
+    }
+    for (size_t i = 0; i < nChroma; i++) {
+        f.vU[i] = (uint8_t)rand();
+        f.vV[i] = (uint8_t)rand();
+        f.vU16[i] = (uint16_t)(rand() & 1023);
+        f.vV16[i] = (uint16_t)(rand() & 1023);
+    }
+
+    static const char *aszKernel[] = {"I420->NV12 chroma", "NV12->I420 chroma", "I010->P010", "P010->I010", "BGRA->NV12", "NV12->BGRA"};
+    const int nKernels = sizeof(aszKernel) / sizeof(aszKernel[0]);
+    HOST_SIMD_LEVEL eBest = DetectHostSimdLevel();
+    std::vector<HOST_SIMD_LEVEL> vLevel = {HOST_SIMD_SCALAR};
+    if (eBest == HOST_SIMD_NEON) {
+        vLevel.push_back(HOST_SIMD_NEON);
+    } else {
+        for (int i = HOST_SIMD_SSE41; i <= eBest; i++) {
+            vLevel.push_back((HOST_SIMD_LEVEL)i);
+        }
+    }
+    printf("%dx%d, best instruction set: %s\n", f.nWidth, f.nHeight, GetHostSimdLevelName(eBest));
+
+    bool bOk = true;
+    for (int iKernel = 0; iKernel < nKernels; iKernel++) {
+        // The 8-bit interleave runs before deinterleave and BGRA->NV12 before NV12->BGRA, so later kernels read fresh data
+        BenchFrames ref = f;
+        RunKernels(GetHostColorKernels(HOST_SIMD_SCALAR), ref, iKernel);
+        printf("%-18s", aszKernel[iKernel]);
+        for (HOST_SIMD_LEVEL eLevel : vLevel) {
+            BenchFrames out = f;
+            RunKernels(GetHostColorKernels(eLevel), out, iKernel);
+            bool bSame = out.vUv == ref.vUv && out.vU == ref.vU && out.vV == ref.vV && out.vY == ref.vY && out.vBgraOut == ref.vBgraOut
+                && out.vY16 == ref.vY16 && out.vUv16 == ref.vUv16 && out.vU16 == ref.vU16 && out.vV16 == ref.vV16;
+            bOk = bOk && bSame;
+            BenchFrames work = f;
+            double ms = TimeMs(nIterations, [&]() { RunKernels(GetHostColorKernels(eLevel), work, iKernel); });
+            printf("  %s %7.3f ms%s", GetHostSimdLevelName(eLevel), ms, bSame ? "" : " MISMATCH");
+        }
+        printf("\n");
+        f = ref;
+    }
+
+    printf("Frame functions (%s, %s):\n", GetHostSimdLevelName(eBest),
+        (int64_t)nPixels >= HOST_COLOR_MT_MIN_PIXELS ? "threaded" : "single thread");
+    printf("  I420ToNv12Host  %7.3f ms\n", TimeMs(nIterations, [&]() {
+        I420ToNv12Host(f.vY.data(), f.nWidth, f.vU.data(), f.vV.data(), f.nChromaWidth, f.vY.data(), f.nWidth, f.vUv.data(), f.nWidth,
+            f.nWidth, f.nHeight);
+    }));
+    printf("  Nv12ToI420Host  %7.3f ms\n", TimeMs(nIterations, [&]() {
+        Nv12ToI420Host(f.vY.data(), f.nWidth, f.vUv.data(), f.nWidth, f.vY.data(), f.nWidth, f.vU.data(), f.vV.data(), f.nChromaWidth,
+            f.nWidth, f.nHeight);
+    }));
+    printf("  BgraToNv12Host  %7.3f ms\n", TimeMs(nIterations, [&]() {
+        BgraToNv12Host(f.vBgra.data(), f.nWidth * 4, f.vY.data(), f.nWidth, f.vUv.data(), f.nWidth, f.nWidth, f.nHeight);
+    }));
+    printf("  Nv12ToBgraHost  %7.3f ms\n", TimeMs(nIterations, [&]() {
+        Nv12ToBgraHost(f.vY.data(), f.nWidth, f.vUv.data(), f.nWidth, f.vBgraOut.data(), f.nWidth * 4, f.nWidth, f.nHeight);
+    }));
+    return bOk ? 0 : 1;
+}
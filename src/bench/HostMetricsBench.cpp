@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "HostMetrics.h"
+
+//---------------------------------------------------------------------------
+//! \file HostMetricsBench.cpp
+//! \brief Times ComputeMetricsSumsHost() with the HostMetrics.h kernels of every
+//! instruction set this CPU has, on a noisy copy of a synthetic frame, after checking
+//! that each variant gives the same sums as the scalar one.
+//!
+//! Usage: HostMetricsBench [width] [height] [iterations]
+//---------------------------------------------------------------------------
+
+static double TimeMs(int nIterations, const std::function<void()> &fn) {
+    fn();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nIterations; i++) {
+        fn();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / nIterations;
+}
+
+static bool SameSums(const MetricsSums &a, const MetricsSums &b) {
+    return !memcmp(&a, &b, sizeof(MetricsSums));
+}
+
+// Smooth gradient with texture as the reference, and the same frame with small noise as the distorted one
+static void MakeFrames(METRICS_FORMAT eFormat, int nBitDepth, int nWidth, int nHeight, int nPitch, std::vector<uint8_t> &vRef,
+    std::vector<uint8_t> &vDis) {
+    bool b444 = eFormat == METRICS_FORMAT_YUV444 || eFormat == METRICS_FORMAT_YUV444P16;
+    size_t nSize = (size_t)nPitch * (b444 ? 3 * nHeight : nHeight + (nHeight + 1) / 2);
+    vRef.assign(nSize, 0);
+    vDis.assign(nSize, 0);
+    MetricsPlane aRef[3], aDis[3];
+    GetMetricsPlanes(eFormat, nBitDepth, vRef.data(), nPitch, nWidth, nHeight, aRef);
+    GetMetricsPlanes(eFormat, nBitDepth, vDis.data(), nPitch, nWidth, nHeight, aDis);
+    int nMax = (1 << nBitDepth) - 1;
+    for (int i = 0; i < 3; i++) {
+        const MetricsPlane &p = aRef[i];
+        for (int y = 0; y < p.nHeight; y++) {
+            for (int x = 0; x < p.nWidth; x++) {
+                int v = (x * 3 + y * 2 + (x * y) % 17 * 4 + i * 50) * nMax / 1024 % (nMax + 1);
+                int d = v + rand() % 9 - 4;
+                d = d < 0 ? 0 : (d > nMax ? nMax : d);
+                size_t nOffset = (size_t)y * p.nPitch + (size_t)x * p.nStep * p.nBytesPerSample;
+                uint8_t *pRef = (uint8_t *)aRef[i].p + nOffset, *pDis = (uint8_t *)aDis[i].p + nOffset;
+                if (p.nBytesPerSample == 1) {
+                    *pRef = (uint8_t)v;
+                    *pDis = (uint8_t)d;
+                } else {
+                    *(uint16_t *)pRef = (uint16_t)(v << p.nShift);
+                    *(uint16_t *)pDis = (uint16_t)(d << p.nShift);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int nWidth = argc > 1 ? atoi(argv[1]) : 3840;
+    int nHeight = argc > 2 ? atoi(argv[2]) : 2160;
+    int nIterations = argc > 3 ? atoi(argv[3]) : 5;
+    const uint32_t nFlags = METRICS_PSNR | METRICS_SSIM | METRICS_MS_SSIM;
+
+    HOST_SIMD_LEVEL eBest = DetectHostSimdLevel();
+    std::vector<HOST_SIMD_LEVEL> vLevel = {HOST_SIMD_SCALAR};
+    for (int i = HOST_SIMD_SSE41; eBest != HOST_SIMD_NEON && i <= eBest; i++) {
+        vLevel.push_back((HOST_SIMD_LEVEL)i);
+    }
+    printf("%dx%d, best instruction set: %s\n", nWidth, nHeight, GetHostSimdLevelName(eBest));
+
+    struct {
+        const char *szName;
+        METRICS_FORMAT eFormat;
+        int nBitDepth, nBytes;
+    } aCase[] = {{"NV12", METRICS_FORMAT_NV12, 8, 1}, {"P010", METRICS_FORMAT_P016, 10, 2}, {"YUV444", METRICS_FORMAT_YUV444, 8, 1}};
+
+    bool bOk = true;
+    for (auto &c : aCase) {
+        int nPitch = nWidth * c.nBytes;
+        std::vector<uint8_t> vRef, vDis;
+        MakeFrames(c.eFormat, c.nBitDepth, nWidth, nHeight, nPitch, vRef, vDis);
+        MetricsPlane aRef[3], aDis[3];
+        GetMetricsPlanes(c.eFormat, c.nBitDepth, vRef.data(), nPitch, nWidth, nHeight, aRef);
+        GetMetricsPlanes(c.eFormat, c.nBitDepth, vDis.data(), nPitch, nWidth, nHeight, aDis);
+
+        MetricsSums ref = ComputeMetricsSumsHost(GetHostMetricsKernels(HOST_SIMD_SCALAR), aRef, aDis, 3, c.nBitDepth, nFlags);
+        FrameMetrics m = MakeFrameMetrics(ref, aRef, 3, c.nBitDepth, nFlags);
+        printf("%-7s PSNR Y/U/V %.3f/%.3f/%.3f YUV %.3f, SSIM %.5f/%.5f/%.5f, MS-SSIM %.5f\n", c.szName, m.adPsnr[0], m.adPsnr[1],
+            m.adPsnr[2], m.dPsnrYuv, m.adSsim[0], m.adSsim[1], m.adSsim[2], m.dMsSsim);
+        printf("%-7s", "");
+        for (HOST_SIMD_LEVEL eLevel : vLevel) {
+            const HostMetricsKernels &k = GetHostMetricsKernels(eLevel);
+            bool bSame = SameSums(ComputeMetricsSumsHost(k, aRef, aDis, 3, c.nBitDepth, nFlags), ref);
+            bOk = bOk && bSame;
+            double ms = TimeMs(nIterations, [&]() { ComputeMetricsSumsHost(k, aRef, aDis, 3, c.nBitDepth, nFlags); });
+            printf("  %s %8.3f ms%s", GetHostSimdLevelName(eLevel), ms, bSame ? "" : " MISMATCH");
+        }
+        printf("\n");
+
+        FrameMetrics self = ComputeFrameMetricsHost(vRef.data(), nPitch, vRef.data(), nPitch, nWidth, nHeight, c.eFormat, c.nBitDepth, nFlags);
+        bool bSelf = self.adPsnr[0] == 100.0 && self.adSsim[0] == 1.0 && self.dMsSsim == 1.0;
+        bOk = bOk && bSelf;
+        if (!bSelf) {
+            printf("%-7s frame against itself: PSNR %f SSIM %f MS-SSIM %f\n", c.szName, self.adPsnr[0], self.adSsim[0], self.dMsSsim);
+        }
+    }
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "NalUnitSplitter.h"
+
+//---------------------------------------------------------------------------
+//! \file NalScanBench.cpp
+//! \brief Measures the start code scan of every instruction set this CPU has, and
+//! SplitNalUnits() with the one picked at run time, in GB/s on a synthetic Annex-B stream.
+//!
+//! Usage: NalScanBench [megabytes] [average NAL size] [iterations]
+//---------------------------------------------------------------------------
+
+// Random payload, which like real slice data rarely holds 00 00 0x, between 4-byte start codes
+static std::vector<uint8_t> MakeStream(size_t nBytes, size_t nAverageNal) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> vBuf(nBytes);
+    for (uint8_t &b : vBuf) {
+        b = (uint8_t)rng();
+    }
+    for (size_t i = 0; i + 5 < nBytes; i += 1 + rng() % (2 * nAverageNal)) {
+        vBuf[i] = vBuf[i + 1] = vBuf[i + 2] = 0;
+        vBuf[i + 3] = 1;
+        vBuf[i + 4] = 0x41;
+    }
+    return vBuf;
+}
+
+template<class Fn>
+static double TimeGbps(size_t nBytes, int nIterations, const Fn &fn) {
+    fn();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nIterations; i++) {
+        fn();
+    }
+    double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return (double)nBytes * nIterations / dSeconds / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t nBytes = (size_t)(argc > 1 ? atoi(argv[1]) : 64) << 20;
+    size_t nAverageNal = argc > 2 ? (size_t)atoi(argv[2]) : 4096;
+    int nIterations = argc > 3 ? atoi(argv[3]) : 10;
+    std::vector<uint8_t> vBuf = MakeStream(nBytes, nAverageNal);
+    const uint8_t *pBegin = vBuf.data(), *pEnd = pBegin + vBuf.size();
+
+    std::vector<HOST_SIMD_LEVEL> vLevel = GetNalStartCodeLevels();
+    printf("%zu MB, average NAL %zu bytes, best start code scanner: %s\n", nBytes >> 20, nAverageNal,
+        GetNalStartCodeScannerName(vLevel.back()));
+
+    bool bOk = true;
+    size_t nReference = 0;
+    for (HOST_SIMD_LEVEL eLevel : vLevel) {
+        NalStartCodeScanner pfnScan = GetNalStartCodeScanner(eLevel);
+        size_t nFound = 0;
+        double dGbps = TimeGbps(nBytes, nIterations, [&]() {
+            nFound = 0;
+            for (const uint8_t *p = pfnScan(pBegin, pEnd); p < pEnd; p = pfnScan(p + 3, pEnd)) {
+                nFound++;
+            }
+        });
+        if (eLevel == HOST_SIMD_SCALAR) {
+            nReference = nFound;
+        }
+        bOk = bOk && nFound == nReference;
+        printf("  scan %-7s %7.2f GB/s, %zu start codes%s\n", GetNalStartCodeScannerName(eLevel), dGbps, nFound,
+            nFound == nReference ? "" : " MISMATCH");
+    }
+
+    std::vector<NalUnit> vNal;
+    vNal.reserve(nReference);
+    double dGbps = TimeGbps(nBytes, nIterations, [&]() { SplitNalUnits(pBegin, vBuf.size(), vNal, NAL_CODEC_H264); });
+    printf("  SplitNalUnits %7.2f GB/s, %zu NAL units\n", dGbps, vNal.size());
+    return bOk ? 0 : 1;
+}
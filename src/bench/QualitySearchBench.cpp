@@ -0,0 +1,62 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "QualitySearchStubs.h"
+
+//---------------------------------------------------------------------------
+//! \file QualitySearchBench.cpp
+//! \brief Runs QualityParamSearch against a stub encoder whose quality follows a synthetic
+//! QP model with drifting content and scene cuts, and compares the iterations per frame
+//! of the fixed-step search with the secant one.
+//!
+//! Usage: QualitySearchBench [frames] [min quality] [max quality] [max iterations]
+//---------------------------------------------------------------------------
+
+// Mean distance of the kept encodes from the centre of the window
+static double GetMeanError(const std::vector<double> &vKeptQuality, const QualitySearchConfig &config) {
+    double dErrorSum = 0, dTarget = 0.5 * (config.dMinQuality + config.dMaxQuality);
+    for (double dQuality : vKeptQuality) {
+        dErrorSum += fabs(dQuality - dTarget);
+    }
+    return vKeptQuality.empty() ? 0.0 : dErrorSum / vKeptQuality.size();
+}
+
+static void PrintStats(const char *szName, const QualitySearchStats &stats, double dMeanError, int nMaxIterations) {
+    printf("%-14s %6.3f iterations/frame, %5.1f%% in window, mean error %.3f dB, frames by iterations:", szName,
+        stats.GetIterationsPerFrame(), stats.nFrames ? 100.0 * stats.nFramesInWindow / stats.nFrames : 0.0, dMeanError);
+    for (int i = 1; i <= nMaxIterations && i <= QUALITY_SEARCH_MAX_ITERATIONS; i++) {
+        printf(" %llu", (unsigned long long)stats.anFramesByIterations[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    int nFrames = argc > 1 ? atoi(argv[1]) : 3000;
+    QualitySearchConfig config;
+    config.dMinQuality = argc > 2 ? atof(argv[2]) : 38.0;
+    config.dMaxQuality = argc > 3 ? atof(argv[3]) : 39.0;
+    config.nMaxIterations = argc > 4 ? atoi(argv[4]) : 6;
+    StubQualityEncoder encoder(nFrames, 1234);
+
+    struct {
+        const char *szName;
+        QUALITY_SEARCH_MODE eMode;
+        int nStep;
+    } aCase[] = {{"fixed step 1", QUALITY_SEARCH_FIXED_STEP, 1}, {"fixed step 2", QUALITY_SEARCH_FIXED_STEP, 2},
+        {"secant", QUALITY_SEARCH_SECANT, 1}};
+
+    QualitySearchStats aStats[3];
+    for (int i = 0; i < 3; i++) {
+        config.eMode = aCase[i].eMode;
+        config.nStep = aCase[i].nStep;
+        std::vector<double> vKeptQuality;
+        aStats[i] = RunQualitySearch(encoder, config, 30, vKeptQuality);
+        PrintStats(aCase[i].szName, aStats[i], GetMeanError(vKeptQuality, config), config.nMaxIterations);
+    }
+
+    // The secant search must not take more iterations than the original search nor hit the window less often
+    const QualitySearchStats &fixed = aStats[0], &secant = aStats[2];
+    bool bOk = secant.GetIterationsPerFrame() <= fixed.GetIterationsPerFrame() && secant.nFramesInWindow >= fixed.nFramesInWindow;
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#include <cuda_runtime.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "ScaleLadder.h"
+
+//---------------------------------------------------------------------------
+//! \file ResizeLadderBench.cpp
+//! \brief Times ResizeNv12Ladder() against one ResizeNv12() per rendition and checks the
+//! ladder against ResizeNv12LadderHost().
+//!
+//! Usage: ResizeLadderBench [source width] [source height] [iterations]
+//---------------------------------------------------------------------------
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+static const char *aszFilter[] = {"nearest", "bilinear", "box"};
+
+static float TimeMs(cudaEvent_t start, cudaEvent_t stop) {
+    float ms = 0.0f;
+    ck(cudaEventElapsedTime(&ms, start, stop));
+    return ms;
+}
+
+int main(int argc, char **argv) {
+    int nSrcWidth = argc > 1 ? atoi(argv[1]) : 1920;
+    int nSrcHeight = argc > 2 ? atoi(argv[2]) : 1080;
+    int nIterations = argc > 3 ? atoi(argv[3]) : 200;
+    const int anLadder[][2] = {{1280, 720}, {960, 540}, {768, 432}, {640, 360}, {480, 270}, {320, 180}};
+    const int nRungs = sizeof(anLadder) / sizeof(anLadder[0]);
+
+    // Diagonal luma ramp with slowly varying chroma, so every filter has something to average
+    int nSrcPitch = nSrcWidth;
+    std::vector<uint8_t> vSrc((size_t)nSrcPitch * nSrcHeight * 3 / 2);
+    for (int y = 0; y < nSrcHeight; y++) {
+        for (int x = 0; x < nSrcWidth; x++) {
+            vSrc[(size_t)y * nSrcPitch + x] = (uint8_t)(16 + (x + y) * 7 % 220);
+        }
+    }
+    for (int y = 0; y < nSrcHeight / 2; y++) {
+        for (int x = 0; x < nSrcWidth / 2; x++) {
+            uint8_t *p = &vSrc[(size_t)(nSrcHeight + y) * nSrcPitch + x * 2];
+            p[0] = (uint8_t)(64 + x % 128);
+            p[1] = (uint8_t)(64 + y % 128);
+        }
+    }
+
+    uint8_t *dpSrc = NULL;
+    ck(cudaMalloc(&dpSrc, vSrc.size()));
+    ck(cudaMemcpy(dpSrc, vSrc.data(), vSrc.size(), cudaMemcpyHostToDevice));
+
+    std::vector<ScaleLadderRung> vRung(nRungs), vHostRung(nRungs);
+    std::vector<std::vector<uint8_t>> vvHost(nRungs), vvDevice(nRungs);
+    for (int r = 0; r < nRungs; r++) {
+        int nWidth = anLadder[r][0], nHeight = anLadder[r][1];
+        size_t nSize = (size_t)nWidth * nHeight * 3 / 2;
+        uint8_t *dpDst = NULL;
+        ck(cudaMalloc(&dpDst, nSize));
+        vRung[r] = {dpDst, NULL, nWidth, nWidth, nHeight};
+        vvHost[r].resize(nSize);
+        vvDevice[r].resize(nSize);
+        vHostRung[r] = {vvHost[r].data(), NULL, nWidth, nWidth, nHeight};
+    }
+
+    bool bOk = true;
+    for (int f = SCALE_FILTER_NEAREST; f <= SCALE_FILTER_BOX; f++) {
+        ResizeNv12Ladder(dpSrc, nSrcPitch, nSrcWidth, nSrcHeight, vRung.data(), nRungs, (SCALE_FILTER)f);
+        ResizeNv12LadderHost(vSrc.data(), nSrcPitch, nSrcWidth, nSrcHeight, vHostRung.data(), nRungs, (SCALE_FILTER)f);
+        int nMaxDiff = 0;
+        for (int r = 0; r < nRungs; r++) {
+            ck(cudaMemcpy(vvDevice[r].data(), vRung[r].dpDst, vvDevice[r].size(), cudaMemcpyDeviceToHost));
+            for (size_t i = 0; i < vvHost[r].size(); i++) {
+                int nDiff = abs((int)vvHost[r][i] - (int)vvDevice[r][i]);
+                nMaxDiff = nDiff > nMaxDiff ? nDiff : nMaxDiff;
+            }
+        }
+        // Contracted multiply-adds on the device may move a value across a rounding boundary
+        printf("%-8s max difference to CPU reference: %d\n", aszFilter[f], nMaxDiff);
+        bOk = bOk && nMaxDiff <= 1;
+    }
+
+    cudaStream_t stream;
+    cudaEvent_t start, stop;
+    ck(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+    ck(cudaEventCreate(&start));
+    ck(cudaEventCreate(&stop));
+
+    // ResizeNv12() runs on the default stream and sets up its textures on every call
+    ck(cudaEventRecord(start, 0));
+    for (int i = 0; i < nIterations; i++) {
+        for (int r = 0; r < nRungs; r++) {
+            ResizeNv12(vRung[r].dpDst, vRung[r].nPitch, vRung[r].nWidth, vRung[r].nHeight, dpSrc, nSrcPitch, nSrcWidth, nSrcHeight);
+        }
+    }
+    ck(cudaEventRecord(stop, 0));
+    ck(cudaEventSynchronize(stop));
+    float msSeparate = TimeMs(start, stop) / nIterations;
+
+    Nv12TextureCache cache;
+    for (int f = SCALE_FILTER_NEAREST; f <= SCALE_FILTER_BOX; f++) {
+        ck(cudaEventRecord(start, stream));
+        for (int i = 0; i < nIterations; i++) {
+            ResizeNv12Ladder(dpSrc, nSrcPitch, nSrcWidth, nSrcHeight, vRung.data(), nRungs, (SCALE_FILTER)f, &cache, stream);
+        }
+        ck(cudaEventRecord(stop, stream));
+        ck(cudaEventSynchronize(stop));
+        printf("%dx%d -> %d rungs: ladder %-8s %.3f ms/frame\n", nSrcWidth, nSrcHeight, nRungs, aszFilter[f],
+            TimeMs(start, stop) / nIterations);
+    }
+    printf("%dx%d -> %d rungs: ResizeNv12 x%d    %.3f ms/frame\n", nSrcWidth, nSrcHeight, nRungs, nRungs, msSeparate);
+
+    cache.Clear();
+    ck(cudaEventDestroy(start));
+    ck(cudaEventDestroy(stop));
+    ck(cudaStreamDestroy(stream));
+    for (ScaleLadderRung &rung : vRung) {
+        ck(cudaFree(rung.dpDst));
+    }
+    ck(cudaFree(dpSrc));
+    return bOk ? 0 : 1;
+}
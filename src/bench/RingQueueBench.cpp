@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "NvCodecUtils.h"
+
+//---------------------------------------------------------------------------
+//! \file RingQueueBench.cpp
+//! \brief Moves integers from producer threads to consumer threads through ConcurrentQueue,
+//! SpscRingQueue and MpmcRingQueue, blocking and spinning, and reports millions of items
+//! per second. Every run checks that each item arrived exactly once by count and sum.
+//!
+//! Usage: RingQueueBench [items] [capacity]
+//---------------------------------------------------------------------------
+
+struct QueueOps {
+    std::function<void(int64_t)> push;
+    std::function<bool(int64_t &)> pop;        /*!< false once the producers are done and the queue is drained */
+    std::function<void(int)> close;            /*!< Called once all producers finished, with the number of consumers */
+};
+
+// Returns millions of items per second, or a negative value if items were lost or duplicated
+static double RunCase(int nProducers, int nConsumers, int64_t nItems, const QueueOps &ops) {
+    std::atomic<int64_t> nCount{0}, nSum{0};
+    std::vector<std::thread> vProducer, vConsumer;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < nConsumers; i++) {
+        vConsumer.emplace_back([&]() {
+            int64_t v = 0, n = 0, nLocalSum = 0;
+            while (ops.pop(v)) {
+                n++;
+                nLocalSum += v;
+            }
+            nCount += n;
+            nSum += nLocalSum;
+        });
+    }
+    for (int i = 0; i < nProducers; i++) {
+        vProducer.emplace_back([&, i]() {
+            for (int64_t v = i; v < nItems; v += nProducers) {
+                ops.push(v);
+            }
+        });
+    }
+    for (auto &t : vProducer) {
+        t.join();
+    }
+    ops.close(nConsumers);
+    for (auto &t : vConsumer) {
+        t.join();
+    }
+    double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    bool bOk = nCount == nItems && nSum == nItems * (nItems - 1) / 2;
+    return bOk ? nItems / dSeconds / 1e6 : -1.0;
+}
+
+int main(int argc, char **argv) {
+    int64_t nItems = argc > 1 ? atoll(argv[1]) : 1 << 20;
+    size_t nCapacity = argc > 2 ? (size_t)atoll(argv[2]) : 1024;
+    printf("%lld items, capacity %zu, %u hardware threads\n", (long long)nItems, nCapacity, std::thread::hardware_concurrency());
+
+    int aaThreads[][2] = {{1, 1}, {1, 4}, {4, 1}, {2, 2}, {4, 4}};
+    bool bOk = true;
+    for (auto &threads : aaThreads) {
+        int nProducers = threads[0], nConsumers = threads[1];
+        printf("%d producer(s), %d consumer(s):", nProducers, nConsumers);
+
+        auto report = [&](const char *szName, double dMops) {
+            bOk = bOk && dMops >= 0;
+            if (dMops >= 0) {
+                printf("  %s %.2f", szName, dMops);
+            } else {
+                printf("  %s LOST ITEMS", szName);
+            }
+            fflush(stdout);
+        };
+
+        {
+            // The existing queue has no close, so each consumer gets a negative item as end marker
+            ConcurrentQueue<int64_t> q(nCapacity);
+            QueueOps ops;
+            ops.push = [&](int64_t v) { q.push_back(v); };
+            ops.pop = [&](int64_t &v) {
+                v = q.pop_front();
+                return v >= 0;
+            };
+            ops.close = [&](int n) {
+                for (int i = 0; i < n; i++) {
+                    q.push_back(-1);
+                }
+            };
+            report("ConcurrentQueue", RunCase(nProducers, nConsumers, nItems, ops));
+        }
+        if (nProducers == 1 && nConsumers == 1) {
+            SpscRingQueue<int64_t> q(nCapacity);
+            QueueOps ops;
+            ops.close = [&](int) { q.Close(); };
+            ops.push = [&](int64_t v) { q.Push(std::move(v)); };
+            ops.pop = [&](int64_t &v) { return q.Pop(v); };
+            report("Spsc", RunCase(1, 1, nItems, ops));
+        }
+        if (nProducers == 1 && nConsumers == 1) {
+            SpscRingQueue<int64_t> q(nCapacity);
+            QueueOps ops;
+            ops.close = [&](int) { q.Close(); };
+            ops.push = [&](int64_t v) { q.PushSpin(std::move(v)); };
+            ops.pop = [&](int64_t &v) { return q.PopSpin(v); };
+            report("SpscSpin", RunCase(1, 1, nItems, ops));
+        }
+        {
+            MpmcRingQueue<int64_t> q(nCapacity);
+            QueueOps ops;
+            ops.close = [&](int) { q.Close(); };
+            ops.push = [&](int64_t v) { q.Push(std::move(v)); };
+            ops.pop = [&](int64_t &v) { return q.Pop(v); };
+            report("Mpmc", RunCase(nProducers, nConsumers, nItems, ops));
+        }
+        {
+            MpmcRingQueue<int64_t> q(nCapacity);
+            QueueOps ops;
+            ops.close = [&](int) { q.Close(); };
+            ops.push = [&](int64_t v) { q.PushSpin(std::move(v)); };
+            ops.pop = [&](int64_t &v) { return q.PopSpin(v); };
+            report("MpmcSpin", RunCase(nProducers, nConsumers, nItems, ops));
+        }
+        printf("  (Mitems/s)\n");
+    }
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "WorkStealingPool.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file WorkerPoolBench.cpp
+//! \brief Runs many sessions of a decode -> metrics -> mux pipeline with stand-in CPU work,
+//! once with a thread per stage and session talking through SpscRingQueue, and once on a
+//! WorkStealingPool with a WorkerStrand per stage and session. Reports frames per second,
+//! the number of threads and, for the pool, the queueing delay of every task class. Both
+//! runs must produce the same checksum.
+//!
+//! Usage: WorkerPoolBench [sessions] [frames] [work per frame] [workers]
+//---------------------------------------------------------------------------
+
+// Stand-in for the CPU side of a stage; nWork of 1000 is a few microseconds
+static uint64_t Work(uint64_t nSeed, int nWork) {
+    uint64_t x = nSeed;
+    for (int i = 0; i < nWork; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        x ^= x >> 29;
+    }
+    return x;
+}
+
+struct PipelineConfig {
+    int nSessions, nFrames, nWork;
+};
+
+// Relative cost of the stages
+static const int anStageWork[3] = {4, 2, 1};
+
+static uint64_t RunThreads(const PipelineConfig &cfg) {
+    std::atomic<uint64_t> nChecksum{0};
+    std::vector<std::unique_ptr<SpscRingQueue<int>>> vQueues;
+    std::vector<std::thread> vThreads;
+    for (int s = 0; s < cfg.nSessions; s++) {
+        vQueues.emplace_back(new SpscRingQueue<int>(4));
+        vQueues.emplace_back(new SpscRingQueue<int>(4));
+        SpscRingQueue<int> &qDecoded = *vQueues[vQueues.size() - 2], &qMeasured = *vQueues.back();
+        vThreads.emplace_back([&, s]() {
+            for (int i = 0; i < cfg.nFrames; i++) {
+                nChecksum += Work(s * 1000003ull + i, anStageWork[0] * cfg.nWork);
+                qDecoded.Push(int(i));
+            }
+            qDecoded.Close();
+        });
+        vThreads.emplace_back([&, s]() {
+            int i = 0;
+            while (qDecoded.Pop(i)) {
+                nChecksum += Work(s * 1000003ull + i + 1, anStageWork[1] * cfg.nWork);
+                qMeasured.Push(int(i));
+            }
+            qMeasured.Close();
+        });
+        vThreads.emplace_back([&, s]() {
+            int i = 0;
+            while (qMeasured.Pop(i)) {
+                nChecksum += Work(s * 1000003ull + i + 2, anStageWork[2] * cfg.nWork);
+            }
+        });
+    }
+    for (std::thread &t : vThreads) {
+        t.join();
+    }
+    return nChecksum;
+}
+
+struct PoolSession {
+    PoolSession(WorkStealingPool &pool) : decode(pool, WORKER_TASK_DECODE), metrics(pool, WORKER_TASK_METRICS), mux(pool, WORKER_TASK_MUX) {}
+    WorkerStrand decode, metrics, mux;
+};
+
+static uint64_t RunPool(const PipelineConfig &cfg, WorkStealingPool &pool) {
+    std::atomic<uint64_t> nChecksum{0};
+    std::vector<std::unique_ptr<PoolSession>> vSessions;
+    for (int s = 0; s < cfg.nSessions; s++) {
+        vSessions.emplace_back(new PoolSession(pool));
+    }
+
+    // Each decode task queues the next one, like a decoder fed by a demuxer, and hands its frame on
+    std::function<void(int, int)> decode = [&](int s, int i) {
+        nChecksum += Work(s * 1000003ull + i, anStageWork[0] * cfg.nWork);
+        PoolSession &session = *vSessions[s];
+        session.metrics.Post([&, s, i]() {
+            nChecksum += Work(s * 1000003ull + i + 1, anStageWork[1] * cfg.nWork);
+            vSessions[s]->mux.Post([&, s, i]() { nChecksum += Work(s * 1000003ull + i + 2, anStageWork[2] * cfg.nWork); });
+        });
+        if (i + 1 < cfg.nFrames) {
+            session.decode.Post([&, s, i]() { decode(s, i + 1); });
+        }
+    };
+    for (int s = 0; s < cfg.nSessions; s++) {
+        vSessions[s]->decode.Post([&, s]() { decode(s, 0); });
+    }
+    // Later stages only get work from earlier ones, so draining in stage order waits for everything
+    for (auto &session : vSessions) {
+        session->decode.Drain();
+    }
+    for (auto &session : vSessions) {
+        session->metrics.Drain();
+    }
+    for (auto &session : vSessions) {
+        session->mux.Drain();
+    }
+    return nChecksum;
+}
+
+template<class Fn>
+static double TimeSeconds(const Fn &fn) {
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char **argv) {
+    PipelineConfig cfg;
+    cfg.nSessions = argc > 1 ? atoi(argv[1]) : 200;
+    cfg.nFrames = argc > 2 ? atoi(argv[2]) : 100;
+    cfg.nWork = argc > 3 ? atoi(argv[3]) : 1000;
+    WorkerPoolConfig poolConfig;
+    poolConfig.nWorkers = argc > 4 ? atoi(argv[4]) : 0;
+    double fFrames = (double)cfg.nSessions * cfg.nFrames;
+
+    uint64_t nThreadSum = 0, nPoolSum = 0;
+    double fThreadSeconds = TimeSeconds([&]() { nThreadSum = RunThreads(cfg); });
+    printf("%d sessions x %d frames, %u hardware threads\n", cfg.nSessions, cfg.nFrames, std::thread::hardware_concurrency());
+    printf("thread per stage: %6d threads %10.0f frames/s\n", 3 * cfg.nSessions, fFrames / fThreadSeconds);
+
+    WorkStealingPool pool(poolConfig);
+    double fPoolSeconds = TimeSeconds([&]() { nPoolSum = RunPool(cfg, pool); });
+    WorkerPoolStats stats = pool.GetStats();
+    printf("work stealing:    %6d threads %10.0f frames/s, %llu steals\n", stats.nWorkers, fFrames / fPoolSeconds,
+        (unsigned long long)stats.nSteals);
+    for (int i = 0; i < WORKER_TASK_CLASS_COUNT; i++) {
+        const WorkerTaskClassStats &c = stats.aClass[i];
+        if (c.nTasks) {
+            printf("  %-8s %8llu tasks, queueing mean %.3f p50 %.3f p99 %.3f max %.3f ms, run mean %.3f ms\n",
+                GetWorkerTaskClassName((WORKER_TASK_CLASS)i), (unsigned long long)c.nTasks, c.fQueueMeanMs, c.fQueueP50Ms,
+                c.fQueueP99Ms, c.fQueueMaxMs, c.fRunMeanMs);
+        }
+    }
+
+    bool bOk = nThreadSum == nPoolSum && stats.aClass[WORKER_TASK_MUX].nTasks == (uint64_t)fFrames;
+    if (!bOk) {
+        printf("Checksum mismatch: %llx vs %llx\n", (unsigned long long)nThreadSum, (unsigned long long)nPoolSum);
+    }
+    return bOk ? 0 : 1;
+}
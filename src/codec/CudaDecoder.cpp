@@ -40,6 +40,9 @@ bool CudaDecoder::Initialize(const CreateParams& params)
             case CODEC_TYPE_H265:
                 codec = cudaVideoCodec_HEVC;
                 break;
+            case CODEC_TYPE_AV1:
+                codec = cudaVideoCodec_AV1;
+                break;
             default:
                 codec = cudaVideoCodec_H264; // Default fallback
                 break;
@@ -1,6 +1,7 @@
 #include "codecImpl.h"
 
 #include "NvEncoder/NvEncoderCuda.h"
+#include "Utils/ColorSpace.h"
 #include "Utils/NvCodecUtils.h"
 
 #include "helper.h"
@@ -14,7 +15,7 @@
 namespace cdc
 {
 
-CudaEncoder::CudaEncoder() : m_encoder(nullptr), m_initialized(false) {}
+CudaEncoder::CudaEncoder() : m_encoder(nullptr), m_initialized(false), m_stream(nullptr) {}
 
 CudaEncoder::~CudaEncoder()
 {
@@ -32,8 +33,33 @@ bool CudaEncoder::Initialize(const CreateParams& params)
 
     try
     {
+        // RGBA8/BGRA8 frames are converted to YUV on the way into NVENC's input buffer, which halves (NV12) the
+        // input buffer size compared to packed RGB and keeps NVENC's own colour conversion out of the loop
+        NV_ENC_BUFFER_FORMAT bufferFormat = to_nvEncFormat(params.pixelFormat);
+        if (is_rgbConvertedFormat(params.pixelFormat))
+        {
+            bufferFormat = params.yuv444 ? NV_ENC_BUFFER_FORMAT_YUV444 : NV_ENC_BUFFER_FORMAT_NV12;
+        }
+
         CUcontext cuContext = reinterpret_cast<CUcontext>(params.device);
-        m_encoder           = new NvEncoderCuda(cuContext, params.width, params.height, to_nvEncFormat(params.pixelFormat));
+        m_encoder           = new NvEncoderCuda(cuContext, params.width, params.height, bufferFormat);
+
+        if (is_rgbConvertedFormat(params.pixelFormat))
+        {
+            CUresult result = cuCtxPushCurrent(cuContext);
+            if (result == CUDA_SUCCESS)
+            {
+                result = cuStreamCreate(&m_stream, CU_STREAM_NON_BLOCKING);
+                cuCtxPopCurrent(nullptr);
+            }
+            if (result != CUDA_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create conversion stream");
+            }
+        }
+
+        // Packets carry the raw bitstream (OBUs for AV1); IVF framing is left to IVFWriter
+        m_encoder->SetUseIVFContainer(false);
 
         // Setup encoding parameters
         NV_ENC_INITIALIZE_PARAMS initializeParams = {NV_ENC_INITIALIZE_PARAMS_VER};
@@ -42,6 +68,19 @@ bool CudaEncoder::Initialize(const CreateParams& params)
         initializeParams.encodeConfig = &encodeConfig;
         m_encoder->CreateDefaultEncoderParams(&initializeParams, NV_ENC_CODEC_H264_GUID, NV_ENC_PRESET_P4_GUID);
 
+        if (is_rgbConvertedFormat(params.pixelFormat))
+        {
+            // Signal the matrix and range the input was converted with so decoders convert back correctly
+            NV_ENC_CONFIG_H264_VUI_PARAMETERS& vui = encodeConfig.encodeCodecConfig.h264Config.h264VUIParameters;
+            vui.videoSignalTypePresentFlag         = 1;
+            vui.videoFormat                        = NV_ENC_VUI_VIDEO_FORMAT_UNSPECIFIED;
+            vui.videoFullRangeFlag                 = params.fullRange ? 1 : 0;
+            vui.colourDescriptionPresentFlag       = 1;
+            vui.colourMatrix                       = to_nvEncVuiMatrix(params.colorMatrix);
+            vui.colourPrimaries                    = NV_ENC_VUI_COLOR_PRIMARIES_UNSPECIFIED;
+            vui.transferCharacteristics            = NV_ENC_VUI_TRANSFER_CHARACTERISTIC_UNSPECIFIED;
+        }
+
         // Initialize encoder
         m_encoder->CreateEncoder(&initializeParams);
         m_initialized = true;
@@ -64,6 +103,19 @@ bool CudaEncoder::EncodeFrame(void* pData, CodecPacket& packet)
     try
     {
         CUdeviceptr pDevidePtr = reinterpret_cast<CUdeviceptr>(pData);
+        CUcontext   cuContext  = reinterpret_cast<CUcontext>(m_params.device);
+
+        const NvEncInputFrame* input = m_encoder->GetNextInputFrame();
+        if (is_rgbConvertedFormat(m_params.pixelFormat))
+        {
+            ConvertRgbInput(cuContext, reinterpret_cast<uint8_t*>(pDevidePtr), input);
+        }
+        else
+        {
+            NvEncoderCuda::CopyToDeviceFrame(cuContext, pData, 0, reinterpret_cast<CUdeviceptr>(input->inputPtr), input->pitch,
+                                             m_params.width, m_params.height, CU_MEMORYTYPE_DEVICE, input->bufferFormat,
+                                             input->chromaOffsets, input->numChromaPlanes);
+        }
 
         // Use the correct NvEncoder function signature
         std::vector<NvEncOutputFrame> vPacket;
@@ -124,6 +176,48 @@ bool CudaEncoder::Flush(CodecPacket& packet)
     }
 }
 
+void CudaEncoder::ConvertRgbInput(CUcontext cuContext, uint8_t* src, const NvEncInputFrame* input)
+{
+    uint8_t* dst       = static_cast<uint8_t*>(input->inputPtr);
+    int      srcPitch  = static_cast<int>(m_params.width) * 4;
+    int      dstPitch  = static_cast<int>(input->pitch);
+    int      width     = static_cast<int>(m_params.width);
+    int      height    = static_cast<int>(m_params.height);
+    int      matrix    = to_colorSpaceStandard(m_params.colorMatrix);
+    bool     fullRange = m_params.fullRange;
+    bool     bgra      = m_params.pixelFormat == PIXEL_FORMAT_BGRA8;
+
+    CUresult result = cuCtxPushCurrent(cuContext);
+    if (result != CUDA_SUCCESS)
+    {
+        throw std::runtime_error("cuCtxPushCurrent failed");
+    }
+
+    if (input->bufferFormat == NV_ENC_BUFFER_FORMAT_YUV444)
+    {
+        if (bgra)
+            Color32ToYuv444<BGRA32>(src, srcPitch, dst, dstPitch, width, height, matrix, fullRange, m_stream);
+        else
+            Color32ToYuv444<RGBA32>(src, srcPitch, dst, dstPitch, width, height, matrix, fullRange, m_stream);
+    }
+    else
+    {
+        uint8_t* dstUV = dst + input->chromaOffsets[0];
+        if (bgra)
+            Color32ToNv12<BGRA32>(src, srcPitch, dst, dstPitch, width, height, matrix, fullRange, dstUV, m_stream);
+        else
+            Color32ToNv12<RGBA32>(src, srcPitch, dst, dstPitch, width, height, matrix, fullRange, dstUV, m_stream);
+    }
+
+    // NVENC reads the input buffer outside of CUDA stream ordering
+    result = cuStreamSynchronize(m_stream);
+    cuCtxPopCurrent(nullptr);
+    if (result != CUDA_SUCCESS)
+    {
+        throw std::runtime_error("RGB to YUV conversion failed");
+    }
+}
+
 void CudaEncoder::Destroy()
 {
     if (m_encoder)
@@ -132,6 +226,11 @@ void CudaEncoder::Destroy()
         delete m_encoder;
         m_encoder = nullptr;
     }
+    if (m_stream)
+    {
+        cuStreamDestroy(m_stream);
+        m_stream = nullptr;
+    }
     m_initialized = false;
 }
 
@@ -0,0 +1,383 @@
+#include "DecodeSessionManager.h"
+
+#include "NvDecoder/NvDecoder.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace cdc
+{
+
+static cudaVideoCodec to_cudaVideoCodec(CodecType codecType)
+{
+    switch (codecType)
+    {
+        case CODEC_TYPE_H264: return cudaVideoCodec_H264;
+        case CODEC_TYPE_H265: return cudaVideoCodec_HEVC;
+        case CODEC_TYPE_AV1: return cudaVideoCodec_AV1;
+        default: return cudaVideoCodec_H264;
+    }
+}
+
+DecodeSessionManager::DecodeSessionManager(CUcontext cuContext, uint32_t numWorkers, DecodeSchedulePolicy policy, uint32_t packetsPerSlice,
+                                           WorkStealingPool* pool) :
+    m_cuContext(cuContext),
+    m_device(0),
+    m_ownsContext(false),
+    m_ctxLock(nullptr),
+    m_policy(policy),
+    m_packetsPerSlice(std::max(packetsPerSlice, 1u)),
+    m_nextStreamId(0),
+    m_stop(false),
+    m_poolTasks(0),
+    m_pool(pool)
+{
+    if (!m_cuContext)
+    {
+        ck(cuInit(0));
+        ck(cuDeviceGet(&m_device, 0));
+        ck(cuDevicePrimaryCtxRetain(&m_cuContext, m_device));
+        m_ownsContext = true;
+    }
+
+    NVDEC_API_CALL(cuvidCtxLockCreate(&m_ctxLock, m_cuContext));
+
+    for (uint32_t i = 0; !m_pool && i < std::max(numWorkers, 1u); i++)
+    {
+        m_workers.emplace_back(&DecodeSessionManager::WorkerLoop, this);
+    }
+}
+
+DecodeSessionManager::~DecodeSessionManager()
+{
+    std::vector<int> ids;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& it : m_streams)
+        {
+            ids.push_back(it.first);
+        }
+    }
+    for (int id : ids)
+    {
+        RemoveStream(id);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        // Tasks still queued on the shared pool touch this object even though every stream is gone
+        m_poolTasksDone.wait(lock, [this] { return m_poolTasks == 0; });
+    }
+    m_workAvailable.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+
+    cuvidCtxLockDestroy(m_ctxLock);
+    if (m_ownsContext)
+    {
+        cuDevicePrimaryCtxRelease(m_device);
+    }
+}
+
+int DecodeSessionManager::AddStream(const CreateParams& params, DecodedFrameCallback callback, uint32_t maxQueuedPackets, bool bUseDeviceFrame)
+{
+    NvDecoder* decoder = nullptr;
+    bool       pushed  = false;
+    try
+    {
+        // NvDecoder creates its CUstream in the constructor, which needs a current context
+        ck(cuCtxPushCurrent(m_cuContext));
+        pushed  = true;
+        decoder = new NvDecoder(m_cuContext, bUseDeviceFrame, to_cudaVideoCodec(params.codecType), false, false, nullptr, nullptr, false,
+                                params.width, params.height, 1000, false, 0, nullptr, m_ctxLock);
+        pushed  = false;
+        ck(cuCtxPopCurrent(nullptr));
+    }
+    catch (const std::exception& e)
+    {
+        // Only undo a push that succeeded; a failed pop leaves nothing of ours on the stack
+        if (pushed)
+        {
+            cuCtxPopCurrent(nullptr);
+        }
+        delete decoder;
+        std::cerr << "Failed to add decode stream: " << e.what() << std::endl;
+        return -1;
+    }
+
+    Stream* stream           = new Stream();
+    stream->decoder          = decoder;
+    stream->callback         = std::move(callback);
+    stream->maxQueuedPackets = std::max(maxQueuedPackets, 1u);
+    stream->scheduled        = false;
+    stream->removing         = false;
+    stream->stats            = {};
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stream->id            = m_nextStreamId++;
+    m_streams[stream->id] = stream;
+    return stream->id;
+}
+
+bool DecodeSessionManager::SubmitPacket(int streamId, const CodecPacket& packet, uint64_t deadline)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end())
+    {
+        return false;
+    }
+
+    Stream* stream = it->second;
+    if (stream->removing || stream->stats.failed)
+    {
+        return false;
+    }
+    if (stream->queue.size() >= stream->maxQueuedPackets)
+    {
+        stream->stats.packetsDropped++;
+        return false;
+    }
+
+    PendingPacket pending;
+    if (!stream->freeBuffers.empty())
+    {
+        pending.data = std::move(stream->freeBuffers.back());
+        stream->freeBuffers.pop_back();
+    }
+    const uint8_t* pData = static_cast<const uint8_t*>(packet.data);
+    pending.data.assign(pData, pData + packet.size);
+    pending.timestamp   = static_cast<int64_t>(packet.timestamp);
+    pending.deadline    = deadline;
+    pending.endOfStream = false;
+    pending.submitTime  = std::chrono::steady_clock::now();
+    stream->queue.push_back(std::move(pending));
+    stream->stats.packetsSubmitted++;
+
+    MakeReady(stream);
+    return true;
+}
+
+void DecodeSessionManager::RemoveStream(int streamId)
+{
+    Stream* stream = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_streams.find(streamId);
+        if (it == m_streams.end() || it->second->removing)
+        {
+            return;
+        }
+        stream           = it->second;
+        stream->removing = true;
+
+        if (!stream->stats.failed)
+        {
+            // Empty packet makes NvDecoder send end of stream and return the frames it still holds
+            PendingPacket eos;
+            eos.timestamp   = 0;
+            eos.deadline    = 0;
+            eos.endOfStream = true;
+            eos.submitTime  = std::chrono::steady_clock::now();
+            stream->queue.push_back(std::move(eos));
+            MakeReady(stream);
+        }
+
+        stream->drained.wait(lock, [stream] { return !stream->scheduled; });
+        m_streams.erase(it);
+    }
+
+    delete stream->decoder;
+    delete stream;
+}
+
+bool DecodeSessionManager::GetStreamStats(int streamId, DecodeStreamStats& stats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_streams.find(streamId);
+    if (it == m_streams.end())
+    {
+        return false;
+    }
+    stats            = it->second->stats;
+    stats.queueDepth = static_cast<uint32_t>(it->second->queue.size());
+    return true;
+}
+
+void DecodeSessionManager::MakeReady(Stream* stream)
+{
+    // A stream is decoded by at most one worker at a time so its packets stay in order
+    if (!stream->scheduled)
+    {
+        stream->scheduled = true;
+        m_ready.push_back(stream);
+        NotifyWorker();
+    }
+}
+
+void DecodeSessionManager::NotifyWorker()
+{
+    // One pool task per ready entry, each picking whichever stream the policy says is next
+    if (m_pool)
+    {
+        m_poolTasks++;
+        m_pool->Submit([this] { RunPoolTask(); }, WORKER_TASK_DECODE);
+    }
+    else
+    {
+        m_workAvailable.notify_one();
+    }
+}
+
+bool DecodeSessionManager::PickStream(Stream*& stream)
+{
+    if (m_ready.empty())
+    {
+        return false;
+    }
+
+    auto pick = m_ready.begin();
+    if (m_policy == DECODE_SCHEDULE_DEADLINE)
+    {
+        pick = std::min_element(m_ready.begin(), m_ready.end(), [](const Stream* a, const Stream* b) {
+            return a->queue.front().deadline < b->queue.front().deadline;
+        });
+    }
+    stream = *pick;
+    m_ready.erase(pick);
+    return true;
+}
+
+void DecodeSessionManager::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        Stream* stream = nullptr;
+        m_workAvailable.wait(lock, [this] { return m_stop || !m_ready.empty(); });
+        if (!PickStream(stream))
+        {
+            if (m_stop)
+            {
+                return;
+            }
+            continue;
+        }
+
+        lock.unlock();
+        DecodeSlice(stream);
+        lock.lock();
+    }
+}
+
+void DecodeSessionManager::RunPoolTask()
+{
+    Stream* stream = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        PickStream(stream);
+    }
+    if (stream)
+    {
+        DecodeSlice(stream);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_poolTasks == 0)
+    {
+        m_poolTasksDone.notify_all();
+    }
+}
+
+void DecodeSessionManager::DecodeSlice(Stream* stream)
+{
+    std::vector<PendingPacket> slice;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!stream->queue.empty() && slice.size() < m_packetsPerSlice)
+        {
+            slice.push_back(std::move(stream->queue.front()));
+            stream->queue.pop_front();
+        }
+    }
+
+    auto     start        = std::chrono::steady_clock::now();
+    double   maxQueueTime = 0.0;
+    uint64_t bytes        = 0;
+    uint64_t frames       = 0;
+    size_t   done         = 0;
+    bool     failed       = false;
+
+    try
+    {
+        for (; done < slice.size(); done++)
+        {
+            PendingPacket& pending = slice[done];
+            maxQueueTime = std::max(maxQueueTime, std::chrono::duration<double>(start - pending.submitTime).count());
+
+            int nFrameReturned = pending.endOfStream ? stream->decoder->Decode(nullptr, 0)
+                                                     : stream->decoder->Decode(pending.data.data(), static_cast<int>(pending.data.size()), 0, pending.timestamp);
+            bytes += pending.data.size();
+
+            for (int i = 0; i < nFrameReturned; i++)
+            {
+                int64_t  timestamp = 0;
+                uint8_t* pFrame    = stream->decoder->GetFrame(&timestamp);
+                if (stream->callback)
+                {
+                    stream->callback(stream->id, pFrame, stream->decoder->GetFrameSize(), timestamp);
+                }
+                frames++;
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Decode stream " << stream->id << " failed: " << e.what() << std::endl;
+        failed = true;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& pending : slice)
+    {
+        if (pending.data.capacity() && stream->freeBuffers.size() < stream->maxQueuedPackets)
+        {
+            stream->freeBuffers.push_back(std::move(pending.data));
+        }
+    }
+
+    DecodeStreamStats& stats = stream->stats;
+    stats.packetsDecoded += done;
+    stats.framesDecoded += frames;
+    stats.bytesDecoded += bytes;
+    stats.decodeSeconds += elapsed;
+    stats.maxQueueSeconds = std::max(stats.maxQueueSeconds, maxQueueTime);
+    if (failed)
+    {
+        stats.failed = true;
+        stream->queue.clear();
+    }
+
+    if (!stream->queue.empty())
+    {
+        // Back of the line, so every ready stream gets a slice before this one runs again
+        m_ready.push_back(stream);
+        NotifyWorker();
+    }
+    else
+    {
+        stream->scheduled = false;
+        if (stream->removing)
+        {
+            stream->drained.notify_all();
+        }
+    }
+}
+
+} // namespace cdc
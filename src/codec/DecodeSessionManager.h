@@ -0,0 +1,130 @@
+#pragma once
+
+#include <codec/codec.h>
+
+#include <cuda.h>
+#include <Interface/nvcuvid.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class NvDecoder;
+class WorkStealingPool;
+
+namespace cdc
+{
+
+// How the worker pool picks the next stream to decode
+enum DecodeSchedulePolicy
+{
+    DECODE_SCHEDULE_ROUND_ROBIN = 0, // Streams take turns, one slice each
+    DECODE_SCHEDULE_DEADLINE         // Stream whose oldest packet has the earliest deadline goes first
+};
+
+// Per-stream counters, sampled with DecodeSessionManager::GetStreamStats()
+struct DecodeStreamStats
+{
+    uint64_t packetsSubmitted; // Packets accepted by SubmitPacket()
+    uint64_t packetsDropped;   // Packets rejected because the stream queue was full
+    uint64_t packetsDecoded;   // Packets handed to NVDEC
+    uint64_t framesDecoded;    // Frames delivered to the frame callback
+    uint64_t bytesDecoded;     // Compressed bytes handed to NVDEC
+    uint32_t queueDepth;       // Packets currently waiting in the stream queue
+    double   decodeSeconds;    // Time spent inside NvDecoder::Decode() and the frame callback
+    double   maxQueueSeconds;  // Longest time a packet waited between submit and decode
+    bool     failed;           // Decoder threw; the stream no longer accepts packets
+};
+
+// Frame callback, invoked on a worker thread. pFrame is only valid for the duration of the call.
+// It points to device memory when the stream was added with bUseDeviceFrame set, host memory otherwise.
+typedef std::function<void(int streamId, const uint8_t* pFrame, int frameSize, int64_t timestamp)> DecodedFrameCallback;
+
+// Multiplexes many NvDecoder sessions onto a small worker pool sharing one CUcontext and one
+// cuvid context lock, instead of one thread and one context per stream.
+class DecodeSessionManager
+{
+public:
+    // If cuContext is null the primary context of device 0 is retained and used.
+    // If pool is set, slices run on it as WORKER_TASK_DECODE tasks and numWorkers is ignored, so
+    // several managers and other pipeline stages can share the same threads. It must outlive the manager,
+    // and RemoveStream() and the destructor must not be called from one of its tasks.
+    DecodeSessionManager(CUcontext cuContext, uint32_t numWorkers = 2, DecodeSchedulePolicy policy = DECODE_SCHEDULE_ROUND_ROBIN,
+                         uint32_t packetsPerSlice = 1, WorkStealingPool* pool = nullptr);
+    ~DecodeSessionManager();
+
+    DecodeSessionManager(const DecodeSessionManager&)            = delete;
+    DecodeSessionManager& operator=(const DecodeSessionManager&) = delete;
+
+    // Add a stream; returns its id or -1 on failure. Only width/height/codecType of params are used.
+    int AddStream(const CreateParams& params, DecodedFrameCallback callback, uint32_t maxQueuedPackets = 16, bool bUseDeviceFrame = false);
+
+    // Queue a packet for decoding. The payload is copied. deadline is in caller units and only
+    // consulted under DECODE_SCHEDULE_DEADLINE. Returns false if the queue is full or the stream failed.
+    bool SubmitPacket(int streamId, const CodecPacket& packet, uint64_t deadline = 0);
+
+    // Drain pending packets, flush the decoder and remove the stream.
+    void RemoveStream(int streamId);
+
+    bool GetStreamStats(int streamId, DecodeStreamStats& stats);
+
+    CUcontext      GetContext() const { return m_cuContext; }
+    CUvideoctxlock GetContextLock() const { return m_ctxLock; }
+
+private:
+    struct PendingPacket
+    {
+        std::vector<uint8_t>                  data;
+        int64_t                               timestamp;
+        uint64_t                              deadline;
+        bool                                  endOfStream;
+        std::chrono::steady_clock::time_point submitTime;
+    };
+
+    struct Stream
+    {
+        int                                id;
+        NvDecoder*                         decoder;
+        DecodedFrameCallback               callback;
+        uint32_t                           maxQueuedPackets;
+        std::deque<PendingPacket>          queue;
+        std::vector<std::vector<uint8_t>>  freeBuffers; // Recycled payload buffers
+        bool                               scheduled;   // In the ready list or being decoded by a worker
+        bool                               removing;
+        std::condition_variable            drained;
+        DecodeStreamStats                  stats;
+    };
+
+    void WorkerLoop();
+    void RunPoolTask();
+    bool PickStream(Stream*& stream);
+    void DecodeSlice(Stream* stream);
+    void MakeReady(Stream* stream);
+    void NotifyWorker(); // m_mutex held
+
+    CUcontext            m_cuContext;
+    CUdevice             m_device;
+    bool                 m_ownsContext;
+    CUvideoctxlock       m_ctxLock;
+    DecodeSchedulePolicy m_policy;
+    uint32_t             m_packetsPerSlice;
+
+    std::mutex              m_mutex; // Guards everything below and every Stream except its decoder
+    std::condition_variable m_workAvailable;
+    std::map<int, Stream*>  m_streams;
+    std::deque<Stream*>     m_ready;
+    int                     m_nextStreamId;
+    bool                    m_stop;
+    uint32_t                m_poolTasks;     // Tasks submitted to m_pool that have not finished
+    std::condition_variable m_poolTasksDone;
+
+    WorkStealingPool*        m_pool;
+    std::vector<std::thread> m_workers;
+};
+
+} // namespace cdc
@@ -0,0 +1,194 @@
+#include "ReplayBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace cdc
+{
+
+ReplayBuffer::ReplayBuffer(size_t capacityBytes, uint32_t maxPackets, uint64_t maxDuration) :
+    m_arena(std::max<size_t>(capacityBytes, 1)),
+    m_entries(std::max(maxPackets, 1u)),
+    m_maxDuration(maxDuration),
+    m_first(0),
+    m_end(0),
+    m_writePosition(0),
+    m_gops(0),
+    m_waitKeyFrame(true),
+    m_stats()
+{
+}
+
+bool ReplayBuffer::HasRoom(uint64_t position, uint32_t size) const
+{
+    if (m_first == m_end)
+    {
+        return true;
+    }
+    return m_end - m_first < m_entries.size() && position + size - GetEntry(m_first).position <= m_arena.size();
+}
+
+void ReplayBuffer::EvictGop()
+{
+    // Drop the oldest key frame and everything up to the next one
+    do
+    {
+        m_first++;
+    } while (m_first != m_end && !GetEntry(m_first).keyFrame);
+    m_gops--;
+    m_stats.gopsEvicted++;
+}
+
+bool ReplayBuffer::Push(const CodecPacket& packet)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (packet.keyFrame)
+    {
+        m_waitKeyFrame = false;
+    }
+    if (m_waitKeyFrame || packet.size == 0 || packet.size > m_arena.size())
+    {
+        m_waitKeyFrame = true;
+        m_stats.packetsDropped++;
+        return false;
+    }
+
+    // Payloads stay contiguous; a packet that would straddle the end of the arena starts over at offset 0
+    uint64_t position = m_writePosition;
+    size_t   offset   = position % m_arena.size();
+    if (offset + packet.size > m_arena.size())
+    {
+        position += m_arena.size() - offset;
+        offset = 0;
+    }
+
+    while (!HasRoom(position, packet.size))
+    {
+        EvictGop();
+    }
+
+    if (m_maxDuration && packet.keyFrame)
+    {
+        // Older GOPs are redundant once the newer ones alone span maxDuration
+        while (m_gops > 1)
+        {
+            uint64_t seq = m_first + 1;
+            while (!GetEntry(seq).keyFrame)
+            {
+                seq++;
+            }
+            uint64_t timestamp = GetEntry(seq).timestamp;
+            if (packet.timestamp < timestamp || packet.timestamp - timestamp < m_maxDuration)
+            {
+                break;
+            }
+            EvictGop();
+        }
+    }
+
+    if (m_first == m_end && !packet.keyFrame)
+    {
+        // The current GOP did not fit; wait for the next key frame instead of keeping an undecodable tail
+        m_waitKeyFrame = true;
+        m_stats.packetsDropped++;
+        return false;
+    }
+
+    memcpy(m_arena.data() + offset, packet.data, packet.size);
+    Entry& entry    = m_entries[m_end % m_entries.size()];
+    entry.position  = position;
+    entry.size      = packet.size;
+    entry.timestamp = packet.timestamp;
+    entry.keyFrame  = packet.keyFrame;
+    m_end++;
+    m_writePosition = position + packet.size;
+    m_gops += packet.keyFrame;
+    m_stats.packetsPushed++;
+    return true;
+}
+
+bool ReplayBuffer::SaveClip(uint64_t duration, const ReplayPacketSink& sink) const
+{
+    uint64_t seq, end;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_first == m_end)
+        {
+            return false;
+        }
+        end = m_end;
+        seq = m_first;
+        if (duration)
+        {
+            uint64_t newest = GetEntry(end - 1).timestamp;
+            uint64_t start  = newest > duration ? newest - duration : 0;
+            for (uint64_t i = m_first; i < end; i++)
+            {
+                const Entry& entry = GetEntry(i);
+                if (entry.timestamp > start)
+                {
+                    break;
+                }
+                if (entry.keyFrame)
+                {
+                    seq = i;
+                }
+            }
+        }
+    }
+
+    // The sink may be slow (file I/O); copy one packet at a time so Push() is never held up for long
+    std::vector<uint8_t> data;
+    for (; seq < end; seq++)
+    {
+        CodecPacket packet;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (seq < m_first)
+            {
+                std::cerr << "Replay clip overtaken by eviction" << std::endl;
+                return false;
+            }
+            const Entry& entry = GetEntry(seq);
+            data.resize(entry.size);
+            memcpy(data.data(), m_arena.data() + entry.position % m_arena.size(), entry.size);
+            packet.size      = entry.size;
+            packet.timestamp = entry.timestamp;
+            packet.keyFrame  = entry.keyFrame;
+        }
+        packet.data = data.data();
+        if (!sink(packet))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ReplayBuffer::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_first         = m_end;
+    m_writePosition = 0;
+    m_gops          = 0;
+    m_waitKeyFrame  = true;
+}
+
+ReplayBufferStats ReplayBuffer::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ReplayBufferStats stats = m_stats;
+    stats.packets           = static_cast<uint32_t>(m_end - m_first);
+    stats.gops              = m_gops;
+    if (m_first != m_end)
+    {
+        stats.bytesUsed       = m_writePosition - GetEntry(m_first).position;
+        stats.oldestTimestamp = GetEntry(m_first).timestamp;
+        stats.newestTimestamp = GetEntry(m_end - 1).timestamp;
+    }
+    return stats;
+}
+
+} // namespace cdc
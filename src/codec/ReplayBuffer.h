@@ -0,0 +1,85 @@
+#pragma once
+
+#include <codec/codec.h>
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace cdc
+{
+
+// Counters and occupancy, sampled with ReplayBuffer::GetStats()
+struct ReplayBufferStats
+{
+    uint64_t bytesUsed;       // Arena bytes between the oldest and the newest packet, wrap padding included
+    uint32_t packets;         // Packets currently held
+    uint32_t gops;            // Key frames currently held
+    uint64_t oldestTimestamp; // Timestamp of the oldest held packet (always a key frame)
+    uint64_t newestTimestamp;
+    uint64_t packetsPushed;   // Packets accepted by Push()
+    uint64_t packetsDropped;  // Packets rejected while waiting for a key frame or larger than the arena
+    uint64_t gopsEvicted;     // GOPs removed to make room
+};
+
+// Receives the packets of a clip in decode order, the first one being a key frame. packet.data is
+// only valid for the duration of the call. Returning false aborts the clip.
+typedef std::function<bool(const CodecPacket& packet)> ReplayPacketSink;
+
+// Keeps the most recent encoded packets in a fixed byte arena so the last N seconds can be saved
+// on demand. Whole GOPs are evicted from the oldest key frame onwards, so the buffer always
+// starts on a key frame and a clip can be remuxed (IVFWriter, Fmp4Writer, FFmpegMuxer) without
+// re-encoding. Push() copies into preallocated memory and never allocates.
+class ReplayBuffer
+{
+public:
+    // capacityBytes sizes the payload arena, maxPackets the packet index. maxDuration, in packet
+    // timestamp units, additionally evicts GOPs that are no longer needed to cover that span; 0 keeps
+    // as much as fits.
+    ReplayBuffer(size_t capacityBytes, uint32_t maxPackets, uint64_t maxDuration = 0);
+
+    ReplayBuffer(const ReplayBuffer&)            = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    // Copy an encoder packet into the arena, evicting old GOPs as needed. Packets are dropped until
+    // the first key frame, and again after a packet had to be dropped, so the held GOPs stay decodable.
+    bool Push(const CodecPacket& packet);
+
+    // Stream the held packets starting at the latest key frame at or before newest - duration
+    // (the oldest key frame if the buffer is shorter) to sink. duration 0 saves everything.
+    // Safe to call from any thread while Push() continues: the lock is only held while one packet
+    // is copied out, never while the sink runs. Returns false if the buffer is empty, the sink
+    // failed, or eviction overtook the clip.
+    bool SaveClip(uint64_t duration, const ReplayPacketSink& sink) const;
+
+    void Clear();
+
+    ReplayBufferStats GetStats() const;
+
+private:
+    struct Entry
+    {
+        uint64_t position;  // Logical arena position; physical offset is position % capacity
+        uint32_t size;
+        uint64_t timestamp;
+        bool     keyFrame;
+    };
+
+    const Entry& GetEntry(uint64_t seq) const { return m_entries[seq % m_entries.size()]; }
+    bool HasRoom(uint64_t position, uint32_t size) const;
+    void EvictGop();
+
+    std::vector<uint8_t> m_arena;
+    std::vector<Entry>   m_entries;
+    uint64_t             m_maxDuration;
+
+    mutable std::mutex m_mutex; // Guards everything below and the arena contents
+    uint64_t           m_first;    // Sequence number of the oldest held packet
+    uint64_t           m_end;      // Sequence number the next packet gets
+    uint64_t           m_writePosition;
+    uint32_t           m_gops;
+    bool               m_waitKeyFrame;
+    ReplayBufferStats  m_stats;
+};
+
+} // namespace cdc
@@ -5,6 +5,10 @@
 class NvEncoderCuda;
 class NvEncoderD3D12;
 class NvDecoder;
+struct NvEncInputFrame;
+
+typedef struct CUctx_st* CUcontext;
+typedef struct CUstream_st* CUstream;
 
 struct ID3D12Resource;
 
@@ -16,6 +20,7 @@ class CudaEncoder : public Encoder
     NvEncoderCuda* m_encoder;
     CreateParams   m_params;
     bool           m_initialized;
+    CUstream       m_stream; // Private stream for input conversion, so sessions do not serialize on the default stream
 
 public:
     CudaEncoder();
@@ -25,6 +30,10 @@ public:
     bool EncodeFrame(void* pData, CodecPacket& packet) override;
     bool Flush(CodecPacket& packet) override;
     void Destroy() override;
+
+private:
+    // Converts an RGBA8/BGRA8 device frame straight into the encoder's YUV input buffer
+    void ConvertRgbInput(CUcontext cuContext, uint8_t* src, const NvEncInputFrame* input);
 };
 
 class DX12Encoder : public Encoder
@@ -2,22 +2,54 @@
 
 #include <codec/codec.h>
 #include <Interface/nvEncodeAPI.h>
+#include <Utils/ColorSpaceMath.h>
 
 namespace cdc
 {
 
 // Helper function to convert PixelFormat to NV_ENC_BUFFER_FORMAT
+// NVENC formats are word-ordered: ARGB is B,G,R,A in memory and ABGR is R,G,B,A
 inline NV_ENC_BUFFER_FORMAT to_nvEncFormat(PixelFormat format)
 {
     switch (format)
     {
-        // case PIXEL_FORMAT_RGBA8: return NV_ENC_BUFFER_FORMAT_RGBA;
+        case PIXEL_FORMAT_RGBA8: return NV_ENC_BUFFER_FORMAT_ABGR;
         case PIXEL_FORMAT_ARGB8: return NV_ENC_BUFFER_FORMAT_ARGB;
-        // case PIXEL_FORMAT_BGRA8: return NV_ENC_BUFFER_FORMAT_BGRA;
+        case PIXEL_FORMAT_BGRA8: return NV_ENC_BUFFER_FORMAT_ARGB;
         case PIXEL_FORMAT_NV12: return NV_ENC_BUFFER_FORMAT_NV12;
         default: return NV_ENC_BUFFER_FORMAT_UNDEFINED;
     }
 
     return NV_ENC_BUFFER_FORMAT_NV12;
 }
-} // namespace cdc
\ No newline at end of file
+
+// RGB formats the CUDA encoder converts to YUV itself instead of handing them to NVENC
+inline bool is_rgbConvertedFormat(PixelFormat format)
+{
+    return format == PIXEL_FORMAT_RGBA8 || format == PIXEL_FORMAT_BGRA8;
+}
+
+// Helper function to convert ColorMatrix to the ColorSpaceStandard used by the conversion kernels
+inline ColorSpaceStandard to_colorSpaceStandard(ColorMatrix matrix)
+{
+    switch (matrix)
+    {
+        case COLOR_MATRIX_BT601: return ColorSpaceStandard_BT601;
+        case COLOR_MATRIX_BT2020: return ColorSpaceStandard_BT2020;
+        case COLOR_MATRIX_BT709:
+        default: return ColorSpaceStandard_BT709;
+    }
+}
+
+// Helper function to convert ColorMatrix to the VUI matrix coefficients signalled in the bitstream
+inline NV_ENC_VUI_MATRIX_COEFFS to_nvEncVuiMatrix(ColorMatrix matrix)
+{
+    switch (matrix)
+    {
+        case COLOR_MATRIX_BT601: return NV_ENC_VUI_MATRIX_COEFFS_SMPTE170M;
+        case COLOR_MATRIX_BT2020: return NV_ENC_VUI_MATRIX_COEFFS_BT2020_NCL;
+        case COLOR_MATRIX_BT709:
+        default: return NV_ENC_VUI_MATRIX_COEFFS_BT709;
+    }
+}
+} // namespace cdc
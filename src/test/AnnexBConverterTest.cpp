@@ -0,0 +1,226 @@
+#include <string.h>
+#include <vector>
+#include "AnnexBConverter.h"
+#include "TestCheck.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file AnnexBConverterTest.cpp
+//! \brief Checks AnnexBConverter on hand-built avcC/hvcC extradata and samples: every NAL
+//! length size, zero-length NAL units, parameter set insertion, malformed lengths, Annex-B
+//! pass-through and the way back with FromAnnexB().
+//---------------------------------------------------------------------------
+
+static const uint8_t aSps[] = {0x67, 0x42, 0x00, 0x1F, 0xAB};
+static const uint8_t aPps[] = {0x68, 0xCE, 0x3C};
+static const uint8_t aIdr[] = {0x65, 0x88, 0x84, 0x00, 0x21};
+static const uint8_t aSlice[] = {0x41, 0x9A, 0x02};
+
+static std::vector<uint8_t> MakeAvcC(int nLengthSize) {
+    std::vector<uint8_t> v = {1, 0x42, 0x00, 0x1F, (uint8_t)(0xFC | (nLengthSize - 1)), 0xE1, 0, sizeof(aSps)};
+    v.insert(v.end(), aSps, aSps + sizeof(aSps));
+    v.insert(v.end(), {1, 0, sizeof(aPps)});
+    v.insert(v.end(), aPps, aPps + sizeof(aPps));
+    return v;
+}
+
+static void AppendNal(std::vector<uint8_t> &v, int nLengthSize, const uint8_t *pNal, size_t nNal) {
+    for (int i = nLengthSize - 1; i >= 0; i--) {
+        v.push_back((uint8_t)(nNal >> (8 * i)));
+    }
+    v.insert(v.end(), pNal, pNal + nNal);
+}
+
+static void AppendAnnexB(std::vector<uint8_t> &v, const uint8_t *pNal, size_t nNal) {
+    v.insert(v.end(), {0, 0, 0, 1});
+    v.insert(v.end(), pNal, pNal + nNal);
+}
+
+static bool Equals(const uint8_t *p, size_t n, const std::vector<uint8_t> &vExpected) {
+    return n == vExpected.size() && !memcmp(p, vExpected.data(), n);
+}
+
+static void TestLengthSizes() {
+    for (int nLengthSize : {1, 2, 4}) {
+        std::vector<uint8_t> vExtradata = MakeAvcC(nLengthSize);
+        AnnexBConverter converter;
+        CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264));
+        CHECK(converter.GetLengthSize() == nLengthSize && !converter.IsPassThrough());
+
+        // A slice that is not a key frame gets no parameter sets
+        std::vector<uint8_t> vSample, vExpected;
+        AppendNal(vSample, nLengthSize, aSlice, sizeof(aSlice));
+        AppendNal(vSample, nLengthSize, aSlice, sizeof(aSlice));
+        AppendAnnexB(vExpected, aSlice, sizeof(aSlice));
+        AppendAnnexB(vExpected, aSlice, sizeof(aSlice));
+        const uint8_t *pOut = NULL;
+        size_t nOut = 0;
+        CHECK(converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+        CHECK(Equals(pOut, nOut, vExpected));
+        // 4-byte lengths become 4-byte start codes in place
+        CHECK((pOut == vSample.data()) == (nLengthSize == 4));
+
+        // The key frame gets SPS and PPS from the extradata
+        vSample.clear();
+        vExpected.clear();
+        AppendNal(vSample, nLengthSize, aIdr, sizeof(aIdr));
+        AppendAnnexB(vExpected, aSps, sizeof(aSps));
+        AppendAnnexB(vExpected, aPps, sizeof(aPps));
+        AppendAnnexB(vExpected, aIdr, sizeof(aIdr));
+        CHECK(converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+        CHECK(Equals(pOut, nOut, vExpected));
+    }
+}
+
+static void TestEmptyNalUnits() {
+    std::vector<uint8_t> vExtradata = MakeAvcC(4);
+    AnnexBConverter converter;
+    CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264));
+
+    // Empty NAL units at the start, in the middle and at the end of a sample that carries its own parameter sets
+    std::vector<uint8_t> vSample, vExpected;
+    AppendNal(vSample, 4, NULL, 0);
+    AppendNal(vSample, 4, aSps, sizeof(aSps));
+    AppendNal(vSample, 4, aPps, sizeof(aPps));
+    AppendNal(vSample, 4, NULL, 0);
+    AppendNal(vSample, 4, aIdr, sizeof(aIdr));
+    AppendNal(vSample, 4, NULL, 0);
+    AppendAnnexB(vExpected, aSps, sizeof(aSps));
+    AppendAnnexB(vExpected, aPps, sizeof(aPps));
+    AppendAnnexB(vExpected, aIdr, sizeof(aIdr));
+    const uint8_t *pOut = NULL;
+    size_t nOut = 0;
+    CHECK(converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+    CHECK(Equals(pOut, nOut, vExpected));
+
+    // With 2-byte lengths and parameter sets inserted ahead of the key frame
+    vExtradata = MakeAvcC(2);
+    CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264));
+    vSample.clear();
+    vExpected.clear();
+    AppendNal(vSample, 2, NULL, 0);
+    AppendNal(vSample, 2, aIdr, sizeof(aIdr));
+    AppendNal(vSample, 2, NULL, 0);
+    AppendNal(vSample, 2, aSlice, sizeof(aSlice));
+    AppendAnnexB(vExpected, aSps, sizeof(aSps));
+    AppendAnnexB(vExpected, aPps, sizeof(aPps));
+    AppendAnnexB(vExpected, aIdr, sizeof(aIdr));
+    AppendAnnexB(vExpected, aSlice, sizeof(aSlice));
+    CHECK(converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+    CHECK(Equals(pOut, nOut, vExpected));
+
+    // Nothing but empty NAL units leaves nothing to decode
+    vSample.clear();
+    AppendNal(vSample, 2, NULL, 0);
+    AppendNal(vSample, 2, NULL, 0);
+    CHECK(!converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+}
+
+static void TestMalformed() {
+    std::vector<uint8_t> vExtradata = MakeAvcC(4);
+    AnnexBConverter converter;
+    CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264));
+
+    // Length past the end of the sample, and a truncated length field
+    std::vector<uint8_t> vSample;
+    AppendNal(vSample, 4, aSlice, sizeof(aSlice));
+    vSample[3]++;
+    std::vector<uint8_t> vCopy = vSample;
+    const uint8_t *pOut = NULL;
+    size_t nOut = 0;
+    CHECK(!converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+    // Nothing is overwritten before the sample is known to be valid
+    CHECK(vSample == vCopy);
+    vSample.assign({0, 0, 0, 3, 0x41, 0x9A, 0x02, 0, 0});
+    CHECK(!converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+
+    const uint8_t aBadAvcC[] = {0, 0x42, 0x00, 0x1F, 0xFF};
+    CHECK(!converter.Init(aBadAvcC, sizeof(aBadAvcC), NAL_CODEC_H264));
+}
+
+static void TestPassThrough() {
+    std::vector<uint8_t> vExtradata;
+    AppendAnnexB(vExtradata, aSps, sizeof(aSps));
+    AppendAnnexB(vExtradata, aPps, sizeof(aPps));
+    AnnexBConverter converter;
+    CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264));
+    CHECK(converter.IsPassThrough());
+
+    std::vector<uint8_t> vSample;
+    AppendAnnexB(vSample, aIdr, sizeof(aIdr));
+    const uint8_t *pOut = NULL;
+    size_t nOut = 0;
+    CHECK(converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+    CHECK(pOut == vSample.data() && nOut == vSample.size());
+}
+
+static void TestHvcC() {
+    static const uint8_t aVps[] = {0x40, 0x01, 0x0C};
+    static const uint8_t aHevcSps[] = {0x42, 0x01, 0x01};
+    static const uint8_t aCra[] = {0x2A, 0x01, 0xAF};
+    std::vector<uint8_t> vExtradata(21, 0);
+    vExtradata[0] = 1;
+    vExtradata.insert(vExtradata.end(), {0xFF, 2});
+    vExtradata.insert(vExtradata.end(), {0xA0, 0, 1, 0, sizeof(aVps)});
+    vExtradata.insert(vExtradata.end(), aVps, aVps + sizeof(aVps));
+    vExtradata.insert(vExtradata.end(), {0xA1, 0, 1, 0, sizeof(aHevcSps)});
+    vExtradata.insert(vExtradata.end(), aHevcSps, aHevcSps + sizeof(aHevcSps));
+    AnnexBConverter converter;
+    CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_HEVC));
+    CHECK(converter.GetLengthSize() == 4);
+
+    std::vector<uint8_t> vSample, vExpected;
+    AppendNal(vSample, 4, aCra, sizeof(aCra));
+    AppendNal(vSample, 4, NULL, 0);
+    AppendAnnexB(vExpected, aVps, sizeof(aVps));
+    AppendAnnexB(vExpected, aHevcSps, sizeof(aHevcSps));
+    AppendAnnexB(vExpected, aCra, sizeof(aCra));
+    const uint8_t *pOut = NULL;
+    size_t nOut = 0;
+    CHECK(converter.ToAnnexB(vSample.data(), vSample.size(), &pOut, &nOut));
+    CHECK(Equals(pOut, nOut, vExpected));
+}
+
+static void TestFromAnnexB() {
+    std::vector<uint8_t> vExtradata = MakeAvcC(4);
+    AnnexBConverter converter;
+    CHECK(converter.Init(vExtradata.data(), vExtradata.size(), NAL_CODEC_H264));
+
+    std::vector<uint8_t> vAnnexB, vExpected, vStripped;
+    AppendAnnexB(vAnnexB, aSps, sizeof(aSps));
+    AppendAnnexB(vAnnexB, aPps, sizeof(aPps));
+    AppendAnnexB(vAnnexB, aIdr, sizeof(aIdr));
+    AppendNal(vExpected, 4, aSps, sizeof(aSps));
+    AppendNal(vExpected, 4, aPps, sizeof(aPps));
+    AppendNal(vExpected, 4, aIdr, sizeof(aIdr));
+    AppendNal(vStripped, 4, aIdr, sizeof(aIdr));
+
+    std::vector<uint8_t> vCopy = vAnnexB;
+    const uint8_t *pOut = NULL;
+    size_t nOut = 0;
+    CHECK(converter.FromAnnexB(vCopy.data(), vCopy.size(), &pOut, &nOut));
+    CHECK(pOut == vCopy.data() && Equals(pOut, nOut, vExpected));
+
+    vCopy = vAnnexB;
+    CHECK(converter.FromAnnexB(vCopy.data(), vCopy.size(), &pOut, &nOut, true));
+    CHECK(Equals(pOut, nOut, vStripped));
+
+    // A 3-byte start code cannot be rewritten in place
+    std::vector<uint8_t> vShort = {0, 0, 1};
+    vShort.insert(vShort.end(), aSlice, aSlice + sizeof(aSlice));
+    std::vector<uint8_t> vShortExpected;
+    AppendNal(vShortExpected, 4, aSlice, sizeof(aSlice));
+    CHECK(converter.FromAnnexB(vShort.data(), vShort.size(), &pOut, &nOut));
+    CHECK(pOut != vShort.data() && Equals(pOut, nOut, vShortExpected));
+}
+
+int main() {
+    TestLengthSizes();
+    TestEmptyNalUnits();
+    TestMalformed();
+    TestPassThrough();
+    TestHvcC();
+    TestFromAnnexB();
+    return TestResult();
+}
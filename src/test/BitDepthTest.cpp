@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <vector>
+#include "BitDepthMath.h"
+#include "TestCheck.h"
+
+//---------------------------------------------------------------------------
+//! \file BitDepthTest.cpp
+//! \brief Checks ConvertYuv420BitDepthHost() between NV12, P010 and I010: 8 to 10 to 8 bits is
+//! the identity, P010 is MSB-aligned and I010 LSB-aligned, and dithered 10 to 8 bit output stays
+//! within one step of rounding and averages to the exact value over a Bayer tile. Odd sizes
+//! convert every visible sample and leave the padding alone.
+//---------------------------------------------------------------------------
+
+static const uint8_t nSentinel = 0xA5;
+
+static const int aBayer[4][4] = {{0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+// A frame with its planes as MakeYuv420Surface() lays them out, plus the plane sizes for indexing
+struct TestFrame {
+    std::vector<uint8_t> vData;
+    Yuv420Surface surface;
+    int nWidth, nHeight, nPitch;
+
+    TestFrame(YUV420_LAYOUT eLayout, int nWidth, int nHeight, int nPaddingSamples) : nWidth(nWidth), nHeight(nHeight) {
+        nPitch = ((nWidth + 1) / 2 * 2 + nPaddingSamples) * GetYuv420SampleSize(eLayout);
+        // The I010 chroma pitch is derived from the luma pitch, so start from a pitch it halves evenly
+        nPitch = (nPitch + 3) / 4 * 4;
+        vData.resize((size_t)nPitch * (nHeight + (nHeight + 1) / 2) * 2, nSentinel);
+        surface = MakeYuv420Surface(eLayout, vData.data(), nPitch, nHeight);
+    }
+
+    int ChromaWidth() const {
+        return (nWidth + 1) / 2;
+    }
+
+    int ChromaHeight() const {
+        return (nHeight + 1) / 2;
+    }
+
+    // Plane 0 is Y, 1 is U, 2 is V; x and y are in samples of that plane
+    uint8_t *SamplePointer(int iPlane, int x, int y) const {
+        int nSample = GetYuv420SampleSize(surface.eLayout);
+        if (iPlane == 0) {
+            return surface.pY + (size_t)y * surface.nYPitch + x * nSample;
+        }
+        uint8_t *pRow = (iPlane == 1 ? surface.pU : surface.pV) + (size_t)y * surface.nUvPitch;
+        return pRow + x * GetYuv420ChromaStep(surface.eLayout) * nSample;
+    }
+
+    uint32_t Get(int iPlane, int x, int y) const {
+        const uint8_t *p = SamplePointer(iPlane, x, y);
+        return surface.eLayout == YUV420_LAYOUT_NV12 ? *p : *(const uint16_t *)p;
+    }
+
+    void Set(int iPlane, int x, int y, uint32_t v) {
+        uint8_t *p = SamplePointer(iPlane, x, y);
+        if (surface.eLayout == YUV420_LAYOUT_NV12) {
+            *p = (uint8_t)v;
+        } else {
+            *(uint16_t *)p = (uint16_t)v;
+        }
+    }
+
+    template<class Func>
+    void ForEachSample(Func func) const {
+        for (int iPlane = 0; iPlane < 3; iPlane++) {
+            int w = iPlane ? ChromaWidth() : nWidth, h = iPlane ? ChromaHeight() : nHeight;
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    func(iPlane, x, y);
+                }
+            }
+        }
+    }
+};
+
+static void FillRandom(TestFrame &frame, uint32_t nMax) {
+    frame.ForEachSample([&](int iPlane, int x, int y) { frame.Set(iPlane, x, y, rand() % (nMax + 1)); });
+}
+
+// Marks the bytes of visible samples; everything else still holds the sentinel after a conversion
+static std::vector<bool> VisibleMask(const TestFrame &frame) {
+    std::vector<bool> vMask(frame.vData.size());
+    int nSample = GetYuv420SampleSize(frame.surface.eLayout);
+    frame.ForEachSample([&](int iPlane, int x, int y) {
+        size_t iByte = frame.SamplePointer(iPlane, x, y) - frame.vData.data();
+        for (int i = 0; i < nSample; i++) {
+            vMask[iByte + i] = true;
+        }
+    });
+    return vMask;
+}
+
+static void CheckPaddingUntouched(const TestFrame &frame) {
+    std::vector<bool> vMask = VisibleMask(frame);
+    int nTouched = 0;
+    for (size_t i = 0; i < frame.vData.size(); i++) {
+        nTouched += !vMask[i] && frame.vData[i] != nSentinel;
+    }
+    CHECK(nTouched == 0);
+}
+
+static void TestBayerThreshold() {
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            CHECK(GetBayerThreshold(x, y) == (uint32_t)aBayer[y & 3][x & 3] * 16 + 8);
+        }
+    }
+}
+
+// 8-bit samples widen exactly, so narrowing them again returns the input with or without dithering
+static void TestRoundTrip(YUV420_LAYOUT eWide, int nWidth, int nHeight, BITDEPTH_DITHER eDither) {
+    TestFrame nv12(YUV420_LAYOUT_NV12, nWidth, nHeight, 3), wide(eWide, nWidth, nHeight, 5), back(YUV420_LAYOUT_NV12, nWidth, nHeight, 1);
+    FillRandom(nv12, 255);
+    // The extremes must survive too
+    nv12.Set(0, 0, 0, 0);
+    nv12.Set(1, 0, 0, 255);
+    ConvertYuv420BitDepthHost(nv12.surface, wide.surface, nWidth, nHeight, eDither);
+    ConvertYuv420BitDepthHost(wide.surface, back.surface, nWidth, nHeight, eDither);
+    nv12.ForEachSample([&](int iPlane, int x, int y) {
+        uint32_t v = nv12.Get(iPlane, x, y), w = wide.Get(iPlane, x, y);
+        CHECK(w == (eWide == YUV420_LAYOUT_P010 ? v << 8 : v << 2));
+        CHECK(back.Get(iPlane, x, y) == v);
+    });
+    CheckPaddingUntouched(wide);
+    CheckPaddingUntouched(back);
+}
+
+// P010 keeps 10 bits in the high end of each word, I010 in the low end; stray high bits of I010 input are ignored
+static void TestAlignment(int nWidth, int nHeight) {
+    TestFrame i010(YUV420_LAYOUT_I010, nWidth, nHeight, 2), p010(YUV420_LAYOUT_P010, nWidth, nHeight, 2);
+    TestFrame i010Back(YUV420_LAYOUT_I010, nWidth, nHeight, 2), p010Back(YUV420_LAYOUT_P010, nWidth, nHeight, 2);
+    FillRandom(i010, 1023);
+    i010.ForEachSample([&](int iPlane, int x, int y) {
+        if ((x + y) % 3 == 0) {
+            i010.Set(iPlane, x, y, i010.Get(iPlane, x, y) | 0xFC00);
+        }
+    });
+    ConvertYuv420BitDepthHost(i010.surface, p010.surface, nWidth, nHeight);
+    ConvertYuv420BitDepthHost(p010.surface, i010Back.surface, nWidth, nHeight);
+    ConvertYuv420BitDepthHost(p010.surface, p010Back.surface, nWidth, nHeight);
+    i010.ForEachSample([&](int iPlane, int x, int y) {
+        uint32_t v = i010.Get(iPlane, x, y) & 0x3FF;
+        CHECK(p010.Get(iPlane, x, y) == v << 6);
+        CHECK(i010Back.Get(iPlane, x, y) == v);
+        CHECK(p010Back.Get(iPlane, x, y) == v << 6);
+    });
+    CheckPaddingUntouched(p010);
+    CheckPaddingUntouched(i010Back);
+}
+
+// P016 input keeps its extra precision until the final rounding to 10 bits
+static void TestP016Rounding() {
+    TestFrame p016(YUV420_LAYOUT_P010, 4, 2, 0), i010(YUV420_LAYOUT_I010, 4, 2, 0);
+    const uint32_t aIn[] = {0x0000, 0x001F, 0x0020, 0xFFC0, 0xFFE0, 0xFFFF};
+    const uint32_t aOut[] = {0, 0, 1, 1023, 1023, 1023};
+    for (int i = 0; i < 6; i++) {
+        p016.Set(0, i % 4, i / 4, aIn[i]);
+    }
+    ConvertYuv420BitDepthHost(p016.surface, i010.surface, 4, 2);
+    for (int i = 0; i < 6; i++) {
+        CHECK(i010.Get(0, i % 4, i / 4) == aOut[i]);
+    }
+}
+
+// Dithering moves a sample by at most one step from rounding, and over a 4x4 tile it averages to the exact 10-bit value / 4
+static void TestDither(YUV420_LAYOUT eSrc) {
+    const int nWidth = 16, nHeight = 8;
+    for (uint32_t v10 = 0; v10 < 1024; v10++) {
+        TestFrame src(eSrc, nWidth, nHeight, 0), rounded(YUV420_LAYOUT_NV12, nWidth, nHeight, 0), dithered(YUV420_LAYOUT_NV12, nWidth, nHeight, 0);
+        uint32_t v = eSrc == YUV420_LAYOUT_P010 ? v10 << 6 : v10;
+        src.ForEachSample([&](int iPlane, int x, int y) { src.Set(iPlane, x, y, v); });
+        ConvertYuv420BitDepthHost(src.surface, rounded.surface, nWidth, nHeight, BITDEPTH_DITHER_NONE);
+        ConvertYuv420BitDepthHost(src.surface, dithered.surface, nWidth, nHeight, BITDEPTH_DITHER_ORDERED);
+
+        uint32_t nRounded = (v10 + 2) / 4 > 255 ? 255 : (v10 + 2) / 4;
+        int nSpread = 0;
+        src.ForEachSample([&](int iPlane, int x, int y) {
+            CHECK(rounded.Get(iPlane, x, y) == nRounded);
+            int d = (int)dithered.Get(iPlane, x, y) - (int)nRounded;
+            nSpread |= d != 0;
+            CHECK(d >= -1 && d <= 1);
+        });
+        // Only values between two 8-bit codes dither
+        CHECK(nSpread == (v10 % 4 != 0 && v10 < 1021));
+
+        // Luma and chroma tiles; the clamp at 255 keeps the top values from averaging out
+        if (v10 <= 1020) {
+            for (int iPlane = 0; iPlane < 3; iPlane++) {
+                uint32_t nSum = 0;
+                for (int y = 0; y < 4; y++) {
+                    for (int x = 0; x < 4; x++) {
+                        nSum += dithered.Get(iPlane, x + 4, y + (iPlane ? 0 : 4));
+                    }
+                }
+                CHECK(nSum * 4 == v10 * 16);
+            }
+        }
+    }
+}
+
+// Every visible sample converts as a lone sample would, including the last odd column and row
+static void TestOddSize(YUV420_LAYOUT eSrc, YUV420_LAYOUT eDst, int nWidth, int nHeight) {
+    TestFrame src(eSrc, nWidth, nHeight, 3), dst(eDst, nWidth, nHeight, 3);
+    FillRandom(src, eSrc == YUV420_LAYOUT_NV12 ? 255 : (eSrc == YUV420_LAYOUT_I010 ? 1023 : 0xFFFF));
+    ConvertYuv420BitDepthHost(src.surface, dst.surface, nWidth, nHeight, BITDEPTH_DITHER_ORDERED);
+    src.ForEachSample([&](int iPlane, int x, int y) {
+        uint32_t v = src.Get(iPlane, x, y);
+        uint32_t v16 = eSrc == YUV420_LAYOUT_NV12 ? v << 8 : (eSrc == YUV420_LAYOUT_I010 ? v << 6 : v);
+        uint32_t nExpected;
+        if (eDst == YUV420_LAYOUT_NV12) {
+            nExpected = (v16 + aBayer[y & 3][x & 3] * 16 + 8) >> 8;
+            nExpected = nExpected > 255 ? 255 : nExpected;
+        } else {
+            nExpected = (v16 + 32) >> 6;
+            nExpected = nExpected > 1023 ? 1023 : nExpected;
+            nExpected <<= eDst == YUV420_LAYOUT_P010 ? 6 : 0;
+        }
+        CHECK(dst.Get(iPlane, x, y) == nExpected);
+    });
+    CheckPaddingUntouched(dst);
+}
+
+int main() {
+    srand(46);
+    TestBayerThreshold();
+    const int aSize[][2] = {{16, 8}, {13, 7}, {1, 1}, {5, 3}, {6, 5}};
+    for (const int *pSize : aSize) {
+        TestRoundTrip(YUV420_LAYOUT_P010, pSize[0], pSize[1], BITDEPTH_DITHER_NONE);
+        TestRoundTrip(YUV420_LAYOUT_P010, pSize[0], pSize[1], BITDEPTH_DITHER_ORDERED);
+        TestRoundTrip(YUV420_LAYOUT_I010, pSize[0], pSize[1], BITDEPTH_DITHER_ORDERED);
+        TestAlignment(pSize[0], pSize[1]);
+        const YUV420_LAYOUT aLayout[] = {YUV420_LAYOUT_NV12, YUV420_LAYOUT_P010, YUV420_LAYOUT_I010};
+        for (YUV420_LAYOUT eSrc : aLayout) {
+            for (YUV420_LAYOUT eDst : aLayout) {
+                TestOddSize(eSrc, eDst, pSize[0], pSize[1]);
+            }
+        }
+    }
+    TestP016Rounding();
+    TestDither(YUV420_LAYOUT_P010);
+    TestDither(YUV420_LAYOUT_I010);
+    return TestResult();
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "ColorSpaceMath.h"
+#include "TestCheck.h"
+
+//---------------------------------------------------------------------------
+//! \file ColorSpaceTest.cpp
+//! \brief Checks the CPU reference converters in ColorSpaceMath.h against published code values
+//! for black, white and the primaries in BT.601, BT.709 and BT.2020, full and limited range,
+//! in both byte orders. The 4:2:0 chroma of odd-sized frames is compared with an average of the
+//! 2x2 block that replicates the last column and row.
+//---------------------------------------------------------------------------
+
+struct KnownColor {
+    uint8_t r, g, b;
+    uint8_t y, u, v;
+};
+
+struct KnownColorTable {
+    int iMatrix;
+    bool bFullRange;
+    KnownColor aColor[5];
+};
+
+// Black, white, red, green, blue
+static const KnownColorTable aKnownColors[] = {
+    {ColorSpaceStandard_BT601, false, {
+        {0, 0, 0, 16, 128, 128}, {255, 255, 255, 235, 128, 128},
+        {255, 0, 0, 81, 90, 240}, {0, 255, 0, 145, 54, 34}, {0, 0, 255, 41, 240, 110}}},
+    {ColorSpaceStandard_BT601, true, {
+        {0, 0, 0, 0, 128, 128}, {255, 255, 255, 255, 128, 128},
+        {255, 0, 0, 76, 85, 255}, {0, 255, 0, 150, 44, 21}, {0, 0, 255, 29, 255, 107}}},
+    {ColorSpaceStandard_BT709, false, {
+        {0, 0, 0, 16, 128, 128}, {255, 255, 255, 235, 128, 128},
+        {255, 0, 0, 63, 102, 240}, {0, 255, 0, 173, 42, 26}, {0, 0, 255, 32, 240, 118}}},
+    {ColorSpaceStandard_BT709, true, {
+        {0, 0, 0, 0, 128, 128}, {255, 255, 255, 255, 128, 128},
+        {255, 0, 0, 54, 99, 255}, {0, 255, 0, 182, 30, 12}, {0, 0, 255, 18, 255, 116}}},
+    {ColorSpaceStandard_BT2020, false, {
+        {0, 0, 0, 16, 128, 128}, {255, 255, 255, 235, 128, 128},
+        {255, 0, 0, 74, 97, 240}, {0, 255, 0, 164, 47, 25}, {0, 0, 255, 29, 240, 119}}},
+    {ColorSpaceStandard_BT2020, true, {
+        {0, 0, 0, 0, 128, 128}, {255, 255, 255, 255, 128, 128},
+        {255, 0, 0, 67, 92, 255}, {0, 255, 0, 173, 36, 11}, {0, 0, 255, 15, 255, 118}}},
+};
+
+static void StorePixel(uint8_t *p, bool bRgba, uint8_t r, uint8_t g, uint8_t b) {
+    p[0] = bRgba ? r : b;
+    p[1] = g;
+    p[2] = bRgba ? b : r;
+    p[3] = 0xFF;
+}
+
+// A flat 2x2 frame, so the 4:2:0 chroma average is the color itself
+static void TestKnownColors() {
+    for (const KnownColorTable &table : aKnownColors) {
+        for (const KnownColor &color : table.aColor) {
+            for (int iOrder = 0; iOrder < 2; iOrder++) {
+                bool bRgba = iOrder == 0;
+                uint8_t aRgb[2 * 2 * 4];
+                for (int i = 0; i < 4; i++) {
+                    StorePixel(aRgb + i * 4, bRgba, color.r, color.g, color.b);
+                }
+
+                uint8_t aYuv[2 * 2 * 3];
+                Rgb32ToYuv444Host(aRgb, 8, bRgba, aYuv, 2, 2, 2, table.iMatrix, table.bFullRange);
+                for (int i = 0; i < 4; i++) {
+                    CHECK(aYuv[i] == color.y);
+                    CHECK(aYuv[4 + i] == color.u);
+                    CHECK(aYuv[8 + i] == color.v);
+                }
+
+                uint8_t aNv12[2 * 2 + 2];
+                Rgb32ToNv12Host(aRgb, 8, bRgba, aNv12, 2, 2, 2, table.iMatrix, table.bFullRange);
+                for (int i = 0; i < 4; i++) {
+                    CHECK(aNv12[i] == color.y);
+                }
+                CHECK(aNv12[4] == color.u);
+                CHECK(aNv12[5] == color.v);
+            }
+        }
+    }
+}
+
+static int ReferenceChroma(int iMatrix, bool bFullRange, bool bV, double r, double g, double b) {
+    float wr, wb;
+    GetLumaWeights(iMatrix, wr, wb);
+    double y = wr * r + (1.0 - wr - wb) * g + wb * b;
+    double c = bV ? (r - y) / (2.0 * (1.0 - wr)) : (b - y) / (2.0 * (1.0 - wb));
+    c = c * (bFullRange ? 1.0 : 224.0 / 255.0) + 128.0;
+    return c < 0.0 ? 0 : (c > 255.0 ? 255 : (int)(c + 0.5));
+}
+
+static bool Near(int a, int b) {
+    return abs(a - b) <= 1;
+}
+
+// Odd sizes replicate the last column and row into the chroma average; padding past the width stays untouched
+static void TestOddSizes(int nWidth, int nHeight, int iMatrix, bool bFullRange) {
+    const int nRgbPitch = nWidth * 4 + 12, nPitch = nWidth + 5;
+    const uint8_t nSentinel = 0xA5;
+    std::vector<uint8_t> vRgba(nRgbPitch * nHeight), vBgra(nRgbPitch * nHeight);
+    srand(nWidth * 31 + nHeight);
+    for (int y = 0; y < nHeight; y++) {
+        for (int x = 0; x < nWidth; x++) {
+            uint8_t r = rand() & 0xFF, g = rand() & 0xFF, b = rand() & 0xFF;
+            StorePixel(&vRgba[y * nRgbPitch + x * 4], true, r, g, b);
+            StorePixel(&vBgra[y * nRgbPitch + x * 4], false, r, g, b);
+        }
+    }
+
+    int nChromaHeight = (nHeight + 1) / 2;
+    std::vector<uint8_t> vNv12(nPitch * (nHeight + nChromaHeight), nSentinel);
+    std::vector<uint8_t> vNv12Bgra(vNv12.size(), nSentinel);
+    std::vector<uint8_t> vYuv444(nPitch * nHeight * 3, nSentinel);
+    Rgb32ToNv12Host(vRgba.data(), nRgbPitch, true, vNv12.data(), nPitch, nWidth, nHeight, iMatrix, bFullRange);
+    Rgb32ToNv12Host(vBgra.data(), nRgbPitch, false, vNv12Bgra.data(), nPitch, nWidth, nHeight, iMatrix, bFullRange);
+    Rgb32ToYuv444Host(vRgba.data(), nRgbPitch, true, vYuv444.data(), nPitch, nWidth, nHeight, iMatrix, bFullRange);
+    CHECK(vNv12 == vNv12Bgra);
+
+    // Luma does not depend on the chroma layout
+    for (int y = 0; y < nHeight; y++) {
+        for (int x = 0; x < nPitch; x++) {
+            CHECK(vNv12[y * nPitch + x] == (x < nWidth ? vYuv444[y * nPitch + x] : nSentinel));
+        }
+    }
+
+    const uint8_t *pUv = vNv12.data() + nPitch * nHeight;
+    int nChromaWidth = (nWidth + 1) / 2;
+    for (int y = 0; y < nChromaHeight; y++) {
+        for (int x = 0; x < nChromaWidth; x++) {
+            double r = 0.0, g = 0.0, b = 0.0;
+            for (int i = 0; i < 4; i++) {
+                int px = 2 * x + (i & 1), py = 2 * y + (i >> 1);
+                px = px < nWidth ? px : nWidth - 1;
+                py = py < nHeight ? py : nHeight - 1;
+                const uint8_t *p = &vRgba[py * nRgbPitch + px * 4];
+                r += p[0];
+                g += p[1];
+                b += p[2];
+            }
+            const uint8_t *pDst = pUv + y * nPitch + 2 * x;
+            CHECK(Near(pDst[0], ReferenceChroma(iMatrix, bFullRange, false, r / 4, g / 4, b / 4)));
+            CHECK(Near(pDst[1], ReferenceChroma(iMatrix, bFullRange, true, r / 4, g / 4, b / 4)));
+        }
+        for (int x = 2 * nChromaWidth; x < nPitch; x++) {
+            CHECK(pUv[y * nPitch + x] == nSentinel);
+        }
+    }
+}
+
+int main() {
+    TestKnownColors();
+    const int aMatrix[] = {ColorSpaceStandard_BT601, ColorSpaceStandard_BT709, ColorSpaceStandard_BT2020};
+    for (int iMatrix : aMatrix) {
+        for (int iRange = 0; iRange < 2; iRange++) {
+            TestOddSizes(5, 3, iMatrix, iRange != 0);
+            TestOddSizes(1, 1, iMatrix, iRange != 0);
+            TestOddSizes(16, 9, iMatrix, iRange != 0);
+            TestOddSizes(8, 4, iMatrix, iRange != 0);
+        }
+    }
+    return TestResult();
+}
@@ -0,0 +1,301 @@
+#include <string.h>
+#include <string>
+#include <vector>
+#include "Fmp4Writer.h"
+#include "TestCheck.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file Fmp4WriterTest.cpp
+//! \brief Writes H.264 init segments and fragments with Fmp4Writer and reads them back with
+//! a small box parser: box sizes, trun entries, data offsets and the mdat payload of fragments
+//! that have the reserved number of samples, more and fewer. Also feeds truncated parameter
+//! sets to the avcC/hvcC builders.
+//---------------------------------------------------------------------------
+
+struct Box {
+    std::string type;
+    const uint8_t *pPayload;
+    size_t nPayload;
+    size_t nOffset;             /*!< Of the box header from the start of the parsed buffer */
+    std::vector<Box> vChildren;
+};
+
+static uint32_t Get32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static bool IsContainer(const std::string &type) {
+    static const char *aszContainers[] = {"moov", "trak", "mdia", "minf", "dinf", "stbl", "mvex", "moof", "traf"};
+    for (const char *sz : aszContainers) {
+        if (type == sz) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Boxes must tile [p, p + n) exactly; returns false on the first size that does not fit
+static bool ParseBoxes(const uint8_t *pBase, const uint8_t *p, size_t n, std::vector<Box> &vBoxes) {
+    while (n) {
+        if (n < 8) {
+            return false;
+        }
+        uint32_t nSize = Get32(p);
+        if (nSize < 8 || nSize > n) {
+            return false;
+        }
+        Box box;
+        box.type.assign((const char *)p + 4, 4);
+        box.pPayload = p + 8;
+        box.nPayload = nSize - 8;
+        box.nOffset = p - pBase;
+        if (IsContainer(box.type) && !ParseBoxes(pBase, box.pPayload, box.nPayload, box.vChildren)) {
+            return false;
+        }
+        vBoxes.push_back(box);
+        p += nSize;
+        n -= nSize;
+    }
+    return true;
+}
+
+static const Box *FindBox(const std::vector<Box> &vBoxes, const char *szPath) {
+    std::string path(szPath), type = path.substr(0, 4);
+    for (const Box &box : vBoxes) {
+        if (box.type == type) {
+            return path.size() == 4 ? &box : FindBox(box.vChildren, szPath + 5);
+        }
+    }
+    return NULL;
+}
+
+// Baseline SPS with seq_parameter_set_id 0, and a PPS
+static const uint8_t aSps[] = {0x67, 0x42, 0x00, 0x1F, 0xE9, 0x40};
+static const uint8_t aPps[] = {0x68, 0xCE, 0x3C, 0x80};
+
+static void AppendNal(std::vector<uint8_t> &v, const std::vector<uint8_t> &vNal) {
+    v.insert(v.end(), {0, 0, 0, 1});
+    v.insert(v.end(), vNal.begin(), vNal.end());
+}
+
+struct TestSample {
+    std::vector<uint8_t> vAnnexB;
+    std::vector<uint8_t> vExpected;     /*!< Length-prefixed, without AUD and parameter sets */
+    int64_t nDts, nPts;
+    bool bKey;
+};
+
+static TestSample MakeSample(int i, bool bKey) {
+    TestSample s;
+    s.nDts = i * 3000;
+    s.nPts = s.nDts + (i % 3) * 3000;
+    s.bKey = bKey;
+    AppendNal(s.vAnnexB, {0x09, 0xF0});
+    if (bKey) {
+        AppendNal(s.vAnnexB, std::vector<uint8_t>(aSps, aSps + sizeof(aSps)));
+        AppendNal(s.vAnnexB, std::vector<uint8_t>(aPps, aPps + sizeof(aPps)));
+    }
+    // One or two slices with distinct payloads
+    for (int iSlice = 0; iSlice <= i % 2; iSlice++) {
+        std::vector<uint8_t> vSlice = {(uint8_t)(bKey ? 0x65 : 0x41)};
+        for (int j = 0; j < 10 + i * 7 + iSlice; j++) {
+            vSlice.push_back((uint8_t)(0x80 | (i * 31 + j)));
+        }
+        AppendNal(s.vAnnexB, vSlice);
+        s.vExpected.insert(s.vExpected.end(), {0, 0, 0, (uint8_t)vSlice.size()});
+        s.vExpected.insert(s.vExpected.end(), vSlice.begin(), vSlice.end());
+    }
+    return s;
+}
+
+static void TestInitSegment() {
+    Fmp4Writer writer(cdc::CODEC_TYPE_H264, 1920, 1080, 90000, 3000);
+    std::vector<uint8_t> vInit;
+    CHECK(!writer.WriteInitSegment(vInit));
+
+    std::vector<uint8_t> vHeader;
+    AppendNal(vHeader, std::vector<uint8_t>(aSps, aSps + sizeof(aSps)));
+    AppendNal(vHeader, std::vector<uint8_t>(aPps, aPps + sizeof(aPps)));
+    CHECK(writer.SetSequenceHeader(vHeader.data(), vHeader.size()));
+    CHECK(writer.GetCodecString() == "avc1.42001F");
+    CHECK(writer.WriteInitSegment(vInit));
+
+    std::vector<Box> vBoxes;
+    CHECK(ParseBoxes(vInit.data(), vInit.data(), vInit.size(), vBoxes));
+    CHECK(vBoxes.size() == 2 && vBoxes[0].type == "ftyp" && vBoxes[1].type == "moov");
+    CHECK(FindBox(vBoxes, "moov/mvhd") && FindBox(vBoxes, "moov/trak/tkhd") && FindBox(vBoxes, "moov/mvex/trex"));
+    const Box *pStsd = FindBox(vBoxes, "moov/trak/mdia/minf/stbl/stsd");
+    CHECK(pStsd != NULL);
+    if (pStsd) {
+        // Full box header and entry count, then the avc1 entry: 78 bytes of visual sample entry and the avcC
+        std::vector<Box> vEntries;
+        CHECK(Get32(pStsd->pPayload + 4) == 1);
+        CHECK(ParseBoxes(vInit.data(), pStsd->pPayload + 8, pStsd->nPayload - 8, vEntries));
+        CHECK(vEntries.size() == 1 && vEntries[0].type == "avc1");
+        if (vEntries.size() == 1) {
+            const uint8_t *pEntry = vEntries[0].pPayload;
+            CHECK(((pEntry[24] << 8) | pEntry[25]) == 1920 && ((pEntry[26] << 8) | pEntry[27]) == 1080);
+            std::vector<Box> vConfig;
+            CHECK(ParseBoxes(vInit.data(), pEntry + 78, vEntries[0].nPayload - 78, vConfig));
+            CHECK(vConfig.size() == 1 && vConfig[0].type == "avcC");
+            if (vConfig.size() == 1) {
+                const uint8_t *p = vConfig[0].pPayload;
+                CHECK(p[0] == 1 && p[1] == 0x42 && p[3] == 0x1F && p[4] == 0xFF && p[5] == 0xE1);
+                CHECK(((p[6] << 8) | p[7]) == sizeof(aSps) && !memcmp(p + 8, aSps, sizeof(aSps)));
+            }
+        }
+    }
+}
+
+// Checks one moof + mdat pair at nOffset of vOut against the samples that went into it
+static size_t CheckFragment(const std::vector<uint8_t> &vOut, size_t nOffset, const std::vector<TestSample> &vSamples, size_t iFirst,
+    size_t nCount, int64_t nNextDts, uint32_t nSequence) {
+    std::vector<Box> vBoxes;
+    const uint8_t *pMoof = vOut.data() + nOffset;
+    uint32_t nMoofSize = Get32(pMoof);
+    uint32_t nMdatSize = nOffset + nMoofSize + 8 <= vOut.size() ? Get32(pMoof + nMoofSize) : 0;
+    CHECK(nMdatSize >= 8 && nOffset + nMoofSize + nMdatSize <= vOut.size());
+    if (nMdatSize < 8 || !ParseBoxes(pMoof, pMoof, nMoofSize + nMdatSize, vBoxes)) {
+        CHECK(!"fragment boxes do not parse");
+        return vOut.size();
+    }
+    CHECK(vBoxes.size() == 2 && vBoxes[0].type == "moof" && vBoxes[1].type == "mdat");
+    const Box *pMfhd = FindBox(vBoxes, "moof/mfhd"), *pTfdt = FindBox(vBoxes, "moof/traf/tfdt");
+    const Box *pTrun = FindBox(vBoxes, "moof/traf/trun");
+    CHECK(pMfhd && pTfdt && pTrun);
+    if (!pMfhd || !pTfdt || !pTrun) {
+        return vOut.size();
+    }
+    CHECK(Get32(pMfhd->pPayload + 4) == nSequence);
+    CHECK(Get32(pTfdt->pPayload + 8) == (uint32_t)vSamples[iFirst].nDts);
+
+    const uint8_t *p = pTrun->pPayload;
+    CHECK(Get32(p) == 0x01000F01);
+    CHECK(Get32(p + 4) == nCount);
+    CHECK(pTrun->nPayload == 12 + 16 * nCount);
+    // default-base-is-moof: the data offset counts from the first byte of the moof
+    uint32_t nDataOffset = Get32(p + 8);
+    CHECK(nDataOffset == vBoxes[1].nOffset + 8);
+    std::vector<uint8_t> vExpected;
+    for (size_t i = 0; i < nCount; i++) {
+        const TestSample &s = vSamples[iFirst + i];
+        const uint8_t *pEntry = p + 12 + 16 * i;
+        int64_t nEnd = iFirst + i + 1 < iFirst + nCount ? vSamples[iFirst + i + 1].nDts : nNextDts;
+        CHECK(Get32(pEntry) == (uint32_t)(nEnd - s.nDts));
+        CHECK(Get32(pEntry + 4) == s.vExpected.size());
+        CHECK(Get32(pEntry + 8) == (s.bKey ? 0x02000000u : 0x01010000u));
+        CHECK((int32_t)Get32(pEntry + 12) == (int32_t)(s.nPts - s.nDts));
+        vExpected.insert(vExpected.end(), s.vExpected.begin(), s.vExpected.end());
+    }
+    CHECK(vBoxes[1].nPayload == vExpected.size() && !memcmp(pMoof + nDataOffset, vExpected.data(), vExpected.size()));
+    return nOffset + nMoofSize + nMdatSize;
+}
+
+static void TestFragments() {
+    Fmp4Writer writer(cdc::CODEC_TYPE_H264, 1280, 720, 90000, 3000);
+    std::vector<uint8_t> vHeader;
+    AppendNal(vHeader, std::vector<uint8_t>(aSps, aSps + sizeof(aSps)));
+    AppendNal(vHeader, std::vector<uint8_t>(aPps, aPps + sizeof(aPps)));
+    CHECK(writer.SetSequenceHeader(vHeader.data(), vHeader.size()));
+
+    // Fragments of 3, 5 (more than reserved) and 2 (fewer, leaves a free box) samples after some existing bytes
+    const size_t anCounts[] = {3, 5, 2};
+    std::vector<TestSample> vSamples;
+    for (int i = 0; i < 10; i++) {
+        vSamples.push_back(MakeSample(i, i == 0 || i == 3 || i == 8));
+    }
+    std::vector<uint8_t> vOut = {'x', 'y', 'z'};
+    size_t iSample = 0;
+    std::vector<size_t> vStarts;
+    for (size_t nCount : anCounts) {
+        vStarts.push_back(vOut.size());
+        for (size_t i = 0; i < nCount; i++, iSample++) {
+            const TestSample &s = vSamples[iSample];
+            CHECK(writer.AddSample(vOut, s.vAnnexB.data(), s.vAnnexB.size(), s.nDts, s.nPts, s.bKey));
+        }
+        CHECK(writer.GetPendingSampleCount() == nCount);
+        int64_t nNextDts = iSample < vSamples.size() ? vSamples[iSample].nDts : vSamples[iSample - 1].nDts + 3000;
+        CHECK(writer.WriteFragment(vOut, nNextDts));
+        CHECK(writer.GetPendingSampleCount() == 0);
+    }
+    CHECK(vOut[0] == 'x' && vOut[1] == 'y' && vOut[2] == 'z');
+
+    size_t nOffset = vStarts[0], iFirst = 0;
+    for (size_t iFragment = 0; iFragment < vStarts.size(); iFragment++) {
+        CHECK(nOffset == vStarts[iFragment]);
+        size_t nCount = anCounts[iFragment];
+        int64_t nNextDts = iFirst + nCount < vSamples.size() ? vSamples[iFirst + nCount].nDts : vSamples[iFirst + nCount - 1].nDts + 3000;
+        nOffset = CheckFragment(vOut, nOffset, vSamples, iFirst, nCount, nNextDts, (uint32_t)iFragment + 1);
+        iFirst += nCount;
+    }
+    CHECK(nOffset == vOut.size());
+
+    // The last fragment had room for 5 trun entries and used 2
+    std::vector<Box> vBoxes;
+    CHECK(ParseBoxes(vOut.data(), vOut.data() + vStarts[2], vOut.size() - vStarts[2], vBoxes));
+    const Box *pFree = FindBox(vBoxes, "moof/free");
+    CHECK(pFree && pFree->nPayload + 8 == 3 * 16);
+
+    // A fragment must be completed in the buffer its samples went to, and an empty fragment is not written
+    std::vector<uint8_t> vOther;
+    const TestSample &s = vSamples[0];
+    CHECK(writer.AddSample(vOut, s.vAnnexB.data(), s.vAnnexB.size(), 0, 0, true));
+    CHECK(!writer.AddSample(vOther, s.vAnnexB.data(), s.vAnnexB.size(), 3000, 3000, false));
+    CHECK(!writer.WriteFragment(vOther));
+    CHECK(writer.WriteFragment(vOut));
+    CHECK(!writer.WriteFragment(vOut));
+
+    // A sample of nothing but parameter sets has no payload and leaves the buffer as it was
+    size_t nSize = vOut.size();
+    CHECK(!writer.AddSample(vOut, vHeader.data(), vHeader.size(), 0, 0, true));
+    CHECK(vOut.size() == nSize && writer.GetPendingSampleCount() == 0);
+}
+
+// Escapes an RBSP the way an encoder does, so 00 00 0x never appears in the NAL unit
+static std::vector<uint8_t> RbspToNal(const std::vector<uint8_t> &vHeader, const std::vector<uint8_t> &vRbsp) {
+    std::vector<uint8_t> vNal = vHeader;
+    int nZeros = 0;
+    for (uint8_t b : vRbsp) {
+        if (nZeros == 2 && b <= 3) {
+            vNal.push_back(3);
+            nZeros = 0;
+        }
+        vNal.push_back(b);
+        nZeros = b == 0 ? nZeros + 1 : 0;
+    }
+    return vNal;
+}
+
+static void TestTruncatedParameterSets() {
+    // An HEVC SPS whose 13 bytes of profile_tier_level() only reach 15 bytes with emulation prevention
+    std::vector<uint8_t> vRbsp = {0x01, 0x01, 0x60, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x5D, 0xAD, 0xC0};
+    std::vector<uint8_t> vSps = RbspToNal({0x42, 0x01}, vRbsp);
+    std::vector<uint8_t> vHeader;
+    AppendNal(vHeader, vSps);
+    Fmp4Writer hevc(cdc::CODEC_TYPE_H265, 1920, 1080, 90000, 3000);
+    CHECK(hevc.SetSequenceHeader(vHeader.data(), vHeader.size()));
+    CHECK(hevc.GetCodecString().rfind("hvc1.1.6.L93", 0) == 0);
+
+    vRbsp.resize(11);
+    vSps = RbspToNal({0x42, 0x01}, vRbsp);
+    CHECK(vSps.size() >= 15);
+    vHeader.clear();
+    AppendNal(vHeader, vSps);
+    CHECK(!hevc.SetSequenceHeader(vHeader.data(), vHeader.size()));
+
+    // An H.264 SPS of 4 bytes whose RBSP is 2
+    Fmp4Writer avc(cdc::CODEC_TYPE_H264, 1920, 1080, 90000, 3000);
+    vHeader.clear();
+    AppendNal(vHeader, {0x67, 0x00, 0x00, 0x03});
+    AppendNal(vHeader, std::vector<uint8_t>(aPps, aPps + sizeof(aPps)));
+    CHECK(!avc.SetSequenceHeader(vHeader.data(), vHeader.size()));
+}
+
+int main() {
+    TestInitSegment();
+    TestFragments();
+    TestTruncatedParameterSets();
+    return TestResult();
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "IVFReader.h"
+#include "IVFWriter.h"
+#include "TestCheck.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file IVFReaderTest.cpp
+//! \brief Checks Av1ObuParser on hand-built OBUs (leb128, OBU headers, the sequence header
+//! and frame types) and IVFReader on a file written with IVFWriter: temporal units,
+//! keyframe detection, the keyframe index, Seek() and a corrupt sequence header.
+//---------------------------------------------------------------------------
+
+class BitWriter {
+public:
+    void Put(uint32_t nValue, int nBits) {
+        for (int i = nBits - 1; i >= 0; i--) {
+            if (nPos % 8 == 0) {
+                v.push_back(0);
+            }
+            v.back() |= ((nValue >> i) & 1) << (7 - nPos % 8);
+            nPos++;
+        }
+    }
+    std::vector<uint8_t> v;
+
+private:
+    int nPos = 0;
+};
+
+// Main profile 1920x1080, level 4.0, 8-bit 4:2:0, BT.709, full range
+static std::vector<uint8_t> MakeSequenceHeaderPayload() {
+    BitWriter bw;
+    bw.Put(0, 3);           // seq_profile
+    bw.Put(0, 1);           // still_picture
+    bw.Put(0, 1);           // reduced_still_picture_header
+    bw.Put(0, 1);           // timing_info_present_flag
+    bw.Put(0, 1);           // initial_display_delay_present_flag
+    bw.Put(0, 5);           // operating_points_cnt_minus_1
+    bw.Put(0, 12);          // operating_point_idc[0]
+    bw.Put(8, 5);           // seq_level_idx[0]
+    bw.Put(0, 1);           // seq_tier[0]
+    bw.Put(10, 4);          // frame_width_bits_minus_1
+    bw.Put(10, 4);          // frame_height_bits_minus_1
+    bw.Put(1919, 11);
+    bw.Put(1079, 11);
+    bw.Put(0, 1);           // frame_id_numbers_present_flag
+    bw.Put(0, 3);           // use_128x128_superblock .. enable_intra_edge_filter
+    bw.Put(0, 4);           // enable_interintra_compound .. enable_dual_filter
+    bw.Put(1, 1);           // enable_order_hint
+    bw.Put(0, 2);           // enable_jnt_comp, enable_ref_frame_mvs
+    bw.Put(1, 1);           // seq_choose_screen_content_tools
+    bw.Put(1, 1);           // seq_choose_integer_mv
+    bw.Put(6, 3);           // order_hint_bits_minus_1
+    bw.Put(0, 3);           // enable_superres, enable_cdef, enable_restoration
+    bw.Put(0, 1);           // high_bitdepth
+    bw.Put(0, 1);           // mono_chrome
+    bw.Put(1, 1);           // color_description_present_flag
+    bw.Put(1, 8);
+    bw.Put(1, 8);
+    bw.Put(1, 8);
+    bw.Put(1, 1);           // color_range
+    bw.Put(0, 2);           // chroma_sample_position
+    bw.Put(0, 1);           // film_grain_params_present
+    bw.Put(1, 1);           // trailing_one_bit
+    return bw.v;
+}
+
+static void AppendObu(std::vector<uint8_t> &v, int nType, const std::vector<uint8_t> &vPayload) {
+    v.push_back((uint8_t)((nType << 3) | 0x02));
+    uint8_t aSize[8];
+    v.insert(v.end(), aSize, aSize + WriteLeb128(aSize, vPayload.size()));
+    v.insert(v.end(), vPayload.begin(), vPayload.end());
+}
+
+// show_existing_frame = 0, frame_type, show_frame, then filler
+static std::vector<uint8_t> MakeFramePayload(AV1_FRAME_TYPE eType, bool bShow) {
+    return {(uint8_t)((eType << 5) | (bShow ? 0x10 : 0)), 0xAB, 0xCD};
+}
+
+static std::vector<uint8_t> MakeTemporalUnit(AV1_FRAME_TYPE eType, const std::vector<uint8_t> *pSequenceHeader, bool bShow = true) {
+    std::vector<uint8_t> v;
+    AppendObu(v, OBU_TEMPORAL_DELIMITER, {});
+    if (pSequenceHeader) {
+        AppendObu(v, OBU_SEQUENCE_HEADER, *pSequenceHeader);
+    }
+    AppendObu(v, OBU_FRAME, MakeFramePayload(eType, bShow));
+    return v;
+}
+
+static void TestLeb128() {
+    for (uint64_t nValue : {0ull, 1ull, 127ull, 128ull, 300ull, 0xFFFFFFFFull}) {
+        for (int nBytes : {0, 4, 8}) {
+            uint8_t a[8];
+            int n = WriteLeb128(a, nValue, nBytes);
+            CHECK(n >= nBytes);
+            const uint8_t *p = a;
+            uint64_t nRead = 0;
+            CHECK(ReadLeb128(p, a + n, nRead) && nRead == nValue && p == a + n);
+        }
+    }
+    // Truncated, and more than 8 bytes
+    const uint8_t aTruncated[] = {0x80, 0x80};
+    const uint8_t aLong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+    const uint8_t *p = aTruncated;
+    uint64_t nValue = 0;
+    CHECK(!ReadLeb128(p, aTruncated + sizeof(aTruncated), nValue));
+    p = aLong;
+    CHECK(!ReadLeb128(p, aLong + sizeof(aLong), nValue));
+}
+
+static void TestObuSplitting() {
+    std::vector<uint8_t> vSeq = MakeSequenceHeaderPayload();
+    std::vector<uint8_t> vTu = MakeTemporalUnit(AV1_KEY_FRAME, &vSeq);
+    // An OBU with an extension header (temporal_id 2, spatial_id 1) and no size field runs to the end
+    vTu.insert(vTu.end(), {(uint8_t)((OBU_PADDING << 3) | 0x04), (2 << 5) | (1 << 3), 0, 0, 0});
+
+    std::vector<ObuUnit> vObu;
+    CHECK(SplitObuUnits(vTu.data(), vTu.size(), vObu) == 4);
+    CHECK(vObu[0].nType == OBU_TEMPORAL_DELIMITER && vObu[0].nPayloadSize == 0);
+    CHECK(vObu[1].nType == OBU_SEQUENCE_HEADER && vObu[1].nPayloadSize == vSeq.size());
+    CHECK(vObu[2].nType == OBU_FRAME && vObu[2].nPayloadSize == 3);
+    CHECK(vObu[3].nType == OBU_PADDING && vObu[3].bHasExtension && vObu[3].nTemporalId == 2 && vObu[3].nSpatialId == 1);
+    CHECK(vObu[3].nPayloadSize == 3 && vObu[3].pData + vObu[3].nSize == vTu.data() + vTu.size());
+
+    // A size past the end of the buffer and the forbidden bit stop the split
+    std::vector<uint8_t> vBad = {0x12, 0x00, 0x32, 0x09, 0x10};
+    CHECK(SplitObuUnits(vBad.data(), vBad.size(), vObu) == 1);
+    vBad = {0x92, 0x00};
+    CHECK(SplitObuUnits(vBad.data(), vBad.size(), vObu) == 0);
+}
+
+static void TestSequenceHeader() {
+    std::vector<uint8_t> vSeq = MakeSequenceHeaderPayload();
+    Av1SequenceHeader seq;
+    CHECK(ParseSequenceHeader(vSeq.data(), vSeq.size(), seq));
+    CHECK(seq.nProfile == 0 && !seq.bStillPicture && !seq.bReducedStillPictureHeader);
+    CHECK(seq.nLevelIdx == 8 && seq.nTier == 0);
+    CHECK(seq.nMaxFrameWidth == 1920 && seq.nMaxFrameHeight == 1080);
+    CHECK(seq.nBitDepth == 8 && !seq.bMonochrome && seq.nSubsamplingX == 1 && seq.nSubsamplingY == 1);
+    CHECK(seq.nColorPrimaries == 1 && seq.nTransferCharacteristics == 1 && seq.nMatrixCoefficients == 1);
+    CHECK(seq.bFullRange && !seq.bTimingInfoPresent);
+
+    // Truncated: parsing fails, and FindSequenceHeader() leaves the previous header alone
+    CHECK(!ParseSequenceHeader(vSeq.data(), 4, seq));
+    std::vector<uint8_t> vTruncated(vSeq.begin(), vSeq.begin() + 4);
+    std::vector<uint8_t> vTu = MakeTemporalUnit(AV1_KEY_FRAME, &vTruncated);
+    Av1SequenceHeader found = {};
+    found.nMaxFrameWidth = 1234;
+    CHECK(!FindSequenceHeader(vTu.data(), vTu.size(), found) && found.nMaxFrameWidth == 1234);
+
+    // Only a sequence header ahead of the first frame counts
+    vTu = MakeTemporalUnit(AV1_KEY_FRAME, &vSeq);
+    CHECK(FindSequenceHeader(vTu.data(), vTu.size(), found) && found.nMaxFrameWidth == 1920);
+    vTu = MakeTemporalUnit(AV1_KEY_FRAME, NULL);
+    AppendObu(vTu, OBU_SEQUENCE_HEADER, vSeq);
+    CHECK(!FindSequenceHeader(vTu.data(), vTu.size(), found));
+}
+
+static void TestKeyFrameDetection() {
+    std::vector<uint8_t> vSeq = MakeSequenceHeaderPayload();
+    std::vector<uint8_t> v = MakeTemporalUnit(AV1_KEY_FRAME, &vSeq);
+    CHECK(IsKeyFrameTemporalUnit(v.data(), v.size()));
+    v = MakeTemporalUnit(AV1_KEY_FRAME, NULL);
+    CHECK(IsKeyFrameTemporalUnit(v.data(), v.size()));
+    v = MakeTemporalUnit(AV1_INTER_FRAME, NULL);
+    CHECK(!IsKeyFrameTemporalUnit(v.data(), v.size()));
+    v = MakeTemporalUnit(AV1_INTRA_ONLY_FRAME, NULL);
+    CHECK(!IsKeyFrameTemporalUnit(v.data(), v.size()));
+    // A key frame that is not shown cannot start decoding
+    v = MakeTemporalUnit(AV1_KEY_FRAME, NULL, false);
+    CHECK(!IsKeyFrameTemporalUnit(v.data(), v.size()));
+    // show_existing_frame
+    v.clear();
+    AppendObu(v, OBU_FRAME_HEADER, {0x80});
+    CHECK(!IsKeyFrameTemporalUnit(v.data(), v.size()));
+
+    // With a reduced still picture header every frame is a key frame and the frame header has no frame_type
+    Av1SequenceHeader seq = {};
+    seq.bReducedStillPictureHeader = true;
+    v = MakeTemporalUnit(AV1_INTER_FRAME, NULL);
+    CHECK(IsKeyFrameTemporalUnit(v.data(), v.size(), &seq));
+}
+
+static void TestReader() {
+    std::string path = "ivf_reader_test.ivf";
+    std::vector<uint8_t> vSeq = MakeSequenceHeaderPayload();
+    // A corrupt sequence header in temporal unit 4 must not replace the good one; this truncation parses as
+    // reduced_still_picture_header = 1, which would turn every later frame into a key frame
+    std::vector<uint8_t> vCorrupt = {0x18};
+    std::vector<std::vector<uint8_t>> vTu = {
+        MakeTemporalUnit(AV1_KEY_FRAME, &vSeq),
+        MakeTemporalUnit(AV1_INTER_FRAME, NULL),
+        MakeTemporalUnit(AV1_INTER_FRAME, NULL),
+        MakeTemporalUnit(AV1_KEY_FRAME, NULL),
+        MakeTemporalUnit(AV1_INTER_FRAME, &vCorrupt),
+        MakeTemporalUnit(AV1_INTER_FRAME, NULL),
+    };
+    const bool abKey[] = {true, false, false, true, true, false};
+    {
+        IVFWriter writer(path.c_str(), MAKE_FOURCC('A', 'V', '0', '1'), 1920, 1080, 30, 1);
+        CHECK(writer.IsValid());
+        for (size_t i = 0; i < vTu.size(); i++) {
+            CHECK(writer.WriteFrame(vTu[i].data(), vTu[i].size(), (int64_t)i * 2));
+        }
+    }
+
+    IVFReader reader(path.c_str());
+    CHECK(reader.IsValid() && reader.IsAV1());
+    CHECK(reader.GetWidth() == 1920 && reader.GetHeight() == 1080);
+    CHECK(reader.GetFrameRateNum() == 30 && reader.GetFrameRateDen() == 1);
+    CHECK(reader.GetHeaderFrameCount() == vTu.size());
+
+    std::vector<uint64_t> vOffset;
+    cdc::CodecPacket packet = {};
+    for (size_t i = 0; i < vTu.size(); i++) {
+        CHECK(reader.ReadPacket(packet));
+        CHECK(packet.size == vTu[i].size() && !memcmp(packet.data, vTu[i].data(), packet.size));
+        CHECK(packet.timestamp == i * 2);
+        // Unit 4 carries the corrupt header itself, so only the unit after it tells whether the good one survived
+        if (i != 4) {
+            CHECK(packet.keyFrame == abKey[i]);
+        }
+    }
+    CHECK(!reader.ReadPacket(packet));
+    Av1SequenceHeader seq;
+    CHECK(reader.GetSequenceHeader(seq) && seq.nMaxFrameWidth == 1920 && !seq.bReducedStillPictureHeader);
+
+    // The index keeps the read position
+    reader.Rewind();
+    IVFFrame frame;
+    CHECK(reader.ReadFrame(frame) && frame.nPts == 0);
+    std::vector<IVFFrame> vKeyFrames;
+    reader.BuildKeyFrameIndex(vKeyFrames);
+    CHECK(reader.ReadFrame(frame) && frame.nPts == 2);
+    CHECK(vKeyFrames.size() == 3);
+    CHECK(vKeyFrames.size() >= 2 && vKeyFrames[0].nPts == 0 && vKeyFrames[1].nPts == 6);
+    CHECK(vKeyFrames.size() >= 2 && vKeyFrames[0].nOffset == 32 && vKeyFrames[1].nOffset > vKeyFrames[0].nOffset);
+
+    // Seek to an indexed keyframe and read on from there
+    CHECK(vKeyFrames.size() >= 2 && reader.Seek(vKeyFrames[1].nOffset));
+    CHECK(reader.ReadFrame(frame) && frame.nPts == 6 && frame.nSize == vTu[3].size());
+    CHECK(reader.ReadFrame(frame) && frame.nPts == 8);
+    CHECK(!reader.Seek(0) && !reader.Seek(1ull << 40));
+    remove(path.c_str());
+
+    // A frame whose size runs past the end of the file is not returned
+    FILE *fp = fopen(path.c_str(), "wb");
+    uint8_t aHeader[32];
+    IVFUtils::WriteFileHeader(aHeader, MAKE_FOURCC('A', 'V', '0', '1'), 64, 64, 30, 1, 1);
+    uint8_t aFrame[12];
+    IVFUtils::WriteFrameHeader(aFrame, 100, 0);
+    fwrite(aHeader, 1, sizeof(aHeader), fp);
+    fwrite(aFrame, 1, sizeof(aFrame), fp);
+    fwrite(vTu[0].data(), 1, vTu[0].size(), fp);
+    fclose(fp);
+    IVFReader truncated(path.c_str());
+    CHECK(truncated.IsValid() && !truncated.ReadFrame(frame));
+    remove(path.c_str());
+}
+
+int main() {
+    TestLeb128();
+    TestObuSplitting();
+    TestSequenceHeader();
+    TestKeyFrameDetection();
+    TestReader();
+    return TestResult();
+}
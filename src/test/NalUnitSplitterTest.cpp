@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "NalUnitSplitter.h"
+#include "TestCheck.h"
+
+//---------------------------------------------------------------------------
+//! \file NalUnitSplitterTest.cpp
+//! \brief Checks the start code scanners of every instruction set this CPU has against a
+//! byte-by-byte search, and SplitNalUnits() and the NAL helpers on hand-built streams.
+//---------------------------------------------------------------------------
+
+static const uint8_t *FindStartCodeNaive(const uint8_t *p, const uint8_t *pEnd) {
+    for (; pEnd - p >= 3; p++) {
+        if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+            return p;
+        }
+    }
+    return pEnd;
+}
+
+// Mostly zeros and ones so that start codes, near misses and runs of zeros are everywhere
+static void TestScannersRandom() {
+    std::mt19937 rng(7);
+    for (HOST_SIMD_LEVEL eLevel : GetNalStartCodeLevels()) {
+        NalStartCodeScanner pfnScan = GetNalStartCodeScanner(eLevel);
+        int nMismatches = 0;
+        for (int iBuf = 0; iBuf < 2000; iBuf++) {
+            std::vector<uint8_t> vBuf(rng() % 200);
+            int nDensity = 2 + rng() % 40;
+            for (uint8_t &b : vBuf) {
+                int r = rng() % nDensity;
+                b = r == 0 ? 1 : (r < nDensity / 2 ? 0 : (uint8_t)rng());
+            }
+            const uint8_t *pEnd = vBuf.data() + vBuf.size();
+            // Every start offset, so the vector loops see every alignment and tail length
+            for (size_t i = 0; i <= vBuf.size(); i++) {
+                const uint8_t *p = vBuf.data() + i;
+                nMismatches += pfnScan(p, pEnd) != FindStartCodeNaive(p, pEnd);
+            }
+        }
+        if (nMismatches) {
+            printf("%s scanner: %d mismatches\n", GetNalStartCodeScannerName(eLevel), nMismatches);
+        }
+        CHECK(nMismatches == 0);
+    }
+}
+
+static void TestScannersEdges() {
+    for (HOST_SIMD_LEVEL eLevel : GetNalStartCodeLevels()) {
+        NalStartCodeScanner pfnScan = GetNalStartCodeScanner(eLevel);
+        // A start code at every position of a long zero buffer, including the last three bytes
+        for (size_t nSize = 3; nSize < 100; nSize++) {
+            for (size_t iPos = 0; iPos + 3 <= nSize; iPos++) {
+                std::vector<uint8_t> vBuf(nSize, 0);
+                vBuf[iPos + 2] = 1;
+                const uint8_t *pFound = pfnScan(vBuf.data(), vBuf.data() + nSize);
+                CHECK(pFound == vBuf.data() + iPos);
+            }
+        }
+        // Zeros only, and buffers too short to hold a start code
+        uint8_t aTail[40] = {};
+        CHECK(pfnScan(aTail, aTail + sizeof(aTail)) == aTail + sizeof(aTail));
+        CHECK(pfnScan(aTail, aTail) == aTail);
+        CHECK(pfnScan(aTail, aTail + 2) == aTail + 2);
+    }
+}
+
+static void TestSplit() {
+    // Leading garbage, 4-byte SPS, 3-byte PPS, trailing zero bytes after the IDR, then an AUD and a slice
+    const uint8_t aStream[] = {0xAA, 0xBB, 0, 0, 0, 1, 0x67, 0x42, 0x00, 0x1F, 0, 0, 1, 0x68, 0xCE, 0, 0, 0, 1, 0x65, 0x88, 0x84, 0,
+        0, 0, 0, 0, 1, 0x09, 0xF0, 0, 0, 1, 0x41, 0x9A};
+    std::vector<NalUnit> vNal;
+    CHECK(SplitNalUnits(aStream, sizeof(aStream), vNal, NAL_CODEC_H264) == 5);
+    if (vNal.size() == 5) {
+        CHECK(vNal[0].nType == H264_NAL_SPS && vNal[0].nSize == 4 && vNal[0].nStartCodeSize == 4 && vNal[0].nOffset == 2);
+        CHECK(vNal[1].nType == H264_NAL_PPS && vNal[1].nSize == 2 && vNal[1].nStartCodeSize == 3 && vNal[1].nOffset == 10);
+        CHECK(vNal[2].nType == H264_NAL_IDR && vNal[2].nSize == 3 && vNal[2].nStartCodeSize == 4);
+        CHECK(vNal[3].nType == H264_NAL_AUD && vNal[3].nSize == 2 && vNal[3].nStartCodeSize == 4);
+        CHECK(vNal[4].nType == H264_NAL_SLICE && vNal[4].nSize == 2 && vNal[4].pData == aStream + sizeof(aStream) - 2);
+    }
+    CHECK(ContainsKeyFrame(aStream, sizeof(aStream), NAL_CODEC_H264));
+
+    std::vector<NalUnit> vParamSets;
+    ExtractParameterSets(vNal, NAL_CODEC_H264, vParamSets);
+    CHECK(vParamSets.size() == 2);
+
+    std::vector<uint8_t> vOut(sizeof(aStream) + vNal.size());
+    size_t nOut = StripAudNalUnits(vNal, NAL_CODEC_H264, vOut.data());
+    std::vector<NalUnit> vStripped;
+    CHECK(SplitNalUnits(vOut.data(), nOut, vStripped, NAL_CODEC_H264) == 4);
+    CHECK(nOut == 4 * 4 + 4 + 2 + 3 + 2);
+
+    // Empty buffer, no start code, and a start code with no payload
+    CHECK(SplitNalUnits(aStream, 0, vNal, NAL_CODEC_H264) == 0);
+    const uint8_t aNoStartCode[] = {1, 2, 3, 0, 0, 2, 0, 0};
+    CHECK(SplitNalUnits(aNoStartCode, sizeof(aNoStartCode), vNal, NAL_CODEC_H264) == 0);
+    const uint8_t aEmptyNal[] = {0, 0, 1, 0, 0, 1, 0x65, 0x11};
+    CHECK(SplitNalUnits(aEmptyNal, sizeof(aEmptyNal), vNal, NAL_CODEC_H264) == 1 && vNal[0].nType == H264_NAL_IDR);
+}
+
+static void TestHevc() {
+    // VPS, SPS, PPS, CRA slice
+    const uint8_t aStream[] = {0, 0, 0, 1, 0x40, 0x01, 0x0C, 0, 0, 0, 1, 0x42, 0x01, 0x01, 0, 0, 1, 0x44, 0x01, 0xC1, 0, 0, 1, 0x2A, 0x01,
+        0xAF};
+    std::vector<NalUnit> vNal;
+    CHECK(SplitNalUnits(aStream, sizeof(aStream), vNal, NAL_CODEC_HEVC) == 4);
+    if (vNal.size() == 4) {
+        CHECK(vNal[0].nType == HEVC_NAL_VPS && vNal[1].nType == HEVC_NAL_SPS && vNal[2].nType == HEVC_NAL_PPS);
+        CHECK(vNal[3].nType == HEVC_NAL_CRA);
+    }
+    CHECK(ContainsKeyFrame(aStream, sizeof(aStream), NAL_CODEC_HEVC));
+    // TRAIL_R is not a random access point
+    const uint8_t aTrail[] = {0, 0, 1, 0x02, 0x01, 0xD0};
+    CHECK(!ContainsKeyFrame(aTrail, sizeof(aTrail), NAL_CODEC_HEVC));
+}
+
+static void TestRbsp() {
+    const uint8_t aNal[] = {0x67, 0, 0, 3, 1, 0, 0, 3, 0, 0, 3};
+    std::vector<uint8_t> vRbsp;
+    NalToRbsp(aNal, sizeof(aNal), vRbsp);
+    const uint8_t aExpected[] = {0x67, 0, 0, 1, 0, 0, 0, 0};
+    CHECK(vRbsp.size() == sizeof(aExpected) && !memcmp(vRbsp.data(), aExpected, sizeof(aExpected)));
+}
+
+// x86-64 always has the SSE2 scanner, whatever the CPU reports; FindStartCode() uses the fastest one
+static void TestDispatch() {
+    std::vector<HOST_SIMD_LEVEL> vLevel = GetNalStartCodeLevels();
+#if defined(HOSTCC_X86_64)
+    CHECK(vLevel.size() >= 2 && vLevel[1] == HOST_SIMD_SSE41);
+    CHECK(GetNalStartCodeScanner(HOST_SIMD_SSE41) == FindStartCodeSse2);
+#endif
+    uint8_t aBuf[40];
+    memset(aBuf, 0xFF, sizeof(aBuf));
+    aBuf[33] = aBuf[34] = 0;
+    aBuf[35] = 1;
+    CHECK(FindStartCode(aBuf + 1, aBuf + sizeof(aBuf)) == aBuf + 33);
+    CHECK(GetNalStartCodeScanner(vLevel.back())(aBuf + 1, aBuf + sizeof(aBuf)) == aBuf + 33);
+}
+
+int main() {
+    printf("Best start code scanner: %s\n", GetNalStartCodeScannerName(GetNalStartCodeLevels().back()));
+    TestDispatch();
+    TestScannersRandom();
+    TestScannersEdges();
+    TestSplit();
+    TestHevc();
+    TestRbsp();
+    return TestResult();
+}
@@ -0,0 +1,265 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "PostprocessMath.h"
+#include "HostColorConvert.h"
+#include "TestCheck.h"
+
+//---------------------------------------------------------------------------
+//! \file PostprocessTest.cpp
+//! \brief Checks Nv12PostprocessHost(), the CPU reference of the fused crop + resize + RGB +
+//! normalize kernel. A 1:1 crop must match the plain NV12 to RGB conversion of the same
+//! region. Planar and interleaved outputs must hold the same values, and uint8, fp16 and
+//! fp32 must follow the scale and bias. Bilinear sampling must clamp to the crop rectangle.
+//---------------------------------------------------------------------------
+
+// Random luma and gently sloping chroma, which the centre-sited bilinear chroma fetch reproduces to within a quarter code value
+static std::vector<uint8_t> MakeNv12(int nWidth, int nHeight, int nPitch) {
+    std::vector<uint8_t> vNv12((size_t)nPitch * (nHeight + nHeight / 2));
+    srand(nWidth * 7 + nHeight);
+    for (int y = 0; y < nHeight; y++) {
+        for (int x = 0; x < nWidth; x++) {
+            vNv12[y * nPitch + x] = 16 + rand() % 220;
+        }
+    }
+    uint8_t *pUv = vNv12.data() + nPitch * nHeight;
+    for (int y = 0; y < nHeight / 2; y++) {
+        for (int x = 0; x < nWidth / 2; x++) {
+            pUv[y * nPitch + 2 * x] = (uint8_t)(90 + x);
+            pUv[y * nPitch + 2 * x + 1] = (uint8_t)(170 - y);
+        }
+    }
+    return vNv12;
+}
+
+static bool Near(int a, int b, int nTolerance) {
+    return abs(a - b) <= nTolerance;
+}
+
+static float HalfToFloat(uint16_t h) {
+    int nExp = (h >> 10) & 0x1F, nMant = h & 0x3FF;
+    float f = nExp == 0 ? ldexpf((float)nMant, -24) : ldexpf((float)(nMant | 0x400), nExp - 25);
+    return (h & 0x8000) ? -f : f;
+}
+
+static void TestCropMatchesPlainConversion(int iMatrix, bool bFullRange, int nCropX, int nCropY, int nCropWidth, int nCropHeight, bool bBgr) {
+    const int nWidth = 64, nHeight = 36, nPitch = 80;
+    std::vector<uint8_t> vNv12 = MakeNv12(nWidth, nHeight, nPitch);
+    std::vector<uint8_t> vBgra(nWidth * 4 * nHeight);
+    Nv12ToBgraHost(vNv12.data(), nPitch, vNv12.data() + nPitch * nHeight, nPitch, vBgra.data(), nWidth * 4, nWidth, nHeight,
+        iMatrix, bFullRange);
+
+    PostprocessParams params;
+    params.nCropX = nCropX;
+    params.nCropY = nCropY;
+    params.nCropWidth = nCropWidth;
+    params.nCropHeight = nCropHeight;
+    params.nDstWidth = nCropWidth;
+    params.nDstHeight = nCropHeight;
+    params.iMatrix = iMatrix;
+    params.bFullRange = bFullRange;
+    params.bBgr = bBgr;
+    std::vector<uint8_t> vRgb(nCropWidth * 3 * nCropHeight);
+    Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vRgb.data(), nCropWidth * 3, params,
+        POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_U8);
+
+    // Fixed point against float, plus the chroma interpolation: one code value
+    for (int y = 0; y < nCropHeight; y++) {
+        for (int x = 0; x < nCropWidth; x++) {
+            const uint8_t *pRgb = &vRgb[(y * nCropWidth + x) * 3];
+            const uint8_t *pBgra = &vBgra[((nCropY + y) * nWidth + nCropX + x) * 4];
+            for (int c = 0; c < 3; c++) {
+                CHECK(Near(pRgb[c], pBgra[bBgr ? c : 2 - c], 1));
+            }
+        }
+    }
+}
+
+template<POSTPROCESS_TYPE eType>
+static std::vector<uint8_t> RunLayout(const std::vector<uint8_t> &vNv12, int nWidth, int nHeight, int nPitch,
+    const PostprocessParams &params, POSTPROCESS_LAYOUT eLayout, int nDstPitch) {
+    size_t nSize = (size_t)nDstPitch * params.nDstHeight * (eLayout == POSTPROCESS_LAYOUT_PLANAR ? 3 : 1);
+    std::vector<uint8_t> vDst(nSize, 0xCD);
+    Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vDst.data(), nDstPitch, params, eLayout, eType);
+    return vDst;
+}
+
+// The same samples land at [c][y][x] in planar and at [y][x][c] in interleaved output; row padding is not written
+template<POSTPROCESS_TYPE eType>
+static void TestLayouts() {
+    const int nWidth = 48, nHeight = 32, nPitch = 48;
+    std::vector<uint8_t> vNv12 = MakeNv12(nWidth, nHeight, nPitch);
+    PostprocessParams params;
+    params.nCropX = 6;
+    params.nCropY = 4;
+    params.nCropWidth = 30;
+    params.nCropHeight = 20;
+    params.nDstWidth = 13;
+    params.nDstHeight = 7;
+    params.afScale[0] = 2.0f / 255.0f;
+    params.afBias[0] = -1.0f;
+
+    const size_t nSample = GetPostprocessSampleSize(eType);
+    const int nPlanarPitch = (params.nDstWidth + 3) * (int)nSample, nInterleavedPitch = (params.nDstWidth * 3 + 2) * (int)nSample;
+    std::vector<uint8_t> vPlanar = RunLayout<eType>(vNv12, nWidth, nHeight, nPitch, params, POSTPROCESS_LAYOUT_PLANAR, nPlanarPitch);
+    std::vector<uint8_t> vInterleaved = RunLayout<eType>(vNv12, nWidth, nHeight, nPitch, params, POSTPROCESS_LAYOUT_INTERLEAVED,
+        nInterleavedPitch);
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < params.nDstHeight; y++) {
+            const uint8_t *pPlanarRow = &vPlanar[((size_t)c * params.nDstHeight + y) * nPlanarPitch];
+            const uint8_t *pInterleavedRow = &vInterleaved[(size_t)y * nInterleavedPitch];
+            for (int x = 0; x < params.nDstWidth; x++) {
+                CHECK(!memcmp(pPlanarRow + x * nSample, pInterleavedRow + (x * 3 + c) * nSample, nSample));
+            }
+            for (size_t i = params.nDstWidth * nSample; i < (size_t)nPlanarPitch; i++) {
+                CHECK(pPlanarRow[i] == 0xCD);
+            }
+            for (size_t i = params.nDstWidth * 3 * nSample; i < (size_t)nInterleavedPitch; i++) {
+                CHECK(pInterleavedRow[i] == 0xCD);
+            }
+        }
+    }
+}
+
+static void TestFloatToHalf() {
+    CHECK(FloatToHalf(0.0f) == 0x0000);
+    CHECK(FloatToHalf(-0.0f) == 0x8000);
+    CHECK(FloatToHalf(1.0f) == 0x3C00);
+    CHECK(FloatToHalf(0.5f) == 0x3800);
+    CHECK(FloatToHalf(-2.0f) == 0xC000);
+    CHECK(FloatToHalf(255.0f) == 0x5BF8);
+    CHECK(FloatToHalf(65504.0f) == 0x7BFF);
+    CHECK(FloatToHalf(1.0e6f) == 0x7C00);
+    CHECK(FloatToHalf(INFINITY) == 0x7C00);
+    CHECK((FloatToHalf(NAN) & 0x7C00) == 0x7C00 && (FloatToHalf(NAN) & 0x3FF) != 0);
+    // Ties go to even, both up and down
+    CHECK(FloatToHalf(1.0f + ldexpf(1.0f, -11)) == 0x3C00);
+    CHECK(FloatToHalf(1.0f + 3.0f * ldexpf(1.0f, -11)) == 0x3C02);
+    // Subnormals, and the carry from the largest subnormal into the smallest normal
+    CHECK(FloatToHalf(ldexpf(1.0f, -24)) == 0x0001);
+    CHECK(FloatToHalf(ldexpf(1.0f, -26)) == 0x0000);
+    CHECK(FloatToHalf(ldexpf(1023.9f, -24)) == 0x0400);
+}
+
+// out = rgb * scale + bias per output channel, in each sample type
+static void TestNormalization() {
+    const int nWidth = 32, nHeight = 16, nPitch = 32;
+    std::vector<uint8_t> vNv12 = MakeNv12(nWidth, nHeight, nPitch);
+    PostprocessParams params;
+    params.nDstWidth = 24;
+    params.nDstHeight = 12;
+    params.iMatrix = ColorSpaceStandard_BT601;
+    const int nPixels = params.nDstWidth * params.nDstHeight;
+
+    std::vector<float> vRaw(nPixels * 3);
+    Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vRaw.data(), params.nDstWidth * 3 * 4, params,
+        POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F32);
+    std::vector<uint8_t> vU8(nPixels * 3);
+    Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vU8.data(), params.nDstWidth * 3, params,
+        POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_U8);
+
+    // ImageNet mean and standard deviation
+    const float afMean[3] = {0.485f, 0.456f, 0.406f}, afStd[3] = {0.229f, 0.224f, 0.225f};
+    PostprocessParams normalized = params;
+    for (int c = 0; c < 3; c++) {
+        normalized.afScale[c] = 1.0f / (255.0f * afStd[c]);
+        normalized.afBias[c] = -afMean[c] / afStd[c];
+    }
+    std::vector<float> vF32(nPixels * 3);
+    Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vF32.data(), params.nDstWidth * 3 * 4, normalized,
+        POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F32);
+    std::vector<uint16_t> vF16(nPixels * 3);
+    Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vF16.data(), params.nDstWidth * 3 * 2, normalized,
+        POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_F16);
+
+    for (int i = 0; i < nPixels * 3; i++) {
+        int c = i % 3;
+        CHECK(vRaw[i] >= 0.0f && vRaw[i] <= 255.0f);
+        CHECK(vU8[i] == ClampToUint8(vRaw[i]));
+        float fExpected = (vRaw[i] / 255.0f - afMean[c]) / afStd[c];
+        CHECK(fabsf(vF32[i] - fExpected) < 1.0e-5f);
+        CHECK(vF16[i] == FloatToHalf(vF32[i]));
+        CHECK(fabsf(HalfToFloat(vF16[i]) - vF32[i]) <= fabsf(vF32[i]) * ldexpf(1.0f, -11) + ldexpf(1.0f, -24));
+    }
+}
+
+struct RampFetch {
+    void operator()(int x, int y, float *pOut) const {
+        pOut[0] = (float)(10 * x + y);
+    }
+};
+
+// Samples between pixels interpolate, samples past the rectangle take the edge pixel
+static void TestBilinearClamp() {
+    RampFetch fetch;
+    float f;
+    SampleBilinear<1>(fetch, 2.5f, 1.0f, 1, 4, 1, 3, &f);
+    CHECK(fabsf(f - 26.0f) < 1.0e-4f);
+    SampleBilinear<1>(fetch, 2.25f, 2.5f, 1, 4, 1, 3, &f);
+    CHECK(fabsf(f - 25.0f) < 1.0e-4f);
+    SampleBilinear<1>(fetch, -3.0f, -3.0f, 1, 4, 1, 3, &f);
+    CHECK(f == 11.0f);
+    SampleBilinear<1>(fetch, 4.75f, 3.5f, 1, 4, 1, 3, &f);
+    CHECK(f == 43.0f);
+    // A one-pixel rectangle never reads its neighbours
+    SampleBilinear<1>(fetch, 2.5f, 2.5f, 2, 2, 2, 2, &f);
+    CHECK(f == 22.0f);
+
+    // A dark crop inside a white frame: upscaling and downscaling the crop must not pull in the white border
+    const int nWidth = 32, nHeight = 32, nPitch = 32;
+    std::vector<uint8_t> vNv12(nPitch * nHeight * 3 / 2, 128);
+    for (int y = 0; y < nHeight; y++) {
+        for (int x = 0; x < nWidth; x++) {
+            bool bInside = x >= 8 && x < 20 && y >= 10 && y < 18;
+            vNv12[y * nPitch + x] = bInside ? 16 : 235;
+        }
+    }
+    const int anDstSize[][2] = {{36, 24}, {5, 3}, {12, 8}, {1, 1}};
+    for (const int *pSize : anDstSize) {
+        PostprocessParams params;
+        params.nCropX = 8;
+        params.nCropY = 10;
+        params.nCropWidth = 12;
+        params.nCropHeight = 8;
+        params.nDstWidth = pSize[0];
+        params.nDstHeight = pSize[1];
+        std::vector<uint8_t> vRgb(pSize[0] * pSize[1] * 3, 0xCD);
+        Nv12PostprocessHost(vNv12.data(), nPitch, nWidth, nHeight, vRgb.data(), pSize[0], params,
+            POSTPROCESS_LAYOUT_PLANAR, POSTPROCESS_TYPE_U8);
+        for (uint8_t n : vRgb) {
+            CHECK(n == 0);
+        }
+    }
+
+    // Upscaling by 4 puts the first and last outputs past the outermost pixel centres: they are the corner pixels
+    std::vector<uint8_t> vSmall = MakeNv12(4, 4, 4);
+    std::vector<uint8_t> vPlain(4 * 4 * 4);
+    Nv12ToBgraHost(vSmall.data(), 4, vSmall.data() + 16, 4, vPlain.data(), 16, 4, 4);
+    PostprocessParams params;
+    params.nDstWidth = 16;
+    params.nDstHeight = 16;
+    std::vector<uint8_t> vRgb(16 * 16 * 3);
+    Nv12PostprocessHost(vSmall.data(), 4, 4, 4, vRgb.data(), 16 * 3, params, POSTPROCESS_LAYOUT_INTERLEAVED, POSTPROCESS_TYPE_U8);
+    const int aCorner[][2] = {{0, 0}, {15, 0}, {0, 15}, {15, 15}};
+    for (const int *p : aCorner) {
+        int sx = p[0] / 4, sy = p[1] / 4;
+        for (int c = 0; c < 3; c++) {
+            CHECK(Near(vRgb[(p[1] * 16 + p[0]) * 3 + c], vPlain[(sy * 4 + sx) * 4 + 2 - c], 1));
+        }
+    }
+}
+
+int main() {
+    TestCropMatchesPlainConversion(ColorSpaceStandard_BT709, false, 0, 0, 64, 36, false);
+    TestCropMatchesPlainConversion(ColorSpaceStandard_BT709, false, 10, 6, 32, 20, false);
+    TestCropMatchesPlainConversion(ColorSpaceStandard_BT601, true, 14, 8, 40, 22, true);
+    TestCropMatchesPlainConversion(ColorSpaceStandard_BT2020, false, 2, 30, 61, 6, false);
+    TestLayouts<POSTPROCESS_TYPE_U8>();
+    TestLayouts<POSTPROCESS_TYPE_F16>();
+    TestLayouts<POSTPROCESS_TYPE_F32>();
+    TestFloatToHalf();
+    TestNormalization();
+    TestBilinearClamp();
+    return TestResult();
+}
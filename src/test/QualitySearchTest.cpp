@@ -0,0 +1,88 @@
+#include <vector>
+#include "QualitySearchStubs.h"
+#include "TestCheck.h"
+
+//---------------------------------------------------------------------------
+//! \file QualitySearchTest.cpp
+//! \brief Runs QualityParamSearch against the synthetic QP to PSNR model of StubQualityEncoder.
+//! Every frame that some QP can bring into the target window must keep an encode inside
+//! it, and the secant search must take fewer iterations per frame than the fixed step one
+//! on the same frames.
+//---------------------------------------------------------------------------
+
+static bool InWindow(const QualitySearchConfig &config, double dQuality) {
+    return dQuality > config.dMinQuality && dQuality < config.dMaxQuality;
+}
+
+static bool IsReachable(const StubQualityEncoder &encoder, const QualitySearchConfig &config, int iFrame) {
+    for (int nQp = config.nMinParam; nQp <= config.nMaxParam; nQp++) {
+        if (InWindow(config, encoder.GetPsnr(iFrame, nQp))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void CheckStats(const QualitySearchStats &stats, const QualitySearchConfig &config, const std::vector<double> &vKeptQuality) {
+    uint64_t nInWindow = 0, nByIterations = 0, nIterations = 0;
+    for (double dQuality : vKeptQuality) {
+        nInWindow += InWindow(config, dQuality);
+    }
+    for (int i = 1; i <= QUALITY_SEARCH_MAX_ITERATIONS; i++) {
+        nByIterations += stats.anFramesByIterations[i];
+        nIterations += i * stats.anFramesByIterations[i];
+        CHECK(i <= config.nMaxIterations || stats.anFramesByIterations[i] == 0);
+    }
+    CHECK(stats.nFrames == vKeptQuality.size() && nByIterations == stats.nFrames);
+    CHECK(stats.nIterations == nIterations);
+    CHECK(stats.nFramesInWindow == nInWindow);
+}
+
+/**
+*   @param  nWorstIterations    Most encodes the secant search may spend on a frame, 0 for no bound
+*/
+static void TestWindow(double dMinQuality, double dMaxQuality, uint32_t nSeed, bool bAllReachable, int nWorstIterations = 0) {
+    const int nFrames = 1000;
+    StubQualityEncoder encoder(nFrames, nSeed);
+    QualitySearchConfig config;
+    config.dMinQuality = dMinQuality;
+    config.dMaxQuality = dMaxQuality;
+    config.nMaxIterations = 6;
+
+    std::vector<double> vKeptQuality;
+    config.eMode = QUALITY_SEARCH_SECANT;
+    QualitySearchStats secant = RunQualitySearch(encoder, config, 30, vKeptQuality);
+    CheckStats(secant, config, vKeptQuality);
+    int nReachable = 0;
+    for (int i = 0; i < nFrames; i++) {
+        bool bReachable = IsReachable(encoder, config, i);
+        nReachable += bReachable;
+        CHECK(!bReachable || InWindow(config, vKeptQuality[i]));
+    }
+    CHECK(!bAllReachable || (nReachable == nFrames && secant.nFramesInWindow == (uint64_t)nFrames));
+    for (int i = nWorstIterations + 1; nWorstIterations && i <= QUALITY_SEARCH_MAX_ITERATIONS; i++) {
+        CHECK(secant.anFramesByIterations[i] == 0);
+    }
+
+    config.eMode = QUALITY_SEARCH_FIXED_STEP;
+    for (int nStep = 1; nStep <= 2; nStep++) {
+        config.nStep = nStep;
+        QualitySearchStats fixed = RunQualitySearch(encoder, config, 30, vKeptQuality);
+        CheckStats(fixed, config, vKeptQuality);
+        CHECK(secant.GetIterationsPerFrame() < fixed.GetIterationsPerFrame());
+        CHECK(secant.nFramesInWindow >= fixed.nFramesInWindow);
+    }
+}
+
+int main() {
+    const uint32_t anSeed[] = {1234, 1, 2, 7};
+    for (uint32_t nSeed : anSeed) {
+        // Scene cuts take a few encodes to bracket and interpolate the window, never the whole budget
+        TestWindow(38.0, 39.0, nSeed, true, 4);
+        // Windows that the brightest or darkest scenes cannot reach at any QP, and a narrow one that whole QP steps can skip
+        TestWindow(35.0, 36.0, nSeed, false);
+        TestWindow(30.0, 31.0, nSeed, false);
+        TestWindow(41.0, 41.5, nSeed, false);
+    }
+    return TestResult();
+}
@@ -0,0 +1,366 @@
+#include <string.h>
+#include <vector>
+#include "RtpPacketizer.h"
+#include "TestCheck.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file RtpPacketizerTest.cpp
+//! \brief Packetizes hand-built H.264, HEVC and AV1 access units at several MTUs, including ones
+//! below nMinMtu. Checks the RTP headers, the single, aggregate and fragment payload headers and
+//! the packet sizes, then reassembles the units with RtpDepacketizer. Also checks how lost
+//! packets, lost markers and malformed RTP headers are handled.
+//---------------------------------------------------------------------------
+
+static const uint8_t nPayloadType = 96;
+static const uint32_t nSsrc = 0x12345678;
+
+enum PAYLOAD_KIND {
+    PAYLOAD_SINGLE,
+    PAYLOAD_AGGREGATE,
+    PAYLOAD_FRAGMENT,
+};
+
+// Bodies without zero bytes cannot contain start codes
+static void AppendBody(std::vector<uint8_t> &v, size_t nSize, int nSeed) {
+    for (size_t i = 0; i < nSize; i++) {
+        v.push_back((uint8_t)((nSeed + i * 7) % 255 + 1));
+    }
+}
+
+static void AppendNal(std::vector<uint8_t> &v, const std::vector<uint8_t> &vHeader, size_t nBody, int nSeed) {
+    static const uint8_t aStartCode[4] = {0, 0, 0, 1};
+    v.insert(v.end(), aStartCode, aStartCode + 4);
+    v.insert(v.end(), vHeader.begin(), vHeader.end());
+    AppendBody(v, nBody, nSeed);
+}
+
+// An OBU with obu_has_size_field set and a minimal leb128 size, as RtpDepacketizer writes it
+static void AppendObu(std::vector<uint8_t> &v, int nType, int nExtension, size_t nBody, int nSeed) {
+    v.push_back((uint8_t)((nType << 3) | (nExtension >= 0 ? 0x04 : 0) | 0x02));
+    if (nExtension >= 0) {
+        v.push_back((uint8_t)nExtension);
+    }
+    uint8_t aLeb[8];
+    int nLeb = WriteLeb128(aLeb, nBody);
+    v.insert(v.end(), aLeb, aLeb + nLeb);
+    AppendBody(v, nBody, nSeed);
+}
+
+static std::vector<uint8_t> Flatten(const RtpPacket &packet) {
+    std::vector<uint8_t> v;
+    for (int i = 0; i < packet.nIov; i++) {
+        const uint8_t *p = (const uint8_t *)packet.aIov[i].iov_base;
+        v.insert(v.end(), p, p + packet.aIov[i].iov_len);
+    }
+    return v;
+}
+
+static PAYLOAD_KIND GetPayloadKind(cdc::CodecType eCodec, const uint8_t *pPayload) {
+    if (eCodec == cdc::CODEC_TYPE_AV1) {
+        // Z or Y set: part of a fragmented OBU; W == 1: a single OBU
+        if (pPayload[0] & 0xC0) {
+            return PAYLOAD_FRAGMENT;
+        }
+        return ((pPayload[0] >> 4) & 3) == 1 ? PAYLOAD_SINGLE : PAYLOAD_AGGREGATE;
+    }
+    int nType = eCodec == cdc::CODEC_TYPE_H265 ? (pPayload[0] >> 1) & 0x3F : pPayload[0] & 0x1F;
+    int nAggType = eCodec == cdc::CODEC_TYPE_H265 ? 48 : 24, nFuType = eCodec == cdc::CODEC_TYPE_H265 ? 49 : 28;
+    return nType == nAggType ? PAYLOAD_AGGREGATE : (nType == nFuType ? PAYLOAD_FRAGMENT : PAYLOAD_SINGLE);
+}
+
+/**
+* @brief Checks the RTP headers and sizes of one access unit, then reassembles it and compares it with vExpected.
+*/
+static std::vector<PAYLOAD_KIND> CheckAccessUnit(cdc::CodecType eCodec, size_t nMtu, const std::vector<uint8_t> &vInput,
+    const std::vector<uint8_t> &vExpected, uint16_t nFirstSequence = 0) {
+    const size_t nMaxSize = std::max(nMtu, RtpPacketizer::nMinMtu);
+    const uint32_t nTimestamp = 90000;
+    RtpPacketizer packetizer(eCodec, nPayloadType, nSsrc, nMtu, nFirstSequence);
+    std::vector<RtpPacket> vPackets;
+    size_t nPackets = packetizer.Packetize(vInput.data(), vInput.size(), nTimestamp, vPackets);
+    CHECK(nPackets == vPackets.size() && nPackets > 0);
+    CHECK(packetizer.GetNextSequence() == (uint16_t)(nFirstSequence + nPackets));
+
+    RtpDepacketizer depacketizer(eCodec);
+    std::vector<PAYLOAD_KIND> vKinds;
+    int nFrames = 0;
+    for (size_t i = 0; i < vPackets.size(); i++) {
+        const RtpPacket &packet = vPackets[i];
+        std::vector<uint8_t> v = Flatten(packet);
+        CHECK(v.size() == packet.nSize && v.size() <= nMaxSize && v.size() > (size_t)RtpPacketizer::nRtpHeaderSize);
+        // Payload beyond the headers is referenced in the input, not copied
+        if (packet.nIov == 2) {
+            const uint8_t *p = (const uint8_t *)packet.aIov[1].iov_base;
+            CHECK(p >= vInput.data() && p + packet.aIov[1].iov_len <= vInput.data() + vInput.size());
+        }
+
+        bool bLast = i + 1 == vPackets.size();
+        CHECK(v[0] == 0x80);
+        CHECK(v[1] == (nPayloadType | (bLast ? 0x80 : 0)) && packet.bMarker == bLast);
+        CHECK(((v[2] << 8) | v[3]) == (uint16_t)(nFirstSequence + i) && packet.nSequence == (uint16_t)(nFirstSequence + i));
+        CHECK((((uint32_t)v[4] << 24) | (v[5] << 16) | (v[6] << 8) | v[7]) == nTimestamp);
+        CHECK((((uint32_t)v[8] << 24) | (v[9] << 16) | (v[10] << 8) | v[11]) == nSsrc);
+        vKinds.push_back(GetPayloadKind(eCodec, &v[RtpPacketizer::nRtpHeaderSize]));
+
+        bool bFrame = depacketizer.Push(v.data(), v.size());
+        CHECK(bFrame == bLast);
+        nFrames += bFrame;
+    }
+    CHECK(nFrames == 1);
+    CHECK(depacketizer.GetFrame() == vExpected);
+    CHECK(depacketizer.GetTimestamp() == nTimestamp);
+    CHECK(depacketizer.GetLostPackets() == 0 && depacketizer.GetDroppedFrames() == 0);
+    return vKinds;
+}
+
+// The fragments of one unit start with S (or no Z) and end with E (or no Y)
+static void CheckFragmentFlags(cdc::CodecType eCodec, size_t nMtu, const std::vector<uint8_t> &vInput) {
+    RtpPacketizer packetizer(eCodec, nPayloadType, nSsrc, nMtu);
+    std::vector<RtpPacket> vPackets;
+    packetizer.Packetize(vInput.data(), vInput.size(), 0, vPackets);
+    bool bInFragment = false;
+    for (const RtpPacket &packet : vPackets) {
+        std::vector<uint8_t> v = Flatten(packet);
+        const uint8_t *p = &v[RtpPacketizer::nRtpHeaderSize];
+        if (GetPayloadKind(eCodec, p) != PAYLOAD_FRAGMENT) {
+            CHECK(!bInFragment);
+            continue;
+        }
+        bool bStart, bEnd;
+        if (eCodec == cdc::CODEC_TYPE_AV1) {
+            bStart = !(p[0] & 0x80);
+            bEnd = !(p[0] & 0x40);
+        } else {
+            uint8_t nFuHeader = p[eCodec == cdc::CODEC_TYPE_H265 ? 2 : 1];
+            bStart = nFuHeader & 0x80;
+            bEnd = nFuHeader & 0x40;
+        }
+        CHECK(bStart == !bInFragment);
+        CHECK(!(bStart && bEnd));
+        bInFragment = !bEnd;
+    }
+    CHECK(!bInFragment);
+}
+
+static int CountKind(const std::vector<PAYLOAD_KIND> &vKinds, PAYLOAD_KIND eKind) {
+    int n = 0;
+    for (PAYLOAD_KIND e : vKinds) {
+        n += e == eKind;
+    }
+    return n;
+}
+
+// MTUs below nMinMtu are raised to it; 64 is nMinMtu itself
+static const size_t anMtu[] = {1200, 500, 100, 64, 20, 0};
+
+static void TestH264() {
+    // AUD, SPS, PPS, a large IDR slice and a small one; the AUD is not sent
+    std::vector<uint8_t> vInput, vExpected;
+    AppendNal(vInput, {0x09}, 1, 1);
+    AppendNal(vExpected, {0x67}, 11, 2);
+    AppendNal(vExpected, {0x68}, 4, 3);
+    AppendNal(vExpected, {0x65}, 2999, 4);
+    AppendNal(vExpected, {0x65}, 79, 5);
+    vInput.insert(vInput.end(), vExpected.begin(), vExpected.end());
+
+    std::vector<PAYLOAD_KIND> vKinds = CheckAccessUnit(cdc::CODEC_TYPE_H264, 1200, vInput, vExpected);
+    std::vector<PAYLOAD_KIND> vExpectedKinds = {PAYLOAD_AGGREGATE, PAYLOAD_FRAGMENT, PAYLOAD_FRAGMENT, PAYLOAD_FRAGMENT, PAYLOAD_SINGLE};
+    CHECK(vKinds == vExpectedKinds);
+    for (size_t nMtu : anMtu) {
+        vKinds = CheckAccessUnit(cdc::CODEC_TYPE_H264, nMtu, vInput, vExpected);
+        CHECK(CountKind(vKinds, PAYLOAD_AGGREGATE) == 1 && CountKind(vKinds, PAYLOAD_FRAGMENT) >= 3);
+        CheckFragmentFlags(cdc::CODEC_TYPE_H264, nMtu, vInput);
+    }
+    // Below nMinMtu the packets are those of nMinMtu
+    CHECK(CheckAccessUnit(cdc::CODEC_TYPE_H264, 20, vInput, vExpected) == CheckAccessUnit(cdc::CODEC_TYPE_H264, 64, vInput, vExpected));
+
+    // STAP-A takes F OR-ed and the highest NRI; FU-A keeps F and NRI of the unit
+    RtpPacketizer packetizer(cdc::CODEC_TYPE_H264, nPayloadType, nSsrc, 1200);
+    std::vector<RtpPacket> vPackets;
+    packetizer.Packetize(vInput.data(), vInput.size(), 0, vPackets);
+    std::vector<uint8_t> vStap = Flatten(vPackets[0]), vFu = Flatten(vPackets[1]);
+    CHECK(vStap[12] == 0x78);
+    CHECK(vFu[12] == 0x7C && vFu[13] == 0x85);
+
+    // Sequence numbers wrap
+    CheckAccessUnit(cdc::CODEC_TYPE_H264, 100, vInput, vExpected, 0xFFFE);
+}
+
+static void TestHevc() {
+    // AUD, VPS, SPS, PPS (TemporalId 1), a large IDR_W_RADL and a small TRAIL_R
+    std::vector<uint8_t> vInput, vExpected;
+    AppendNal(vInput, {0x46, 0x01}, 1, 1);
+    AppendNal(vExpected, {0x40, 0x01}, 20, 2);
+    AppendNal(vExpected, {0x42, 0x01}, 30, 3);
+    AppendNal(vExpected, {0x44, 0x02}, 6, 4);
+    AppendNal(vExpected, {0x26, 0x01}, 2498, 5);
+    AppendNal(vExpected, {0x02, 0x01}, 40, 6);
+    vInput.insert(vInput.end(), vExpected.begin(), vExpected.end());
+
+    std::vector<PAYLOAD_KIND> vKinds = CheckAccessUnit(cdc::CODEC_TYPE_H265, 1200, vInput, vExpected);
+    std::vector<PAYLOAD_KIND> vExpectedKinds = {PAYLOAD_AGGREGATE, PAYLOAD_FRAGMENT, PAYLOAD_FRAGMENT, PAYLOAD_FRAGMENT, PAYLOAD_SINGLE};
+    CHECK(vKinds == vExpectedKinds);
+    for (size_t nMtu : anMtu) {
+        vKinds = CheckAccessUnit(cdc::CODEC_TYPE_H265, nMtu, vInput, vExpected);
+        CHECK(CountKind(vKinds, PAYLOAD_AGGREGATE) >= 1 && CountKind(vKinds, PAYLOAD_FRAGMENT) >= 3);
+        CheckFragmentFlags(cdc::CODEC_TYPE_H265, nMtu, vInput);
+    }
+
+    // The AP carries the lowest TemporalId of its units; the FU keeps the type in its FU header
+    RtpPacketizer packetizer(cdc::CODEC_TYPE_H265, nPayloadType, nSsrc, 1200);
+    std::vector<RtpPacket> vPackets;
+    packetizer.Packetize(vInput.data(), vInput.size(), 0, vPackets);
+    std::vector<uint8_t> vAp = Flatten(vPackets[0]), vFu = Flatten(vPackets[1]);
+    CHECK(vAp[12] == 0x60 && vAp[13] == 0x01);
+    CHECK(vFu[12] == 0x62 && vFu[13] == 0x01 && vFu[14] == (0x80 | 19));
+}
+
+static void TestAv1() {
+    // Temporal delimiter, sequence header, metadata, a large frame with an extension header and a small frame
+    std::vector<uint8_t> vInput;
+    AppendObu(vInput, OBU_TEMPORAL_DELIMITER, -1, 0, 0);
+    AppendObu(vInput, OBU_SEQUENCE_HEADER, -1, 11, 1);
+    AppendObu(vInput, OBU_METADATA, -1, 20, 2);
+    AppendObu(vInput, OBU_FRAME, 0x28, 3000, 3);
+    AppendObu(vInput, OBU_FRAME, -1, 50, 4);
+
+    std::vector<PAYLOAD_KIND> vKinds = CheckAccessUnit(cdc::CODEC_TYPE_AV1, 1200, vInput, vInput);
+    std::vector<PAYLOAD_KIND> vExpectedKinds = {PAYLOAD_AGGREGATE, PAYLOAD_FRAGMENT, PAYLOAD_FRAGMENT, PAYLOAD_FRAGMENT, PAYLOAD_SINGLE};
+    CHECK(vKinds == vExpectedKinds);
+    for (size_t nMtu : anMtu) {
+        vKinds = CheckAccessUnit(cdc::CODEC_TYPE_AV1, nMtu, vInput, vInput);
+        CHECK(CountKind(vKinds, PAYLOAD_AGGREGATE) == 1 && CountKind(vKinds, PAYLOAD_FRAGMENT) >= 3);
+        CheckFragmentFlags(cdc::CODEC_TYPE_AV1, nMtu, vInput);
+    }
+
+    // N is set on the first packet of a temporal unit that starts a coded video sequence, and only there
+    RtpPacketizer packetizer(cdc::CODEC_TYPE_AV1, nPayloadType, nSsrc, 1200);
+    std::vector<RtpPacket> vPackets;
+    packetizer.Packetize(vInput.data(), vInput.size(), 0, vPackets);
+    for (size_t i = 0; i < vPackets.size(); i++) {
+        CHECK(((Flatten(vPackets[i])[12] & 0x08) != 0) == (i == 0));
+    }
+    std::vector<uint8_t> vInter;
+    AppendObu(vInter, OBU_TEMPORAL_DELIMITER, -1, 0, 0);
+    AppendObu(vInter, OBU_FRAME, -1, 40, 5);
+    CHECK(packetizer.Packetize(vInter.data(), vInter.size(), 3000, vPackets) == 1);
+    CHECK(Flatten(vPackets[0])[12] == 0x10);
+    CheckAccessUnit(cdc::CODEC_TYPE_AV1, 1200, vInter, vInter);
+}
+
+struct Stream {
+    std::vector<std::vector<uint8_t>> vPackets;
+    std::vector<int> vFirstPacket;      // Index of the first packet of each access unit
+};
+
+// Four access units of four packets each: FU-A start, middle, end, then a single NAL unit with the marker
+static Stream MakeStream() {
+    Stream stream;
+    RtpPacketizer packetizer(cdc::CODEC_TYPE_H264, nPayloadType, nSsrc, 100);
+    std::vector<RtpPacket> vPackets;
+    for (int iFrame = 0; iFrame < 4; iFrame++) {
+        std::vector<uint8_t> vInput;
+        AppendNal(vInput, {0x65}, 250, iFrame);
+        AppendNal(vInput, {0x65}, 60, iFrame + 10);
+        packetizer.Packetize(vInput.data(), vInput.size(), iFrame * 3000, vPackets);
+        CHECK(vPackets.size() == 4);
+        stream.vFirstPacket.push_back((int)stream.vPackets.size());
+        for (const RtpPacket &packet : vPackets) {
+            stream.vPackets.push_back(Flatten(packet));
+        }
+    }
+    return stream;
+}
+
+/**
+* @brief Feeds the stream without the packets in vDrop and checks which access units come out, and the loss counters.
+*/
+static void CheckLoss(const std::vector<int> &vDrop, const std::vector<int> &vExpectedFrames, uint64_t nLost, uint64_t nDropped) {
+    Stream stream = MakeStream();
+    RtpDepacketizer depacketizer(cdc::CODEC_TYPE_H264);
+    std::vector<int> vFrames;
+    for (int i = 0; i < (int)stream.vPackets.size(); i++) {
+        if (std::find(vDrop.begin(), vDrop.end(), i) != vDrop.end()) {
+            continue;
+        }
+        if (depacketizer.Push(stream.vPackets[i].data(), stream.vPackets[i].size())) {
+            vFrames.push_back((int)(depacketizer.GetTimestamp() / 3000));
+            // 250 + 60 bytes of NAL units plus headers and start codes
+            CHECK(depacketizer.GetFrame().size() == 4 + 251 + 4 + 61);
+        }
+    }
+    CHECK(vFrames == vExpectedFrames);
+    CHECK(depacketizer.GetLostPackets() == nLost);
+    CHECK(depacketizer.GetDroppedFrames() == nDropped);
+}
+
+static void TestLoss() {
+    CheckLoss({}, {0, 1, 2, 3}, 0, 0);
+    // A middle fragment, then a first fragment: the rest of the unit is not a valid NAL unit
+    CheckLoss({5}, {0, 2, 3}, 1, 1);
+    CheckLoss({8}, {0, 1, 3}, 1, 1);
+    // The marker alone: the next access unit is complete
+    CheckLoss({7}, {0, 2, 3}, 1, 1);
+    // The marker and the first packet of the next access unit
+    CheckLoss({7, 8}, {0, 3}, 2, 2);
+    // A whole access unit: the next one cannot be told apart from one that lost its start
+    CheckLoss({4, 5, 6, 7}, {0, 3}, 4, 1);
+    // The last marker: with nothing after it the loss goes unseen and the access unit stays pending
+    CheckLoss({15}, {0, 1, 2}, 0, 0);
+}
+
+static std::vector<uint8_t> MakeRtpHeader(uint8_t nFirstByte, uint16_t nSeq) {
+    std::vector<uint8_t> v = {nFirstByte, 0x80 | nPayloadType, (uint8_t)(nSeq >> 8), (uint8_t)nSeq, 0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        v.push_back((uint8_t)(nSsrc >> (24 - 8 * i)));
+    }
+    return v;
+}
+
+static void TestRtpHeaders() {
+    const std::vector<uint8_t> vNal = {0x65, 0x88, 0x84};
+    std::vector<uint8_t> vExpected = {0, 0, 0, 1};
+    vExpected.insert(vExpected.end(), vNal.begin(), vNal.end());
+
+    // CSRCs, a header extension and padding around the payload
+    RtpDepacketizer depacketizer(cdc::CODEC_TYPE_H264);
+    std::vector<uint8_t> v = MakeRtpHeader(0x80 | 0x20 | 0x10 | 2, 1);
+    v.insert(v.end(), 8, 0xEE);
+    std::vector<uint8_t> vExtension = {0xBE, 0xDE, 0x00, 0x01, 0x11, 0x22, 0x33, 0x44};
+    v.insert(v.end(), vExtension.begin(), vExtension.end());
+    v.insert(v.end(), vNal.begin(), vNal.end());
+    v.insert(v.end(), {0, 0, 3});
+    CHECK(depacketizer.Push(v.data(), v.size()));
+    CHECK(depacketizer.GetFrame() == vExpected);
+
+    // X set without room for the extension header: rejected rather than read as payload
+    v = MakeRtpHeader(0x80 | 0x10, 2);
+    v.insert(v.end(), vNal.begin(), vNal.end());
+    CHECK(!depacketizer.Push(v.data(), v.size()));
+    // An extension longer than the packet
+    v = MakeRtpHeader(0x80 | 0x10, 3);
+    v.insert(v.end(), {0xBE, 0xDE, 0x00, 0x04});
+    v.insert(v.end(), vNal.begin(), vNal.end());
+    CHECK(!depacketizer.Push(v.data(), v.size()));
+    // Wrong version, and shorter than an RTP header
+    v = MakeRtpHeader(0x40, 4);
+    v.insert(v.end(), vNal.begin(), vNal.end());
+    CHECK(!depacketizer.Push(v.data(), v.size()));
+    CHECK(!depacketizer.Push(v.data(), 11));
+    // Padding that eats the payload
+    v = MakeRtpHeader(0x80 | 0x20, 5);
+    v.insert(v.end(), vNal.begin(), vNal.end());
+    v.push_back(4);
+    CHECK(!depacketizer.Push(v.data(), v.size()));
+}
+
+int main() {
+    TestH264();
+    TestHevc();
+    TestAv1();
+    TestLoss();
+    TestRtpHeaders();
+    return TestResult();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+
+//---------------------------------------------------------------------------
+//! \file TestCheck.h
+//! \brief Minimal checks for the CPU-only unit tests under src/test. A failed CHECK prints
+//! its location and the test keeps going; main() returns TestResult().
+//---------------------------------------------------------------------------
+
+inline int &TestFailureCount() {
+    static int nFailures = 0;
+    return nFailures;
+}
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            TestFailureCount()++;                                           \
+        }                                                                   \
+    } while (0)
+
+inline int TestResult() {
+    if (TestFailureCount()) {
+        printf("%d check(s) failed\n", TestFailureCount());
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "TranscodeStubs.h"
+#include "TestCheck.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file TranscodePipelineTest.cpp
+//! \brief Runs TranscodePipeline on the CPU stubs with an encoder that reorders B-frames and
+//! checks the decode timestamps the muxer gets: increasing, never past pts, and derived from
+//! the reorder depth. Statistics are sampled while the pipeline runs. Frames between the
+//! keyframe a seek lands on and the seek target are decoded and dropped.
+//---------------------------------------------------------------------------
+
+// I0 P3 B1 B2 P6 B4 B5: two frames of reorder delay, so the first two packets decode before input 0
+static void TestDtsQueue() {
+    TranscodeDtsQueue dtsQueue(2);
+    const int64_t aOutputPts[] = {0, 3, 1, 2, 6, 4, 5};
+    const int64_t aExpectedDts[] = {-2, -1, 0, 1, 2, 3, 4};
+    for (int64_t nPts = 0; nPts < 7; nPts++) {
+        dtsQueue.PushInput(nPts * 1000);
+    }
+    for (int i = 0; i < 7; i++) {
+        int64_t nDts = dtsQueue.PopDts(aOutputPts[i] * 1000);
+        CHECK(nDts == aExpectedDts[i] * 1000);
+        CHECK(nDts <= aOutputPts[i] * 1000);
+    }
+
+    // Without reordering dts is the input time
+    TranscodeDtsQueue noReorder;
+    noReorder.PushInput(7);
+    CHECK(noReorder.PopDts(7) == 7);
+}
+
+static void TestReorderedPipeline(int nFrames, int nGopLength, int nBFrames) {
+    StubSource source(nFrames, 64, nGopLength);
+    StubDecoder decoder(64, 32, 24, 2);
+    StubScaler scaler(32, 16, 24);
+    StubEncoder encoder(nGopLength, 0, nBFrames);
+    StubSink sink;
+    TranscodePipeline pipeline(&source, &decoder, &scaler, &encoder, &sink, 8);
+
+    // GetStats() is meant to be called while Run() is in progress
+    std::thread runner([&]() { CHECK(pipeline.Run()); });
+    for (int i = 0; i < 100; i++) {
+        TranscodeStats stats = pipeline.GetStats();
+        CHECK(stats.fWallSeconds >= 0.0 && !stats.bFailed);
+    }
+    runner.join();
+
+    TranscodeStats stats = pipeline.GetStats();
+    CHECK(!stats.bFailed && stats.fWallSeconds > 0.0);
+    CHECK(stats.aStage[TRANSCODE_STAGE_MUX].nItems == (uint64_t)nFrames);
+    CHECK(sink.bClosed);
+    CHECK((int)sink.vPackets.size() == nFrames);
+
+    std::vector<int64_t> vPts;
+    bool bReordered = false;
+    for (size_t i = 0; i < sink.vPackets.size(); i++) {
+        const TranscodePacket &packet = sink.vPackets[i];
+        CHECK(packet.nDts <= packet.nPts);
+        if (i > 0) {
+            CHECK(packet.nDts > sink.vPackets[i - 1].nDts);
+            bReordered |= packet.nPts < sink.vPackets[i - 1].nPts;
+        }
+        // The stub source fills every frame with its number
+        CHECK(packet.vData.size() == 8 && packet.vData[0] == (uint8_t)packet.nPts);
+        CHECK(packet.bKeyFrame == (packet.nPts % nGopLength == 0));
+        vPts.push_back(packet.nPts);
+    }
+    CHECK(bReordered == (nBFrames > 0));
+    // The first packets decode before the first frame is shown, by exactly the reorder depth
+    CHECK(!sink.vPackets.empty() && sink.vPackets[0].nDts == -nBFrames);
+
+    std::sort(vPts.begin(), vPts.end());
+    for (int i = 0; i < (int)vPts.size(); i++) {
+        CHECK(vPts[i] == i);
+    }
+}
+
+// The source starts at the keyframe before the target, as after FFmpegDemuxer::Seek()
+static void TestSeekDiscard(int nFirstFrame, int64_t nTargetPts, int nFrames) {
+    StubSource source(nFrames, 64, 30, 0, nFirstFrame);
+    // Fewer surfaces than discarded frames: the pipeline only finishes if dropped frames are released
+    StubDecoder decoder(64, 32, 4, 2);
+    SeekTranscodeDecoder seekDecoder(&decoder);
+    seekDecoder.SetSeekTarget(nTargetPts);
+    StubEncoder encoder(30);
+    StubSink sink;
+    TranscodePipeline pipeline(&source, &seekDecoder, NULL, &encoder, &sink, 1);
+    CHECK(pipeline.Run());
+
+    int64_t nFirstKept = std::max<int64_t>(nFirstFrame, std::min<int64_t>(nTargetPts, nFrames));
+    CHECK((int64_t)sink.vPackets.size() == nFrames - nFirstKept);
+    CHECK((int64_t)seekDecoder.GetDiscardedFrames() == nFirstKept - nFirstFrame);
+    for (size_t i = 0; i < sink.vPackets.size(); i++) {
+        CHECK(sink.vPackets[i].nPts == nFirstKept + (int64_t)i);
+        CHECK(sink.vPackets[i].vData[0] == (uint8_t)sink.vPackets[i].nPts);
+    }
+}
+
+int main() {
+    TestDtsQueue();
+    TestReorderedPipeline(100, 30, 0);
+    TestReorderedPipeline(100, 30, 2);
+    // Groups cut short by key frames and by the flush
+    TestReorderedPipeline(61, 10, 3);
+    TestSeekDiscard(30, 37, 100);
+    // Target on the keyframe itself, and past the end of the stream
+    TestSeekDiscard(60, 60, 100);
+    TestSeekDiscard(90, 120, 100);
+    return TestResult();
+}
@@ -0,0 +1,150 @@
+#include <string.h>
+#include <vector>
+#include "TsWriter.h"
+#include "TestCheck.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+//---------------------------------------------------------------------------
+//! \file TsWriterTest.cpp
+//! \brief Writes H.264 access units at several frame rates with TsWriter and parses the
+//! transport stream back: PCR spacing and order, the PTS/DTS lead over the PCR, continuity
+//! counters and the reassembled PES payload.
+//---------------------------------------------------------------------------
+
+struct TsStream {
+    std::vector<int64_t> vPcr;              /*!< In byte order */
+    std::vector<int64_t> vPts, vDts;        /*!< Of each PES */
+    std::vector<int64_t> vPcrBeforePes;     /*!< Last PCR seen before each PES started */
+    std::vector<uint8_t> vPayload;          /*!< PES payloads without headers, concatenated */
+    int nCounterErrors = 0;
+    int nRandomAccess = 0;
+};
+
+static int64_t GetTimestamp(const uint8_t *p) {
+    return ((int64_t)(p[0] & 0x0E) << 29) | (p[1] << 22) | ((p[2] & 0xFE) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+static bool ParseTs(const std::vector<uint8_t> &vTs, TsStream &ts) {
+    if (vTs.size() % TsWriter::nTsPacketSize) {
+        return false;
+    }
+    int nLastCounter = -1;
+    int64_t nLastPcr = -1;
+    for (size_t nPos = 0; nPos < vTs.size(); nPos += TsWriter::nTsPacketSize) {
+        const uint8_t *p = vTs.data() + nPos;
+        if (p[0] != 0x47) {
+            return false;
+        }
+        int nPid = ((p[1] & 0x1F) << 8) | p[2];
+        bool bStart = p[1] & 0x40, bAdaptation = p[3] & 0x20, bPayload = p[3] & 0x10;
+        if (nPid != 0x100) {
+            continue;
+        }
+        int nCounter = p[3] & 0x0F;
+        if (nLastCounter >= 0 && nCounter != (bPayload ? (nLastCounter + 1) & 0x0F : nLastCounter)) {
+            ts.nCounterErrors++;
+        }
+        nLastCounter = nCounter;
+
+        const uint8_t *q = p + 4;
+        if (bAdaptation) {
+            if (q[0] > 0 && (q[1] & 0x40)) {
+                ts.nRandomAccess++;
+            }
+            if (q[0] > 0 && (q[1] & 0x10)) {
+                nLastPcr = ((int64_t)q[2] << 25) | (q[3] << 17) | (q[4] << 9) | (q[5] << 1) | (q[6] >> 7);
+                ts.vPcr.push_back(nLastPcr);
+            }
+            q += 1 + q[0];
+        }
+        if (!bPayload) {
+            continue;
+        }
+        if (bStart) {
+            if (q[0] != 0 || q[1] != 0 || q[2] != 1 || q[3] != 0xE0) {
+                return false;
+            }
+            bool bDts = (q[7] & 0xC0) == 0xC0;
+            ts.vPts.push_back(GetTimestamp(q + 9));
+            ts.vDts.push_back(bDts ? GetTimestamp(q + 14) : ts.vPts.back());
+            ts.vPcrBeforePes.push_back(nLastPcr);
+            q += 9 + q[8];
+        }
+        ts.vPayload.insert(ts.vPayload.end(), q, p + TsWriter::nTsPacketSize);
+    }
+    return true;
+}
+
+static std::vector<uint8_t> MakeFrame(int i, bool bKey, size_t nSize) {
+    std::vector<uint8_t> v = {0, 0, 0, 1, (uint8_t)(bKey ? 0x65 : 0x41)};
+    for (size_t j = 0; j < nSize; j++) {
+        v.push_back((uint8_t)(0x80 | (i + j)));
+    }
+    return v;
+}
+
+// nFrameTicks apart, a key frame every 30, B-frame style pts = dts + one frame on non-key frames
+static void TestFrameRate(int64_t nFrameTicks, size_t nFrameSize) {
+    TsWriter writer(cdc::CODEC_TYPE_H264);
+    std::vector<uint8_t> vTs, vExpected;
+    writer.WriteTables(vTs);
+    const int64_t nStart = 900000;
+    const int nFrames = 90;
+    for (int i = 0; i < nFrames; i++) {
+        bool bKey = i % 30 == 0;
+        int64_t nDts = nStart + i * nFrameTicks;
+        std::vector<uint8_t> vFrame = MakeFrame(i, bKey, nFrameSize + i * 37);
+        CHECK(writer.WritePacket(vTs, vFrame.data(), vFrame.size(), bKey ? nDts : nDts + nFrameTicks, nDts, bKey));
+        vExpected.insert(vExpected.end(), vFrame.begin(), vFrame.end());
+    }
+
+    TsStream ts;
+    CHECK(ParseTs(vTs, ts));
+    CHECK(ts.nCounterErrors == 0);
+    CHECK(ts.nRandomAccess == nFrames / 30);
+    CHECK((int)ts.vPts.size() == nFrames);
+    CHECK(ts.vPayload.size() >= vExpected.size() && !memcmp(ts.vPayload.data(), vExpected.data(), vExpected.size()));
+
+    // Every gap between PCRs is within the interval and the PCR never goes back
+    int64_t nMaxGap = 0;
+    for (size_t i = 1; i < ts.vPcr.size(); i++) {
+        CHECK(ts.vPcr[i] >= ts.vPcr[i - 1]);
+        nMaxGap = std::max(nMaxGap, ts.vPcr[i] - ts.vPcr[i - 1]);
+    }
+    CHECK(nMaxGap <= TsWriter::nPcrInterval);
+    CHECK(!ts.vPcr.empty() && ts.vPcr[0] == nStart);
+
+    // Each PES is decoded nMuxDelay after its data started to arrive
+    for (int i = 0; i < (int)ts.vDts.size(); i++) {
+        int64_t nDts = nStart + i * nFrameTicks;
+        CHECK(ts.vDts[i] == nDts + TsWriter::nMuxDelay);
+        CHECK(ts.vPts[i] >= ts.vDts[i]);
+        CHECK(ts.vPcrBeforePes[i] >= 0 && ts.vDts[i] - ts.vPcrBeforePes[i] >= TsWriter::nMuxDelay);
+        CHECK(ts.vDts[i] - ts.vPcrBeforePes[i] <= TsWriter::nMuxDelay + TsWriter::nPcrInterval);
+    }
+}
+
+static void TestDiscontinuity() {
+    TsWriter writer(cdc::CODEC_TYPE_H264);
+    std::vector<uint8_t> vTs;
+    std::vector<uint8_t> vFrame = MakeFrame(0, true, 100);
+    CHECK(writer.WritePacket(vTs, vFrame.data(), vFrame.size(), 0, 0, true));
+    // An hour later: a PCR on the next frame, no hour of PCR-only packets
+    CHECK(writer.WritePacket(vTs, vFrame.data(), vFrame.size(), 324000000, 324000000, false));
+    // And back in time again
+    CHECK(writer.WritePacket(vTs, vFrame.data(), vFrame.size(), 3000, 3000, false));
+    TsStream ts;
+    CHECK(ParseTs(vTs, ts));
+    CHECK(vTs.size() == 3 * TsWriter::nTsPacketSize);
+    CHECK(ts.vPcr.size() == 3 && ts.vPcr[1] == 324000000 && ts.vPcr[2] == 3000);
+}
+
+int main() {
+    // 60, 25 and 5 frames per second; the last is further apart than the PCR interval
+    TestFrameRate(1500, 2000);
+    TestFrameRate(3600, 20000);
+    TestFrameRate(18000, 500);
+    TestDiscontinuity();
+    return TestResult();
+}
@@ -9,6 +9,18 @@ option("enable_example", function()
     set_description("Enable building example program.")
 end)
 
+option("enable_benchmark", function()
+    set_default(false)
+    set_showmenu(true)
+    set_description("Enable building CUDA kernel microbenchmarks.")
+end)
+
+option("enable_test", function()
+    set_default(false)
+    set_showmenu(true)
+    set_description("Enable building CPU-only unit tests, run with xmake test.")
+end)
+
 target("codec", function()
     set_kind("static")
     
@@ -66,3 +78,195 @@ if has_config("enable_example") then
         end
     end)
 end
+
+if has_config("enable_benchmark") then
+    add_requires("ffmpeg", {system = true})
+
+    target("resize_ladder_bench", function()
+        set_kind("binary")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_files("src/bench/ResizeLadderBench.cpp")
+        add_deps("codec")
+
+        if is_plat("windows") then
+            add_links("cudart", "cuda")
+            add_linkdirs("libs", "$(env CUDA_PATH)/lib/x64")
+        end
+
+        if has_config("cuda") then
+            add_packages("cuda")
+        end
+    end)
+
+    target("host_color_bench", function()
+        set_kind("binary")
+        add_includedirs("src/Utils")
+        add_files("src/bench/HostColorBench.cpp")
+        if is_plat("linux") then
+            add_syslinks("pthread")
+        end
+    end)
+
+    target("host_metrics_bench", function()
+        set_kind("binary")
+        add_includedirs("src/Utils")
+        add_files("src/bench/HostMetricsBench.cpp")
+        if is_plat("linux") then
+            add_syslinks("pthread")
+        end
+    end)
+
+    target("quality_search_bench", function()
+        set_kind("binary")
+        add_includedirs("src/Utils")
+        add_files("src/bench/QualitySearchBench.cpp")
+    end)
+
+    target("ring_queue_bench", function()
+        set_kind("binary")
+        add_includedirs("src/Utils")
+        add_files("src/bench/RingQueueBench.cpp")
+        if is_plat("linux") then
+            add_syslinks("pthread")
+        end
+    end)
+
+    target("nal_scan_bench", function()
+        set_kind("binary")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_files("src/bench/NalScanBench.cpp")
+    end)
+
+    target("annexb_bench", function()
+        set_kind("binary")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_files("src/bench/AnnexBBench.cpp")
+        add_packages("ffmpeg")
+    end)
+
+    target("worker_pool_bench", function()
+        set_kind("binary")
+        add_includedirs("src/Utils")
+        add_files("src/bench/WorkerPoolBench.cpp")
+        if is_plat("linux") then
+            add_syslinks("pthread")
+        end
+    end)
+end
+
+if has_config("enable_test") then
+    target("nal_unit_splitter_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/NalUnitSplitterTest.cpp")
+        add_tests("default")
+    end)
+
+    target("ivf_reader_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/IVFReaderTest.cpp")
+        add_tests("default")
+    end)
+
+    target("color_space_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/ColorSpaceTest.cpp")
+        add_tests("default")
+    end)
+
+    target("postprocess_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/PostprocessTest.cpp")
+        if is_plat("linux") then
+            add_syslinks("pthread")
+        end
+        add_tests("default")
+    end)
+
+    target("bit_depth_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/BitDepthTest.cpp")
+        add_tests("default")
+    end)
+
+    target("rtp_packetizer_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/RtpPacketizerTest.cpp")
+        add_tests("default")
+    end)
+
+    target("quality_search_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/QualitySearchTest.cpp")
+        add_tests("default")
+    end)
+
+    target("annexb_converter_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/AnnexBConverterTest.cpp")
+        add_tests("default")
+    end)
+
+    target("fmp4_writer_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/Fmp4WriterTest.cpp")
+        add_tests("default")
+    end)
+
+    target("ts_writer_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/TsWriterTest.cpp")
+        add_tests("default")
+    end)
+
+    target("transcode_pipeline_test", function()
+        set_kind("binary")
+        set_group("test")
+        add_includedirs("include")
+        add_includedirs("src/Utils")
+        add_includedirs("src/test")
+        add_files("src/test/TranscodePipelineTest.cpp")
+        if is_plat("linux") then
+            add_syslinks("pthread")
+        end
+        add_tests("default")
+    end)
+end